@@ -38,25 +38,37 @@
 #include <string.h>
 #include <getopt.h>
 #include <glib.h>
+#include <glib/gstdio.h>
 
 #include <json-glib/json-glib.h>
 
+#include <steam-runtime-tools/glib-backports-internal.h>
+#include <steam-runtime-tools/json-glib-backports-internal.h>
 #include <steam-runtime-tools/json-utils-internal.h>
+#include <steam-runtime-tools/system-info-internal.h>
 #include <steam-runtime-tools/utils-internal.h>
 
 enum
 {
   OPTION_HELP = 1,
+  OPTION_CACHE,
   OPTION_EXPECTATION,
   OPTION_IGNORE_EXTRA_DRIVERS,
+  OPTION_REVALIDATE_CACHE,
+  OPTION_SEQUENTIAL,
+  OPTION_STREAMING,
   OPTION_VERBOSE,
   OPTION_VERSION,
 };
 
 struct option long_options[] =
 {
+    { "cache", no_argument, NULL, OPTION_CACHE },
     { "expectations", required_argument, NULL, OPTION_EXPECTATION },
+    { "revalidate-cache", no_argument, NULL, OPTION_REVALIDATE_CACHE },
     { "ignore-extra-drivers", no_argument, NULL, OPTION_IGNORE_EXTRA_DRIVERS },
+    { "sequential", no_argument, NULL, OPTION_SEQUENTIAL },
+    { "streaming", no_argument, NULL, OPTION_STREAMING },
     { "verbose", no_argument, NULL, OPTION_VERBOSE },
     { "version", no_argument, NULL, OPTION_VERSION },
     { "help", no_argument, NULL, OPTION_HELP },
@@ -805,6 +817,300 @@ static const char * const locales[] =
   "en_US.UTF-8",
 };
 
+/* Members of the report that are the results of slow checks, and can
+ * be reused from the cache */
+static const char * const cached_architecture_members[] =
+{
+  "library-issues-summary",
+  "library-details",
+  "graphics-details",
+};
+static const char * const cached_members[] =
+{
+  "locale-issues",
+  "locales",
+};
+
+#define CACHE_FILENAME_PREFIX "system-info-"
+#define CACHE_FILENAME_SUFFIX ".json"
+
+/*
+ * Load the results of slow checks from a previous run.
+ *
+ * Returns: (nullable): The parsed JSON object, or %NULL if unavailable
+ */
+static JsonNode *
+load_cache (const char *path)
+{
+  g_autoptr(JsonParser) parser = json_parser_new ();
+  g_autoptr(GError) local_error = NULL;
+  JsonNode *node;
+
+  if (!json_parser_load_from_file (parser, path, &local_error))
+    {
+      g_debug ("Unable to load cache: %s", local_error->message);
+      return NULL;
+    }
+
+  node = json_parser_get_root (parser);
+
+  if (node == NULL || !JSON_NODE_HOLDS_OBJECT (node))
+    {
+      g_debug ("Ignoring cache \"%s\": not a JSON object", path);
+      return NULL;
+    }
+
+  g_debug ("Using cached results from \"%s\"", path);
+  return json_node_copy (node);
+}
+
+/*
+ * Copy each of @members that is present in @from into @builder.
+ */
+static void
+add_members_from (JsonBuilder *builder,
+                  JsonObject *from,
+                  const char * const *members,
+                  gsize n_members)
+{
+  gsize i;
+
+  for (i = 0; i < n_members; i++)
+    {
+      if (!json_object_has_member (from, members[i]))
+        continue;
+
+      json_builder_set_member_name (builder, members[i]);
+      json_builder_add_value (builder,
+                              json_node_copy (json_object_get_member (from, members[i])));
+    }
+}
+
+/*
+ * Return the object member @name of @obj, or %NULL.
+ */
+static JsonObject *
+get_object_member_or_null (JsonObject *obj,
+                           const char *name)
+{
+  JsonNode *node;
+
+  if (obj == NULL)
+    return NULL;
+
+  node = json_object_get_member (obj, name);
+
+  if (node == NULL || !JSON_NODE_HOLDS_OBJECT (node))
+    return NULL;
+
+  return json_node_get_object (node);
+}
+
+/*
+ * Start the slow checks for the first @n architectures in
+ * @multiarch_tuples concurrently, and wait for them to finish,
+ * skipping those that are in @cached_architectures or cannot be run.
+ */
+static void
+prefetch_architectures (SrtSystemInfo *info,
+                        JsonObject *cached_architectures,
+                        const char * const *multiarch_tuples,
+                        gsize n)
+{
+  g_autoptr(GPtrArray) to_check = g_ptr_array_new ();
+  gsize i;
+
+  for (i = 0; i < n; i++)
+    {
+      if (get_object_member_or_null (cached_architectures,
+                                     multiarch_tuples[i]) != NULL)
+        continue;
+
+      if (srt_system_info_can_run (info, multiarch_tuples[i]))
+        g_ptr_array_add (to_check, (char *) multiarch_tuples[i]);
+    }
+
+  if (to_check->len == 0)
+    return;
+
+  g_ptr_array_add (to_check, NULL);
+  srt_system_info_prefetch (info,
+                            (const char * const *) to_check->pdata,
+                            (SRT_PREFETCH_FLAGS_LIBRARIES
+                             | SRT_PREFETCH_FLAGS_GRAPHICS));
+}
+
+/*
+ * Save the results of slow checks from @report into @path, in the same
+ * format as the full report, and delete any other cache files that
+ * are now outdated.
+ */
+static void
+save_cache (const char *path,
+            JsonObject *report,
+            const char * const *multiarch_tuples)
+{
+  g_autoptr(JsonBuilder) builder = json_builder_new ();
+  g_autoptr(JsonGenerator) generator = json_generator_new ();
+  g_autoptr(JsonNode) root = NULL;
+  g_autoptr(GError) local_error = NULL;
+  g_autoptr(GDir) dir = NULL;
+  g_autofree gchar *dir_path = g_path_get_dirname (path);
+  g_autofree gchar *basename = g_path_get_basename (path);
+  g_autofree gchar *data = NULL;
+  JsonObject *architectures;
+  const char *member;
+  gsize i;
+
+  architectures = get_object_member_or_null (report, "architectures");
+
+  json_builder_begin_object (builder);
+  json_builder_set_member_name (builder, "architectures");
+  json_builder_begin_object (builder);
+
+  for (i = 0; multiarch_tuples[i] != NULL; i++)
+    {
+      JsonObject *arch = get_object_member_or_null (architectures,
+                                                    multiarch_tuples[i]);
+
+      if (arch == NULL)
+        continue;
+
+      json_builder_set_member_name (builder, multiarch_tuples[i]);
+      json_builder_begin_object (builder);
+      add_members_from (builder, arch, cached_architecture_members,
+                        G_N_ELEMENTS (cached_architecture_members));
+      json_builder_end_object (builder);
+    }
+
+  json_builder_end_object (builder);
+  add_members_from (builder, report, cached_members,
+                    G_N_ELEMENTS (cached_members));
+  json_builder_end_object (builder);
+
+  root = json_builder_get_root (builder);
+  json_generator_set_root (generator, root);
+  data = json_generator_to_data (generator, NULL);
+
+  if (g_mkdir_with_parents (dir_path, 0700) != 0)
+    {
+      g_debug ("Unable to create \"%s\": %s", dir_path, g_strerror (errno));
+      return;
+    }
+
+  if (!g_file_set_contents (path, data, -1, &local_error))
+    {
+      g_debug ("Unable to save cache: %s", local_error->message);
+      return;
+    }
+
+  dir = g_dir_open (dir_path, 0, NULL);
+
+  while (dir != NULL && (member = g_dir_read_name (dir)) != NULL)
+    {
+      if (g_str_has_prefix (member, CACHE_FILENAME_PREFIX)
+          && g_str_has_suffix (member, CACHE_FILENAME_SUFFIX)
+          && strcmp (member, basename) != 0)
+        {
+          g_autofree gchar *outdated = g_build_filename (dir_path, member, NULL);
+
+          if (g_unlink (outdated) != 0)
+            g_debug ("Unable to delete \"%s\": %s", outdated, g_strerror (errno));
+        }
+    }
+}
+
+typedef struct
+{
+  JsonBuilder *builder;
+  FILE *out;
+  /* If non-NULL, each section is also merged into this, for the cache */
+  JsonObject *collected;
+  gboolean streaming;
+} Report;
+
+/*
+ * Start a section of the report. In streaming mode, this is a new
+ * top-level object; otherwise, it is part of the single top-level object.
+ */
+static void
+report_begin_section (Report *report)
+{
+  if (report->streaming)
+    json_builder_begin_object (report->builder);
+}
+
+/*
+ * Merge the top-level members of @section into @collected.
+ * Architectures are merged individually, because in streaming mode
+ * each one is in its own section.
+ */
+static void
+merge_section (JsonObject *collected,
+               JsonObject *section)
+{
+  g_autoptr(GList) members = json_object_get_members (section);
+  const GList *iter;
+
+  for (iter = members; iter != NULL; iter = iter->next)
+    {
+      const char *name = iter->data;
+      JsonNode *node = json_object_get_member (section, name);
+      JsonObject *architectures = NULL;
+
+      if (strcmp (name, "architectures") == 0 && JSON_NODE_HOLDS_OBJECT (node))
+        architectures = get_object_member_or_null (collected, name);
+
+      if (architectures != NULL)
+        {
+          JsonObject *from = json_node_get_object (node);
+          g_autoptr(GList) arch_members = json_object_get_members (from);
+          const GList *arch_iter;
+
+          for (arch_iter = arch_members; arch_iter != NULL; arch_iter = arch_iter->next)
+            json_object_set_member (architectures, arch_iter->data,
+                                    json_node_copy (json_object_get_member (from,
+                                                                            arch_iter->data)));
+        }
+      else
+        {
+          json_object_set_member (collected, name, json_node_copy (node));
+        }
+    }
+}
+
+/*
+ * Finish a section of the report. In streaming mode, write it out
+ * immediately as a single line, then discard it.
+ */
+static void
+report_end_section (Report *report)
+{
+  g_autoptr(JsonGenerator) generator = NULL;
+  g_autoptr(JsonNode) root = NULL;
+  g_autofree gchar *json_output = NULL;
+
+  if (!report->streaming)
+    return;
+
+  json_builder_end_object (report->builder);
+  root = json_builder_get_root (report->builder);
+  json_builder_reset (report->builder);
+
+  generator = json_generator_new ();
+  json_generator_set_root (generator, root);
+  json_generator_set_pretty (generator, FALSE);
+  json_output = json_generator_to_data (generator, NULL);
+
+  if (fputs (json_output, report->out) < 0
+      || fputs ("\n", report->out) < 0
+      || fflush (report->out) != 0)
+    g_warning ("Unable to write output: %s", g_strerror (errno));
+
+  if (report->collected != NULL)
+    merge_section (report->collected, json_node_get_object (root));
+}
+
 int
 main (int argc,
       char **argv)
@@ -834,6 +1140,15 @@ main (int argc,
   g_autofree gchar *steamscript_path = NULL;
   g_autofree gchar *steamscript_version = NULL;
   g_autofree gchar *xdg_portal_messages = NULL;
+  g_autofree gchar *cache_path = NULL;
+  g_autoptr(JsonNode) cache = NULL;
+  JsonObject *cached_report = NULL;
+  JsonObject *cached_architectures = NULL;
+  gboolean use_cache = FALSE;
+  gboolean revalidate_cache = FALSE;
+  gboolean sequential = FALSE;
+  Report report = { NULL };
+  g_autoptr(JsonObject) collected = NULL;
   gchar *json_output;
   gchar *version = NULL;
   gchar *inst_path = NULL;
@@ -856,10 +1171,27 @@ main (int argc,
     {
       switch (opt)
         {
+          case OPTION_CACHE:
+            use_cache = TRUE;
+            break;
+
           case OPTION_EXPECTATION:
             expectations = optarg;
             break;
 
+          case OPTION_REVALIDATE_CACHE:
+            use_cache = TRUE;
+            revalidate_cache = TRUE;
+            break;
+
+          case OPTION_SEQUENTIAL:
+            sequential = TRUE;
+            break;
+
+          case OPTION_STREAMING:
+            report.streaming = TRUE;
+            break;
+
           case OPTION_VERBOSE:
             verbose = TRUE;
             break;
@@ -922,13 +1254,59 @@ main (int argc,
     {
       info = srt_system_info_new (expectations);
 
+      /* We check many libraries and locales per architecture, so keep
+       * inspect-library and check-locale running between checks */
+      _srt_system_info_set_check_flags (info, SRT_CHECK_FLAGS_HELPER_SERVERS);
+
       /* For unit testing */
       srt_system_info_set_sysroot (info, g_getenv ("SRT_TEST_SYSROOT"));
     }
 
+  if (use_cache)
+    {
+      g_autofree gchar *key = _srt_system_info_dup_cache_key (info,
+                                                              multiarch_tuples);
+
+      if (key != NULL)
+        {
+          /* Library details are only reported in full in verbose mode,
+           * so the verbose and non-verbose results are not interchangeable */
+          g_autofree gchar *filename = g_strdup_printf (CACHE_FILENAME_PREFIX "%s%s" CACHE_FILENAME_SUFFIX,
+                                                        key,
+                                                        verbose ? "-verbose" : "");
+
+          cache_path = g_build_filename (g_get_user_cache_dir (),
+                                         "steam-runtime-tools",
+                                         filename, NULL);
+
+          if (!revalidate_cache)
+            cache = load_cache (cache_path);
+        }
+    }
+
+  if (cache != NULL)
+    {
+      cached_report = json_node_get_object (cache);
+      cached_architectures = get_object_member_or_null (cached_report,
+                                                        "architectures");
+    }
+
   builder = json_builder_new ();
-  json_builder_begin_object (builder);
+  report.builder = builder;
+  report.out = original_stdout;
 
+  /* In streaming mode we don't keep the whole report, so collect the
+   * sections as they are written if we will need to cache them */
+  if (report.streaming && cache_path != NULL && cache == NULL)
+    {
+      collected = json_object_new ();
+      report.collected = collected;
+    }
+
+  if (!report.streaming)
+    json_builder_begin_object (builder);
+
+  report_begin_section (&report);
   json_builder_set_member_name (builder, "can-write-uinput");
   json_builder_add_boolean_value (builder, srt_system_info_can_write_to_uinput (info));
 
@@ -956,7 +1334,9 @@ main (int argc,
   jsonify_steam_issues (builder, steam_issues);
   json_builder_end_array (builder);
   json_builder_end_object (builder);
+  report_end_section (&report);
 
+  report_begin_section (&report);
   json_builder_set_member_name (builder, "runtime");
   json_builder_begin_object (builder);
     {
@@ -1033,7 +1413,9 @@ main (int argc,
       }
     }
   json_builder_end_object (builder);
+  report_end_section (&report);
 
+  report_begin_section (&report);
   jsonify_os_release (builder, info);
   jsonify_container (builder, info);
 
@@ -1041,12 +1423,26 @@ main (int argc,
   _srt_json_builder_add_strv_value (builder, "driver_environment",
                                     (const gchar * const *)driver_environment,
                                     TRUE);
+  report_end_section (&report);
 
-  json_builder_set_member_name (builder, "architectures");
-  json_builder_begin_object (builder);
+  /* In streaming mode, each architecture is a separate section */
+  if (!report.streaming)
+    {
+      json_builder_set_member_name (builder, "architectures");
+      json_builder_begin_object (builder);
+    }
 
   g_assert (multiarch_tuples[G_N_ELEMENTS (multiarch_tuples) - 1] == NULL);
 
+  /* The slow checks for each architecture are independent, so start
+   * them all at once, and only collect the results below. In streaming
+   * mode we want to write out each architecture as soon as it is ready,
+   * so only start the checks for one architecture at a time instead. */
+  if (!sequential && !report.streaming)
+    prefetch_architectures (info, cached_architectures,
+                            multiarch_tuples,
+                            G_N_ELEMENTS (multiarch_tuples) - 1);
+
   for (gsize i = 0; i < G_N_ELEMENTS (multiarch_tuples) - 1; i++)
     {
       GList *libraries = NULL;
@@ -1054,12 +1450,25 @@ main (int argc,
       GList *va_api_list = NULL;
       GList *vdpau_list = NULL;
       GList *glx_list = NULL;
+      GList *graphics_list = NULL;
+      JsonObject *cached_arch = NULL;
       g_autofree gchar *libdl_lib = NULL;
       g_autofree gchar *libdl_platform = NULL;
       g_autoptr(GError) libdl_lib_error = NULL;
       g_autoptr(GError) libdl_platform_error = NULL;
       const char *ld_so;
 
+      if (!sequential && report.streaming)
+        prefetch_architectures (info, cached_architectures,
+                                &multiarch_tuples[i], 1);
+
+      if (report.streaming)
+        {
+          report_begin_section (&report);
+          json_builder_set_member_name (builder, "architectures");
+          json_builder_begin_object (builder);
+        }
+
       json_builder_set_member_name (builder, multiarch_tuples[i]);
       json_builder_begin_object (builder);
       json_builder_set_member_name (builder, "can-run");
@@ -1123,7 +1532,16 @@ main (int argc,
           json_builder_end_object (builder);
         }
 
-      if (can_run)
+      if (cached_architectures != NULL)
+        cached_arch = get_object_member_or_null (cached_architectures,
+                                                 multiarch_tuples[i]);
+
+      if (cached_arch != NULL)
+        {
+          add_members_from (builder, cached_arch, cached_architecture_members,
+                            G_N_ELEMENTS (cached_architecture_members));
+        }
+      else if (can_run)
         {
           json_builder_set_member_name (builder, "library-issues-summary");
           json_builder_begin_array (builder);
@@ -1137,9 +1555,12 @@ main (int argc,
       if (libraries != NULL && (library_issues != SRT_LIBRARY_ISSUES_NONE || verbose))
           print_libraries_details (builder, libraries, verbose);
 
-      GList *graphics_list = srt_system_info_check_all_graphics (info,
-                                                                 multiarch_tuples[i]);
-      print_graphics_details (builder, graphics_list);
+      if (cached_arch == NULL)
+        {
+          graphics_list = srt_system_info_check_all_graphics (info,
+                                                              multiarch_tuples[i]);
+          print_graphics_details (builder, graphics_list);
+        }
 
       dri_list = srt_system_info_list_dri_drivers (info, multiarch_tuples[i],
                                                    extra_driver_flags);
@@ -1158,6 +1579,13 @@ main (int argc,
       print_glx_details (builder, glx_list);
 
       json_builder_end_object (builder); // End multiarch_tuple object
+
+      if (report.streaming)
+        {
+          json_builder_end_object (builder); // End architectures
+          report_end_section (&report);
+        }
+
       g_list_free_full (libraries, g_object_unref);
       g_list_free_full (graphics_list, g_object_unref);
       g_list_free_full (dri_list, g_object_unref);
@@ -1166,53 +1594,69 @@ main (int argc,
       g_list_free_full (glx_list, g_object_unref);
     }
 
-  json_builder_end_object (builder);
+  if (!report.streaming)
+    json_builder_end_object (builder);
 
-  json_builder_set_member_name (builder, "locale-issues");
-  json_builder_begin_array (builder);
-  locale_issues = srt_system_info_get_locale_issues (info);
-  jsonify_locale_issues (builder, locale_issues);
-  json_builder_end_array (builder);
+  report_begin_section (&report);
 
-  json_builder_set_member_name (builder, "locales");
-  json_builder_begin_object (builder);
-
-  for (gsize i = 0; i < G_N_ELEMENTS (locales); i++)
+  if (cached_report != NULL
+      && json_object_has_member (cached_report, "locale-issues")
+      && json_object_has_member (cached_report, "locales"))
     {
-      SrtLocale *locale = srt_system_info_check_locale (info, locales[i],
-                                                        &error);
-
-      if (locales[i][0] == '\0')
-        json_builder_set_member_name (builder, "<default>");
-      else
-        json_builder_set_member_name (builder, locales[i]);
+      add_members_from (builder, cached_report, cached_members,
+                        G_N_ELEMENTS (cached_members));
+    }
+  else
+    {
+      json_builder_set_member_name (builder, "locale-issues");
+      json_builder_begin_array (builder);
+      locale_issues = srt_system_info_get_locale_issues (info);
+      jsonify_locale_issues (builder, locale_issues);
+      json_builder_end_array (builder);
 
+      json_builder_set_member_name (builder, "locales");
       json_builder_begin_object (builder);
 
-      if (locale != NULL)
+      for (gsize i = 0; i < G_N_ELEMENTS (locales); i++)
         {
-          json_builder_set_member_name (builder, "resulting-name");
-          json_builder_add_string_value (builder,
-                                         srt_locale_get_resulting_name (locale));
-          json_builder_set_member_name (builder, "charset");
-          json_builder_add_string_value (builder,
-                                         srt_locale_get_charset (locale));
-          json_builder_set_member_name (builder, "is_utf8");
-          json_builder_add_boolean_value (builder,
-                                          srt_locale_is_utf8 (locale));
-        }
-      else
-        {
-          _srt_json_builder_add_error_members (builder, error);
+          SrtLocale *locale = srt_system_info_check_locale (info, locales[i],
+                                                            &error);
+
+          if (locales[i][0] == '\0')
+            json_builder_set_member_name (builder, "<default>");
+          else
+            json_builder_set_member_name (builder, locales[i]);
+
+          json_builder_begin_object (builder);
+
+          if (locale != NULL)
+            {
+              json_builder_set_member_name (builder, "resulting-name");
+              json_builder_add_string_value (builder,
+                                             srt_locale_get_resulting_name (locale));
+              json_builder_set_member_name (builder, "charset");
+              json_builder_add_string_value (builder,
+                                             srt_locale_get_charset (locale));
+              json_builder_set_member_name (builder, "is_utf8");
+              json_builder_add_boolean_value (builder,
+                                              srt_locale_is_utf8 (locale));
+            }
+          else
+            {
+              _srt_json_builder_add_error_members (builder, error);
+            }
+
+          json_builder_end_object (builder);
+          g_clear_object (&locale);
+          g_clear_error (&error);
         }
 
       json_builder_end_object (builder);
-      g_clear_object (&locale);
-      g_clear_error (&error);
     }
 
-  json_builder_end_object (builder);
+  report_end_section (&report);
 
+  report_begin_section (&report);
   json_builder_set_member_name (builder, "egl");
   json_builder_begin_object (builder);
   json_builder_set_member_name (builder, "icds");
@@ -1324,7 +1768,9 @@ main (int argc,
   print_layer_details (builder, implicit_layers, FALSE);
 
   json_builder_end_object (builder);  // vulkan
+  report_end_section (&report);
 
+  report_begin_section (&report);
   json_builder_set_member_name (builder, "desktop-entries");
   json_builder_begin_array (builder);
     {
@@ -1361,7 +1807,9 @@ main (int argc,
       g_list_free_full (desktop_entries, g_object_unref);
     }
   json_builder_end_array (builder);
+  report_end_section (&report);
 
+  report_begin_section (&report);
   json_builder_set_member_name (builder, "xdg-portals");
   json_builder_begin_object (builder);
     {
@@ -1421,7 +1869,9 @@ main (int argc,
         _srt_json_builder_add_array_of_lines (builder, "messages", xdg_portal_messages);
     }
   json_builder_end_object (builder);
+  report_end_section (&report);
 
+  report_begin_section (&report);
   json_builder_set_member_name (builder, "cpu-features");
   json_builder_begin_object (builder);
     {
@@ -1430,27 +1880,40 @@ main (int argc,
       jsonify_x86_features (builder, x86_features, known_x86_features);
     }
   json_builder_end_object (builder);
+  report_end_section (&report);
 
-  json_builder_end_object (builder); // End global object
+  if (report.streaming)
+    {
+      if (collected != NULL)
+        save_cache (cache_path, collected, multiarch_tuples);
+    }
+  else
+    {
+      json_builder_end_object (builder); // End global object
 
-  JsonNode *root = json_builder_get_root (builder);
-  generator = json_generator_new ();
-  json_generator_set_root (generator, root);
-  json_generator_set_pretty (generator, TRUE);
-  json_output = json_generator_to_data (generator, NULL);
+      JsonNode *root = json_builder_get_root (builder);
+      generator = json_generator_new ();
+      json_generator_set_root (generator, root);
+      json_generator_set_pretty (generator, TRUE);
+      json_output = json_generator_to_data (generator, NULL);
 
-  if (fputs (json_output, original_stdout) < 0)
-    g_warning ("Unable to write output: %s", g_strerror (errno));
+      if (cache_path != NULL && cache == NULL)
+        save_cache (cache_path, json_node_get_object (root), multiarch_tuples);
 
-  if (fputs ("\n", original_stdout) < 0)
-    g_warning ("Unable to write final newline: %s", g_strerror (errno));
+      if (fputs (json_output, original_stdout) < 0)
+        g_warning ("Unable to write output: %s", g_strerror (errno));
+
+      if (fputs ("\n", original_stdout) < 0)
+        g_warning ("Unable to write final newline: %s", g_strerror (errno));
+
+      g_free (json_output);
+      g_object_unref (generator);
+      json_node_free (root);
+    }
 
   if (fclose (original_stdout) != 0)
     g_warning ("Unable to close stdout: %s", g_strerror (errno));
 
-  g_free (json_output);
-  g_object_unref (generator);
-  json_node_free (root);
   g_object_unref (builder);
   g_object_unref (info);
   g_free (bin32_path);
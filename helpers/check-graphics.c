@@ -0,0 +1,500 @@
+/*
+ * Copyright © 2019-2021 Collabora Ltd.
+ *
+ * SPDX-License-Identifier: MIT
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/*
+ * Run several of the graphics checks in one process tree.
+ *
+ * The Vulkan, VDPAU and VA-API checks are linked into this executable,
+ * so the loader libraries and their dependencies are loaded and
+ * relocated once. Each check then runs in a forked child, so that a
+ * driver that crashes or hangs only affects its own check. The output
+ * is a single JSON object, with one member per check, in the form
+ * that _srt_check_graphics() expects from the individual helpers.
+ */
+
+#include <errno.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <glib.h>
+#include <glib-unix.h>
+#include <json-glib/json-glib.h>
+
+#include <steam-runtime-tools/glib-backports-internal.h>
+#include <steam-runtime-tools/json-glib-backports-internal.h>
+#include <steam-runtime-tools/utils-internal.h>
+
+/* The main() functions of check-vulkan.c, check-vdpau.c and
+ * check-va-api.c, renamed when they are compiled into this executable */
+int _srt_check_vulkan_main (int argc, char **argv);
+int _srt_check_vdpau_main (int argc, char **argv);
+int _srt_check_va_api_main (int argc, char **argv);
+
+typedef int (*CheckMain) (int argc, char **argv);
+
+static const struct
+{
+  /* The same as the SrtRenderingInterface nick */
+  const char *name;
+  CheckMain main;
+  /* The same arguments that _srt_check_graphics() would use */
+  const char *argument;
+} checks[] =
+{
+  { "vulkan", _srt_check_vulkan_main, NULL },
+  { "vdpau", _srt_check_vdpau_main, "--verbose" },
+  { "vaapi", _srt_check_va_api_main, "--verbose" },
+};
+
+typedef struct
+{
+  const char *name;
+  GPid pid;
+  int stdout_fd;
+  int stderr_fd;
+  GString *stdout_buf;
+  GString *stderr_buf;
+  int wait_status;
+  gboolean terminated;
+  gboolean killed;
+} Child;
+
+static const char *argv0;
+static gboolean opt_print_version = FALSE;
+static int opt_kill_after = 3;
+static int opt_timeout = 10;
+
+static const GOptionEntry option_entries[] =
+{
+  { "kill-after", 0, G_OPTION_FLAG_NONE, G_OPTION_ARG_INT, &opt_kill_after,
+    "Kill a check that is still running this many seconds after it "
+    "timed out [default: 3]", "SECONDS" },
+  { "timeout", 0, G_OPTION_FLAG_NONE, G_OPTION_ARG_INT, &opt_timeout,
+    "Terminate a check that takes longer than this [default: 10]",
+    "SECONDS" },
+  { "version", 0, G_OPTION_FLAG_NONE, G_OPTION_ARG_NONE, &opt_print_version,
+    "Print version number and exit", NULL },
+  { NULL }
+};
+
+/*
+ * Run the check in a child process, with its stdout and stderr
+ * connected to pipes.
+ */
+static gboolean
+start_child (Child *child,
+             CheckMain check_main,
+             const char *argument,
+             GPtrArray *children,
+             GError **error)
+{
+  int stdout_pipe[2];
+  int stderr_pipe[2];
+  gsize i;
+
+  if (!g_unix_open_pipe (stdout_pipe, FD_CLOEXEC, error))
+    return FALSE;
+
+  if (!g_unix_open_pipe (stderr_pipe, FD_CLOEXEC, error))
+    {
+      close (stdout_pipe[0]);
+      close (stdout_pipe[1]);
+      return FALSE;
+    }
+
+  /* Don't let the child flush our buffered output a second time */
+  fflush (stdout);
+  fflush (stderr);
+
+  child->pid = fork ();
+
+  if (child->pid < 0)
+    {
+      int saved_errno = errno;
+
+      close (stdout_pipe[0]);
+      close (stdout_pipe[1]);
+      close (stderr_pipe[0]);
+      close (stderr_pipe[1]);
+      g_set_error (error, G_IO_ERROR, g_io_error_from_errno (saved_errno),
+                   "Unable to fork: %s", g_strerror (saved_errno));
+      return FALSE;
+    }
+
+  if (child->pid == 0)
+    {
+      /* check-vulkan finds its shaders relative to argv[0], and they
+       * are installed alongside this executable */
+      char *argv[] = { (char *) argv0, (char *) argument, NULL };
+      int argc = (argument == NULL ? 1 : 2);
+
+      /* Put the check and anything it starts in a new process group,
+       * so we can terminate all of them if it times out */
+      setpgid (0, 0);
+
+      for (i = 0; i < children->len; i++)
+        {
+          Child *other = g_ptr_array_index (children, i);
+
+          if (other->stdout_fd >= 0)
+            close (other->stdout_fd);
+
+          if (other->stderr_fd >= 0)
+            close (other->stderr_fd);
+        }
+
+      if (dup2 (stdout_pipe[1], STDOUT_FILENO) < 0
+          || dup2 (stderr_pipe[1], STDERR_FILENO) < 0)
+        _exit (255);
+
+      /* Use exit() rather than _exit() so that stdio buffers are flushed */
+      exit (check_main (argc, argv));
+    }
+
+  /* Also do this in the parent, to avoid a race with killing the
+   * process group */
+  setpgid (child->pid, child->pid);
+
+  close (stdout_pipe[1]);
+  close (stderr_pipe[1]);
+  child->stdout_fd = stdout_pipe[0];
+  child->stderr_fd = stderr_pipe[0];
+  return TRUE;
+}
+
+/*
+ * Read from @fd into @buf, closing @fd on EOF or error.
+ */
+static void
+read_from_child (int *fd,
+                 GString *buf)
+{
+  char chunk[4096];
+  ssize_t n;
+
+  n = read (*fd, chunk, sizeof (chunk));
+
+  if (n < 0 && (errno == EINTR || errno == EAGAIN))
+    return;
+
+  if (n <= 0)
+    {
+      close (*fd);
+      *fd = -1;
+      return;
+    }
+
+  g_string_append_len (buf, chunk, n);
+}
+
+/*
+ * Collect the output of all children, terminating any that take too long
+ * in the same way as timeout(1).
+ */
+static void
+wait_for_children (GPtrArray *children)
+{
+  gint64 terminate_time = g_get_monotonic_time () + (gint64) opt_timeout * G_USEC_PER_SEC;
+  gint64 kill_time = terminate_time + (gint64) opt_kill_after * G_USEC_PER_SEC;
+  g_autofree struct pollfd *fds = g_new0 (struct pollfd, children->len * 2);
+  gsize i;
+
+  while (TRUE)
+    {
+      gint64 now = g_get_monotonic_time ();
+      gint64 next_deadline;
+      nfds_t n_fds = 0;
+      int poll_timeout;
+
+      if (now >= terminate_time)
+        {
+          for (i = 0; i < children->len; i++)
+            {
+              Child *child = g_ptr_array_index (children, i);
+              int sig;
+
+              if (child->stdout_fd < 0 && child->stderr_fd < 0)
+                continue;
+
+              if (now >= kill_time && !child->killed)
+                {
+                  child->killed = TRUE;
+                  sig = SIGKILL;
+                }
+              else if (!child->terminated)
+                {
+                  child->terminated = TRUE;
+                  sig = SIGTERM;
+                }
+              else
+                {
+                  continue;
+                }
+
+              if (kill (-child->pid, sig) < 0)
+                kill (child->pid, sig);
+            }
+        }
+
+      for (i = 0; i < children->len; i++)
+        {
+          Child *child = g_ptr_array_index (children, i);
+
+          if (child->stdout_fd >= 0)
+            {
+              fds[n_fds].fd = child->stdout_fd;
+              fds[n_fds].events = POLLIN;
+              n_fds++;
+            }
+
+          if (child->stderr_fd >= 0)
+            {
+              fds[n_fds].fd = child->stderr_fd;
+              fds[n_fds].events = POLLIN;
+              n_fds++;
+            }
+        }
+
+      if (n_fds == 0)
+        break;
+
+      if (now < terminate_time)
+        next_deadline = terminate_time;
+      else if (now < kill_time)
+        next_deadline = kill_time;
+      else
+        next_deadline = now + G_USEC_PER_SEC;
+
+      poll_timeout = (int) ((next_deadline - now + 999) / 1000);
+
+      if (poll (fds, n_fds, poll_timeout) < 0 && errno != EINTR)
+        {
+          g_warning ("poll: %s", g_strerror (errno));
+          break;
+        }
+
+      for (i = 0; i < n_fds; i++)
+        {
+          gsize j;
+
+          if (fds[i].revents == 0)
+            continue;
+
+          for (j = 0; j < children->len; j++)
+            {
+              Child *child = g_ptr_array_index (children, j);
+
+              if (fds[i].fd == child->stdout_fd)
+                read_from_child (&child->stdout_fd, child->stdout_buf);
+              else if (fds[i].fd == child->stderr_fd)
+                read_from_child (&child->stderr_fd, child->stderr_buf);
+            }
+        }
+    }
+
+  for (i = 0; i < children->len; i++)
+    {
+      Child *child = g_ptr_array_index (children, i);
+
+      while (waitpid (child->pid, &child->wait_status, 0) < 0)
+        {
+          if (errno != EINTR)
+            {
+              g_warning ("waitpid: %s", g_strerror (errno));
+              child->wait_status = W_EXITCODE (255, 0);
+              break;
+            }
+        }
+
+      /* Report a timeout in the same way as timeout(1) would */
+      if (child->killed)
+        child->wait_status = W_EXITCODE (128 + SIGKILL, 0);
+      else if (child->terminated)
+        child->wait_status = W_EXITCODE (124, 0);
+    }
+}
+
+static void
+child_free (gpointer p)
+{
+  Child *child = p;
+
+  if (child->stdout_fd >= 0)
+    close (child->stdout_fd);
+
+  if (child->stderr_fd >= 0)
+    close (child->stderr_fd);
+
+  g_string_free (child->stdout_buf, TRUE);
+  g_string_free (child->stderr_buf, TRUE);
+  g_slice_free (Child, child);
+}
+
+static void
+add_string_member (JsonBuilder *builder,
+                   const char *name,
+                   GString *value)
+{
+  g_autofree gchar *valid = g_utf8_make_valid (value->str, value->len);
+
+  json_builder_set_member_name (builder, name);
+  json_builder_add_string_value (builder, valid);
+}
+
+int
+main (int argc,
+      char **argv)
+{
+  g_autoptr(FILE) original_stdout = NULL;
+  g_autoptr(GOptionContext) option_context = NULL;
+  g_autoptr(GError) local_error = NULL;
+  g_autoptr(GPtrArray) children = g_ptr_array_new_with_free_func (child_free);
+  g_autoptr(JsonBuilder) builder = NULL;
+  g_autoptr(JsonGenerator) generator = NULL;
+  g_autoptr(JsonNode) root = NULL;
+  g_autofree gchar *json = NULL;
+  int i;
+  gsize j;
+
+  argv0 = argv[0];
+
+  option_context = g_option_context_new ("INTERFACE...");
+  g_option_context_set_summary (option_context,
+                                "Check the vulkan, vdpau and/or vaapi "
+                                "rendering interfaces.");
+  g_option_context_add_main_entries (option_context, option_entries, NULL);
+
+  if (!g_option_context_parse (option_context, &argc, &argv, &local_error))
+    {
+      g_printerr ("%s\n", local_error->message);
+      return 2;
+    }
+
+  if (opt_print_version)
+    {
+      /* Output version number as YAML for machine-readability,
+       * inspired by `ostree --version` and `docker version` */
+      g_print ("%s:\n"
+               " Package: steam-runtime-tools\n"
+               " Version: %s\n",
+               argv[0], VERSION);
+      return EXIT_SUCCESS;
+    }
+
+  if (argc < 2)
+    {
+      g_printerr ("At least one rendering interface is required\n");
+      return 2;
+    }
+
+  /* stdout is reserved for machine-readable output, so avoid having
+   * things like g_debug() pollute it. The children get their own
+   * stdout, so they are unaffected. */
+  original_stdout = _srt_divert_stdout_to_stderr (&local_error);
+
+  if (original_stdout == NULL)
+    {
+      g_printerr ("Unable to divert stdout to stderr: %s\n",
+                  local_error->message);
+      return EXIT_FAILURE;
+    }
+
+  for (i = 1; i < argc; i++)
+    {
+      Child *child = NULL;
+
+      for (j = 0; j < G_N_ELEMENTS (checks); j++)
+        {
+          if (strcmp (argv[i], checks[j].name) == 0)
+            break;
+        }
+
+      if (j == G_N_ELEMENTS (checks))
+        {
+          g_printerr ("Unsupported rendering interface \"%s\"\n", argv[i]);
+          return 2;
+        }
+
+      child = g_slice_new0 (Child);
+      child->name = checks[j].name;
+      child->stdout_fd = -1;
+      child->stderr_fd = -1;
+      child->stdout_buf = g_string_new ("");
+      child->stderr_buf = g_string_new ("");
+
+      if (!start_child (child, checks[j].main, checks[j].argument,
+                        children, &local_error))
+        {
+          g_printerr ("%s\n", local_error->message);
+          child_free (child);
+          /* Reap the children that we already started */
+          opt_timeout = 0;
+          opt_kill_after = 0;
+          wait_for_children (children);
+          return EXIT_FAILURE;
+        }
+
+      g_ptr_array_add (children, child);
+    }
+
+  wait_for_children (children);
+
+  builder = json_builder_new ();
+  json_builder_begin_object (builder);
+
+  for (j = 0; j < children->len; j++)
+    {
+      Child *child = g_ptr_array_index (children, j);
+
+      json_builder_set_member_name (builder, child->name);
+      json_builder_begin_object (builder);
+      json_builder_set_member_name (builder, "wait-status");
+      json_builder_add_int_value (builder, child->wait_status);
+      add_string_member (builder, "stdout", child->stdout_buf);
+      add_string_member (builder, "stderr", child->stderr_buf);
+      json_builder_end_object (builder);
+    }
+
+  json_builder_end_object (builder);
+
+  root = json_builder_get_root (builder);
+  generator = json_generator_new ();
+  json_generator_set_root (generator, root);
+  json = json_generator_to_data (generator, NULL);
+
+  if (fputs (json, original_stdout) < 0 || fputs ("\n", original_stdout) < 0)
+    {
+      g_printerr ("Unable to write output: %s\n", g_strerror (errno));
+      return EXIT_FAILURE;
+    }
+
+  return EXIT_SUCCESS;
+}
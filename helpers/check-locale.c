@@ -25,6 +25,8 @@
 
 #include <errno.h>
 #include <locale.h>
+#include <stdio.h>
+#include <string.h>
 
 #include <glib.h>
 #include <json-glib/json-glib.h>
@@ -152,6 +154,7 @@ mock_get_charset (const char **charset)
 
 static gchar *opt_locale = NULL;
 static gboolean opt_print_version = FALSE;
+static gboolean opt_server = FALSE;
 
 static gboolean
 opt_locale_cb (const char *name,
@@ -172,6 +175,9 @@ opt_locale_cb (const char *name,
 
 static const GOptionEntry option_entries[] =
 {
+  { "server", 0, G_OPTION_FLAG_NONE, G_OPTION_ARG_NONE, &opt_server,
+    "Read locale names from stdin and write results to stdout, "
+    "each framed by its length in bytes and a newline", NULL },
   { "version", 0, G_OPTION_FLAG_NONE, G_OPTION_ARG_NONE, &opt_print_version,
     "Print version number and exit", NULL },
   { G_OPTION_REMAINING, 0, G_OPTION_FLAG_NONE, G_OPTION_ARG_CALLBACK,
@@ -181,49 +187,23 @@ static const GOptionEntry option_entries[] =
   { NULL }
 };
 
-int
-main (int argc,
-      char **argv)
+/*
+ * Try to set @locale_name as the locale.
+ *
+ * Returns: (transfer full): The result as JSON
+ */
+static gchar *
+check_locale (const char *locale_name,
+              gboolean pretty,
+              int *exit_status_out)
 {
-  GOptionContext *option_context = NULL;
-  GError *local_error = NULL;
+  g_autoptr(JsonBuilder) builder = NULL;
+  g_autoptr(JsonGenerator) generator = NULL;
+  g_autoptr(JsonNode) root = NULL;
   const char *locale_result;
-  const char *locale_name;
   const char *charset;
-  gchar *json = NULL;
-  JsonNode *root = NULL;
-  JsonBuilder *builder = NULL;
-  JsonGenerator *generator = NULL;
-  int ret = 1;
   gboolean is_utf8;
 
-  option_context = g_option_context_new ("");
-  g_option_context_add_main_entries (option_context, option_entries, NULL);
-
-  if (!g_option_context_parse (option_context, &argc, &argv, &local_error))
-    {
-      ret = 2;
-      goto out;
-    }
-
-  if (opt_print_version)
-    {
-      /* Output version number as YAML for machine-readability,
-       * inspired by `ostree --version` and `docker version` */
-      g_print (
-          "%s:\n"
-          " Package: steam-runtime-tools\n"
-          " Version: %s\n",
-          argv[0], VERSION);
-      ret = 0;
-      goto out;
-    }
-
-  if (opt_locale == NULL)
-    locale_name = "";
-  else
-    locale_name = opt_locale;
-
   builder = json_builder_new ();
   json_builder_begin_object (builder);
   json_builder_set_member_name (builder, "requested");
@@ -242,7 +222,7 @@ main (int argc,
       json_builder_set_member_name (builder, "error");
       json_builder_add_string_value (builder,
                                      g_strerror (saved_errno));
-      ret = 1;
+      *exit_status_out = 1;
     }
   else
     {
@@ -258,26 +238,143 @@ main (int argc,
       json_builder_add_string_value (builder, charset);
       json_builder_set_member_name (builder, "is_utf8");
       json_builder_add_boolean_value (builder, is_utf8);
-      ret = 0;
+      *exit_status_out = 0;
     }
 
   json_builder_end_object (builder);
 
   root = json_builder_get_root (builder);
   generator = json_generator_new ();
-  json_generator_set_pretty (generator, TRUE);
+  json_generator_set_pretty (generator, pretty);
   json_generator_set_root (generator, root);
-  json = json_generator_to_data (generator, NULL);
+  return json_generator_to_data (generator, NULL);
+}
+
+/*
+ * Answer requests from stdin until end-of-file. Each request is a
+ * locale name, and each response is the JSON that we would have
+ * printed for it, both framed by their length and a newline.
+ *
+ * Returns: 0 on success, or an exit status on failure
+ */
+static int
+check_locale_server (void)
+{
+  g_autofree gchar *initial_locale = NULL;
+  char header[24];
+
+  /* Go back to this locale after each request, so that the result
+   * does not depend on which locales were requested before it,
+   * in particular if setting the requested locale fails */
+#ifdef MOCK_CHECK_LOCALE
+  initial_locale = g_strdup (mock_setlocale (NULL));
+#else
+  initial_locale = g_strdup (setlocale (LC_ALL, NULL));
+#endif
+
+  while (fgets (header, sizeof (header), stdin) != NULL)
+    {
+      g_autofree gchar *locale_name = NULL;
+      g_autofree gchar *json = NULL;
+      gchar *endptr;
+      guint64 len;
+      int exit_status;
+
+      len = g_ascii_strtoull (header, &endptr, 10);
+
+      if (endptr == header || *endptr != '\n')
+        {
+          g_printerr ("%s: Invalid request header\n", g_get_prgname ());
+          return 2;
+        }
+
+      locale_name = g_malloc (len + 1);
+
+      if (fread (locale_name, 1, len, stdin) != len)
+        {
+          g_printerr ("%s: Truncated request\n", g_get_prgname ());
+          return 2;
+        }
+
+      locale_name[len] = '\0';
+      json = check_locale (locale_name, FALSE, &exit_status);
+
+#ifdef MOCK_CHECK_LOCALE
+      mock_setlocale (initial_locale);
+#else
+      setlocale (LC_ALL, initial_locale);
+#endif
+
+      /* Write the JSON directly, because g_print() would convert it
+       * into the charset of whatever locale we just tried */
+      if (fprintf (stdout, "%" G_GSIZE_FORMAT "\n", strlen (json)) < 0
+          || fputs (json, stdout) < 0
+          || fflush (stdout) != 0)
+        return 1;
+    }
+
+  return 0;
+}
+
+int
+main (int argc,
+      char **argv)
+{
+  GOptionContext *option_context = NULL;
+  GError *local_error = NULL;
+  const char *locale_name;
+  gchar *json = NULL;
+  int ret = 1;
+
+  option_context = g_option_context_new ("");
+  g_option_context_add_main_entries (option_context, option_entries, NULL);
+
+  if (!g_option_context_parse (option_context, &argc, &argv, &local_error))
+    {
+      ret = 2;
+      goto out;
+    }
+
+  if (opt_print_version)
+    {
+      /* Output version number as YAML for machine-readability,
+       * inspired by `ostree --version` and `docker version` */
+      g_print (
+          "%s:\n"
+          " Package: steam-runtime-tools\n"
+          " Version: %s\n",
+          argv[0], VERSION);
+      ret = 0;
+      goto out;
+    }
+
+  if (opt_server)
+    {
+      if (opt_locale != NULL)
+        {
+          g_set_error (&local_error, G_OPTION_ERROR, G_OPTION_ERROR_FAILED,
+                       "A locale cannot be specified in server mode");
+          ret = 2;
+          goto out;
+        }
+
+      ret = check_locale_server ();
+      goto out;
+    }
+
+  if (opt_locale == NULL)
+    locale_name = "";
+  else
+    locale_name = opt_locale;
+
+  json = check_locale (locale_name, TRUE, &ret);
   g_print ("%s\n", json);
 
 out:
   if (local_error != NULL)
     g_printerr ("%s: %s\n", g_get_prgname (), local_error->message);
 
-  g_clear_object (&generator);
-  g_clear_object (&builder);
   g_clear_error (&local_error);
-  g_clear_pointer (&root, json_node_free);
   g_clear_pointer (&option_context, g_option_context_free);
   g_free (opt_locale);
   g_free (json);
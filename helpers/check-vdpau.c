@@ -54,7 +54,7 @@ enum
   OPTION_VERSION,
 };
 
-struct option long_options[] =
+static struct option long_options[] =
 {
   { "help", no_argument, NULL, OPTION_HELP },
   { "verbose", no_argument, NULL, OPTION_VERBOSE },
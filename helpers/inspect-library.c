@@ -30,6 +30,21 @@
  *
  * For a usage example see `srt_check_library_presence` in
  * `steam-runtime-tools/library.c`.
+ *
+ * With --batch, it takes any number of SONAME and symbols filename pairs
+ * instead, and inspects each one in a forked subprocess, producing a
+ * line-based result stream where each library's results start with
+ * `begin=SONAME` and end with `wait_status=STATUS`.
+ * For a usage example see `_srt_check_library_presence_batch` in
+ * `steam-runtime-tools/library.c`.
+ *
+ * With --server, it reads requests from stdin and writes responses to
+ * stdout until it reaches end-of-file. Each request and response is
+ * framed as a decimal length, a newline and that many bytes of payload.
+ * A request is a sequence of NUL-terminated fields: the SONAME, the
+ * symbols filename (empty if none), `plain` or `deb-symbols`, and any
+ * number of hidden dependencies. The response is the same as the
+ * output of --batch for that one library.
  */
 
 #include <argz.h>
@@ -37,14 +52,24 @@
 #include <errno.h>
 #include <getopt.h>
 #include <link.h>
+#include <poll.h>
+#include <signal.h>
 #include <stdbool.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <sysexits.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/wait.h>
 
 #define BASE "Base"
 
+/* Match the timeout(1) arguments used by _srt_get_helper() */
+#define TIME_OUT_SECONDS 10
+#define KILL_AFTER_SECONDS 3
+
 static void print_json_string_content (const char *s);
 static bool has_symbol (void *handle, const char *symbol);
 static bool has_versioned_symbol (void *handle,
@@ -112,18 +137,24 @@ clear_with_fclose (void *pp)
 enum
 {
   OPTION_HELP = 1,
+  OPTION_BATCH,
   OPTION_DEB_SYMBOLS,
   OPTION_HIDDEN_DEPENDENCY,
+  OPTION_HIDDEN_DEPENDENCY_OF,
   OPTION_LINE_BASED,
+  OPTION_SERVER,
   OPTION_VERSION,
 };
 
 struct option long_options[] =
 {
+    { "batch", no_argument, NULL, OPTION_BATCH },
     { "hidden-dependency", required_argument, NULL, OPTION_HIDDEN_DEPENDENCY },
+    { "hidden-dependency-of", required_argument, NULL, OPTION_HIDDEN_DEPENDENCY_OF },
     { "deb-symbols", no_argument, NULL, OPTION_DEB_SYMBOLS },
     { "help", no_argument, NULL, OPTION_HELP },
     { "line-based", no_argument, NULL, OPTION_LINE_BASED },
+    { "server", no_argument, NULL, OPTION_SERVER },
     { "version", no_argument, NULL, OPTION_VERSION },
     { NULL, 0, NULL, 0 }
 };
@@ -145,6 +176,12 @@ usage (int code)
 
   fprintf (fp, "Usage: %s [OPTIONS] SONAME [SYMBOLS_FILENAME]\n",
            program_invocation_short_name);
+  fprintf (fp, "       %s --line-based --batch [--deb-symbols] "
+               "[--hidden-dependency-of=SONAME=DEPENDENCY...] "
+               "SONAME SYMBOLS_FILENAME [SONAME SYMBOLS_FILENAME...]\n",
+           program_invocation_short_name);
+  fprintf (fp, "       %s --line-based --server\n",
+           program_invocation_short_name);
   exit (code);
 }
 
@@ -184,29 +221,39 @@ find_tag_value (const ElfW(Dyn) *dyn,
 }
 
 /*
- * Print a bytestring to stdout, escaping backslashes and control
+ * Print a bytestring to @fp, escaping backslashes and control
  * characters in octal. The result can be parsed with g_strcompress().
  */
 static void
-print_strescape (const char *bytestring)
+print_strescape (FILE *fp,
+                 const char *bytestring)
 {
   const unsigned char *p;
 
   for (p = (const unsigned char *) bytestring; *p != '\0'; p++)
     {
       if (*p < ' ' || *p >= 0x7f || *p == '\\')
-        printf ("\\%03o", *p);
+        fprintf (fp, "\\%03o", *p);
       else
-        putc (*p, stdout);
+        putc (*p, fp);
     }
 }
 
-int
-main (int argc,
-      char **argv)
+/*
+ * Inspect @soname and print the results to stdout, either as JSON
+ * or in the line-based format.
+ *
+ * Returns: 0 on success, or an exit status on failure
+ */
+static int
+inspect_library (const char *soname,
+                 const char *symbols_path,
+                 bool deb_symbols,
+                 const char *hidden_deps,
+                 size_t hidden_deps_len,
+                 bool line_based)
 {
   const char *entry;
-  const char *soname;
   const char *version;
   const char *symbol;
   autodlclose void *handle = NULL;
@@ -221,61 +268,12 @@ main (int argc,
   size_t len = 0;
   ssize_t chars;
   bool first;
-  bool deb_symbols = false;
-  int opt;
-  autofree char *hidden_deps = NULL;
-  size_t hidden_deps_len = 0;
   const char *hidden_dep;
-  bool line_based = false;
-
-  while ((opt = getopt_long (argc, argv, "", long_options, NULL)) != -1)
-    {
-      switch (opt)
-        {
-          case OPTION_HIDDEN_DEPENDENCY:
-            argz_add_or_die (&hidden_deps, &hidden_deps_len, optarg);
-            break;
-
-          case OPTION_DEB_SYMBOLS:
-            deb_symbols = true;
-            break;
-
-          case OPTION_HELP:
-            usage (0);
-            break;
-
-          case OPTION_LINE_BASED:
-            line_based = true;
-            break;
-
-          case OPTION_VERSION:
-            /* Output version number as YAML for machine-readability,
-             * inspired by `ostree --version` and `docker version` */
-            printf (
-                "%s:\n"
-                " Package: steam-runtime-tools\n"
-                " Version: %s\n",
-                argv[0], VERSION);
-            return 0;
-
-          case '?':
-          default:
-            usage (1);
-            break;  /* not reached */
-        }
-    }
-
-  if (argc < optind + 1 || argc > optind + 2)
-    {
-      usage (1);
-    }
-
-  soname = argv[optind];
 
   if (line_based)
     {
       fputs ("requested=", stdout);
-      print_strescape (soname);
+      print_strescape (stdout, soname);
       putc ('\n', stdout);
     }
   else
@@ -322,7 +320,7 @@ main (int argc,
       if (line_based)
         {
           fputs ("soname=", stdout);
-          print_strescape (&strtab[soname_val]);
+          print_strescape (stdout, &strtab[soname_val]);
           putc ('\n', stdout);
         }
       else
@@ -342,7 +340,7 @@ main (int argc,
   if (line_based)
     {
       fputs ("path=", stdout);
-      print_strescape (the_library->l_name);
+      print_strescape (stdout, the_library->l_name);
       putc ('\n', stdout);
     }
   else
@@ -352,23 +350,23 @@ main (int argc,
       printf ("\"");
     }
 
-  if (argc >= optind + 2)
+  if (symbols_path != NULL)
     {
       size_t soname_len = strlen (soname);
       bool found_our_soname = false;
       bool in_our_soname = false;
 
-      if (strcmp(argv[optind + 1], "-") == 0)
+      if (strcmp(symbols_path, "-") == 0)
         fp = stdin;
       else
-        fp = fopen(argv[optind + 1], "r");
+        fp = fopen(symbols_path, "r");
 
       if (fp == NULL)
         {
           int saved_errno = errno;
 
           fprintf (stderr, "Error reading \"%s\": %s\n",
-                   argv[optind + 1], strerror (saved_errno));
+                   symbols_path, strerror (saved_errno));
           return 1;
         }
 
@@ -468,7 +466,7 @@ main (int argc,
       if (deb_symbols && !found_our_soname)
         {
           fprintf (stderr, "Warning: \"%s\" does not describe ABI of \"%s\"\n",
-                   argv[optind + 1], soname);
+                   symbols_path, soname);
         }
 
       first = true;
@@ -487,7 +485,7 @@ main (int argc,
           if (line_based)
             {
               fputs ("missing_symbol=", stdout);
-              print_strescape (entry);
+              print_strescape (stdout, entry);
               putc ('\n', stdout);
             }
           else
@@ -517,7 +515,7 @@ main (int argc,
           if (line_based)
             {
               fputs ("misversioned_symbol=", stdout);
-              print_strescape (entry);
+              print_strescape (stdout, entry);
               putc ('\n', stdout);
             }
           else
@@ -562,7 +560,7 @@ main (int argc,
       if (line_based)
         {
           fputs ("dependency=", stdout);
-          print_strescape (dep_map->l_name);
+          print_strescape (stdout, dep_map->l_name);
           putc ('\n', stdout);
         }
       else
@@ -581,6 +579,523 @@ main (int argc,
   return 0;
 }
 
+/*
+ * Append whatever is available to read from @fd to @buffer.
+ *
+ * Returns: false on end-of-file or error
+ */
+static bool
+read_some (int fd,
+           char **buffer,
+           size_t *len,
+           size_t *allocated)
+{
+  ssize_t n;
+
+  if (*allocated - *len < 4096)
+    {
+      char *new_buffer = realloc (*buffer, *allocated + 4096);
+
+      if (new_buffer == NULL)
+        oom ();
+
+      *buffer = new_buffer;
+      *allocated += 4096;
+    }
+
+  do
+    n = read (fd, *buffer + *len, *allocated - *len - 1);
+  while (n < 0 && errno == EINTR);
+
+  if (n <= 0)
+    return false;
+
+  *len += n;
+  (*buffer)[*len] = '\0';
+  return true;
+}
+
+static long
+monotonic_ms (void)
+{
+  struct timespec ts;
+
+  clock_gettime (CLOCK_MONOTONIC, &ts);
+  return (ts.tv_sec * 1000L) + (ts.tv_nsec / 1000000L);
+}
+
+/*
+ * Inspect @soname in a forked child process, so that each library is
+ * loaded into a fresh address space (and a crash or hang only affects
+ * that one library), but without paying for another exec() and
+ * dynamic linker startup.
+ *
+ * The child's line-based output is passed through to @out,
+ * followed by its stderr as `messages=...` and its wait status as
+ * `wait_status=...`. If the child takes longer than the same time
+ * limit that timeout(1) would enforce for a one-shot inspect-library
+ * process, it is killed and reported as having exited with status 124,
+ * like timeout(1) would.
+ *
+ * Returns: true on success, false if we could not fork
+ */
+static bool
+inspect_library_in_subprocess (const char *soname,
+                               const char *symbols_path,
+                               bool deb_symbols,
+                               const char *hidden_deps,
+                               size_t hidden_deps_len,
+                               FILE *out)
+{
+  autofree char *out_buf = NULL;
+  autofree char *err_buf = NULL;
+  size_t out_len = 0;
+  size_t err_len = 0;
+  size_t out_allocated = 0;
+  size_t err_allocated = 0;
+  int out_pipe[2];
+  int err_pipe[2];
+  struct pollfd fds[2];
+  bool timed_out = false;
+  bool killed = false;
+  long deadline;
+  pid_t pid;
+  int wait_status = -1;
+
+  if (pipe (out_pipe) < 0)
+    return false;
+
+  if (pipe (err_pipe) < 0)
+    {
+      close (out_pipe[0]);
+      close (out_pipe[1]);
+      return false;
+    }
+
+  fflush (stdout);
+  fflush (stderr);
+
+  pid = fork ();
+
+  if (pid < 0)
+    {
+      close (out_pipe[0]);
+      close (out_pipe[1]);
+      close (err_pipe[0]);
+      close (err_pipe[1]);
+      return false;
+    }
+
+  if (pid == 0)
+    {
+      int ret;
+
+      if (dup2 (out_pipe[1], STDOUT_FILENO) != STDOUT_FILENO
+          || dup2 (err_pipe[1], STDERR_FILENO) != STDERR_FILENO)
+        _exit (EX_OSERR);
+
+      close (out_pipe[0]);
+      close (out_pipe[1]);
+      close (err_pipe[0]);
+      close (err_pipe[1]);
+
+      ret = inspect_library (soname, symbols_path, deb_symbols,
+                             hidden_deps, hidden_deps_len, true);
+      fflush (stdout);
+      fflush (stderr);
+      _exit (ret);
+    }
+
+  close (out_pipe[1]);
+  close (err_pipe[1]);
+
+  fds[0].fd = out_pipe[0];
+  fds[0].events = POLLIN;
+  fds[1].fd = err_pipe[0];
+  fds[1].events = POLLIN;
+  deadline = monotonic_ms () + (TIME_OUT_SECONDS * 1000L);
+
+  while (fds[0].fd >= 0 || fds[1].fd >= 0)
+    {
+      long remaining = deadline - monotonic_ms ();
+      int n;
+
+      if (remaining <= 0)
+        {
+          if (killed)
+            break;
+
+          /* Behave like `timeout --kill-after=3 10` */
+          if (timed_out)
+            {
+              kill (pid, SIGKILL);
+              killed = true;
+            }
+          else
+            {
+              kill (pid, SIGTERM);
+              timed_out = true;
+            }
+
+          deadline = monotonic_ms () + (KILL_AFTER_SECONDS * 1000L);
+          continue;
+        }
+
+      n = poll (fds, 2, (int) remaining);
+
+      if (n < 0 && errno == EINTR)
+        continue;
+
+      if (n < 0)
+        break;
+
+      if (fds[0].fd >= 0 && fds[0].revents != 0
+          && !read_some (fds[0].fd, &out_buf, &out_len, &out_allocated))
+        {
+          close (fds[0].fd);
+          fds[0].fd = -1;
+        }
+
+      if (fds[1].fd >= 0 && fds[1].revents != 0
+          && !read_some (fds[1].fd, &err_buf, &err_len, &err_allocated))
+        {
+          close (fds[1].fd);
+          fds[1].fd = -1;
+        }
+    }
+
+  if (fds[0].fd >= 0)
+    close (fds[0].fd);
+
+  if (fds[1].fd >= 0)
+    close (fds[1].fd);
+
+  while (waitpid (pid, &wait_status, 0) < 0)
+    {
+      if (errno != EINTR)
+        {
+          wait_status = -1;
+          break;
+        }
+    }
+
+  if (timed_out)
+    wait_status = 124 << 8;
+
+  if (out_len > 0)
+    {
+      fwrite (out_buf, 1, out_len, out);
+
+      if (out_buf[out_len - 1] != '\n')
+        putc ('\n', out);
+    }
+
+  if (err_len > 0)
+    {
+      fputs ("messages=", out);
+      print_strescape (out, err_buf);
+      putc ('\n', out);
+    }
+
+  fprintf (out, "wait_status=%d\n", wait_status);
+  return true;
+}
+
+/*
+ * Inspect each SONAME/symbols pair in @args in turn.
+ * An empty symbols filename means we have no expectations.
+ * @hidden_deps_of is a list of `SONAME=DEPENDENCY` pairs.
+ *
+ * Returns: 0 on success, or an exit status on failure
+ */
+static int
+inspect_library_batch (char **args,
+                       size_t n_args,
+                       bool deb_symbols,
+                       const char *hidden_deps_of,
+                       size_t hidden_deps_of_len)
+{
+  size_t i;
+
+  if (n_args % 2 != 0)
+    usage (1);
+
+  for (i = 0; i < n_args; i += 2)
+    {
+      const char *soname = args[i];
+      const char *symbols_path = args[i + 1];
+      size_t soname_len = strlen (soname);
+      autofree char *hidden_deps = NULL;
+      size_t hidden_deps_len = 0;
+      const char *entry;
+
+      if (symbols_path[0] == '\0')
+        symbols_path = NULL;
+
+      for (entry = argz_next (hidden_deps_of, hidden_deps_of_len, NULL);
+           entry != NULL;
+           entry = argz_next (hidden_deps_of, hidden_deps_of_len, entry))
+        {
+          if (strncmp (entry, soname, soname_len) == 0
+              && entry[soname_len] == '=')
+            argz_add_or_die (&hidden_deps, &hidden_deps_len,
+                             &entry[soname_len + 1]);
+        }
+
+      fputs ("begin=", stdout);
+      print_strescape (stdout, soname);
+      putc ('\n', stdout);
+
+      if (!inspect_library_in_subprocess (soname, symbols_path, deb_symbols,
+                                          hidden_deps, hidden_deps_len,
+                                          stdout))
+        {
+          int saved_errno = errno;
+
+          fprintf (stderr, "Unable to start subprocess for \"%s\": %s\n",
+                   soname, strerror (saved_errno));
+          return EX_OSERR;
+        }
+    }
+
+  return 0;
+}
+
+/*
+ * Read one framed request from stdin into @request_out.
+ *
+ * Returns: 0 on success, -1 on end-of-file, or an exit status on failure
+ */
+static int
+read_request (char **request_out,
+              size_t *len_out)
+{
+  autofree char *header = NULL;
+  autofree char *request = NULL;
+  size_t header_allocated = 0;
+  unsigned long len;
+  char *endptr;
+
+  if (getline (&header, &header_allocated, stdin) < 0)
+    return -1;
+
+  errno = 0;
+  len = strtoul (header, &endptr, 10);
+
+  if (errno != 0 || endptr == header || *endptr != '\n')
+    {
+      fprintf (stderr, "Invalid request header\n");
+      return EX_PROTOCOL;
+    }
+
+  request = malloc (len + 1);
+
+  if (request == NULL)
+    oom ();
+
+  if (fread (request, 1, len, stdin) != len)
+    {
+      fprintf (stderr, "Truncated request\n");
+      return EX_PROTOCOL;
+    }
+
+  request[len] = '\0';
+  *request_out = steal_pointer (&request);
+  *len_out = len;
+  return 0;
+}
+
+/*
+ * Answer requests from stdin until end-of-file, inspecting each
+ * library in a forked subprocess as in inspect_library_batch().
+ *
+ * Returns: 0 on success, or an exit status on failure
+ */
+static int
+inspect_library_server (void)
+{
+  while (true)
+    {
+      autofree char *request = NULL;
+      autofree char *response = NULL;
+      size_t request_len = 0;
+      size_t response_len = 0;
+      const char *soname = NULL;
+      const char *symbols_path = NULL;
+      const char *format = NULL;
+      const char *hidden_deps = NULL;
+      size_t hidden_deps_len = 0;
+      FILE *out;
+      int ret;
+
+      ret = read_request (&request, &request_len);
+
+      if (ret < 0)
+        return 0;
+      else if (ret > 0)
+        return ret;
+
+      if (request_len > 0 && request[request_len - 1] == '\0')
+        soname = argz_next (request, request_len, NULL);
+
+      if (soname != NULL)
+        symbols_path = argz_next (request, request_len, soname);
+
+      if (symbols_path != NULL)
+        format = argz_next (request, request_len, symbols_path);
+
+      if (format == NULL)
+        {
+          fprintf (stderr, "Invalid request\n");
+          return EX_PROTOCOL;
+        }
+
+      hidden_deps = argz_next (request, request_len, format);
+
+      if (hidden_deps != NULL)
+        hidden_deps_len = request_len - (hidden_deps - request);
+
+      if (symbols_path[0] == '\0')
+        symbols_path = NULL;
+
+      out = open_memstream (&response, &response_len);
+
+      if (out == NULL)
+        oom ();
+
+      fputs ("begin=", out);
+      print_strescape (out, soname);
+      putc ('\n', out);
+
+      if (symbols_path != NULL && strcmp (symbols_path, "-") == 0)
+        {
+          /* stdin is where our requests come from */
+          fputs ("messages=Reading symbols from stdin is not supported\n", out);
+          fprintf (out, "wait_status=%d\n", EX_USAGE << 8);
+        }
+      else if (!inspect_library_in_subprocess (soname, symbols_path,
+                                               strcmp (format, "deb-symbols") == 0,
+                                               hidden_deps, hidden_deps_len,
+                                               out))
+        {
+          int saved_errno = errno;
+
+          fclose (out);
+          fprintf (stderr, "Unable to start subprocess for \"%s\": %s\n",
+                   soname, strerror (saved_errno));
+          return EX_OSERR;
+        }
+
+      if (fclose (out) != 0)
+        oom ();
+
+      printf ("%zu\n", response_len);
+      fwrite (response, 1, response_len, stdout);
+
+      if (fflush (stdout) != 0)
+        return EX_IOERR;
+    }
+}
+
+int
+main (int argc,
+      char **argv)
+{
+  bool deb_symbols = false;
+  int opt;
+  autofree char *hidden_deps = NULL;
+  size_t hidden_deps_len = 0;
+  autofree char *hidden_deps_of = NULL;
+  size_t hidden_deps_of_len = 0;
+  bool line_based = false;
+  bool batch = false;
+  bool server = false;
+
+  while ((opt = getopt_long (argc, argv, "", long_options, NULL)) != -1)
+    {
+      switch (opt)
+        {
+          case OPTION_BATCH:
+            batch = true;
+            break;
+
+          case OPTION_HIDDEN_DEPENDENCY:
+            argz_add_or_die (&hidden_deps, &hidden_deps_len, optarg);
+            break;
+
+          case OPTION_HIDDEN_DEPENDENCY_OF:
+            if (strchr (optarg, '=') == NULL)
+              usage (1);
+
+            argz_add_or_die (&hidden_deps_of, &hidden_deps_of_len, optarg);
+            break;
+
+          case OPTION_DEB_SYMBOLS:
+            deb_symbols = true;
+            break;
+
+          case OPTION_HELP:
+            usage (0);
+            break;
+
+          case OPTION_LINE_BASED:
+            line_based = true;
+            break;
+
+          case OPTION_SERVER:
+            server = true;
+            break;
+
+          case OPTION_VERSION:
+            /* Output version number as YAML for machine-readability,
+             * inspired by `ostree --version` and `docker version` */
+            printf (
+                "%s:\n"
+                " Package: steam-runtime-tools\n"
+                " Version: %s\n",
+                argv[0], VERSION);
+            return 0;
+
+          case '?':
+          default:
+            usage (1);
+            break;  /* not reached */
+        }
+    }
+
+  if (server)
+    {
+      /* Server mode only supports the line-based output format, and
+       * everything else is specified per-request */
+      if (!line_based || batch || deb_symbols || hidden_deps != NULL
+          || hidden_deps_of != NULL || optind != argc)
+        usage (1);
+
+      return inspect_library_server ();
+    }
+
+  if (batch)
+    {
+      /* Batch mode only supports the line-based output format, and
+       * hidden dependencies are specified per-library */
+      if (!line_based || hidden_deps != NULL)
+        usage (1);
+
+      return inspect_library_batch (&argv[optind], argc - optind, deb_symbols,
+                                    hidden_deps_of, hidden_deps_of_len);
+    }
+
+  if (argc < optind + 1 || argc > optind + 2 || hidden_deps_of != NULL)
+    {
+      usage (1);
+    }
+
+  return inspect_library (argv[optind],
+                          argc >= optind + 2 ? argv[optind + 1] : NULL,
+                          deb_symbols, hidden_deps, hidden_deps_len,
+                          line_based);
+}
+
 static void
 print_json_string_content (const char *s)
 {
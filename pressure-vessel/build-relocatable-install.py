@@ -116,6 +116,7 @@ EXECUTABLES = [
     'pressure-vessel-adverb',
     'pressure-vessel-launch',
     'pressure-vessel-launcher',
+    'pressure-vessel-mtree-compile',
     'pressure-vessel-try-setlocale',
     'pressure-vessel-wrap',
     'steam-runtime-system-info',
@@ -247,6 +247,99 @@ pv_bwrap_bind_usr (FlatpakBwrap *bwrap,
   return TRUE;
 }
 
+/**
+ * pv_bwrap_overlay_usr:
+ * @bwrap: The #FlatpakBwrap
+ * @lower_in_host_namespace: A merged `/usr` in the host system's
+ *  namespace, to be used as the lower layer
+ * @sysroot_in_host_namespace: A sysroot whose `usr` directory contains
+ *  files to be layered on top of @lower_in_host_namespace, in the host
+ *  system's namespace
+ * @sysroot_in_current_namespace: The same sysroot in the current namespace
+ * @mount_point: The root directory in the container
+ * @error: Used to raise an error on failure
+ *
+ * Use overlayfs to mount `${sysroot}/usr` over @lower_in_host_namespace,
+ * read-only, on `${mount_point}/usr` in the container. Each symbolic
+ * link in the top level of the sysroot, such as `lib -> usr/lib`,
+ * is recreated in @mount_point.
+ *
+ * Files that were deleted from the lower layer must have been replaced
+ * by overlayfs whiteouts (character devices with device number 0/0)
+ * in `${sysroot}/usr`. Mounting the overlay requires a version of
+ * bubblewrap that supports `--ro-overlay`, and a kernel that allows
+ * unprivileged overlayfs mounts.
+ *
+ * Returns: %TRUE on success
+ */
+gboolean
+pv_bwrap_overlay_usr (FlatpakBwrap *bwrap,
+                      const char *lower_in_host_namespace,
+                      const char *sysroot_in_host_namespace,
+                      const char *sysroot_in_current_namespace,
+                      const char *mount_point,
+                      GError **error)
+{
+  g_auto(GLnxDirFdIterator) iter = { FALSE };
+  g_autofree gchar *upper = NULL;
+  g_autofree gchar *dest = NULL;
+
+  g_return_val_if_fail (bwrap != NULL, FALSE);
+  g_return_val_if_fail (!pv_bwrap_was_finished (bwrap), FALSE);
+  g_return_val_if_fail (lower_in_host_namespace != NULL, FALSE);
+  g_return_val_if_fail (lower_in_host_namespace[0] == '/', FALSE);
+  g_return_val_if_fail (sysroot_in_host_namespace != NULL, FALSE);
+  g_return_val_if_fail (sysroot_in_host_namespace[0] == '/', FALSE);
+  g_return_val_if_fail (sysroot_in_current_namespace != NULL, FALSE);
+  g_return_val_if_fail (sysroot_in_current_namespace[0] == '/', FALSE);
+  g_return_val_if_fail (mount_point != NULL, FALSE);
+  g_return_val_if_fail (mount_point[0] == '/', FALSE);
+  g_return_val_if_fail (error == NULL || *error == NULL, FALSE);
+
+  upper = g_build_filename (sysroot_in_host_namespace, "usr", NULL);
+  dest = g_build_filename (mount_point, "usr", NULL);
+
+  /* Layers are listed from the bottom up */
+  flatpak_bwrap_add_args (bwrap,
+                          "--overlay-src", lower_in_host_namespace,
+                          "--overlay-src", upper,
+                          "--ro-overlay", dest,
+                          NULL);
+
+  if (!glnx_dirfd_iterator_init_at (AT_FDCWD, sysroot_in_current_namespace,
+                                    TRUE, &iter, error))
+    return FALSE;
+
+  while (TRUE)
+    {
+      g_autofree gchar *target = NULL;
+      g_autofree gchar *link_dest = NULL;
+      struct dirent *dent;
+
+      if (!glnx_dirfd_iterator_next_dent_ensure_dtype (&iter, &dent,
+                                                       NULL, error))
+        return FALSE;
+
+      if (dent == NULL)
+        break;
+
+      if (dent->d_type != DT_LNK)
+        continue;
+
+      target = glnx_readlinkat_malloc (iter.fd, dent->d_name, NULL, error);
+
+      if (target == NULL)
+        return FALSE;
+
+      link_dest = g_build_filename (mount_point, dent->d_name, NULL);
+      flatpak_bwrap_add_args (bwrap,
+                              "--symlink", target, link_dest,
+                              NULL);
+    }
+
+  return TRUE;
+}
+
 /* nftw() doesn't have a user_data argument so we need to use a global
  * variable :-( */
 static struct
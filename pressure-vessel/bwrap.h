@@ -38,6 +38,12 @@ gboolean pv_bwrap_bind_usr (FlatpakBwrap *bwrap,
                             const char *provider_in_current_namespace,
                             const char *provider_in_container_namespace,
                             GError **error);
+gboolean pv_bwrap_overlay_usr (FlatpakBwrap *bwrap,
+                               const char *lower_in_host_namespace,
+                               const char *sysroot_in_host_namespace,
+                               const char *sysroot_in_current_namespace,
+                               const char *mount_point,
+                               GError **error);
 void pv_bwrap_copy_tree (FlatpakBwrap *bwrap,
                          const char *source,
                          const char *dest);
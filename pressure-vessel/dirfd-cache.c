@@ -0,0 +1,297 @@
+/*
+ * Copyright © 2026 Collabora Ltd.
+ * SPDX-License-Identifier: MIT
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include "dirfd-cache.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+
+/* Enabling debug logging for this is rather too verbose, so only
+ * enable it when actively debugging this module */
+#if 0
+#define trace(...) g_debug (__VA_ARGS__)
+#else
+#define trace(...) do { } while (0)
+#endif
+
+typedef struct
+{
+  /* Normalized path relative to the root, without leading or trailing
+   * slashes, for example "usr/lib" */
+  gchar *path;
+  int fd;
+} DirfdCacheEntry;
+
+/*
+ * PvDirfdCache:
+ *
+ * A cache of open directory file descriptors below a root directory,
+ * organized as a stack in which each entry is a subdirectory of the
+ * one below it.
+ *
+ * Callers that visit paths in sorted or depth-first order, such as
+ * pv_mtree_apply() and pv_cheap_tree_copy(), usually ask for the
+ * same directory as last time or for a subdirectory of a recently-used
+ * directory, so most lookups need zero or one openat() call instead of
+ * walking from the root one component at a time.
+ *
+ * This is not thread-safe: each thread needs its own cache.
+ */
+struct _PvDirfdCache
+{
+  gchar *root_path;
+  /* (element-type DirfdCacheEntry) */
+  GArray *stack;
+  /* Borrowed from the caller */
+  int root_fd;
+};
+
+static void
+dirfd_cache_entry_clear (gpointer p)
+{
+  DirfdCacheEntry *entry = p;
+
+  g_clear_pointer (&entry->path, g_free);
+  glnx_close_fd (&entry->fd);
+}
+
+/*
+ * pv_dirfd_cache_new:
+ * @root_fd: A file descriptor opened on a directory, which must
+ *  remain open until the cache is freed
+ * @root_path: The path to @root_fd, used in debug messages
+ *
+ * Returns: (transfer full): A new cache
+ */
+PvDirfdCache *
+pv_dirfd_cache_new (int root_fd,
+                    const char *root_path)
+{
+  PvDirfdCache *self;
+
+  g_return_val_if_fail (root_fd >= 0, NULL);
+  g_return_val_if_fail (root_path != NULL, NULL);
+
+  self = g_slice_new0 (PvDirfdCache);
+  self->root_fd = root_fd;
+  self->root_path = g_strdup (root_path);
+  self->stack = g_array_new (FALSE, FALSE, sizeof (DirfdCacheEntry));
+  g_array_set_clear_func (self->stack, dirfd_cache_entry_clear);
+  return self;
+}
+
+/*
+ * Return @path without "." components or redundant slashes.
+ */
+static gchar *
+dirfd_cache_normalize (const char *path)
+{
+  GString *buf = g_string_new ("");
+
+  while (*path != '\0')
+    {
+      const char *end;
+
+      while (*path == '/')
+        path++;
+
+      end = strchrnul (path, '/');
+
+      if (end > path && !(end == path + 1 && path[0] == '.'))
+        {
+          if (buf->len > 0)
+            g_string_append_c (buf, '/');
+
+          g_string_append_len (buf, path, end - path);
+        }
+
+      path = end;
+    }
+
+  return g_string_free (buf, FALSE);
+}
+
+static void
+dirfd_cache_push (PvDirfdCache *self,
+                  gchar *path,
+                  int fd)
+{
+  DirfdCacheEntry entry = { path, fd };
+
+  trace ("Caching fd %d for \"%s\" in \"%s\"", fd, path, self->root_path);
+  g_array_append_val (self->stack, entry);
+}
+
+/*
+ * pv_dirfd_cache_resolve:
+ * @self: The cache
+ * @path: A directory relative to the root, for example "usr/lib",
+ *  or "." or "" for the root itself
+ * @flags: %SRT_RESOLVE_FLAGS_MKDIR_P, %SRT_RESOLVE_FLAGS_REJECT_SYMLINKS
+ *  or %SRT_RESOLVE_FLAGS_NONE
+ *
+ * Open @path as if via _srt_resolve_in_sysroot(), treating the
+ * root directory as the sysroot, but reusing previously-opened
+ * directories where possible.
+ *
+ * Symbolic links are not followed by the fast path: if any uncached
+ * component of @path is a symbolic link or "..", the whole of @path is
+ * resolved by _srt_resolve_in_sysroot() instead, so that the result is
+ * the same. Directories cached by an earlier call are reused regardless
+ * of @flags, so each cache should always be used with the same
+ * %SRT_RESOLVE_FLAGS_REJECT_SYMLINKS setting.
+ *
+ * Returns: A file descriptor owned by @self, which remains valid until
+ *  the next call to this function or until @self is freed,
+ *  or -1 on error
+ */
+int
+pv_dirfd_cache_resolve (PvDirfdCache *self,
+                        const char *path,
+                        SrtResolveFlags flags,
+                        GError **error)
+{
+  g_autofree gchar *normalized = NULL;
+  const char *remaining;
+  int base_fd;
+  gsize base_len;
+  int fd = -1;
+
+  g_return_val_if_fail (self != NULL, -1);
+  g_return_val_if_fail (path != NULL, -1);
+  g_return_val_if_fail ((flags & ~(SRT_RESOLVE_FLAGS_MKDIR_P
+                                   | SRT_RESOLVE_FLAGS_REJECT_SYMLINKS)) == 0,
+                        -1);
+  g_return_val_if_fail (error == NULL || *error == NULL, -1);
+
+  normalized = dirfd_cache_normalize (path);
+
+  if (normalized[0] == '\0')
+    return self->root_fd;
+
+  /* Discard cached directories that are not ancestors of @path */
+  while (self->stack->len > 0)
+    {
+      const DirfdCacheEntry *top = &g_array_index (self->stack,
+                                                   DirfdCacheEntry,
+                                                   self->stack->len - 1);
+      size_t len = strlen (top->path);
+
+      if (strncmp (normalized, top->path, len) == 0
+          && (normalized[len] == '\0' || normalized[len] == '/'))
+        break;
+
+      g_array_set_size (self->stack, self->stack->len - 1);
+    }
+
+  if (self->stack->len > 0)
+    {
+      const DirfdCacheEntry *top = &g_array_index (self->stack,
+                                                   DirfdCacheEntry,
+                                                   self->stack->len - 1);
+
+      base_fd = top->fd;
+      base_len = strlen (top->path);
+
+      if (normalized[base_len] == '\0')
+        return base_fd;
+
+      remaining = normalized + base_len + 1;
+    }
+  else
+    {
+      base_fd = self->root_fd;
+      base_len = 0;
+      remaining = normalized;
+    }
+
+  while (*remaining != '\0')
+    {
+      g_autofree gchar *component = NULL;
+      const char *end = strchrnul (remaining, '/');
+
+      component = g_strndup (remaining, end - remaining);
+
+      if (strcmp (component, "..") == 0)
+        goto slow_path;
+
+      fd = TEMP_FAILURE_RETRY (openat (base_fd, component,
+                                       (O_PATH | O_DIRECTORY | O_NOFOLLOW
+                                        | O_CLOEXEC)));
+
+      if (fd < 0
+          && errno == ENOENT
+          && (flags & SRT_RESOLVE_FLAGS_MKDIR_P)
+          && (mkdirat (base_fd, component, 0755) == 0 || errno == EEXIST))
+        fd = TEMP_FAILURE_RETRY (openat (base_fd, component,
+                                         (O_PATH | O_DIRECTORY | O_NOFOLLOW
+                                          | O_CLOEXEC)));
+
+      /* Most likely a symlink, which we need to resolve relative to
+       * the root, or something that does not exist: either way, let
+       * _srt_resolve_in_sysroot() deal with it */
+      if (fd < 0)
+        goto slow_path;
+
+      dirfd_cache_push (self, g_strndup (normalized, end - normalized), fd);
+      base_fd = fd;
+      remaining = end;
+
+      while (*remaining == '/')
+        remaining++;
+    }
+
+  return base_fd;
+
+slow_path:
+  trace ("Resolving \"%s\" in \"%s\" the slow way",
+         normalized, self->root_path);
+  fd = _srt_resolve_in_sysroot (self->root_fd, normalized, flags,
+                                NULL, error);
+
+  if (fd < 0)
+    return -1;
+
+  dirfd_cache_push (self, g_steal_pointer (&normalized), fd);
+  return fd;
+}
+
+/*
+ * pv_dirfd_cache_free:
+ * @self: (transfer full): The cache
+ *
+ * Close all cached file descriptors and free @self.
+ */
+void
+pv_dirfd_cache_free (PvDirfdCache *self)
+{
+  g_return_if_fail (self != NULL);
+
+  g_array_unref (self->stack);
+  g_free (self->root_path);
+  g_slice_free (PvDirfdCache, self);
+}
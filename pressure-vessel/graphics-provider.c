@@ -233,9 +233,13 @@ pv_graphics_provider_create_system_info (PvGraphicsProvider *self)
 
   system_info = srt_system_info_new (NULL);
   srt_system_info_set_sysroot (system_info, self->path_in_current_ns);
+  /* Each architecture looks up several graphics driver loaders: keep
+   * one inspect-library process per architecture instead of one per
+   * loader */
   _srt_system_info_set_check_flags (system_info,
                                     (SRT_CHECK_FLAGS_SKIP_SLOW_CHECKS
-                                     | SRT_CHECK_FLAGS_SKIP_EXTRAS));
+                                     | SRT_CHECK_FLAGS_SKIP_EXTRAS
+                                     | SRT_CHECK_FLAGS_HELPER_SERVERS));
   return g_steal_pointer (&system_info);
 }
 
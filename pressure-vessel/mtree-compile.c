@@ -0,0 +1,123 @@
+/*
+ * pressure-vessel-mtree-compile — convert a mtree manifest to binary
+ *
+ * Copyright © 2026 Collabora Ltd.
+ * SPDX-License-Identifier: MIT
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include "config.h"
+#include "subprojects/libglnx/config.h"
+
+#include <locale.h>
+#include <sysexits.h>
+
+#include "libglnx/libglnx.h"
+
+#include "steam-runtime-tools/glib-backports-internal.h"
+#include "steam-runtime-tools/utils-internal.h"
+
+#include "mtree.h"
+#include "utils.h"
+
+static gboolean opt_verbose = FALSE;
+static gboolean opt_version = FALSE;
+
+static GOptionEntry options[] =
+{
+  { "verbose", '\0',
+    G_OPTION_FLAG_NONE, G_OPTION_ARG_NONE, &opt_verbose,
+    "Be more verbose.", NULL },
+  { "version", '\0',
+    G_OPTION_FLAG_NONE, G_OPTION_ARG_NONE, &opt_version,
+    "Print version number and exit.", NULL },
+  { NULL }
+};
+
+int
+main (int argc,
+      char *argv[])
+{
+  g_autoptr(GOptionContext) context = NULL;
+  g_autoptr(GError) local_error = NULL;
+  GError **error = &local_error;
+  PvMtreeApplyFlags flags = PV_MTREE_APPLY_FLAGS_NONE;
+  int ret = EX_USAGE;
+
+  setlocale (LC_ALL, "");
+  _srt_setenv_disable_gio_modules ();
+
+  g_set_prgname ("pressure-vessel-mtree-compile");
+
+  /* Set up the initial base logging */
+  pv_set_up_logging (FALSE);
+
+  context = g_option_context_new ("MTREE OUTPUT");
+  g_option_context_set_summary (context,
+                                "Convert a mtree(5) manifest into the "
+                                "binary format used by pressure-vessel.");
+  g_option_context_add_main_entries (context, options, NULL);
+  opt_verbose = pv_boolean_environment ("PRESSURE_VESSEL_VERBOSE", FALSE);
+
+  if (!g_option_context_parse (context, &argc, &argv, error))
+    goto out;
+
+  if (opt_version)
+    {
+      g_print ("%s:\n"
+               " Package: pressure-vessel\n"
+               " Version: %s\n",
+               g_get_prgname (), VERSION);
+      ret = 0;
+      goto out;
+    }
+
+  if (opt_verbose)
+    pv_set_up_logging (opt_verbose);
+
+  if (argc >= 2 && strcmp (argv[1], "--") == 0)
+    {
+      argv++;
+      argc--;
+    }
+
+  if (argc != 3)
+    {
+      glnx_throw (error, "Usage: %s MTREE OUTPUT", g_get_prgname ());
+      goto out;
+    }
+
+  ret = EX_UNAVAILABLE;
+
+  if (g_str_has_suffix (argv[1], ".gz"))
+    flags |= PV_MTREE_APPLY_FLAGS_GZIP;
+
+  if (!pv_mtree_compile (argv[1], argv[2], flags, error))
+    goto out;
+
+  ret = 0;
+
+out:
+  if (local_error != NULL)
+    pv_log_failure ("%s", local_error->message);
+
+  return ret;
+}
@@ -24,6 +24,8 @@
 
 #include "mtree.h"
 
+#include "dirfd-cache.h"
+
 #include "steam-runtime-tools/profiling-internal.h"
 #include "steam-runtime-tools/resolve-in-sysroot-internal.h"
 #include "steam-runtime-tools/utils-internal.h"
@@ -371,6 +373,814 @@ pv_mtree_entry_parse (const char *line,
   return TRUE;
 }
 
+typedef struct
+{
+  const char *sysroot;
+  int sysroot_fd;
+  const char *source_files;
+  int source_files_fd;
+} MtreeApplyContext;
+
+/*
+ * A batch of regular files that all share the same parent directory,
+ * so that the parent only needs to be resolved once.
+ */
+typedef struct
+{
+  gchar *parent;
+  /* (element-type PvMtreeEntry) (transfer none): borrowed from the
+   * array of entries */
+  GPtrArray *entries;
+  GError *error;
+} MtreeApplyJob;
+
+static MtreeApplyJob *
+mtree_apply_job_new (const char *parent)
+{
+  MtreeApplyJob *job = g_slice_new0 (MtreeApplyJob);
+
+  job->parent = g_strdup (parent);
+  job->entries = g_ptr_array_new ();
+  return job;
+}
+
+static void
+mtree_apply_job_free (gpointer p)
+{
+  MtreeApplyJob *job = p;
+
+  g_free (job->parent);
+  g_ptr_array_unref (job->entries);
+  g_clear_error (&job->error);
+  g_slice_free (MtreeApplyJob, job);
+}
+
+/*
+ * Set the permissions of @fd, and its modification time if it is a
+ * regular file, to conform to @entry.
+ */
+static gboolean
+mtree_apply_metadata (const MtreeApplyContext *context,
+                      const PvMtreeEntry *entry,
+                      int fd,
+                      GError **error)
+{
+  int adjusted_mode;
+
+  if (fd < 0 || (entry->entry_flags & PV_MTREE_ENTRY_FLAGS_NO_CHANGE))
+    return TRUE;
+
+  if (entry->kind == PV_MTREE_ENTRY_KIND_DIR
+      || (entry->mode >= 0 && entry->mode & 0111))
+    adjusted_mode = 0755;
+  else
+    adjusted_mode = 0644;
+
+  if (!glnx_fchmod (fd, adjusted_mode, error))
+    {
+      g_prefix_error (error,
+                      "Unable to set mode of \"%s\" in \"%s\": ",
+                      entry->name, context->sysroot);
+      return FALSE;
+    }
+
+  if (entry->mtime_usec >= 0
+      && entry->kind == PV_MTREE_ENTRY_KIND_FILE)
+    {
+      struct timespec times[2] =
+      {
+        { .tv_sec = 0, .tv_nsec = UTIME_OMIT },   /* atime */
+        {
+          .tv_sec = entry->mtime_usec / G_TIME_SPAN_SECOND,
+          .tv_nsec = (entry->mtime_usec % G_TIME_SPAN_SECOND) * 1000
+        }   /* mtime */
+      };
+
+      if (futimens (fd, times) != 0)
+        g_warning ("Unable to set mtime of \"%s\" in \"%s\": %s",
+                   entry->name, context->sysroot, g_strerror (errno));
+    }
+
+  return TRUE;
+}
+
+/*
+ * Populate the regular file described by @entry, which is in the
+ * directory @parent_fd.
+ *
+ * This is called in worker threads, so it must only use @context
+ * and @entry.
+ */
+static gboolean
+mtree_apply_file (const MtreeApplyContext *context,
+                  const PvMtreeEntry *entry,
+                  int parent_fd,
+                  GError **error)
+{
+  const char *base = glnx_basename (entry->name);
+  glnx_autofd int fd = -1;
+
+  if (entry->size == 0)
+    {
+      /* For empty files, we can create it from nothing. */
+      fd = TEMP_FAILURE_RETRY (openat (parent_fd, base,
+                                       (O_RDWR | O_CLOEXEC | O_NOCTTY
+                                        | O_NOFOLLOW | O_CREAT
+                                        | O_TRUNC),
+                                       0644));
+
+      if (fd < 0)
+        return glnx_throw_errno_prefix (error,
+                                        "Unable to open \"%s\" in \"%s\"",
+                                        entry->name, context->sysroot);
+    }
+  else if (context->source_files_fd >= 0)
+    {
+      const char *source = entry->contents;
+
+      if (source == NULL)
+        source = entry->name;
+
+      /* If it already exists, assume it's correct */
+      if (glnx_openat_rdonly (parent_fd, base, FALSE, &fd, NULL))
+        {
+          trace ("\"%s\" already exists in \"%s\"",
+                 entry->name, context->sysroot);
+        }
+      /* If we can create a hard link, that's also fine */
+      else if (TEMP_FAILURE_RETRY (linkat (context->source_files_fd, source,
+                                           parent_fd, base, 0)) == 0)
+        {
+          trace ("Created hard link \"%s\" in \"%s\"",
+                 entry->name, context->sysroot);
+        }
+      /* Or if we can copy it, that's fine too */
+      else
+        {
+          g_debug ("Could not create hard link \"%s\" from \"%s/%s\" into \"%s\": %s",
+                   entry->name, context->source_files, source,
+                   context->sysroot, g_strerror (errno));
+
+          if (!glnx_file_copy_at (context->source_files_fd, source, NULL,
+                                  parent_fd, base,
+                                  GLNX_FILE_COPY_OVERWRITE | GLNX_FILE_COPY_NOCHOWN,
+                                  NULL, error))
+            return glnx_prefix_error (error,
+                                      "Could not create copy \"%s\" from \"%s/%s\" into \"%s\"",
+                                      entry->name, context->source_files,
+                                      source, context->sysroot);
+
+        }
+    }
+
+  /* For other regular files we just assert that it already exists
+   * (and is not a symlink). */
+  if (fd < 0
+      && !(entry->entry_flags & PV_MTREE_ENTRY_FLAGS_OPTIONAL)
+      && !glnx_openat_rdonly (parent_fd, base, FALSE, &fd, error))
+    return glnx_prefix_error (error,
+                              "Unable to open \"%s\" in \"%s\"",
+                              entry->name, context->sysroot);
+
+  return mtree_apply_metadata (context, entry, fd, error);
+}
+
+/*
+ * Populate all the regular files in one parent directory.
+ * Called via _srt_run_jobs_in_parallel(), possibly in a worker thread.
+ */
+static void
+mtree_apply_job_run (gpointer data,
+                     gpointer user_data)
+{
+  MtreeApplyJob *job = data;
+  const MtreeApplyContext *context = user_data;
+  glnx_autofd int parent_fd = -1;
+  guint i;
+
+  /* The parent was already created by pv_mtree_apply(), so we don't
+   * need SRT_RESOLVE_FLAGS_MKDIR_P here */
+  parent_fd = _srt_resolve_in_sysroot (context->sysroot_fd, job->parent,
+                                       SRT_RESOLVE_FLAGS_NONE,
+                                       NULL, &job->error);
+
+  if (parent_fd < 0)
+    {
+      const PvMtreeEntry *entry = g_ptr_array_index (job->entries, 0);
+
+      g_prefix_error (&job->error,
+                      "Unable to create parent directory for \"%s\" in \"%s\": ",
+                      entry->name, context->sysroot);
+      return;
+    }
+
+  for (i = 0; i < job->entries->len; i++)
+    {
+      const PvMtreeEntry *entry = g_ptr_array_index (job->entries, i);
+
+      if (!mtree_apply_file (context, entry, parent_fd, &job->error))
+        return;
+    }
+}
+
+/*
+ * Read and parse @mtree in its entirety, appending one #PvMtreeEntry
+ * to @entries for each line that describes a file.
+ */
+static gboolean
+mtree_read_entries (const char *mtree,
+                    PvMtreeApplyFlags flags,
+                    GArray *entries,
+                    GError **error)
+{
+  glnx_autofd int mtree_fd = -1;
+  g_autoptr(GInputStream) istream = NULL;
+  g_autoptr(GDataInputStream) reader = NULL;
+  guint line_number = 0;
+
+  if (!glnx_openat_rdonly (AT_FDCWD, mtree, TRUE, &mtree_fd, error))
+    return FALSE;
+
+  istream = g_unix_input_stream_new (glnx_steal_fd (&mtree_fd), TRUE);
+
+  if (flags & PV_MTREE_APPLY_FLAGS_GZIP)
+    {
+      g_autoptr(GInputStream) filter = NULL;
+      g_autoptr(GZlibDecompressor) decompressor = NULL;
+
+      decompressor = g_zlib_decompressor_new (G_ZLIB_COMPRESSOR_FORMAT_GZIP);
+      filter = g_converter_input_stream_new (istream, G_CONVERTER (decompressor));
+      g_clear_object (&istream);
+      istream = g_object_ref (filter);
+    }
+
+  reader = g_data_input_stream_new (istream);
+  g_data_input_stream_set_newline_type (reader, G_DATA_STREAM_NEWLINE_TYPE_LF);
+
+  while (TRUE)
+    {
+      g_autofree gchar *line = NULL;
+      g_autoptr(GError) local_error = NULL;
+      PvMtreeEntry entry = PV_MTREE_ENTRY_BLANK;
+
+      line = g_data_input_stream_read_line (reader, NULL, NULL, &local_error);
+
+      if (line == NULL)
+        {
+          if (local_error != NULL)
+            {
+              g_propagate_prefixed_error (error, g_steal_pointer (&local_error),
+                                          "While reading a line from %s: ",
+                                          mtree);
+              return FALSE;
+            }
+          else
+            {
+              /* End of file, not an error */
+              break;
+            }
+        }
+
+      g_strstrip (line);
+      line_number++;
+
+      trace ("line %u: %s", line_number, line);
+
+      if (!pv_mtree_entry_parse (line, &entry, mtree, line_number, error))
+        {
+          pv_mtree_entry_clear (&entry);
+          return FALSE;
+        }
+
+      if (entry.name == NULL || strcmp (entry.name, ".") == 0)
+        {
+          pv_mtree_entry_clear (&entry);
+          continue;
+        }
+
+      switch (entry.kind)
+        {
+          case PV_MTREE_ENTRY_KIND_FILE:
+          case PV_MTREE_ENTRY_KIND_DIR:
+          case PV_MTREE_ENTRY_KIND_LINK:
+            break;
+
+          case PV_MTREE_ENTRY_KIND_BLOCK:
+          case PV_MTREE_ENTRY_KIND_CHAR:
+          case PV_MTREE_ENTRY_KIND_FIFO:
+          case PV_MTREE_ENTRY_KIND_SOCKET:
+          case PV_MTREE_ENTRY_KIND_UNKNOWN:
+          default:
+            pv_mtree_entry_clear (&entry);
+            return glnx_throw (error,
+                               "%s:%u: Special file not supported",
+                               mtree, line_number);
+        }
+
+      /* Ownership of the contents is transferred to the array */
+      g_array_append_val (entries, entry);
+    }
+
+  return TRUE;
+}
+
+/*
+ * Compiled manifests
+ *
+ * A compiled manifest is a binary representation of the subset of a
+ * mtree(5) manifest that pv_mtree_apply() uses, designed to be mapped
+ * into memory and used without parsing. It consists of:
+ *
+ * - a #MtreeCompiledHeader, which includes the SHA-256 digest of the
+ *   text manifest that was compiled, so that a compiled manifest that
+ *   is out of date can be detected
+ * - an array of #MtreeCompiledEntry, in manifest order
+ * - a string table: concatenated, unescaped, `\0`-terminated strings,
+ *   referenced by their offset from the beginning of the table
+ *
+ * Integers are in the byte order of the machine that compiled the
+ * manifest, which is recorded in the header. Compiled manifests with an
+ * unexpected byte order or version are rejected, and the caller is
+ * expected to fall back to the text manifest.
+ */
+
+#define MTREE_COMPILED_MAGIC "PVMTREE\n"
+#define MTREE_COMPILED_BYTE_ORDER 0x01020304
+#define MTREE_COMPILED_VERSION 2
+#define MTREE_COMPILED_DIGEST_SIZE 32
+/* Used for optional strings and for entries whose parent is not listed */
+#define MTREE_COMPILED_NONE G_MAXUINT32
+
+typedef struct
+{
+  char magic[8];
+  guint32 byte_order;
+  guint32 version;
+  guint32 n_entries;
+  guint32 entry_size;
+  guint64 entries_offset;
+  guint64 strings_offset;
+  guint64 strings_size;
+  /* SHA-256 of the text manifest, exactly as stored (possibly compressed) */
+  guint8 source_sha256[MTREE_COMPILED_DIGEST_SIZE];
+} MtreeCompiledHeader;
+
+typedef struct
+{
+  guint32 name;
+  guint32 contents;
+  guint32 link;
+  /* Index of the entry for the parent directory */
+  guint32 parent;
+  gint64 size;
+  gint64 mtime_usec;
+  gint32 mode;
+  guint32 kind;
+  guint32 entry_flags;
+  guint32 reserved;
+} MtreeCompiledEntry;
+
+G_STATIC_ASSERT (sizeof (MtreeCompiledHeader) == 80);
+G_STATIC_ASSERT (sizeof (MtreeCompiledEntry) == 48);
+
+/*
+ * Validate the fixed-size header at the beginning of a compiled
+ * manifest of @len bytes.
+ */
+static gboolean
+mtree_compiled_check_header (const MtreeCompiledHeader *header,
+                             gsize len,
+                             GError **error)
+{
+  if (len < sizeof (MtreeCompiledHeader)
+      || memcmp (header->magic, MTREE_COMPILED_MAGIC,
+                 sizeof (header->magic)) != 0)
+    return glnx_throw (error, "Not a compiled mtree manifest");
+
+  if (header->byte_order != MTREE_COMPILED_BYTE_ORDER)
+    {
+      g_set_error (error, G_IO_ERROR, G_IO_ERROR_NOT_SUPPORTED,
+                   "Compiled mtree manifest has the wrong byte order");
+      return FALSE;
+    }
+
+  if (header->version != MTREE_COMPILED_VERSION)
+    {
+      g_set_error (error, G_IO_ERROR, G_IO_ERROR_NOT_SUPPORTED,
+                   "Compiled mtree manifest version %u not supported",
+                   header->version);
+      return FALSE;
+    }
+
+  if (header->entry_size != sizeof (MtreeCompiledEntry))
+    {
+      g_set_error (error, G_IO_ERROR, G_IO_ERROR_NOT_SUPPORTED,
+                   "Compiled mtree manifest entry size %u not supported "
+                   "(expected %" G_GSIZE_FORMAT ")",
+                   header->entry_size, sizeof (MtreeCompiledEntry));
+      return FALSE;
+    }
+
+  if (header->entries_offset > len
+      || header->n_entries > (len - header->entries_offset) / sizeof (MtreeCompiledEntry)
+      || header->entries_offset % 8 != 0
+      || header->strings_offset > len
+      || header->strings_size > len - header->strings_offset
+      || header->strings_size == 0
+      || header->strings_size >= MTREE_COMPILED_NONE)
+    return glnx_throw (error, "Compiled mtree manifest is truncated or corrupt");
+
+  return TRUE;
+}
+
+/*
+ * Return the string at @offset in @strings, or %NULL if @offset is
+ * %MTREE_COMPILED_NONE. @strings_size must be nonzero and
+ * `strings[strings_size - 1]` must be `\0`.
+ */
+static gboolean
+mtree_compiled_get_string (const char *strings,
+                           guint64 strings_size,
+                           guint32 offset,
+                           gchar **out,
+                           GError **error)
+{
+  if (offset == MTREE_COMPILED_NONE)
+    {
+      *out = NULL;
+      return TRUE;
+    }
+
+  if (offset >= strings_size)
+    return glnx_throw (error, "String offset %u out of range", offset);
+
+  *out = (gchar *) &strings[offset];
+  return TRUE;
+}
+
+/*
+ * Check whether @mapped is a compiled manifest. If it is, append one
+ * #PvMtreeEntry to @entries for each item, borrowing its strings from
+ * @mapped, and append the index of its parent to @parents.
+ */
+static gboolean
+mtree_read_compiled (const char *mtree,
+                     GMappedFile *mapped,
+                     GArray *entries,
+                     GArray *parents,
+                     GError **error)
+{
+  const char *contents = g_mapped_file_get_contents (mapped);
+  gsize len = g_mapped_file_get_length (mapped);
+  const MtreeCompiledHeader *header = (const MtreeCompiledHeader *) contents;
+  const MtreeCompiledEntry *items;
+  const char *strings;
+  guint32 i;
+
+  if (contents == NULL)
+    len = 0;
+
+  if (!mtree_compiled_check_header (header, len, error))
+    return glnx_prefix_error (error, "%s", mtree);
+
+  items = (const MtreeCompiledEntry *) (contents + header->entries_offset);
+  strings = contents + header->strings_offset;
+
+  if (strings[header->strings_size - 1] != '\0')
+    return glnx_throw (error, "%s: String table not terminated", mtree);
+
+  g_array_set_size (entries, 0);
+  g_array_set_size (parents, 0);
+
+  for (i = 0; i < header->n_entries; i++)
+    {
+      const MtreeCompiledEntry *item = &items[i];
+      PvMtreeEntry entry = PV_MTREE_ENTRY_BLANK;
+
+      if (!mtree_compiled_get_string (strings, header->strings_size,
+                                      item->name, &entry.name, error)
+          || !mtree_compiled_get_string (strings, header->strings_size,
+                                         item->contents, &entry.contents,
+                                         error)
+          || !mtree_compiled_get_string (strings, header->strings_size,
+                                         item->link, &entry.link, error))
+        return glnx_prefix_error (error, "%s: entry %u", mtree, i);
+
+      entry.size = item->size;
+      entry.mtime_usec = item->mtime_usec;
+      entry.mode = item->mode;
+      entry.kind = item->kind;
+      entry.entry_flags = item->entry_flags;
+
+      if (entry.name == NULL)
+        return glnx_throw (error, "%s: entry %u has no name", mtree, i);
+
+      if (item->parent != MTREE_COMPILED_NONE
+          && (item->parent >= i
+              || items[item->parent].kind != PV_MTREE_ENTRY_KIND_DIR))
+        return glnx_throw (error, "%s: entry %u has an invalid parent",
+                           mtree, i);
+
+      switch (entry.kind)
+        {
+          case PV_MTREE_ENTRY_KIND_FILE:
+          case PV_MTREE_ENTRY_KIND_DIR:
+            if (entry.link != NULL)
+              return glnx_throw (error,
+                                 "%s: Non-symlink cannot have a symlink target",
+                                 mtree);
+            break;
+
+          case PV_MTREE_ENTRY_KIND_LINK:
+            if (entry.link == NULL)
+              return glnx_throw (error,
+                                 "%s: Symlink must have a symlink target",
+                                 mtree);
+            break;
+
+          case PV_MTREE_ENTRY_KIND_BLOCK:
+          case PV_MTREE_ENTRY_KIND_CHAR:
+          case PV_MTREE_ENTRY_KIND_FIFO:
+          case PV_MTREE_ENTRY_KIND_SOCKET:
+          case PV_MTREE_ENTRY_KIND_UNKNOWN:
+          default:
+            return glnx_throw (error,
+                               "%s: entry %u: Special file not supported",
+                               mtree, i);
+        }
+
+      g_array_append_val (entries, entry);
+      g_array_append_val (parents, item->parent);
+    }
+
+  return TRUE;
+}
+
+/*
+ * If @mtree is a compiled manifest, map it into memory and return
+ * it in @mapped_out. Otherwise set @mapped_out to %NULL: it is assumed
+ * to be a text manifest.
+ */
+static gboolean
+mtree_map_if_compiled (const char *mtree,
+                       GMappedFile **mapped_out,
+                       GError **error)
+{
+  glnx_autofd int fd = -1;
+  char magic[sizeof (MTREE_COMPILED_MAGIC) - 1];
+  gssize n;
+
+  *mapped_out = NULL;
+
+  if (!glnx_openat_rdonly (AT_FDCWD, mtree, TRUE, &fd, error))
+    return FALSE;
+
+  n = TEMP_FAILURE_RETRY (pread (fd, magic, sizeof (magic), 0));
+
+  if (n < 0)
+    return glnx_throw_errno_prefix (error, "Unable to read \"%s\"", mtree);
+
+  if ((gsize) n < sizeof (magic)
+      || memcmp (magic, MTREE_COMPILED_MAGIC, sizeof (magic)) != 0)
+    return TRUE;
+
+  *mapped_out = g_mapped_file_new_from_fd (fd, FALSE, error);
+  return (*mapped_out != NULL);
+}
+
+/*
+ * Compute the SHA-256 digest of the file at @path, without
+ * decompressing it.
+ */
+static gboolean
+mtree_compute_source_digest (const char *path,
+                             guint8 digest[MTREE_COMPILED_DIGEST_SIZE],
+                             GError **error)
+{
+  g_autoptr(GChecksum) checksum = g_checksum_new (G_CHECKSUM_SHA256);
+  g_autofree guint8 *buf = g_malloc (65536);
+  glnx_autofd int fd = -1;
+  gsize len = MTREE_COMPILED_DIGEST_SIZE;
+
+  if (!glnx_openat_rdonly (AT_FDCWD, path, TRUE, &fd, error))
+    return FALSE;
+
+  while (TRUE)
+    {
+      gssize n = TEMP_FAILURE_RETRY (read (fd, buf, 65536));
+
+      if (n < 0)
+        return glnx_throw_errno_prefix (error, "Unable to read \"%s\"", path);
+
+      if (n == 0)
+        break;
+
+      g_checksum_update (checksum, buf, n);
+    }
+
+  g_checksum_get_digest (checksum, digest, &len);
+  g_return_val_if_fail (len == MTREE_COMPILED_DIGEST_SIZE, FALSE);
+  return TRUE;
+}
+
+/*
+ * pv_mtree_check_compiled:
+ * @path: (type filename): Path to a compiled manifest
+ * @source: (type filename) (nullable): Path to the text manifest that
+ *  @path is meant to have been compiled from
+ *
+ * Check whether @path is a compiled manifest that pv_mtree_apply()
+ * can use. This only checks the header, so pv_mtree_apply() can
+ * still fail if the rest of the file is corrupt.
+ *
+ * If @source is not %NULL, also check that @path was compiled from
+ * the current contents of @source, so that if the text manifest is
+ * updated without also updating @path, the text manifest will be used.
+ *
+ * Returns: %TRUE if @path appears to be usable. On failure,
+ *  the error is %G_IO_ERROR_NOT_SUPPORTED if it was created for a
+ *  different byte order or by an incompatible version.
+ */
+gboolean
+pv_mtree_check_compiled (const char *path,
+                         const char *source,
+                         GError **error)
+{
+  glnx_autofd int fd = -1;
+  MtreeCompiledHeader header = {};
+  struct stat stat_buf;
+  gssize n;
+  gsize len;
+
+  g_return_val_if_fail (path != NULL, FALSE);
+  g_return_val_if_fail (error == NULL || *error == NULL, FALSE);
+
+  if (!glnx_openat_rdonly (AT_FDCWD, path, TRUE, &fd, error))
+    return FALSE;
+
+  if (!glnx_fstat (fd, &stat_buf, error))
+    return FALSE;
+
+  n = TEMP_FAILURE_RETRY (pread (fd, &header, sizeof (header), 0));
+
+  if (n < 0)
+    return glnx_throw_errno_prefix (error, "Unable to read \"%s\"", path);
+
+  /* If the header was truncated, pass its real length so that it will
+   * be rejected */
+  if ((gsize) n < sizeof (header))
+    len = n;
+  else
+    len = stat_buf.st_size;
+
+  if (!mtree_compiled_check_header (&header, len, error))
+    return glnx_prefix_error (error, "%s", path);
+
+  if (source != NULL)
+    {
+      guint8 digest[MTREE_COMPILED_DIGEST_SIZE];
+
+      if (!mtree_compute_source_digest (source, digest, error))
+        return FALSE;
+
+      if (memcmp (digest, header.source_sha256, sizeof (digest)) != 0)
+        return glnx_throw (error,
+                           "\"%s\" was not compiled from the current "
+                           "version of \"%s\"",
+                           path, source);
+    }
+
+  return TRUE;
+}
+
+/*
+ * Append @str to the string table @strings and return its offset,
+ * or %MTREE_COMPILED_NONE if @str is %NULL.
+ */
+static guint32
+mtree_compile_string (GString *strings,
+                      const char *str)
+{
+  gsize offset = strings->len;
+
+  if (str == NULL)
+    return MTREE_COMPILED_NONE;
+
+  g_string_append_len (strings, str, strlen (str) + 1);
+  g_return_val_if_fail (offset < MTREE_COMPILED_NONE, MTREE_COMPILED_NONE);
+  return offset;
+}
+
+/*
+ * pv_mtree_compile:
+ * @mtree: (type filename): Path to a mtree(5) manifest
+ * @output: (type filename): Path to the compiled manifest to write
+ * @flags: %PV_MTREE_APPLY_FLAGS_GZIP if @mtree is compressed
+ *
+ * Convert @mtree into a compiled manifest that pv_mtree_apply() can
+ * use without parsing text, replacing @output atomically. The same
+ * subset of mtree(5) syntax is accepted as for pv_mtree_apply().
+ * The digest of @mtree is recorded in @output, so that
+ * pv_mtree_check_compiled() can detect when it is out of date.
+ *
+ * Returns: %TRUE on success
+ */
+gboolean
+pv_mtree_compile (const char *mtree,
+                  const char *output,
+                  PvMtreeApplyFlags flags,
+                  GError **error)
+{
+  g_autoptr(GArray) entries = NULL;
+  g_autoptr(GArray) items = NULL;
+  g_autoptr(GHashTable) dirs = NULL;
+  g_autoptr(GString) strings = NULL;
+  g_autoptr(GByteArray) blob = NULL;
+  MtreeCompiledHeader header = {};
+  guint i;
+
+  g_return_val_if_fail (mtree != NULL, FALSE);
+  g_return_val_if_fail (output != NULL, FALSE);
+  g_return_val_if_fail (error == NULL || *error == NULL, FALSE);
+
+  entries = g_array_new (FALSE, FALSE, sizeof (PvMtreeEntry));
+  g_array_set_clear_func (entries, (GDestroyNotify) pv_mtree_entry_clear);
+
+  if (!mtree_compute_source_digest (mtree, header.source_sha256, error))
+    return FALSE;
+
+  if (!mtree_read_entries (mtree, flags, entries, error))
+    return FALSE;
+
+  if (entries->len >= MTREE_COMPILED_NONE)
+    return glnx_throw (error, "Too many entries in %s", mtree);
+
+  items = g_array_sized_new (FALSE, TRUE, sizeof (MtreeCompiledEntry),
+                             entries->len);
+  /* Map from directory name to its index in @entries */
+  dirs = g_hash_table_new (g_str_hash, g_str_equal);
+  strings = g_string_new ("");
+
+  for (i = 0; i < entries->len; i++)
+    {
+      const PvMtreeEntry *entry = &g_array_index (entries, PvMtreeEntry, i);
+      g_autofree gchar *parent = g_path_get_dirname (entry->name);
+      MtreeCompiledEntry item = {};
+      gpointer parent_index;
+
+      item.name = mtree_compile_string (strings, entry->name);
+      item.contents = mtree_compile_string (strings, entry->contents);
+      item.link = mtree_compile_string (strings, entry->link);
+
+      if (g_hash_table_lookup_extended (dirs, parent, NULL, &parent_index))
+        item.parent = GPOINTER_TO_UINT (parent_index);
+      else
+        item.parent = MTREE_COMPILED_NONE;
+
+      item.size = entry->size;
+      item.mtime_usec = entry->mtime_usec;
+      item.mode = entry->mode;
+      item.kind = entry->kind;
+      item.entry_flags = entry->entry_flags;
+
+      if (entry->kind == PV_MTREE_ENTRY_KIND_DIR)
+        g_hash_table_replace (dirs, entry->name, GUINT_TO_POINTER (i));
+
+      g_array_append_val (items, item);
+    }
+
+  if (strings->len >= MTREE_COMPILED_NONE)
+    return glnx_throw (error, "Too much text in %s", mtree);
+
+  /* Make sure the string table is never empty, so that we can
+   * check that it is terminated */
+  if (strings->len == 0)
+    g_string_append_c (strings, '\0');
+
+  memcpy (header.magic, MTREE_COMPILED_MAGIC, sizeof (header.magic));
+  header.byte_order = MTREE_COMPILED_BYTE_ORDER;
+  header.version = MTREE_COMPILED_VERSION;
+  header.n_entries = items->len;
+  header.entry_size = sizeof (MtreeCompiledEntry);
+  header.entries_offset = sizeof (header);
+  header.strings_offset = (header.entries_offset
+                           + (guint64) items->len * sizeof (MtreeCompiledEntry));
+  header.strings_size = strings->len;
+
+  blob = g_byte_array_sized_new (header.strings_offset + strings->len);
+  g_byte_array_append (blob, (const guint8 *) &header, sizeof (header));
+  g_byte_array_append (blob, (const guint8 *) items->data,
+                       items->len * sizeof (MtreeCompiledEntry));
+  g_byte_array_append (blob, (const guint8 *) strings->str, strings->len);
+
+  if (!glnx_file_replace_contents_at (AT_FDCWD, output,
+                                      blob->data, blob->len,
+                                      0, NULL, error))
+    return glnx_prefix_error (error, "Unable to write \"%s\"", output);
+
+  return TRUE;
+}
+
 /*
  * pv_mtree_apply:
  * @mtree: (type filename): Path to a mtree(5) manifest
@@ -425,6 +1235,14 @@ pv_mtree_entry_parse (const char *line,
  * modification time of a source file in @source_files might be modified
  * to conform to the @mtree.
  *
+ * @mtree can also be a compiled manifest produced by pv_mtree_compile(),
+ * which is detected automatically. In that case @flags are ignored.
+ *
+ * The whole manifest is parsed before anything is changed. Directories
+ * and symbolic links are then created in manifest order, after which
+ * regular files are populated by a pool of worker threads, one job per
+ * parent directory.
+ *
  * Returns: %TRUE on success
  */
 gboolean
@@ -435,12 +1253,16 @@ pv_mtree_apply (const char *mtree,
                 PvMtreeApplyFlags flags,
                 GError **error)
 {
-  glnx_autofd int mtree_fd = -1;
-  g_autoptr(GInputStream) istream = NULL;
-  g_autoptr(GDataInputStream) reader = NULL;
   g_autoptr(SrtProfilingTimer) timer = NULL;
+  g_autoptr(GMappedFile) compiled = NULL;
+  g_autoptr(GArray) entries = NULL;
+  g_autoptr(GArray) parent_indices = NULL;
+  g_autoptr(PvDirfdCache) parents = NULL;
+  g_autoptr(GHashTable) jobs_by_parent = NULL;
+  g_autoptr(GPtrArray) jobs = NULL;
   glnx_autofd int source_files_fd = -1;
-  guint line_number = 0;
+  MtreeApplyContext context = {};
+  guint i;
 
   g_return_val_if_fail (error == NULL || *error == NULL, FALSE);
   g_return_val_if_fail (mtree != NULL, FALSE);
@@ -449,24 +1271,27 @@ pv_mtree_apply (const char *mtree,
 
   timer = _srt_profiling_start ("Apply %s to %s", mtree, sysroot);
 
-  if (!glnx_openat_rdonly (AT_FDCWD, mtree, TRUE, &mtree_fd, error))
-    return FALSE;
+  entries = g_array_new (FALSE, FALSE, sizeof (PvMtreeEntry));
 
-  istream = g_unix_input_stream_new (glnx_steal_fd (&mtree_fd), TRUE);
+  if (!mtree_map_if_compiled (mtree, &compiled, error))
+    return FALSE;
 
-  if (flags & PV_MTREE_APPLY_FLAGS_GZIP)
+  if (compiled != NULL)
     {
-      g_autoptr(GInputStream) filter = NULL;
-      g_autoptr(GZlibDecompressor) decompressor = NULL;
+      /* The entries borrow their strings from @compiled */
+      parent_indices = g_array_new (FALSE, FALSE, sizeof (guint32));
 
-      decompressor = g_zlib_decompressor_new (G_ZLIB_COMPRESSOR_FORMAT_GZIP);
-      filter = g_converter_input_stream_new (istream, G_CONVERTER (decompressor));
-      g_clear_object (&istream);
-      istream = g_object_ref (filter);
+      if (!mtree_read_compiled (mtree, compiled, entries, parent_indices,
+                                error))
+        return FALSE;
     }
+  else
+    {
+      g_array_set_clear_func (entries, (GDestroyNotify) pv_mtree_entry_clear);
 
-  reader = g_data_input_stream_new (istream);
-  g_data_input_stream_set_newline_type (reader, G_DATA_STREAM_NEWLINE_TYPE_LF);
+      if (!mtree_read_entries (mtree, flags, entries, error))
+        return FALSE;
+    }
 
   if (source_files != NULL)
     {
@@ -475,209 +1300,182 @@ pv_mtree_apply (const char *mtree,
         return FALSE;
     }
 
+  context.sysroot = sysroot;
+  context.sysroot_fd = sysroot_fd;
+  context.source_files = source_files;
+  context.source_files_fd = source_files_fd;
+
   g_info ("Applying \"%s\" to \"%s\"...", mtree, sysroot);
 
-  while (TRUE)
+  parents = pv_dirfd_cache_new (sysroot_fd, sysroot);
+  jobs_by_parent = g_hash_table_new (g_str_hash, g_str_equal);
+  jobs = g_ptr_array_new_with_free_func (mtree_apply_job_free);
+
+  /* Directories and symlinks affect how later paths are resolved, so
+   * create them in manifest order before populating any files. */
+  for (i = 0; i < entries->len; i++)
     {
-      g_autofree gchar *line = NULL;
-      g_autofree gchar *parent = NULL;
+      const PvMtreeEntry *entry = &g_array_index (entries, PvMtreeEntry, i);
+      g_autofree gchar *parent_buf = NULL;
+      const char *parent;
       const char *base;
-      g_autoptr(GError) local_error = NULL;
-      g_auto(PvMtreeEntry) entry = PV_MTREE_ENTRY_BLANK;
-      glnx_autofd int parent_fd = -1;
+      int parent_fd;
       glnx_autofd int fd = -1;
-      int adjusted_mode;
+      guint32 parent_index = MTREE_COMPILED_NONE;
 
-      line = g_data_input_stream_read_line (reader, NULL, NULL, &local_error);
+      trace ("mtree entry: %s", entry->name);
 
-      if (line == NULL)
+      if (parent_indices != NULL)
+        parent_index = g_array_index (parent_indices, guint32, i);
+
+      /* A compiled manifest tells us which entry is the parent, if any */
+      if (parent_index != MTREE_COMPILED_NONE)
         {
-          if (local_error != NULL)
-            {
-              g_propagate_prefixed_error (error, g_steal_pointer (&local_error),
-                                          "While reading a line from %s: ",
-                                          mtree);
-              return FALSE;
-            }
-          else
-            {
-              /* End of file, not an error */
-              break;
-            }
+          parent = g_array_index (entries, PvMtreeEntry, parent_index).name;
+        }
+      else
+        {
+          parent_buf = g_path_get_dirname (entry->name);
+          parent = parent_buf;
         }
 
-      g_strstrip (line);
-      line_number++;
-
-      trace ("line %u: %s", line_number, line);
-
-      if (!pv_mtree_entry_parse (line, &entry, mtree, line_number, error))
-        return FALSE;
-
-      if (entry.name == NULL || strcmp (entry.name, ".") == 0)
-        continue;
-
-      trace ("mtree entry: %s", entry.name);
+      base = glnx_basename (entry->name);
 
-      parent = g_path_get_dirname (entry.name);
-      base = glnx_basename (entry.name);
+      /* Entries are usually sorted, so this is normally either the same
+       * directory as last time or a subdirectory of it */
       trace ("Creating %s in %s", parent, sysroot);
-      parent_fd = _srt_resolve_in_sysroot (sysroot_fd, parent,
-                                           SRT_RESOLVE_FLAGS_MKDIR_P,
-                                           NULL, error);
+      parent_fd = pv_dirfd_cache_resolve (parents, parent,
+                                          SRT_RESOLVE_FLAGS_MKDIR_P, error);
 
       if (parent_fd < 0)
         return glnx_prefix_error (error,
                                   "Unable to create parent directory for \"%s\" in \"%s\"",
-                                  entry.name, sysroot);
+                                  entry->name, sysroot);
 
-      switch (entry.kind)
+      if (entry->kind == PV_MTREE_ENTRY_KIND_FILE)
         {
-          case PV_MTREE_ENTRY_KIND_FILE:
-            if (entry.size == 0)
-              {
-                /* For empty files, we can create it from nothing. */
-                fd = TEMP_FAILURE_RETRY (openat (parent_fd, base,
-                                                 (O_RDWR | O_CLOEXEC | O_NOCTTY
-                                                  | O_NOFOLLOW | O_CREAT
-                                                  | O_TRUNC),
-                                                 0644));
-
-                if (fd < 0)
-                  return glnx_throw_errno_prefix (error,
-                                                  "Unable to open \"%s\" in \"%s\"",
-                                                  entry.name, sysroot);
-              }
-            else if (source_files_fd >= 0)
-              {
-                const char *source = entry.contents;
-
-                if (source == NULL)
-                  source = entry.name;
-
-                /* If it already exists, assume it's correct */
-                if (glnx_openat_rdonly (parent_fd, base, FALSE, &fd, NULL))
-                  {
-                    trace ("\"%s\" already exists in \"%s\"",
-                           entry.name, sysroot);
-                  }
-                /* If we can create a hard link, that's also fine */
-                else if (TEMP_FAILURE_RETRY (linkat (source_files_fd, source,
-                                                     parent_fd, base, 0)) == 0)
-                  {
-                    trace ("Created hard link \"%s\" in \"%s\"",
-                           entry.name, sysroot);
-                  }
-                /* Or if we can copy it, that's fine too */
-                else
-                  {
-                    g_debug ("Could not create hard link \"%s\" from \"%s/%s\" into \"%s\": %s",
-                             entry.name, source_files, source, sysroot,
-                             g_strerror (errno));
-
-                    if (!glnx_file_copy_at (source_files_fd, source, NULL,
-                                            parent_fd, base,
-                                            GLNX_FILE_COPY_OVERWRITE | GLNX_FILE_COPY_NOCHOWN,
-                                            NULL, error))
-                      return glnx_prefix_error (error,
-                                                "Could not create copy \"%s\" from \"%s/%s\" into \"%s\"",
-                                                entry.name, source_files,
-                                                source, sysroot);
-
-                  }
-              }
-
-            /* For other regular files we just assert that it already exists
-             * (and is not a symlink). */
-            if (fd < 0
-                && !(entry.entry_flags & PV_MTREE_ENTRY_FLAGS_OPTIONAL)
-                && !glnx_openat_rdonly (parent_fd, base, FALSE, &fd, error))
-              return glnx_prefix_error (error,
-                                        "Unable to open \"%s\" in \"%s\"",
-                                        entry.name, sysroot);
-
-            break;
+          MtreeApplyJob *job;
 
-          case PV_MTREE_ENTRY_KIND_DIR:
-            /* Create directories on-demand */
-            if (!glnx_ensure_dir (parent_fd, base, 0755, error))
-              return glnx_prefix_error (error,
-                                        "Unable to create directory \"%s\" in \"%s\"",
-                                        entry.name, sysroot);
-
-            /* Assert that it is in fact a directory */
-            if (!glnx_opendirat (parent_fd, base, FALSE, &fd, error))
-              return glnx_prefix_error (error,
-                                        "Unable to open directory \"%s\" in \"%s\"",
-                                        entry.name, sysroot);
-
-            break;
+          job = g_hash_table_lookup (jobs_by_parent, parent);
 
-          case PV_MTREE_ENTRY_KIND_LINK:
-              {
-                g_autofree char *target = NULL;
-                /* Create symlinks on-demand. To be idempotent, don't delete
-                 * an existing symlink. */
-                target = glnx_readlinkat_malloc (parent_fd, base,
-                                                 NULL, NULL);
-
-                if (target == NULL && symlinkat (entry.link, parent_fd, base) != 0)
-                  return glnx_throw_errno_prefix (error,
-                                                  "Unable to create symlink \"%s\" in \"%s\"",
-                                                  entry.name, sysroot);
-              }
-            break;
+          if (job == NULL)
+            {
+              job = mtree_apply_job_new (parent);
+              g_ptr_array_add (jobs, job);
+              g_hash_table_insert (jobs_by_parent, job->parent, job);
+            }
 
-          case PV_MTREE_ENTRY_KIND_BLOCK:
-          case PV_MTREE_ENTRY_KIND_CHAR:
-          case PV_MTREE_ENTRY_KIND_FIFO:
-          case PV_MTREE_ENTRY_KIND_SOCKET:
-          case PV_MTREE_ENTRY_KIND_UNKNOWN:
-          default:
-            return glnx_throw (error,
-                               "%s:%u: Special file not supported",
-                               mtree, line_number);
+          g_ptr_array_add (job->entries, (gpointer) entry);
+          continue;
         }
 
-      if (entry.kind == PV_MTREE_ENTRY_KIND_DIR
-          || (entry.mode >= 0 && entry.mode & 0111))
-        adjusted_mode = 0755;
+      if (entry->kind == PV_MTREE_ENTRY_KIND_DIR)
+        {
+          /* Create directories on-demand */
+          if (!glnx_ensure_dir (parent_fd, base, 0755, error))
+            return glnx_prefix_error (error,
+                                      "Unable to create directory \"%s\" in \"%s\"",
+                                      entry->name, sysroot);
+
+          /* Assert that it is in fact a directory */
+          if (!glnx_opendirat (parent_fd, base, FALSE, &fd, error))
+            return glnx_prefix_error (error,
+                                      "Unable to open directory \"%s\" in \"%s\"",
+                                      entry->name, sysroot);
+
+          if (!mtree_apply_metadata (&context, entry, fd, error))
+            return FALSE;
+        }
       else
-        adjusted_mode = 0644;
-
-      if (fd >= 0
-          && !(entry.entry_flags & PV_MTREE_ENTRY_FLAGS_NO_CHANGE)
-          && !glnx_fchmod (fd, adjusted_mode, error))
         {
-          g_prefix_error (error,
-                          "Unable to set mode of \"%s\" in \"%s\": ",
-                          entry.name, sysroot);
-          return FALSE;
+          g_autofree char *target = NULL;
+
+          g_assert (entry->kind == PV_MTREE_ENTRY_KIND_LINK);
+
+          /* Create symlinks on-demand. To be idempotent, don't delete
+           * an existing symlink. */
+          target = glnx_readlinkat_malloc (parent_fd, base,
+                                           NULL, NULL);
+
+          if (target == NULL && symlinkat (entry->link, parent_fd, base) != 0)
+            return glnx_throw_errno_prefix (error,
+                                            "Unable to create symlink \"%s\" in \"%s\"",
+                                            entry->name, sysroot);
         }
+    }
+
+  _srt_run_jobs_in_parallel (jobs, mtree_apply_job_run, &context);
+
+  /* Report the first failure in manifest order, for consistency */
+  for (i = 0; i < jobs->len; i++)
+    {
+      MtreeApplyJob *job = g_ptr_array_index (jobs, i);
 
-      if (entry.mtime_usec >= 0
-          && fd >= 0
-          && !(entry.entry_flags & PV_MTREE_ENTRY_FLAGS_NO_CHANGE)
-          && entry.kind == PV_MTREE_ENTRY_KIND_FILE)
+      if (job->error != NULL)
         {
-          struct timespec times[2] =
-          {
-            { .tv_sec = 0, .tv_nsec = UTIME_OMIT },   /* atime */
-            {
-              .tv_sec = entry.mtime_usec / G_TIME_SPAN_SECOND,
-              .tv_nsec = (entry.mtime_usec % G_TIME_SPAN_SECOND) * 1000
-            }   /* mtime */
-          };
-
-          if (futimens (fd, times) != 0)
-            g_warning ("Unable to set mtime of \"%s\" in \"%s\": %s",
-                       entry.name, sysroot, g_strerror (errno));
+          g_propagate_error (error, g_steal_pointer (&job->error));
+          return FALSE;
         }
     }
 
   return TRUE;
 }
 
+/*
+ * pv_mtree_load_digests:
+ * @mtree: (type filename): Path to a text mtree(5) manifest
+ * @prefix: Prefix to prepend to each path, for example `files/`
+ * @flags: Flags affecting how @mtree is read
+ * @error: Used to raise an error on failure
+ *
+ * Load the SHA-256 digests of regular files from @mtree.
+ * Compiled manifests do not contain digests, so they are not
+ * supported here.
+ *
+ * Returns: (transfer full) (element-type filename utf8): A map from
+ *  @prefix + path, without leading `./`, to the hex SHA-256 digest
+ *  of the file, or %NULL on error
+ */
+GHashTable *
+pv_mtree_load_digests (const char *mtree,
+                       const char *prefix,
+                       PvMtreeApplyFlags flags,
+                       GError **error)
+{
+  g_autoptr(GArray) entries = NULL;
+  g_autoptr(GHashTable) ret = NULL;
+  guint i;
+
+  g_return_val_if_fail (mtree != NULL, NULL);
+  g_return_val_if_fail (prefix != NULL, NULL);
+  g_return_val_if_fail (error == NULL || *error == NULL, NULL);
+
+  entries = g_array_new (FALSE, FALSE, sizeof (PvMtreeEntry));
+  g_array_set_clear_func (entries, (GDestroyNotify) pv_mtree_entry_clear);
+
+  if (!mtree_read_entries (mtree, flags, entries, error))
+    return NULL;
+
+  ret = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, g_free);
+
+  for (i = 0; i < entries->len; i++)
+    {
+      PvMtreeEntry *entry = &g_array_index (entries, PvMtreeEntry, i);
+      const char *name = entry->name;
+
+      if (entry->kind != PV_MTREE_ENTRY_KIND_FILE || entry->sha256 == NULL)
+        continue;
+
+      while (g_str_has_prefix (name, "./"))
+        name += 2;
+
+      g_hash_table_replace (ret, g_strconcat (prefix, name, NULL),
+                            g_steal_pointer (&entry->sha256));
+    }
+
+  return g_steal_pointer (&ret);
+}
+
 /*
  * Free the contents of @entry, but not @entry itself.
  */
@@ -101,3 +101,15 @@ gboolean pv_mtree_apply (const char *mtree,
                          const char *source_files,
                          PvMtreeApplyFlags flags,
                          GError **error);
+
+gboolean pv_mtree_compile (const char *mtree,
+                           const char *output,
+                           PvMtreeApplyFlags flags,
+                           GError **error);
+gboolean pv_mtree_check_compiled (const char *path,
+                                  const char *source,
+                                  GError **error);
+GHashTable *pv_mtree_load_digests (const char *mtree,
+                                   const char *prefix,
+                                   PvMtreeApplyFlags flags,
+                                   GError **error);
@@ -1355,6 +1355,51 @@ class Main:
                 for name in sorted(not_windows_friendly):
                     writer.write('# {}\n'.format(self.octal_escape(name)))
 
+        self.compile_lookaside(dest)
+
+    def compile_lookaside(self, dest: str) -> None:
+        '''
+        Write usr-mtree.bin, a binary version of usr-mtree.txt.gz that
+        pressure-vessel can use without parsing text.
+
+        This is optional: if pressure-vessel-mtree-compile cannot be
+        run on this machine, pressure-vessel will use the text manifest.
+        '''
+        compiler = os.path.join(
+            self.depot, 'pressure-vessel', 'bin',
+            'pressure-vessel-mtree-compile',
+        )
+
+        if not os.access(compiler, os.X_OK):
+            compiler = shutil.which('pressure-vessel-mtree-compile') or ''
+
+        output = os.path.join(dest, 'usr-mtree.bin')
+
+        with suppress(FileNotFoundError):
+            os.remove(output)
+
+        if not compiler:
+            logger.info(
+                'pressure-vessel-mtree-compile not found, not writing %s',
+                output,
+            )
+            return
+
+        argv = [
+            compiler,
+            os.path.join(dest, 'usr-mtree.txt.gz'),
+            output,
+        ]
+        logger.info('%r', argv)
+
+        try:
+            subprocess.run(argv, check=True)
+        except (OSError, subprocess.CalledProcessError) as e:
+            logger.warning('Unable to write %s: %s', output, e)
+
+            with suppress(FileNotFoundError):
+                os.remove(output)
+
     def minimize_runtime(self, root: str) -> None:
         '''
         Remove files that pressure-vessel can reconstitute from the manifest.
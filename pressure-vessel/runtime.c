@@ -19,7 +19,11 @@
 
 #include "runtime.h"
 
+#include <sched.h>
 #include <sysexits.h>
+#include <sys/syscall.h>
+#include <sys/sysmacros.h>
+#include <sys/utsname.h>
 
 #include <gio/gio.h>
 
@@ -45,6 +49,7 @@
 #include "mtree.h"
 #include "supported-architectures.h"
 #include "tree-copy.h"
+#include "untar.h"
 #include "utils.h"
 
 typedef struct
@@ -69,15 +74,19 @@ struct _PvRuntime
   gchar *id;
   gchar *deployment;
   gchar *source_files;          /* either deployment or that + "/files" */
+  gchar *debug_tarball;         /* still to be unpacked into deployment */
   const gchar *pv_prefix;
   const gchar *helpers_path;
   PvBwrapLock *runtime_lock;
+  PvBwrapLock *overlay_lower_lock;  /* if mutable_sysroot/usr is an overlay */
   GStrv original_environ;
 
   gchar *libcapsule_knowledge;
   gchar *runtime_abi_json;
   gchar *variable_dir;
+  gchar *copy_cache_key;
   gchar *mutable_sysroot;
+  gchar *overlay_lower;         /* if mutable_sysroot/usr is an overlay */
   gchar *tmpdir;
   gchar *overrides;
   const gchar *overrides_in_container;
@@ -444,21 +453,160 @@ pv_runtime_constructed (GObject *object)
   g_return_if_fail (self->source != NULL);
 }
 
+/* Garbage-collected directories are renamed to this prefix, and
+ * deleted later by a background process */
+#define TRASH_PREFIX "trash-"
+
+/* The maximum number of directories that one launch will garbage-collect.
+ * Any more are left for the next launch. */
+#define MAX_GC_PER_LAUNCH 8
+
+/* Not in glibc headers, see ioprio_set(2) */
+#define PV_IOPRIO_CLASS_SHIFT 13
+#define PV_IOPRIO_CLASS_IDLE 3
+#define PV_IOPRIO_WHO_PROCESS 1
+
+/*
+ * Called in the child process between fork() and exec(), so it
+ * can only use async-signal-safe functions.
+ */
 static void
+pv_runtime_detached_child_setup (gpointer user_data)
+{
+  gboolean idle = GPOINTER_TO_INT (user_data);
+
+  /* We use LEAVE_DESCRIPTORS_OPEN to work around a deadlock in older GLib,
+   * see flatpak_close_fds_workaround. We must not leak our lock fds into
+   * the child, because it might outlive us. */
+  flatpak_close_fds_workaround (3);
+
+  if (idle)
+    {
+      struct sched_param param = { 0 };
+
+      /* Best-effort, so ignore errors */
+      sched_setscheduler (0, SCHED_IDLE, &param);
+      syscall (SYS_ioprio_set, PV_IOPRIO_WHO_PROCESS, 0,
+               PV_IOPRIO_CLASS_IDLE << PV_IOPRIO_CLASS_SHIFT);
+    }
+}
+
+/*
+ * Start @argv as a process that will outlive us. If @idle is true,
+ * it runs with idle CPU and I/O priority.
+ */
+static gboolean
+pv_runtime_spawn_detached (FlatpakBwrap *argv,
+                           gboolean idle,
+                           GError **error)
+{
+  g_return_val_if_fail (argv->argv->len > 0, FALSE);
+  g_return_val_if_fail (g_ptr_array_index (argv->argv,
+                                           argv->argv->len - 1) == NULL,
+                        FALSE);
+
+  /* Without G_SPAWN_DO_NOT_REAP_CHILD, GLib double-forks, so the
+   * background process will not become a zombie child of bwrap when
+   * we exec it */
+  return g_spawn_async (NULL,
+                        (char **) argv->argv->pdata,
+                        argv->envp,
+                        (G_SPAWN_SEARCH_PATH
+                         | G_SPAWN_LEAVE_DESCRIPTORS_OPEN
+                         | G_SPAWN_STDOUT_TO_DEV_NULL
+                         | G_SPAWN_STDERR_TO_DEV_NULL),
+                        pv_runtime_detached_child_setup,
+                        GINT_TO_POINTER (idle),
+                        NULL,
+                        error);
+}
+
+/*
+ * Delete the directories in @trash, which have already been renamed
+ * out of the way, in a low-priority background process.
+ */
+static void
+pv_runtime_empty_trash (GPtrArray *trash)
+{
+  g_autoptr(FlatpakBwrap) rm = NULL;
+  g_autoptr(GError) local_error = NULL;
+  guint i;
+
+  if (trash->len == 0)
+    return;
+
+  rm = flatpak_bwrap_new (NULL);
+  flatpak_bwrap_add_args (rm, "rm", "-fr", "--", NULL);
+
+  for (i = 0; i < trash->len; i++)
+    flatpak_bwrap_add_arg (rm, g_ptr_array_index (trash, i));
+
+  flatpak_bwrap_finish (rm);
+
+  g_debug ("Deleting %u garbage-collected directories in the background",
+           trash->len);
+
+  if (pv_runtime_spawn_detached (rm, TRUE, &local_error))
+    return;
+
+  g_debug ("Unable to delete in the background, deleting now: %s",
+           local_error->message);
+
+  for (i = 0; i < trash->len; i++)
+    {
+      const char *path = g_ptr_array_index (trash, i);
+
+      g_clear_error (&local_error);
+
+      if (!glnx_shutil_rm_rf_at (AT_FDCWD, path, NULL, &local_error))
+        g_debug ("Unable to delete %s: %s", path, local_error->message);
+    }
+}
+
+/*
+ * If @member in @parent_fd is a trash directory left behind by an
+ * interrupted background deletion, add it to @trash to be deleted again.
+ *
+ * Returns: %TRUE if it was a trash directory
+ */
+static gboolean
+pv_runtime_collect_old_trash (const char *parent,
+                              const char *member,
+                              GPtrArray *trash)
+{
+  if (!g_str_has_prefix (member, TRASH_PREFIX))
+    return FALSE;
+
+  g_debug ("Found leftover %s/%s, deleting it", parent, member);
+  g_ptr_array_add (trash, g_build_filename (parent, member, NULL));
+  return TRUE;
+}
+
+/*
+ * If @member in @parent_fd is no longer needed, rename it into a trash
+ * directory and add that to @trash, so that it can be deleted later
+ * without delaying the launch.
+ *
+ * Returns: %TRUE if @member was removed
+ */
+static gboolean
 pv_runtime_maybe_garbage_collect_subdir (const char *description,
                                          const char *parent,
                                          int parent_fd,
-                                         const char *member)
+                                         const char *member,
+                                         GPtrArray *trash)
 {
   g_autoptr(GError) local_error = NULL;
   g_autoptr(PvBwrapLock) temp_lock = NULL;
   g_autofree gchar *keep = NULL;
   g_autofree gchar *ref = NULL;
   struct stat ignore;
+  gsize attempt;
 
-  g_return_if_fail (parent != NULL);
-  g_return_if_fail (parent_fd >= 0);
-  g_return_if_fail (member != NULL);
+  g_return_val_if_fail (parent != NULL, FALSE);
+  g_return_val_if_fail (parent_fd >= 0, FALSE);
+  g_return_val_if_fail (member != NULL, FALSE);
+  g_return_val_if_fail (trash != NULL, FALSE);
 
   g_debug ("Found %s %s/%s, considering whether to delete it...",
            description, parent, member);
@@ -470,7 +618,7 @@ pv_runtime_maybe_garbage_collect_subdir (const char *description,
     {
       g_debug ("Not deleting \"%s/%s\": ./keep exists",
                parent, member);
-      return;
+      return FALSE;
     }
   else if (!g_error_matches (local_error, G_IO_ERROR,
                              G_IO_ERROR_NOT_FOUND))
@@ -478,7 +626,7 @@ pv_runtime_maybe_garbage_collect_subdir (const char *description,
       /* EACCES or something? Give it the benefit of the doubt */
       g_warning ("Not deleting \"%s/%s\": unable to stat ./keep: %s",
                parent, member, local_error->message);
-      return;
+      return FALSE;
     }
 
   g_clear_error (&local_error);
@@ -493,18 +641,42 @@ pv_runtime_maybe_garbage_collect_subdir (const char *description,
     {
       g_info ("Not deleting \"%s/%s\": unable to get lock: %s",
               parent, member, local_error->message);
-      return;
+      return FALSE;
     }
 
   g_debug ("Deleting \"%s/%s\"...", parent, member);
 
   /* We have the lock, which would not have happened if someone was
-   * still using the runtime, so we can safely delete it. */
+   * still using the runtime, so we can safely delete it. Renaming it
+   * is atomic and fast, so do that now, and leave the slow part for
+   * later. */
+  for (attempt = 0; attempt < 100; attempt++)
+    {
+      g_autofree gchar *name = g_strdup (TRASH_PREFIX "XXXXXX");
+
+      glnx_gen_temp_name (name);
+
+      if (glnx_renameat2_noreplace (parent_fd, member, parent_fd, name) == 0)
+        {
+          g_ptr_array_add (trash, g_build_filename (parent, name, NULL));
+          return TRUE;
+        }
+
+      if (errno != EEXIST)
+        break;
+    }
+
+  g_debug ("Unable to rename %s/%s, deleting it now: %s",
+           parent, member, g_strerror (errno));
+
   if (!glnx_shutil_rm_rf_at (parent_fd, member, NULL, &local_error))
     {
       g_debug ("Unable to delete %s/%s: %s",
                parent, member, local_error->message);
+      return FALSE;
     }
+
+  return TRUE;
 }
 
 static gboolean
@@ -544,6 +716,7 @@ pv_runtime_garbage_collect_legacy (const char *variable_dir,
   G_GNUC_UNUSED g_autoptr(SrtProfilingTimer) timer = NULL;
   g_auto(GLnxDirFdIterator) variable_dir_iter = { FALSE };
   g_auto(GLnxDirFdIterator) runtime_base_iter = { FALSE };
+  g_autoptr(GPtrArray) trash = NULL;
   glnx_autofd int variable_dir_fd = -1;
   glnx_autofd int runtime_base_fd = -1;
   struct
@@ -554,6 +727,7 @@ pv_runtime_garbage_collect_legacy (const char *variable_dir,
     { variable_dir, &variable_dir_iter },
     { runtime_base, &runtime_base_iter },
   };
+  guint collected = 0;
   gsize i;
 
   g_return_val_if_fail (variable_dir != NULL, FALSE);
@@ -598,6 +772,8 @@ pv_runtime_garbage_collect_legacy (const char *variable_dir,
   if (base_lock == NULL)
     return TRUE;
 
+  trash = g_ptr_array_new_with_free_func (g_free);
+
   for (i = 0; i < G_N_ELEMENTS (iters); i++)
     {
       const char * const symlinks[] = { "scout", "soldier" };
@@ -616,7 +792,10 @@ pv_runtime_garbage_collect_legacy (const char *variable_dir,
 
           if (!glnx_dirfd_iterator_next_dent_ensure_dtype (iters[i].iter,
                                                            &dent, NULL, error))
-            return FALSE;
+            {
+              pv_runtime_empty_trash (trash);
+              return FALSE;
+            }
 
           if (dent == NULL)
             break;
@@ -639,13 +818,26 @@ pv_runtime_garbage_collect_legacy (const char *variable_dir,
                 continue;
             }
 
+          if (pv_runtime_collect_old_trash (iters[i].path, dent->d_name,
+                                            trash))
+            continue;
+
           if (!is_old_runtime_deployment (dent->d_name))
             continue;
 
-          pv_runtime_maybe_garbage_collect_subdir ("legacy runtime",
-                                                   iters[i].path,
-                                                   iters[i].iter->fd,
-                                                   dent->d_name);
+          if (collected >= MAX_GC_PER_LAUNCH)
+            {
+              g_debug ("Leaving %s/%s for a later launch",
+                       iters[i].path, dent->d_name);
+              continue;
+            }
+
+          if (pv_runtime_maybe_garbage_collect_subdir ("legacy runtime",
+                                                       iters[i].path,
+                                                       iters[i].iter->fd,
+                                                       dent->d_name,
+                                                       trash))
+            collected++;
         }
 
       g_debug ("Cleaning up old symlinks in %s...",
@@ -656,6 +848,7 @@ pv_runtime_garbage_collect_legacy (const char *variable_dir,
                                     symlinks[j]);
     }
 
+  pv_runtime_empty_trash (trash);
   return TRUE;
 }
 
@@ -665,7 +858,9 @@ pv_runtime_garbage_collect (PvRuntime *self,
                             GError **error)
 {
   g_auto(GLnxDirFdIterator) iter = { FALSE };
+  g_autoptr(GPtrArray) trash = NULL;
   G_GNUC_UNUSED g_autoptr(SrtProfilingTimer) timer = NULL;
+  guint collected = 0;
 
   g_return_val_if_fail (PV_IS_RUNTIME (self), FALSE);
   g_return_val_if_fail (self->variable_dir != NULL, FALSE);
@@ -681,13 +876,18 @@ pv_runtime_garbage_collect (PvRuntime *self,
                                     TRUE, &iter, error))
     return FALSE;
 
+  trash = g_ptr_array_new_with_free_func (g_free);
+
   while (TRUE)
     {
       struct dirent *dent;
 
       if (!glnx_dirfd_iterator_next_dent_ensure_dtype (&iter, &dent,
                                                        NULL, error))
-        return FALSE;
+        {
+          pv_runtime_empty_trash (trash);
+          return FALSE;
+        }
 
       if (dent == NULL)
         break;
@@ -710,6 +910,10 @@ pv_runtime_garbage_collect (PvRuntime *self,
             continue;
         }
 
+      if (pv_runtime_collect_old_trash (self->variable_dir, dent->d_name,
+                                        trash))
+        continue;
+
       if (g_str_has_prefix (dent->d_name, "deploy-"))
         {
           if (_srt_fstatat_is_same_file (self->variable_dir_fd,
@@ -722,6 +926,16 @@ pv_runtime_garbage_collect (PvRuntime *self,
               continue;
             }
         }
+      else if (g_str_has_prefix (dent->d_name, "copy-"))
+        {
+          if (g_strcmp0 (dent->d_name + strlen ("copy-"),
+                         self->copy_cache_key) == 0)
+            {
+              g_debug ("Ignoring %s/%s: is the current cached copy",
+                       self->variable_dir, dent->d_name);
+              continue;
+            }
+        }
       else if (!g_str_has_prefix (dent->d_name, "tmp-"))
         {
           g_debug ("Ignoring %s/%s: not tmp-*",
@@ -729,12 +943,22 @@ pv_runtime_garbage_collect (PvRuntime *self,
           continue;
         }
 
-      pv_runtime_maybe_garbage_collect_subdir ("temporary runtime",
-                                               self->variable_dir,
-                                               self->variable_dir_fd,
-                                               dent->d_name);
+      if (collected >= MAX_GC_PER_LAUNCH)
+        {
+          g_debug ("Leaving %s/%s for a later launch",
+                   self->variable_dir, dent->d_name);
+          continue;
+        }
+
+      if (pv_runtime_maybe_garbage_collect_subdir ("temporary runtime",
+                                                   self->variable_dir,
+                                                   self->variable_dir_fd,
+                                                   dent->d_name,
+                                                   trash))
+        collected++;
     }
 
+  pv_runtime_empty_trash (trash);
   return TRUE;
 }
 
@@ -757,59 +981,132 @@ pv_runtime_init_variable_dir (PvRuntime *self,
   return TRUE;
 }
 
+/* Decisions made by capsule-capture-libs, reused while the libraries
+ * it compared are unchanged */
+#define LIBCAPSULE_CMP_CACHE "libcapsule-cmp-cache.txt"
+
+/* Whether bubblewrap was able to mount an overlayfs runtime, cached
+ * so that we do not need to try it again for every launch */
+#define OVERLAY_PROBE_CACHE "overlay-probe-cache.txt"
+
+/* Created in the deployment when its detached debug symbols have
+ * been unpacked */
+#define DEBUG_SYMBOLS_MARKER ".debug-symbols-unpacked"
+/* Held while unpacking detached debug symbols */
+#define DEBUG_SYMBOLS_LOCK ".debug-symbols.lock"
+/* Created in the deployment if unpacking its detached debug symbols
+ * failed, containing the size and modification time of the tarball */
+#define DEBUG_SYMBOLS_FAILED ".debug-symbols-failed"
+
+/*
+ * Returns: %TRUE if the detached debug symbols for the deployment
+ *  have been unpacked, or there were none to unpack
+ */
 static gboolean
-pv_runtime_create_copy (PvRuntime *self,
-                        PvBwrapLock *variable_dir_lock,
-                        const char *usr_mtree,
-                        PvMtreeApplyFlags mtree_flags,
-                        GError **error)
+pv_runtime_has_debug_symbols (PvRuntime *self)
 {
-  g_autofree gchar *dest_usr = NULL;
-  g_autofree gchar *temp_dir = NULL;
-  g_autoptr(GDir) dir = NULL;
-  g_autoptr(PvBwrapLock) copy_lock = NULL;
-  G_GNUC_UNUSED g_autoptr(PvBwrapLock) source_lock = NULL;
-  G_GNUC_UNUSED g_autoptr(SrtProfilingTimer) timer = NULL;
-  const char *member;
-  glnx_autofd int temp_dir_fd = -1;
-  gboolean is_just_usr;
+  g_autofree gchar *marker = NULL;
 
-  g_return_val_if_fail (PV_IS_RUNTIME (self), FALSE);
-  g_return_val_if_fail (self->variable_dir != NULL, FALSE);
-  g_return_val_if_fail (self->flags & PV_RUNTIME_FLAGS_COPY_RUNTIME, FALSE);
-  g_return_val_if_fail (error == NULL || *error == NULL, FALSE);
-  /* We don't actually *use* this: it just acts as an assertion that
-   * we are holding the lock on the parent directory. */
-  g_return_val_if_fail (variable_dir_lock != NULL, FALSE);
+  if (self->debug_tarball == NULL)
+    return TRUE;
 
-  timer = _srt_profiling_start ("Temporary runtime copy");
+  marker = g_build_filename (self->deployment, DEBUG_SYMBOLS_MARKER, NULL);
+  return g_file_test (marker, G_FILE_TEST_EXISTS);
+}
 
-  temp_dir = g_build_filename (self->variable_dir, "tmp-XXXXXX", NULL);
+/*
+ * Compute a key identifying the result of pv_runtime_populate_copy(),
+ * or return %NULL if it cannot be cached.
+ *
+ * We only cache copies that were made from a manifest: the manifest
+ * describes the entire content of the copy, so if it is unchanged,
+ * the copy will be too.
+ *
+ * The key is based on files/ and the manifest, but not on the deployment
+ * directory itself, whose modification and change times are updated
+ * whenever we create the debug symbols lock or marker in it. Whether
+ * detached debug symbols have been unpacked is not relevant either,
+ * because they are not listed in the manifest, so they never appear
+ * in the copy.
+ */
+static gchar *
+pv_runtime_get_copy_cache_key (PvRuntime *self,
+                               const char *usr_mtree,
+                               PvMtreeApplyFlags mtree_flags)
+{
+  g_autoptr(GChecksum) checksum = NULL;
+  g_autofree gchar *flags_str = NULL;
+  struct stat stat_buf;
+  const char * const paths[] = { self->source_files, usr_mtree };
+  gsize i;
 
-  if (g_mkdtemp (temp_dir) == NULL)
-    return glnx_throw_errno_prefix (error,
-                                    "Cannot create temporary directory \"%s\"",
-                                    temp_dir);
+  if (usr_mtree == NULL)
+    return NULL;
 
-  dest_usr = g_build_filename (temp_dir, "usr", NULL);
+  checksum = g_checksum_new (G_CHECKSUM_SHA256);
+
+  for (i = 0; i < G_N_ELEMENTS (paths); i++)
+    {
+      g_autofree gchar *description = NULL;
+
+      if (stat (paths[i], &stat_buf) != 0)
+        return NULL;
+
+      description = g_strdup_printf ("%s\n"
+                                     "dev=%" G_GUINT64_FORMAT
+                                     " ino=%" G_GUINT64_FORMAT
+                                     " size=%" G_GINT64_FORMAT
+                                     " mtime=%" G_GINT64_FORMAT ".%09ld"
+                                     " ctime=%" G_GINT64_FORMAT ".%09ld\n",
+                                     paths[i],
+                                     (guint64) stat_buf.st_dev,
+                                     (guint64) stat_buf.st_ino,
+                                     (gint64) stat_buf.st_size,
+                                     (gint64) stat_buf.st_mtim.tv_sec,
+                                     (long) stat_buf.st_mtim.tv_nsec,
+                                     (gint64) stat_buf.st_ctim.tv_sec,
+                                     (long) stat_buf.st_ctim.tv_nsec);
+      g_checksum_update (checksum, (const guchar *) description, -1);
+    }
+
+  flags_str = g_strdup_printf ("mtree_flags=0x%x\n", mtree_flags);
+  g_checksum_update (checksum, (const guchar *) flags_str, -1);
+
+  return g_strdup (g_checksum_get_string (checksum));
+}
+
+/*
+ * Populate @dest with an unmodified copy of the runtime.
+ *
+ * @is_just_usr: (out): Set to %TRUE if @dest/usr is the entire runtime
+ */
+static gboolean
+pv_runtime_populate_copy (PvRuntime *self,
+                          const char *dest,
+                          const char *usr_mtree,
+                          PvMtreeApplyFlags mtree_flags,
+                          gboolean *is_just_usr,
+                          GError **error)
+{
+  g_autofree gchar *dest_usr = g_build_filename (dest, "usr", NULL);
 
   if (usr_mtree != NULL)
     {
-      is_just_usr = TRUE;
+      *is_just_usr = TRUE;
     }
   else
     {
       g_autofree gchar *source_usr_subdir = g_build_filename (self->source_files,
                                                               "usr", NULL);
 
-      is_just_usr = !g_file_test (source_usr_subdir, G_FILE_TEST_IS_DIR);
+      *is_just_usr = !g_file_test (source_usr_subdir, G_FILE_TEST_IS_DIR);
     }
 
-  if (is_just_usr)
+  if (*is_just_usr)
     {
       /* ${source_files}/usr does not exist, so assume it's a merged /usr,
        * for example ./scout/files. Copy ${source_files}/bin to
-       * ${temp_dir}/usr/bin, etc. */
+       * ${dest}/usr/bin, etc. */
       if (usr_mtree != NULL)
         {
           /* If there's a manifest available, it's actually quicker to iterate
@@ -845,14 +1142,168 @@ pv_runtime_create_copy (PvRuntime *self,
     {
       /* ${source_files}/usr exists, so assume it's a complete sysroot.
        * Merge ${source_files}/bin and ${source_files}/usr/bin into
-       * ${temp_dir}/usr/bin, etc. */
+       * ${dest}/usr/bin, etc. */
       g_assert (usr_mtree == NULL);
 
-      if (!pv_cheap_tree_copy (self->source_files, temp_dir,
+      if (!pv_cheap_tree_copy (self->source_files, dest,
                                PV_COPY_FLAGS_USRMERGE, error))
         return FALSE;
     }
 
+  return TRUE;
+}
+
+/*
+ * Make sure ${variable_dir}/copy-${copy_cache_key} contains an
+ * unmodified copy of the runtime, creating it if necessary.
+ *
+ * The caller must hold at least a shared lock on the variable directory,
+ * which prevents the cached copy from being garbage-collected.
+ * Cached copies are never modified after creation: each launch makes a
+ * cheap hard-linked copy of it, and modifies that instead.
+ */
+static gboolean
+pv_runtime_ensure_cached_copy (PvRuntime *self,
+                               const char *cached,
+                               const char *usr_mtree,
+                               PvMtreeApplyFlags mtree_flags,
+                               GError **error)
+{
+  g_autofree gchar *staging = NULL;
+  G_GNUC_UNUSED g_autoptr(SrtProfilingTimer) timer = NULL;
+  gboolean is_just_usr;
+  struct stat stat_buf;
+  const char *staging_name;
+
+  if (glnx_fstatat (self->variable_dir_fd, cached, &stat_buf,
+                    AT_SYMLINK_NOFOLLOW, NULL)
+      && S_ISDIR (stat_buf.st_mode))
+    {
+      g_debug ("Reusing cached runtime copy %s/%s",
+               self->variable_dir, cached);
+      return TRUE;
+    }
+
+  timer = _srt_profiling_start ("Creating cached runtime copy");
+
+  /* Build it under a tmp-* name, so that if we crash or fail, it will
+   * be garbage-collected next time */
+  staging = g_build_filename (self->variable_dir, "tmp-XXXXXX", NULL);
+
+  if (g_mkdtemp (staging) == NULL)
+    return glnx_throw_errno_prefix (error,
+                                    "Cannot create temporary directory \"%s\"",
+                                    staging);
+
+  staging_name = glnx_basename (staging);
+
+  if (!pv_runtime_populate_copy (self, staging, usr_mtree, mtree_flags,
+                                 &is_just_usr, error))
+    return FALSE;
+
+  /* Don't keep the source's lock file: each copy will have its own */
+  if (TEMP_FAILURE_RETRY (unlinkat (self->variable_dir_fd,
+                                    glnx_strjoina (staging_name, "/usr/.ref"),
+                                    0)) != 0
+      && errno != ENOENT)
+    return glnx_throw_errno_prefix (error,
+                                    "Cannot remove \"%s/usr/.ref\"",
+                                    staging);
+
+  if (!glnx_renameat (self->variable_dir_fd, staging_name,
+                      self->variable_dir_fd, cached, error))
+    {
+      g_autoptr(GError) local_error = NULL;
+
+      /* If another process raced with us and created an equivalent copy,
+       * use theirs and discard ours. */
+      if (!glnx_fstatat (self->variable_dir_fd, cached, &stat_buf,
+                         AT_SYMLINK_NOFOLLOW, NULL)
+          || !S_ISDIR (stat_buf.st_mode))
+        return glnx_prefix_error (error,
+                                  "Unable to save cached runtime copy");
+
+      g_clear_error (error);
+
+      if (!glnx_shutil_rm_rf_at (self->variable_dir_fd, staging_name,
+                                 NULL, &local_error))
+        g_debug ("Unable to delete %s: %s", staging, local_error->message);
+    }
+
+  return TRUE;
+}
+
+static gboolean
+pv_runtime_create_copy (PvRuntime *self,
+                        PvBwrapLock *variable_dir_lock,
+                        const char *usr_mtree,
+                        PvMtreeApplyFlags mtree_flags,
+                        GError **error)
+{
+  g_autofree gchar *dest_usr = NULL;
+  g_autofree gchar *temp_dir = NULL;
+  g_autoptr(GDir) dir = NULL;
+  g_autoptr(PvBwrapLock) copy_lock = NULL;
+  G_GNUC_UNUSED g_autoptr(PvBwrapLock) source_lock = NULL;
+  G_GNUC_UNUSED g_autoptr(SrtProfilingTimer) timer = NULL;
+  const char *member;
+  glnx_autofd int temp_dir_fd = -1;
+  gboolean is_just_usr;
+
+  g_return_val_if_fail (PV_IS_RUNTIME (self), FALSE);
+  g_return_val_if_fail (self->variable_dir != NULL, FALSE);
+  g_return_val_if_fail (self->flags & PV_RUNTIME_FLAGS_COPY_RUNTIME, FALSE);
+  g_return_val_if_fail (error == NULL || *error == NULL, FALSE);
+  /* We don't actually *use* this: it just acts as an assertion that
+   * we are holding the lock on the parent directory. */
+  g_return_val_if_fail (variable_dir_lock != NULL, FALSE);
+
+  timer = _srt_profiling_start ("Temporary runtime copy");
+
+  temp_dir = g_build_filename (self->variable_dir, "tmp-XXXXXX", NULL);
+
+  if (g_mkdtemp (temp_dir) == NULL)
+    return glnx_throw_errno_prefix (error,
+                                    "Cannot create temporary directory \"%s\"",
+                                    temp_dir);
+
+  dest_usr = g_build_filename (temp_dir, "usr", NULL);
+
+  if (self->copy_cache_key != NULL)
+    {
+      /* If we have already copied this exact runtime, we can skip
+       * parsing the manifest and applying its metadata, and just
+       * hard-link the previous copy. This is particularly important if
+       * the variable directory is on a different filesystem from the
+       * runtime, because then the files cannot be hard-linked from
+       * the source and have to be copied.
+       *
+       * We still need a new copy for each launch, because setting up the
+       * graphics stack modifies it in ways that depend on the provider
+       * and the environment. */
+      g_autofree gchar *cached = g_strdup_printf ("copy-%s",
+                                                  self->copy_cache_key);
+      g_autofree gchar *cached_usr = g_build_filename (self->variable_dir,
+                                                       cached, "usr", NULL);
+
+      if (!pv_runtime_ensure_cached_copy (self, cached, usr_mtree,
+                                          mtree_flags, error))
+        return FALSE;
+
+      /* We only cache copies that came from a manifest, which are
+       * always merged-/usr */
+      is_just_usr = TRUE;
+
+      if (!pv_cheap_tree_copy (cached_usr, dest_usr,
+                               PV_COPY_FLAGS_NONE, error))
+        return FALSE;
+    }
+  else if (!pv_runtime_populate_copy (self, temp_dir, usr_mtree, mtree_flags,
+                                      &is_just_usr, error))
+    {
+      return FALSE;
+    }
+
   if (!glnx_opendirat (-1, temp_dir, FALSE, &temp_dir_fd, error))
     return FALSE;
 
@@ -901,54 +1352,504 @@ pv_runtime_create_copy (PvRuntime *self,
                                         temp_dir);
     }
 
-  dir = g_dir_open (dest_usr, 0, error);
+  dir = g_dir_open (dest_usr, 0, error);
+
+  if (dir == NULL)
+    return FALSE;
+
+  for (member = g_dir_read_name (dir);
+       member != NULL;
+       member = g_dir_read_name (dir))
+    {
+      /* Create symlinks ${temp_dir}/bin -> usr/bin, etc. if missing.
+       *
+       * Also make ${temp_dir}/etc, ${temp_dir}/var symlinks to etc
+       * and var, for the benefit of tools like capsule-capture-libs
+       * accessing /etc/ld.so.cache in the incomplete container (for the
+       * final container command-line they get merged by bind_runtime()
+       * instead). */
+      if (g_str_equal (member, "bin") ||
+          g_str_equal (member, "etc") ||
+          (g_str_has_prefix (member, "lib") &&
+           !g_str_equal (member, "libexec")) ||
+          g_str_equal (member, "sbin") ||
+          g_str_equal (member, "var"))
+        {
+          g_autofree gchar *dest = g_build_filename (temp_dir, member, NULL);
+          g_autofree gchar *target = g_build_filename ("usr", member, NULL);
+
+          if (symlink (target, dest) != 0)
+            {
+              /* Ignore EEXIST in the case where it was not just /usr:
+               * it's fine if the runtime we copied from source_files
+               * already had either directories or symlinks in its root
+               * directory */
+              if (is_just_usr || errno != EEXIST)
+                return glnx_throw_errno_prefix (error,
+                                                "Cannot create symlink \"%s\" -> %s",
+                                                dest, target);
+            }
+        }
+    }
+
+  /* Hand over from holding a lock on the source to just holding a lock
+   * on the copy. We'll release source_lock when we leave this scope */
+  source_lock = g_steal_pointer (&self->runtime_lock);
+  self->runtime_lock = g_steal_pointer (&copy_lock);
+  self->mutable_sysroot = g_steal_pointer (&temp_dir);
+  self->mutable_sysroot_fd = glnx_steal_fd (&temp_dir_fd);
+
+  return TRUE;
+}
+
+/*
+ * Populate @rel in the upper layer @upper_fd with hard links to the
+ * non-directory members of @rel in the lower layer @lower_fd.
+ * Subdirectories are not copied: overlayfs will merge them with the
+ * lower layer.
+ */
+static gboolean
+pv_runtime_copy_up_shallow (int lower_fd,
+                            const char *lower,
+                            int upper_fd,
+                            const char *rel,
+                            GError **error)
+{
+  g_auto(GLnxDirFdIterator) iter = { FALSE };
+  glnx_autofd int lower_dir_fd = -1;
+  glnx_autofd int upper_dir_fd = -1;
+  struct stat stat_buf;
+
+  /* If the directory doesn't exist, there is nothing to copy. If it
+   * is reached via a symlink, creating a real directory in the upper
+   * layer would hide the symlink, so leave it to be handled via its
+   * canonical path instead. */
+  lower_dir_fd = _srt_resolve_in_sysroot (lower_fd, rel,
+                                          (SRT_RESOLVE_FLAGS_REJECT_SYMLINKS
+                                           | SRT_RESOLVE_FLAGS_READABLE
+                                           | SRT_RESOLVE_FLAGS_DIRECTORY),
+                                          NULL, NULL);
+
+  if (lower_dir_fd < 0)
+    return TRUE;
+
+  if (!glnx_fstat (lower_dir_fd, &stat_buf, error))
+    return FALSE;
+
+  if (!glnx_shutil_mkdir_p_at (upper_fd, rel, stat_buf.st_mode & 07777,
+                               NULL, error))
+    return FALSE;
+
+  if (!glnx_opendirat (upper_fd, rel, FALSE, &upper_dir_fd, error))
+    return FALSE;
+
+  if (!glnx_dirfd_iterator_init_take_fd (&lower_dir_fd, &iter, error))
+    return FALSE;
+
+  while (TRUE)
+    {
+      struct dirent *dent;
+
+      if (!glnx_dirfd_iterator_next_dent_ensure_dtype (&iter, &dent,
+                                                       NULL, error))
+        return glnx_prefix_error (error, "Unable to read \"%s/%s\"",
+                                  lower, rel);
+
+      if (dent == NULL)
+        break;
+
+      if (dent->d_type == DT_DIR)
+        continue;
+
+      if (dent->d_type == DT_LNK)
+        {
+          g_autofree gchar *target = NULL;
+
+          target = glnx_readlinkat_malloc (iter.fd, dent->d_name, NULL, error);
+
+          if (target == NULL)
+            return FALSE;
+
+          if (TEMP_FAILURE_RETRY (symlinkat (target, upper_dir_fd,
+                                             dent->d_name)) != 0)
+            return glnx_throw_errno_prefix (error,
+                                            "Unable to create symlink \"%s/%s\"",
+                                            rel, dent->d_name);
+
+          continue;
+        }
+
+      if (linkat (iter.fd, dent->d_name, upper_dir_fd, dent->d_name, 0) != 0)
+        return glnx_throw_errno_prefix (error,
+                                        "Unable to hard-link \"%s/%s/%s\"",
+                                        lower, rel, dent->d_name);
+    }
+
+  return TRUE;
+}
+
+/*
+ * Return a key identifying the bubblewrap executable and the running
+ * kernel, which together decide whether an overlayfs runtime can be
+ * mounted, or %NULL if they cannot be identified.
+ */
+static gchar *
+pv_runtime_get_overlay_probe_key (PvRuntime *self)
+{
+  g_autoptr(GChecksum) checksum = NULL;
+  g_autofree gchar *boot_id = NULL;
+  g_autofree gchar *description = NULL;
+  struct stat stat_buf;
+  struct utsname uts;
+
+  if (stat (self->bubblewrap, &stat_buf) != 0 || uname (&uts) != 0)
+    return NULL;
+
+  /* Unprivileged overlayfs mounts can be allowed or forbidden by kernel
+   * configuration, so don't reuse the result after a reboot */
+  if (!g_file_get_contents ("/proc/sys/kernel/random/boot_id", &boot_id,
+                            NULL, NULL))
+    return NULL;
+
+  description = g_strdup_printf ("%s\n"
+                                 "dev=%" G_GUINT64_FORMAT
+                                 " ino=%" G_GUINT64_FORMAT
+                                 " size=%" G_GINT64_FORMAT
+                                 " mtime=%" G_GINT64_FORMAT ".%09ld\n"
+                                 "kernel=%s %s\n"
+                                 "boot_id=%s\n",
+                                 self->bubblewrap,
+                                 (guint64) stat_buf.st_dev,
+                                 (guint64) stat_buf.st_ino,
+                                 (gint64) stat_buf.st_size,
+                                 (gint64) stat_buf.st_mtim.tv_sec,
+                                 (long) stat_buf.st_mtim.tv_nsec,
+                                 uts.release, uts.version,
+                                 g_strstrip (boot_id));
+  checksum = g_checksum_new (G_CHECKSUM_SHA256);
+  g_checksum_update (checksum, (const guchar *) description, -1);
+  return g_strdup (g_checksum_get_string (checksum));
+}
+
+/*
+ * If an earlier launch recorded whether an overlayfs runtime can be
+ * mounted with the bubblewrap and kernel identified by @key, return
+ * %TRUE and set @works to the result.
+ */
+static gboolean
+pv_runtime_get_cached_overlay_probe (PvRuntime *self,
+                                     const char *key,
+                                     gboolean *works)
+{
+  g_autofree gchar *contents = NULL;
+  const char *result;
+
+  if (key == NULL)
+    return FALSE;
+
+  contents = glnx_file_get_contents_utf8_at (self->variable_dir_fd,
+                                             OVERLAY_PROBE_CACHE, NULL,
+                                             NULL, NULL);
+
+  if (contents == NULL
+      || !g_str_has_prefix (contents, key)
+      || contents[strlen (key)] != ' ')
+    return FALSE;
+
+  result = contents + strlen (key) + 1;
+
+  if (g_str_equal (result, "ok\n"))
+    *works = TRUE;
+  else if (g_str_equal (result, "failed\n"))
+    *works = FALSE;
+  else
+    return FALSE;
+
+  return TRUE;
+}
+
+static void
+pv_runtime_set_cached_overlay_probe (PvRuntime *self,
+                                     const char *key,
+                                     gboolean works)
+{
+  g_autoptr(GError) local_error = NULL;
+  g_autofree gchar *contents = NULL;
+
+  if (key == NULL)
+    return;
+
+  contents = g_strdup_printf ("%s %s\n", key, works ? "ok" : "failed");
+
+  if (!glnx_file_replace_contents_at (self->variable_dir_fd,
+                                      OVERLAY_PROBE_CACHE,
+                                      (const guint8 *) contents,
+                                      strlen (contents),
+                                      GLNX_FILE_REPLACE_NODATASYNC,
+                                      NULL, &local_error))
+    g_debug ("Unable to save overlayfs probe result: %s",
+             local_error->message);
+}
+
+/*
+ * Create ${variable_dir}/tmp-XXXXXX as a sysroot whose /usr is only an
+ * overlayfs upper layer, to be mounted on top of self->source_files.
+ * Instead of copying the whole runtime, we only populate the directories
+ * that pv_runtime_use_provider_graphics_stack() and related code will
+ * inspect or edit, using hard links to the runtime's files.
+ *
+ * If overlayfs cannot be used here, raise an error, leaving no
+ * side-effects: the caller can fall back to pv_runtime_create_copy().
+ */
+static gboolean
+pv_runtime_create_overlay (PvRuntime *self,
+                           PvBwrapLock *variable_dir_lock,
+                           GError **error)
+{
+  /* These are small, and read in their entirety during setup */
+  static const char * const recursive[] = { "etc", "lib/steamrt", "var" };
+  static const char * const top_level[] = { "bin", "etc", "lib", "sbin",
+                                            "var" };
+  g_autoptr(FlatpakBwrap) probe = NULL;
+  g_autoptr(GError) local_error = NULL;
+  g_autoptr(GHashTable) shallow = NULL;
+  g_autoptr(GDir) dir = NULL;
+  g_autoptr(PvBwrapLock) copy_lock = NULL;
+  g_autofree gchar *probe_key = NULL;
+  g_autofree gchar *source_usr_subdir = NULL;
+  g_autofree gchar *lower_on_host = NULL;
+  g_autofree gchar *temp_dir = NULL;
+  g_autofree gchar *temp_dir_on_host = NULL;
+  g_autofree gchar *upper = NULL;
+  G_GNUC_UNUSED g_autoptr(SrtProfilingTimer) timer = NULL;
+  glnx_autofd int lower_fd = -1;
+  glnx_autofd int temp_dir_fd = -1;
+  glnx_autofd int upper_fd = -1;
+  const char *member;
+  gboolean probe_result;
+  gsize i, j;
+
+  g_return_val_if_fail (PV_IS_RUNTIME (self), FALSE);
+  g_return_val_if_fail (self->variable_dir != NULL, FALSE);
+  g_return_val_if_fail (self->runtime_lock != NULL, FALSE);
+  g_return_val_if_fail (self->flags & PV_RUNTIME_FLAGS_OVERLAY_RUNTIME, FALSE);
+  g_return_val_if_fail (error == NULL || *error == NULL, FALSE);
+  /* We don't actually *use* this: it just acts as an assertion that
+   * we are holding the lock on the parent directory. */
+  g_return_val_if_fail (variable_dir_lock != NULL, FALSE);
+
+  if (self->bubblewrap == NULL)
+    return glnx_throw (error, "overlayfs can only be mounted by bubblewrap");
+
+  if (self->flags & PV_RUNTIME_FLAGS_FLATPAK_SUBSANDBOX)
+    return glnx_throw (error,
+                       "Flatpak subsandboxes cannot use an overlayfs runtime");
+
+  source_usr_subdir = g_build_filename (self->source_files, "usr", NULL);
+
+  if (g_file_test (source_usr_subdir, G_FILE_TEST_IS_DIR))
+    return glnx_throw (error,
+                       "overlayfs can only be used for a merged-/usr runtime");
+
+  /* The container needs to hold a lock on the lower layer as well as
+   * on the temporary sysroot, but the lower layer's .ref is hidden by
+   * the upper layer's, so it can only be passed in as a file descriptor */
+  if (!pv_bwrap_lock_is_ofd (self->runtime_lock))
+    return glnx_throw (error,
+                       "overlayfs requires open file description locks");
+
+  probe_key = pv_runtime_get_overlay_probe_key (self);
+
+  if (pv_runtime_get_cached_overlay_probe (self, probe_key, &probe_result)
+      && !probe_result)
+    return glnx_throw (error,
+                       "overlayfs could not be mounted by a previous launch");
+
+  timer = _srt_profiling_start ("Temporary runtime overlay");
+
+  temp_dir = g_build_filename (self->variable_dir, "tmp-XXXXXX", NULL);
+
+  if (g_mkdtemp (temp_dir) == NULL)
+    return glnx_throw_errno_prefix (error,
+                                    "Cannot create temporary directory \"%s\"",
+                                    temp_dir);
+
+  upper = g_build_filename (temp_dir, "usr", NULL);
+
+  if (!glnx_opendirat (AT_FDCWD, temp_dir, FALSE, &temp_dir_fd, &local_error)
+      || !glnx_opendirat (AT_FDCWD, self->source_files, FALSE, &lower_fd,
+                          &local_error)
+      || !glnx_ensure_dir (temp_dir_fd, "usr", 0755, &local_error)
+      || !glnx_opendirat (temp_dir_fd, "usr", FALSE, &upper_fd, &local_error))
+    goto fail;
+
+  /* Give the temporary sysroot its own lock file, created in a
+   * pre-locked state as in pv_runtime_create_copy(), so that it can be
+   * garbage-collected independently of the runtime. The lock on the
+   * lower layer is held separately, in self->overlay_lower_lock. */
+  copy_lock = pv_bwrap_lock_new (upper_fd, ".ref",
+                                 (PV_BWRAP_LOCK_FLAGS_CREATE
+                                  | PV_BWRAP_LOCK_FLAGS_REQUIRE_OFD),
+                                 &local_error);
+
+  if (copy_lock == NULL)
+    {
+      g_prefix_error (&local_error,
+                      "Unable to lock \"%s/.ref\" in temporary runtime: ",
+                      upper);
+      goto fail;
+    }
+
+  for (i = 0; i < G_N_ELEMENTS (recursive); i++)
+    {
+      g_autofree gchar *src = NULL;
+      g_autofree gchar *dest = NULL;
+      glnx_autofd int fd = -1;
+
+      fd = _srt_resolve_in_sysroot (lower_fd, recursive[i],
+                                    (SRT_RESOLVE_FLAGS_REJECT_SYMLINKS
+                                     | SRT_RESOLVE_FLAGS_DIRECTORY),
+                                    NULL, NULL);
+
+      if (fd < 0)
+        continue;
+
+      src = g_build_filename (self->source_files, recursive[i], NULL);
+      dest = g_build_filename (upper, recursive[i], NULL);
+
+      if (!pv_cheap_tree_copy (src, dest, PV_COPY_FLAGS_NONE, &local_error))
+        goto fail;
+    }
+
+  /* Library directories are potentially large, but we only need their
+   * top level, to be able to delete or replace libraries */
+  shallow = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
+  g_hash_table_add (shallow, g_strdup ("lib"));
+
+  for (i = 0; i < PV_N_SUPPORTED_ARCHITECTURES; i++)
+    {
+      g_autoptr(GPtrArray) dirs = NULL;
+
+      dirs = pv_multiarch_details_get_libdirs (&pv_multiarch_details[i],
+                                               PV_MULTIARCH_LIBDIRS_FLAGS_REMOVE_OVERRIDDEN);
+
+      for (j = 0; j < dirs->len; j++)
+        {
+          const char *libdir = g_ptr_array_index (dirs, j);
+
+          /* The runtime is a merged /usr, so /lib and /usr/lib are
+           * both ${source_files}/lib */
+          if (g_str_has_prefix (libdir, "/usr/"))
+            libdir += strlen ("/usr/");
+
+          while (libdir[0] == '/')
+            libdir++;
+
+          g_hash_table_add (shallow, g_strdup (libdir));
+        }
+    }
+
+  GLNX_HASH_TABLE_FOREACH (shallow, const char *, libdir)
+    {
+      if (!pv_runtime_copy_up_shallow (lower_fd, self->source_files,
+                                       upper_fd, libdir, &local_error))
+        goto fail;
+    }
+
+  /* Create symlinks ${temp_dir}/bin -> usr/bin, etc., as in
+   * pv_runtime_create_copy() */
+  dir = g_dir_open (self->source_files, 0, &local_error);
+
+  if (dir == NULL)
+    goto fail;
+
+  for (member = g_dir_read_name (dir);
+       member != NULL;
+       member = g_dir_read_name (dir))
+    {
+      g_autofree gchar *target = NULL;
+
+      for (i = 0; i < G_N_ELEMENTS (top_level); i++)
+        {
+          if (g_str_equal (member, top_level[i]))
+            break;
+        }
+
+      if (i == G_N_ELEMENTS (top_level)
+          && !(g_str_has_prefix (member, "lib")
+               && !g_str_equal (member, "libexec")))
+        continue;
+
+      target = g_build_filename ("usr", member, NULL);
+
+      if (TEMP_FAILURE_RETRY (symlinkat (target, temp_dir_fd, member)) != 0)
+        {
+          glnx_throw_errno_prefix (&local_error,
+                                   "Cannot create symlink \"%s/%s\" -> %s",
+                                   temp_dir, member, target);
+          goto fail;
+        }
+    }
+
+  if (TEMP_FAILURE_RETRY (symlinkat ("usr/.ref", temp_dir_fd, ".ref")) != 0)
+    {
+      glnx_throw_errno_prefix (&local_error,
+                               "Cannot create symlink \"%s/.ref\" -> usr/.ref",
+                               temp_dir);
+      goto fail;
+    }
+
+  /* Check that bubblewrap and the kernel will let us mount the result.
+   * This will fail with bubblewrap < 0.10.0, with setuid bubblewrap, or
+   * with a kernel that does not allow unprivileged overlayfs mounts.
+   * The answer only depends on bubblewrap and the kernel, so only do
+   * this the first time. */
+  if (pv_runtime_get_cached_overlay_probe (self, probe_key, &probe_result))
+    {
+      g_debug ("Assuming overlayfs can be mounted, as it could be before");
+    }
+  else
+    {
+      lower_on_host = pv_current_namespace_path_to_host_path (self->source_files);
+      temp_dir_on_host = pv_current_namespace_path_to_host_path (temp_dir);
+      probe = flatpak_bwrap_new (NULL);
+      flatpak_bwrap_add_args (probe,
+                              self->bubblewrap,
+                              "--ro-bind", "/", "/",
+                              "--tmpfs", "/tmp",
+                              NULL);
+
+      if (!pv_bwrap_overlay_usr (probe, lower_on_host, temp_dir_on_host,
+                                 temp_dir, "/tmp", &local_error))
+        goto fail;
 
-  if (dir == NULL)
-    return FALSE;
+      flatpak_bwrap_add_args (probe, "true", NULL);
+      flatpak_bwrap_finish (probe);
 
-  for (member = g_dir_read_name (dir);
-       member != NULL;
-       member = g_dir_read_name (dir))
-    {
-      /* Create symlinks ${temp_dir}/bin -> usr/bin, etc. if missing.
-       *
-       * Also make ${temp_dir}/etc, ${temp_dir}/var symlinks to etc
-       * and var, for the benefit of tools like capsule-capture-libs
-       * accessing /etc/ld.so.cache in the incomplete container (for the
-       * final container command-line they get merged by bind_runtime()
-       * instead). */
-      if (g_str_equal (member, "bin") ||
-          g_str_equal (member, "etc") ||
-          (g_str_has_prefix (member, "lib") &&
-           !g_str_equal (member, "libexec")) ||
-          g_str_equal (member, "sbin") ||
-          g_str_equal (member, "var"))
+      if (!pv_bwrap_run_sync (probe, NULL, &local_error))
         {
-          g_autofree gchar *dest = g_build_filename (temp_dir, member, NULL);
-          g_autofree gchar *target = g_build_filename ("usr", member, NULL);
-
-          if (symlink (target, dest) != 0)
-            {
-              /* Ignore EEXIST in the case where it was not just /usr:
-               * it's fine if the runtime we copied from source_files
-               * already had either directories or symlinks in its root
-               * directory */
-              if (is_just_usr || errno != EEXIST)
-                return glnx_throw_errno_prefix (error,
-                                                "Cannot create symlink \"%s\" -> %s",
-                                                dest, target);
-            }
+          g_prefix_error (&local_error, "Unable to mount overlayfs: ");
+          pv_runtime_set_cached_overlay_probe (self, probe_key, FALSE);
+          goto fail;
         }
+
+      pv_runtime_set_cached_overlay_probe (self, probe_key, TRUE);
     }
 
-  /* Hand over from holding a lock on the source to just holding a lock
-   * on the copy. We'll release source_lock when we leave this scope */
-  source_lock = g_steal_pointer (&self->runtime_lock);
+  /* Unlike pv_runtime_create_copy(), we need to keep holding a lock on
+   * the lower layer for as long as the container runs, as well as
+   * holding a lock on the temporary sysroot. */
+  self->overlay_lower_lock = g_steal_pointer (&self->runtime_lock);
   self->runtime_lock = g_steal_pointer (&copy_lock);
   self->mutable_sysroot = g_steal_pointer (&temp_dir);
   self->mutable_sysroot_fd = glnx_steal_fd (&temp_dir_fd);
-
+  self->overlay_lower = g_strdup (self->source_files);
   return TRUE;
+
+fail:
+  glnx_shutil_rm_rf_at (AT_FDCWD, temp_dir, NULL, NULL);
+  g_propagate_error (error, g_steal_pointer (&local_error));
+  return FALSE;
 }
 
 static gboolean
@@ -969,6 +1870,189 @@ gstring_replace_suffix (GString *s,
   return FALSE;
 }
 
+/*
+ * Find the most recently unpacked runtime in the variable directory,
+ * other than @exclude, that has a manifest with SHA-256 digests.
+ * Files that have not changed since that version can be hard-linked
+ * from it instead of being written again.
+ *
+ * @fd_out: (out): Used to return a fd for the previous deployment
+ *
+ * Returns: (transfer full) (nullable): Digests of files in the previous
+ *  deployment, keyed by path relative to @fd_out, or %NULL if there
+ *  is no suitable previous deployment
+ */
+static GHashTable *
+pv_runtime_load_previous_deployment (PvRuntime *self,
+                                     const char *exclude,
+                                     int *fd_out)
+{
+  g_auto(GLnxDirFdIterator) iter = { FALSE };
+  g_autoptr(GError) local_error = NULL;
+  g_autoptr(GHashTable) digests = NULL;
+  g_autofree gchar *best = NULL;
+  g_autofree gchar *best_mtree = NULL;
+  g_autofree gchar *gz_path = NULL;
+  g_autofree gchar *txt_path = NULL;
+  PvMtreeApplyFlags best_mtree_flags = PV_MTREE_APPLY_FLAGS_NONE;
+  gint64 best_mtime = G_MININT64;
+
+  if (!glnx_dirfd_iterator_init_at (self->variable_dir_fd, ".", TRUE,
+                                    &iter, &local_error))
+    {
+      g_debug ("Unable to look for previous deployment: %s",
+               local_error->message);
+      return NULL;
+    }
+
+  while (TRUE)
+    {
+      struct dirent *dent;
+      struct stat stat_buf;
+      const char *mtree;
+      PvMtreeApplyFlags mtree_flags;
+      gint64 mtime;
+
+      if (!glnx_dirfd_iterator_next_dent_ensure_dtype (&iter, &dent,
+                                                        NULL, &local_error))
+        {
+          g_debug ("Unable to look for previous deployment: %s",
+                   local_error->message);
+          return NULL;
+        }
+
+      if (dent == NULL)
+        break;
+
+      if (dent->d_type != DT_DIR
+          || !g_str_has_prefix (dent->d_name, "deploy-")
+          || strcmp (dent->d_name, exclude) == 0)
+        continue;
+
+      g_free (gz_path);
+      gz_path = g_build_filename (dent->d_name, "usr-mtree.txt.gz", NULL);
+      g_free (txt_path);
+      txt_path = g_build_filename (dent->d_name, "usr-mtree.txt", NULL);
+
+      /* Compiled manifests don't have the digests */
+      if (faccessat (iter.fd, gz_path, F_OK, 0) == 0)
+        {
+          mtree = "usr-mtree.txt.gz";
+          mtree_flags = PV_MTREE_APPLY_FLAGS_GZIP;
+        }
+      else if (faccessat (iter.fd, txt_path, F_OK, 0) == 0)
+        {
+          mtree = "usr-mtree.txt";
+          mtree_flags = PV_MTREE_APPLY_FLAGS_NONE;
+        }
+      else
+        {
+          continue;
+        }
+
+      if (!glnx_fstatat (iter.fd, dent->d_name, &stat_buf,
+                         AT_SYMLINK_NOFOLLOW, NULL))
+        continue;
+
+      mtime = ((gint64) stat_buf.st_mtim.tv_sec * G_GINT64_CONSTANT (1000000000)
+               + stat_buf.st_mtim.tv_nsec);
+
+      if (best == NULL || mtime > best_mtime)
+        {
+          g_free (best);
+          best = g_strdup (dent->d_name);
+          g_free (best_mtree);
+          best_mtree = g_build_filename (self->variable_dir, dent->d_name,
+                                         mtree, NULL);
+          best_mtree_flags = mtree_flags;
+          best_mtime = mtime;
+        }
+    }
+
+  if (best == NULL)
+    return NULL;
+
+  g_debug ("Reusing unchanged files from \"%s/%s\"",
+           self->variable_dir, best);
+  digests = pv_mtree_load_digests (best_mtree, "files/", best_mtree_flags,
+                                   &local_error);
+
+  if (digests == NULL)
+    {
+      g_debug ("Unable to load digests from previous deployment: %s",
+               local_error->message);
+      return NULL;
+    }
+
+  if (!glnx_opendirat (self->variable_dir_fd, best, TRUE, fd_out,
+                       &local_error))
+    {
+      g_debug ("Unable to open previous deployment: %s",
+               local_error->message);
+      return NULL;
+    }
+
+  return g_steal_pointer (&digests);
+}
+
+/*
+ * Unpack @archive into @dest_path, which must already exist.
+ * If @reference_digests is non-%NULL, files that are unchanged from
+ * the deployment @reference_fd are hard-linked instead of written.
+ *
+ * We do this in-process if possible, and fall back to tar(1) for
+ * archives that pv_untar() does not support.
+ */
+static gboolean
+pv_runtime_unpack_archive (PvRuntime *self,
+                           const char *archive,
+                           const char *dest_path,
+                           int reference_fd,
+                           GHashTable *reference_digests,
+                           GError **error)
+{
+  g_autoptr(FlatpakBwrap) tar = NULL;
+  g_autoptr(GError) local_error = NULL;
+  glnx_autofd int dest_fd = -1;
+  PvUntarFlags untar_flags = PV_UNTAR_FLAGS_NONE;
+
+  if (!glnx_opendirat (AT_FDCWD, dest_path, TRUE, &dest_fd, error))
+    return FALSE;
+
+  if (self->flags & PV_RUNTIME_FLAGS_VERBOSE)
+    untar_flags |= PV_UNTAR_FLAGS_VERBOSE;
+
+  if (pv_untar (archive, dest_fd, dest_path, NULL,
+                reference_fd, reference_digests, untar_flags,
+                &local_error))
+    return TRUE;
+
+  if (!g_error_matches (local_error, G_IO_ERROR, G_IO_ERROR_NOT_SUPPORTED))
+    {
+      g_propagate_error (error, g_steal_pointer (&local_error));
+      return FALSE;
+    }
+
+  g_info ("%s, falling back to tar(1)", local_error->message);
+
+  tar = flatpak_bwrap_new (NULL);
+  flatpak_bwrap_add_args (tar,
+                          "tar",
+                          "--force-local",
+                          "-C", dest_path,
+                          NULL);
+
+  if (self->flags & PV_RUNTIME_FLAGS_VERBOSE)
+    flatpak_bwrap_add_arg (tar, "-v");
+
+  flatpak_bwrap_add_args (tar,
+                          "-xf", archive,
+                          NULL);
+
+  flatpak_bwrap_finish (tar);
+  return pv_bwrap_run_sync (tar, NULL, error);
+}
+
 /*
  * mutable_lock: (out) (not optional):
  */
@@ -981,6 +2065,11 @@ pv_runtime_unpack (PvRuntime *self,
   G_GNUC_UNUSED g_autoptr(SrtProfilingTimer) timer = NULL;
   g_autofree gchar *deploy_basename = NULL;
   g_autofree gchar *unpack_dir = NULL;
+  g_autofree gchar *runtime_suffix = NULL;
+  g_autofree gchar *debug_suffix = NULL;
+  g_autoptr(GHashTable) reference_digests = NULL;
+  glnx_autofd int reference_fd = -1;
+  const char *suffix;
 
   g_return_val_if_fail (PV_IS_RUNTIME (self), FALSE);
   g_return_val_if_fail (mutable_lock != NULL, FALSE);
@@ -994,19 +2083,27 @@ pv_runtime_unpack (PvRuntime *self,
   if (!g_file_test (self->source, G_FILE_TEST_IS_REGULAR))
     return glnx_throw (error, "\"%s\" is not a regular file", self->source);
 
-  if (!g_str_has_suffix (self->source, ".tar.gz"))
-    return glnx_throw (error, "\"%s\" is not a .tar.gz file", self->source);
+  if (g_str_has_suffix (self->source, ".tar.gz"))
+    suffix = ".tar.gz";
+  else if (g_str_has_suffix (self->source, ".tar.zst"))
+    suffix = ".tar.zst";
+  else
+    return glnx_throw (error, "\"%s\" is not a .tar.gz or .tar.zst file",
+                       self->source);
+
+  runtime_suffix = g_strconcat ("-runtime", suffix, NULL);
 
   if (self->id == NULL)
     {
       g_autoptr(GString) build_id_file = g_string_new (self->source);
+      g_autofree gchar *sysroot_suffix = g_strconcat ("-sysroot", suffix, NULL);
       g_autofree char *id = NULL;
       gsize len;
       gsize i;
 
-      if (gstring_replace_suffix (build_id_file, "-runtime.tar.gz",
+      if (gstring_replace_suffix (build_id_file, runtime_suffix,
                                   "-buildid.txt")
-          || gstring_replace_suffix (build_id_file, "-sysroot.tar.gz",
+          || gstring_replace_suffix (build_id_file, sysroot_suffix,
                                      "-buildid.txt"))
         {
           if (!g_file_get_contents (build_id_file->str, &id, &len, error))
@@ -1049,6 +2146,17 @@ pv_runtime_unpack (PvRuntime *self,
   self->deployment = g_build_filename (self->variable_dir,
                                        deploy_basename, NULL);
 
+  /* Detached debug symbols are large and rarely needed, so we unpack
+   * them later, in the background: see
+   * pv_runtime_start_unpacking_debug_symbols() */
+  debug_tarball = g_string_new (self->source);
+  debug_suffix = g_strconcat ("-debug", suffix, NULL);
+
+  if (gstring_replace_suffix (debug_tarball, runtime_suffix, debug_suffix)
+      && g_file_test (debug_tarball->str, G_FILE_TEST_EXISTS))
+    self->debug_tarball = g_string_free (g_steal_pointer (&debug_tarball),
+                                         FALSE);
+
   /* Fast path: if we already unpacked it, nothing more to do! */
   if (g_file_test (self->deployment, G_FILE_TEST_IS_DIR))
     return TRUE;
@@ -1079,74 +2187,131 @@ pv_runtime_unpack (PvRuntime *self,
 
   g_info ("Unpacking \"%s\" into \"%s\"...", self->source, unpack_dir);
 
-    {
-      g_autoptr(FlatpakBwrap) tar = flatpak_bwrap_new (NULL);
-
-      flatpak_bwrap_add_args (tar,
-                              "tar",
-                              "--force-local",
-                              "-C", unpack_dir,
-                              NULL);
-
-      if (self->flags & PV_RUNTIME_FLAGS_VERBOSE)
-        flatpak_bwrap_add_arg (tar, "-v");
+  reference_digests = pv_runtime_load_previous_deployment (self,
+                                                          deploy_basename,
+                                                          &reference_fd);
 
-      flatpak_bwrap_add_args (tar,
-                              "-xf", self->source,
-                              NULL);
-      flatpak_bwrap_finish (tar);
-
-      if (!pv_bwrap_run_sync (tar, NULL, error))
-        {
-          glnx_shutil_rm_rf_at (-1, unpack_dir, NULL, NULL);
-          return FALSE;
-        }
+  if (!pv_runtime_unpack_archive (self, self->source, unpack_dir,
+                                  reference_fd, reference_digests, error))
+    {
+      glnx_shutil_rm_rf_at (-1, unpack_dir, NULL, NULL);
+      return FALSE;
     }
 
-  debug_tarball = g_string_new (self->source);
+  g_info ("Renaming \"%s\" to \"%s\"...", unpack_dir, deploy_basename);
 
-  if (gstring_replace_suffix (debug_tarball, "-runtime.tar.gz",
-                              "-debug.tar.gz")
-      && g_file_test (debug_tarball->str, G_FILE_TEST_EXISTS))
+  if (!glnx_renameat (self->variable_dir_fd, unpack_dir,
+                      self->variable_dir_fd, deploy_basename,
+                      error))
     {
-      g_autoptr(FlatpakBwrap) tar = flatpak_bwrap_new (NULL);
-      g_autoptr(GError) local_error = NULL;
-      g_autofree char *files_lib_debug = NULL;
+      glnx_shutil_rm_rf_at (-1, unpack_dir, NULL, NULL);
+      return FALSE;
+    }
 
-      files_lib_debug = g_build_filename (unpack_dir, "files", "lib",
-                                          "debug", NULL);
+  return TRUE;
+}
 
-      flatpak_bwrap_add_args (tar,
-                              "tar",
-                              "--force-local",
-                              "-C", files_lib_debug,
-                              NULL);
+/*
+ * If the deployment has detached debug symbols that have not yet been
+ * unpacked, start unpacking them in a background process that will
+ * outlive us. We don't wait for it: the runtime is usable without
+ * them, and a later launch will see the marker file once they are
+ * complete.
+ *
+ * The background process holds a read-lock on the runtime, so that
+ * it cannot be garbage-collected while we are unpacking into it,
+ * and a write-lock on DEBUG_SYMBOLS_LOCK, so that only one process
+ * is unpacking at a time. If it is interrupted, the marker file is
+ * not created, and the next launch will try again. If tar fails,
+ * DEBUG_SYMBOLS_FAILED records which version of the tarball it was,
+ * so that we don't try again until the tarball is replaced.
+ */
+static void
+pv_runtime_start_unpacking_debug_symbols (PvRuntime *self)
+{
+  g_autoptr(FlatpakBwrap) adverb = NULL;
+  g_autoptr(GError) local_error = NULL;
+  g_autofree gchar *files_lib_debug = NULL;
+  g_autofree gchar *marker = NULL;
+  g_autofree gchar *failed = NULL;
+  g_autofree gchar *failed_contents = NULL;
+  g_autofree gchar *tarball_id = NULL;
+  struct stat stat_buf;
+
+  if (pv_runtime_has_debug_symbols (self))
+    return;
 
-      if (self->flags & PV_RUNTIME_FLAGS_VERBOSE)
-        flatpak_bwrap_add_arg (tar, "-v");
+  if (stat (self->debug_tarball, &stat_buf) != 0)
+    {
+      g_debug ("Not unpacking \"%s\": %s",
+               self->debug_tarball, g_strerror (errno));
+      return;
+    }
 
-      flatpak_bwrap_add_args (tar,
-                              "-xf", debug_tarball->str,
-                              "files/",
-                              NULL);
-      flatpak_bwrap_finish (tar);
+  tarball_id = g_strdup_printf ("size=%" G_GINT64_FORMAT
+                                " mtime=%" G_GINT64_FORMAT ".%09ld\n",
+                                (gint64) stat_buf.st_size,
+                                (gint64) stat_buf.st_mtim.tv_sec,
+                                (long) stat_buf.st_mtim.tv_nsec);
+  failed = g_build_filename (self->deployment, DEBUG_SYMBOLS_FAILED, NULL);
 
-      if (!pv_bwrap_run_sync (tar, NULL, &local_error))
-        g_debug ("Ignoring error unpacking detached debug symbols: %s",
-                 local_error->message);
+  if (g_file_get_contents (failed, &failed_contents, NULL, NULL)
+      && g_str_equal (failed_contents, tarball_id))
+    {
+      g_debug ("Not unpacking \"%s\": it failed last time, see \"%s\"",
+               self->debug_tarball, failed);
+      return;
     }
 
-  g_info ("Renaming \"%s\" to \"%s\"...", unpack_dir, deploy_basename);
+  files_lib_debug = g_build_filename (self->source_files, "lib", "debug",
+                                      NULL);
 
-  if (!glnx_renameat (self->variable_dir_fd, unpack_dir,
-                      self->variable_dir_fd, deploy_basename,
-                      error))
+  if (!g_file_test (files_lib_debug, G_FILE_TEST_IS_DIR))
     {
-      glnx_shutil_rm_rf_at (-1, unpack_dir, NULL, NULL);
-      return FALSE;
+      g_debug ("Not unpacking \"%s\": \"%s\" is not a directory",
+               self->debug_tarball, files_lib_debug);
+      return;
     }
 
-  return TRUE;
+  marker = g_build_filename (self->deployment, DEBUG_SYMBOLS_MARKER, NULL);
+  adverb = flatpak_bwrap_new (NULL);
+  flatpak_bwrap_add_arg_printf (adverb, "%s/bin/pressure-vessel-adverb",
+                                self->pv_prefix);
+  flatpak_bwrap_add_arg (adverb, "--lock-file");
+  flatpak_bwrap_add_arg_printf (adverb, "%s/.ref", self->source_files);
+  flatpak_bwrap_add_args (adverb,
+                          "--create",
+                          "--write",
+                          "--lock-file",
+                          NULL);
+  flatpak_bwrap_add_arg_printf (adverb, "%s/" DEBUG_SYMBOLS_LOCK,
+                                self->deployment);
+  flatpak_bwrap_add_args (adverb,
+                          "--",
+                          "sh", "-euc",
+                          "if tar --force-local --strip-components=1 "
+                          "-C \"$1\" -xf \"$2\" files/; then\n"
+                          "  rm -f \"$4\"\n"
+                          "  : > \"$3\"\n"
+                          "else\n"
+                          "  printf '%s' \"$5\" > \"$4\"\n"
+                          "  exit 1\n"
+                          "fi\n",
+                          "sh",
+                          files_lib_debug,
+                          self->debug_tarball,
+                          marker,
+                          failed,
+                          tarball_id,
+                          NULL);
+  flatpak_bwrap_finish (adverb);
+
+  g_info ("Unpacking detached debug symbols from \"%s\" in the background",
+          self->debug_tarball);
+
+  if (!pv_runtime_spawn_detached (adverb, FALSE, &local_error))
+    g_debug ("Unable to unpack detached debug symbols: %s",
+             local_error->message);
 }
 
 typedef struct
@@ -1391,6 +2556,7 @@ pv_runtime_initable_init (GInitable *initable,
   g_autofree gchar *contents = NULL;
   g_autofree gchar *os_release = NULL;
   g_autofree gchar *usr_mtree = NULL;
+  g_autofree gchar *compiled_mtree = NULL;
   gsize len;
   PvMtreeApplyFlags mtree_flags = PV_MTREE_APPLY_FLAGS_NONE;
 
@@ -1466,7 +2632,11 @@ pv_runtime_initable_init (GInitable *initable,
    *
    * The manifest compresses well (about 3:1 if sha256sums are included)
    * so try to read a compressed version first, falling back to
-   * uncompressed. */
+   * uncompressed.
+   *
+   * If a compiled version generated by pressure-vessel-mtree-compile
+   * is available, compatible and was compiled from that same text
+   * manifest, prefer it, because it can be used without parsing. */
   usr_mtree = g_build_filename (self->deployment, "usr-mtree.txt.gz", NULL);
 
   if (g_file_test (usr_mtree, G_FILE_TEST_IS_REGULAR))
@@ -1482,6 +2652,24 @@ pv_runtime_initable_init (GInitable *initable,
   if (!g_file_test (usr_mtree, G_FILE_TEST_IS_REGULAR))
     g_clear_pointer (&usr_mtree, g_free);
 
+  compiled_mtree = g_build_filename (self->deployment, "usr-mtree.bin", NULL);
+
+  if (g_file_test (compiled_mtree, G_FILE_TEST_IS_REGULAR))
+    {
+      g_autoptr(GError) local_error = NULL;
+
+      if (pv_mtree_check_compiled (compiled_mtree, usr_mtree, &local_error))
+        {
+          g_free (usr_mtree);
+          usr_mtree = g_steal_pointer (&compiled_mtree);
+          mtree_flags &= ~PV_MTREE_APPLY_FLAGS_GZIP;
+        }
+      else
+        {
+          g_debug ("Not using compiled manifest: %s", local_error->message);
+        }
+    }
+
   /* Or, if it contains ./files/, assume it's a Flatpak-style runtime where
    * ./files is a merged /usr and ./metadata is an optional GKeyFile. */
   self->source_files = g_build_filename (self->deployment, "files", NULL);
@@ -1505,6 +2693,12 @@ pv_runtime_initable_init (GInitable *initable,
 
   g_debug ("Taking runtime files from: %s", self->source_files);
 
+  /* This needs to be done before GC, so that GC will not delete a
+   * cached copy that we can reuse. */
+  if (self->variable_dir_fd >= 0)
+    self->copy_cache_key = pv_runtime_get_copy_cache_key (self, usr_mtree,
+                                                          mtree_flags);
+
   /* Take a lock on the runtime until we're finished with setup,
    * to make sure it doesn't get deleted.
    *
@@ -1526,6 +2720,9 @@ pv_runtime_initable_init (GInitable *initable,
   if (self->runtime_lock == NULL)
     return FALSE;
 
+  if (self->debug_tarball != NULL)
+    pv_runtime_start_unpacking_debug_symbols (self);
+
   /* GC old runtimes (if they have become unused) before we create a
    * new one. This means we should only ever have one temporary runtime
    * copy per game that is run concurrently. */
@@ -1573,8 +2770,20 @@ pv_runtime_initable_init (GInitable *initable,
       if (mutable_lock == NULL)
         return FALSE;
 
-      if (!pv_runtime_create_copy (self, mutable_lock, usr_mtree,
-                                   mtree_flags, error))
+      /* The overlay's lower layer is the runtime's files/ as-is, so the
+       * manifest is not needed in this case */
+      if (self->flags & PV_RUNTIME_FLAGS_OVERLAY_RUNTIME)
+        {
+          g_autoptr(GError) local_error = NULL;
+
+          if (!pv_runtime_create_overlay (self, mutable_lock, &local_error))
+            g_info ("Copying runtime instead of using overlayfs: %s",
+                    local_error->message);
+        }
+
+      if (self->mutable_sysroot == NULL
+          && !pv_runtime_create_copy (self, mutable_lock, usr_mtree,
+                                      mtree_flags, error))
         return FALSE;
     }
 
@@ -1731,8 +2940,11 @@ pv_runtime_finalize (GObject *object)
   g_free (self->runtime_abi_json);
   glnx_close_fd (&self->variable_dir_fd);
   g_free (self->variable_dir);
+  g_free (self->copy_cache_key);
+  g_free (self->debug_tarball);
   glnx_close_fd (&self->mutable_sysroot_fd);
   g_free (self->mutable_sysroot);
+  g_free (self->overlay_lower);
   g_free (self->runtime_files_on_host);
   g_free (self->runtime_app);
   g_free (self->runtime_usr);
@@ -1743,6 +2955,9 @@ pv_runtime_finalize (GObject *object)
   if (self->runtime_lock != NULL)
     pv_bwrap_lock_free (self->runtime_lock);
 
+  if (self->overlay_lower_lock != NULL)
+    pv_bwrap_lock_free (self->overlay_lower_lock);
+
   G_OBJECT_CLASS (pv_runtime_parent_class)->finalize (object);
 }
 
@@ -1963,6 +3178,20 @@ pv_runtime_get_adverb (PvRuntime *self,
                               NULL);
     }
 
+  /* pv_runtime_create_overlay() only succeeds if this is an OFD lock */
+  if (self->overlay_lower_lock != NULL)
+    {
+      int fd = pv_bwrap_lock_steal_fd (self->overlay_lower_lock);
+      g_autofree gchar *fd_str = NULL;
+
+      g_debug ("Passing overlay lower layer lock fd %d down to adverb", fd);
+      flatpak_bwrap_add_fd (bwrap, fd);
+      fd_str = g_strdup_printf ("%d", fd);
+      flatpak_bwrap_add_args (bwrap,
+                              "--fd", fd_str,
+                              NULL);
+    }
+
   pv_runtime_adverb_regenerate_ld_so_cache (self, bwrap);
 
   return TRUE;
@@ -1981,7 +3210,51 @@ pv_runtime_provide_container_access (PvRuntime *self,
   if (self->container_access_adverb != NULL)
     return TRUE;
 
-  if (!self->runtime_is_just_usr)
+  if (self->overlay_lower != NULL)
+    {
+      g_autofree gchar *lower_on_host = NULL;
+
+      if (self->bubblewrap == NULL)
+        return glnx_throw (error,
+                           "Cannot run bubblewrap to set up runtime");
+
+      /* The mutable sysroot only contains the parts of /usr that we
+       * have copied or changed, so we need to mount the overlay to see
+       * what the container will look like. */
+      g_info ("%s: Using bwrap to mount runtime overlay", G_STRFUNC);
+
+      lower_on_host = pv_current_namespace_path_to_host_path (self->overlay_lower);
+      self->container_access = g_build_filename (self->mutable_sysroot,
+                                                 ".mnt", NULL);
+      g_mkdir (self->container_access, 0700);
+
+      self->container_access_adverb = flatpak_bwrap_new (NULL);
+      flatpak_bwrap_add_args (self->container_access_adverb,
+                              self->bubblewrap,
+                              "--ro-bind", "/", "/",
+                              NULL);
+
+      /* So that capsule-capture-libs can update LIBCAPSULE_CMP_CACHE */
+      if (self->variable_dir != NULL)
+        flatpak_bwrap_add_args (self->container_access_adverb,
+                                "--bind", self->variable_dir,
+                                self->variable_dir,
+                                NULL);
+
+      flatpak_bwrap_add_args (self->container_access_adverb,
+                              "--bind", self->overrides, self->overrides,
+                              "--tmpfs", self->container_access,
+                              NULL);
+
+      if (!pv_bwrap_overlay_usr (self->container_access_adverb,
+                                 lower_on_host,
+                                 self->runtime_files_on_host,
+                                 self->runtime_files,
+                                 self->container_access,
+                                 error))
+        return FALSE;
+    }
+  else if (!self->runtime_is_just_usr)
     {
       static const char * const need_top_level[] =
       {
@@ -2053,6 +3326,16 @@ pv_runtime_provide_container_access (PvRuntime *self,
       flatpak_bwrap_add_args (self->container_access_adverb,
                               self->bubblewrap,
                               "--ro-bind", "/", "/",
+                              NULL);
+
+      /* So that capsule-capture-libs can update LIBCAPSULE_CMP_CACHE */
+      if (self->variable_dir != NULL)
+        flatpak_bwrap_add_args (self->container_access_adverb,
+                                "--bind", self->variable_dir,
+                                self->variable_dir,
+                                NULL);
+
+      flatpak_bwrap_add_args (self->container_access_adverb,
                               "--bind", self->overrides, self->overrides,
                               "--tmpfs", self->container_access,
                               NULL);
@@ -2127,6 +3410,15 @@ pv_runtime_get_capsule_capture_libs (PvRuntime *self,
                             "--library-knowledge", self->libcapsule_knowledge,
                             NULL);
 
+  if (self->variable_dir != NULL)
+    {
+      g_autofree gchar *cmp_cache = g_build_filename (self->variable_dir,
+                                                      LIBCAPSULE_CMP_CACHE,
+                                                      NULL);
+
+      flatpak_bwrap_add_args (ret, "--library-cmp-cache", cmp_cache, NULL);
+    }
+
   return ret;
 }
 
@@ -2517,8 +3809,21 @@ bind_runtime_base (PvRuntime *self,
   g_return_val_if_fail (container_env != NULL, FALSE);
   g_return_val_if_fail (error == NULL || *error == NULL, FALSE);
 
-  if (!pv_bwrap_bind_usr (bwrap, self->runtime_files_on_host, self->runtime_files, "/", error))
-    return FALSE;
+  if (self->overlay_lower != NULL)
+    {
+      g_autofree gchar *lower_on_host = NULL;
+
+      lower_on_host = pv_current_namespace_path_to_host_path (self->overlay_lower);
+
+      if (!pv_bwrap_overlay_usr (bwrap, lower_on_host,
+                                 self->runtime_files_on_host,
+                                 self->runtime_files, "/", error))
+        return FALSE;
+    }
+  else if (!pv_bwrap_bind_usr (bwrap, self->runtime_files_on_host, self->runtime_files, "/", error))
+    {
+      return FALSE;
+    }
 
   /* In the case where we have a mutable sysroot, we mount the overrides
    * as part of /usr. Make /overrides a symbolic link, to be nice to
@@ -3513,6 +4818,16 @@ pv_runtime_remove_overridden_libraries (PvRuntime *self,
                          name, local_error->message);
               g_clear_error (&local_error);
             }
+          /* Hide the original in the lower layer, too */
+          else if (self->overlay_lower != NULL
+                   && TEMP_FAILURE_RETRY (mknodat (iters[i].fd, name,
+                                                   S_IFCHR | 0000,
+                                                   makedev (0, 0))) != 0)
+            {
+              g_warning ("Unable to create overlayfs whiteout %s/%s/%s: %s",
+                         self->mutable_sysroot, libdir,
+                         name, g_strerror (errno));
+            }
         }
     }
 
@@ -5782,6 +7097,8 @@ pv_runtime_get_modified_usr (PvRuntime *self)
 {
   g_return_val_if_fail (PV_IS_RUNTIME (self), NULL);
   g_return_val_if_fail (self->mutable_sysroot != NULL, NULL);
+  /* An overlay is only half of the modified /usr */
+  g_return_val_if_fail (self->overlay_lower == NULL, NULL);
   return self->runtime_usr;
 }
 
@@ -22,7 +22,8 @@
 
 #include "tree-copy.h"
 
-#include <ftw.h>
+#include <dirent.h>
+#include <sys/stat.h>
 
 #include <glib.h>
 #include <glib/gstdio.h>
@@ -61,272 +62,534 @@ gets_usrmerged (const char *path)
   return FALSE;
 }
 
-/* nftw() doesn't have a user_data argument so we need to use a global
- * variable :-( */
-static struct
+/*
+ * State shared between all the threads taking part in one call to
+ * pv_cheap_tree_copy().
+ */
+typedef struct
 {
   gchar *source_root;
   gchar *dest_root;
+  int source_root_fd;
+  int dest_root_fd;
   PvCopyFlags flags;
+
+  /* Worker threads, or NULL if we could not create a thread pool.
+   * Each item pushed to the pool is a token asking a thread to take
+   * one directory from @queue. */
+  GThreadPool *pool;
+
+  GMutex mutex;
+  /* Signalled when a directory is queued or @pending reaches 0 */
+  GCond cond;
+  /* Directories waiting to be copied: protected by @mutex */
+  GQueue *queue;
+  /* Number of directories queued or in progress: protected by @mutex */
+  guint pending;
+  /* The first error encountered, if any: protected by @mutex */
   GError *error;
-} nftw_data;
+  /* Nonzero if @error has been set: accessed atomically */
+  gint failed;
+} CopyTreeData;
 
-static int
-copy_tree_helper (const char *fpath,
-                  const struct stat *sb,
-                  int typeflag,
-                  struct FTW *ftwbuf)
+/*
+ * Return the path corresponding to @suffix in the copy, which is
+ * different if it gets moved into /usr.
+ */
+static gchar *
+copy_tree_dest_rel (const CopyTreeData *data,
+                    const char *suffix,
+                    gboolean *usrmerge_out)
 {
-  size_t len;
-  const char *suffix;
-  g_autofree gchar *dest = NULL;
+  gboolean usrmerge = FALSE;
+  gchar *ret;
+
+  if ((data->flags & PV_COPY_FLAGS_USRMERGE) != 0 &&
+      gets_usrmerged (suffix))
+    {
+      trace ("Transforming to \"usr/%s\" for /usr merge", suffix);
+      usrmerge = TRUE;
+      /* usr/foo/bar */
+      ret = g_build_filename ("usr", suffix, NULL);
+    }
+  else
+    {
+      /* foo/bar */
+      ret = g_strdup (suffix);
+    }
+
+  if (usrmerge_out != NULL)
+    *usrmerge_out = usrmerge;
+
+  return ret;
+}
+
+static gboolean
+copy_tree_failed (CopyTreeData *data)
+{
+  return g_atomic_int_get (&data->failed) != 0;
+}
+
+/*
+ * Queue the directory @suffix (relative to the source root) to be
+ * copied by a worker thread or by the thread that called
+ * pv_cheap_tree_copy().
+ */
+static void
+copy_tree_queue_dir (CopyTreeData *data,
+                     const char *suffix)
+{
+  g_autoptr(GError) local_error = NULL;
+
+  g_mutex_lock (&data->mutex);
+  data->pending++;
+  g_queue_push_tail (data->queue, g_strdup (suffix));
+  g_cond_broadcast (&data->cond);
+  g_mutex_unlock (&data->mutex);
+
+  /* If this fails, the directory is still in our own queue, and will
+   * be picked up by a thread that did start, or by the main thread
+   * if no threads could be started at all */
+  if (data->pool != NULL
+      && !g_thread_pool_push (data->pool, GINT_TO_POINTER (1), &local_error))
+    g_debug ("Unable to start another thread: %s", local_error->message);
+}
+
+/*
+ * Copy one item from the source tree.
+ *
+ * @suffix: Path relative to the source root, for example foo/bar
+ * @source_dir_fd: The directory containing @suffix in the source
+ * @dest_parent_fd: The directory that will contain it in the destination
+ * @name: The basename of @suffix
+ * @sb: The result of lstat() on @suffix
+ */
+static gboolean
+copy_tree_entry (CopyTreeData *data,
+                 const char *suffix,
+                 int source_dir_fd,
+                 int dest_parent_fd,
+                 const char *name,
+                 const struct stat *sb,
+                 GError **error)
+{
+  g_autofree gchar *dest_rel = NULL;
   g_autofree gchar *target = NULL;
-  GError **error = &nftw_data.error;
   gboolean usrmerge;
 
-  g_return_val_if_fail (g_str_has_prefix (fpath, nftw_data.source_root), 1);
+  trace ("\"%s/%s\": suffix=\"%s\"", data->source_root, suffix, suffix);
+
+  /* If source_root was /path/to/source and the file was
+   * /path/to/source/foo/bar, then suffix is foo/bar. */
+  dest_rel = copy_tree_dest_rel (data, suffix, &usrmerge);
 
-  if (strcmp (fpath, nftw_data.source_root) == 0)
+  if (S_ISDIR (sb->st_mode))
     {
-      if (typeflag != FTW_D)
+      trace ("Is a directory");
+
+      /* If merging /usr, replace /bin, /sbin, /lib* with symlinks like
+       * /bin -> usr/bin */
+      if (usrmerge && strchr (suffix, '/') == NULL)
         {
-          glnx_throw (error, "\"%s\" is not a directory", fpath);
-          return 1;
+          target = g_build_filename ("usr", suffix, NULL);
+
+          if (TEMP_FAILURE_RETRY (symlinkat (target, data->dest_root_fd,
+                                             suffix)) != 0)
+            return glnx_throw_errno_prefix (error,
+                                            "Unable to create symlink \"%s/%s\" -> \"%s\"",
+                                            data->dest_root, dest_rel,
+                                            target);
+
+          /* Fall through to create usr/bin or similar too */
         }
 
-      if (!glnx_shutil_mkdir_p_at (-1, nftw_data.dest_root,
+      if (!glnx_shutil_mkdir_p_at (data->dest_root_fd, dest_rel,
                                    sb->st_mode & 07777, NULL, error))
-        return 1;
+        return FALSE;
 
-      return 0;
+      copy_tree_queue_dir (data, suffix);
+      return TRUE;
     }
 
-  len = strlen (nftw_data.source_root);
-  g_return_val_if_fail (fpath[len] == '/', 1);
-  suffix = &fpath[len + 1];
+  if (S_ISLNK (sb->st_mode))
+    {
+      target = glnx_readlinkat_malloc (source_dir_fd, name, NULL, error);
 
-  while (suffix[0] == '/')
-    suffix++;
+      if (target == NULL)
+        return FALSE;
 
-  trace ("\"%s\": suffix=\"%s\"", fpath, suffix);
+      trace ("Is a symlink to \"%s\"", target);
 
-  /* If source_root was /path/to/source and fpath was /path/to/source/foo/bar,
-   * then suffix is now foo/bar. */
+      if (usrmerge)
+        {
+          trace ("Checking for compat symlinks into /usr");
+
+          /* Ignore absolute compat symlinks /lib/foo -> /usr/lib/foo.
+           * In this case suffix would be lib/foo. (In a Debian-based
+           * source root, Debian Policy §10.5 says this is the only
+           * form of compat symlink that should exist in this
+           * direction.) */
+          if (g_str_has_prefix (target, "/usr/") &&
+              strcmp (target + 5, suffix) == 0)
+            {
+              trace ("Ignoring compat symlink \"%s\" -> \"%s\"",
+                     suffix, target);
+              return TRUE;
+            }
+
+          /* Ignore relative compat symlinks /lib/foo -> ../usr/lib/foo. */
+          if (target[0] != '/')
+            {
+              g_autofree gchar *dir = g_path_get_dirname (suffix);
+              g_autofree gchar *joined = NULL;
+              g_autofree gchar *canon = NULL;
+
+              joined = g_build_filename (dir, target, NULL);
+              trace ("Joined: \"%s\"", joined);
+              canon = g_canonicalize_filename (joined, "/");
+              trace ("Canonicalized: \"%s\"", canon);
+
+              if (g_str_has_prefix (canon, "/usr/") &&
+                  strcmp (canon + 5, suffix) == 0)
+                {
+                  trace ("Ignoring compat symlink \"%s\" -> \"%s\"",
+                         suffix, target);
+                  return TRUE;
+                }
+            }
+        }
 
-  if ((nftw_data.flags & PV_COPY_FLAGS_USRMERGE) != 0 &&
-      gets_usrmerged (suffix))
-    {
-      trace ("Transforming to \"usr/%s\" for /usr merge", suffix);
-      usrmerge = TRUE;
-      /* /path/to/dest/usr/foo/bar */
-      dest = g_build_filename (nftw_data.dest_root, "usr", suffix, NULL);
+      if ((data->flags & PV_COPY_FLAGS_USRMERGE) != 0 &&
+           g_str_has_prefix (suffix, "usr/") &&
+           gets_usrmerged (suffix + 4))
+        {
+          trace ("Checking for compat symlinks out of /usr");
+
+          /* Ignore absolute compat symlinks /usr/lib/foo -> /lib/foo.
+           * In this case suffix would be usr/lib/foo. (In a Debian-based
+           * source root, Debian Policy §10.5 says this is the only
+           * form of compat symlink that should exist in this
+           * direction.) */
+          if (strcmp (suffix + 3, target) == 0)
+            {
+              trace ("Ignoring compat symlink \"%s\" -> \"%s\"",
+                     suffix, target);
+              return TRUE;
+            }
+
+          /* Ignore relative compat symlinks
+           * /usr/lib/foo -> ../../lib/foo. */
+          if (target[0] != '/')
+            {
+              g_autofree gchar *dir = g_path_get_dirname (suffix);
+              g_autofree gchar *joined = NULL;
+              g_autofree gchar *canon = NULL;
+
+              joined = g_build_filename (dir, target, NULL);
+              trace ("Joined: \"%s\"", joined);
+              canon = g_canonicalize_filename (joined, "/");
+              trace ("Canonicalized: \"%s\"", canon);
+              g_assert (canon[0] == '/');
+
+              if (strcmp (suffix + 3, canon) == 0)
+                {
+                  trace ("Ignoring compat symlink \"%s\" -> \"%s\"",
+                         suffix, target);
+                  return TRUE;
+                }
+            }
+        }
+
+      if (TEMP_FAILURE_RETRY (symlinkat (target, dest_parent_fd, name)) != 0)
+        return glnx_throw_errno_prefix (error,
+                                        "Unable to create symlink \"%s/%s\" -> \"%s\"",
+                                        data->dest_root, dest_rel, target);
+
+      return TRUE;
     }
+
+  /* Anything else is treated like a regular file, as nftw() used to */
+  trace ("Is a regular file");
+
+  /* Fast path: try to make a hard link. */
+  if (linkat (source_dir_fd, name, dest_parent_fd, name, 0) == 0)
+    return TRUE;
+
+  /* Slow path: fall back to copying.
+   *
+   * This does a FICLONE or copy_file_range to get btrfs reflinks
+   * if possible, making the copy as cheap as cp --reflink=auto.
+   *
+   * Rather than second-guessing which errno values would result
+   * in link() failing but a copy succeeding, we just try it
+   * unconditionally - the worst that can happen is that this
+   * fails too. */
+  if (!glnx_file_copy_at (source_dir_fd, name, sb,
+                          dest_parent_fd, name,
+                          GLNX_FILE_COPY_OVERWRITE | GLNX_FILE_COPY_NOCHOWN,
+                          NULL, error))
+    return glnx_prefix_error (error, "Unable to copy \"%s/%s\" to \"%s/%s\"",
+                              data->source_root, suffix,
+                              data->dest_root, dest_rel);
+
+  return TRUE;
+}
+
+/*
+ * Copy the contents of the directory @suffix, which has already been
+ * created in the destination, queueing its subdirectories for other
+ * threads to copy.
+ */
+static gboolean
+copy_tree_dir (CopyTreeData *data,
+               const char *suffix,
+               GError **error)
+{
+  g_auto(GLnxDirFdIterator) iter = { FALSE };
+  glnx_autofd int dest_fd = -1;
+  glnx_autofd int usr_fd = -1;
+  g_autofree gchar *dest_rel = NULL;
+  gboolean top_level = (suffix[0] == '\0');
+
+  if (!glnx_dirfd_iterator_init_at (data->source_root_fd,
+                                    top_level ? "." : suffix,
+                                    FALSE, &iter, error))
+    return glnx_prefix_error (error, "Unable to open \"%s/%s\"",
+                              data->source_root, suffix);
+
+  if (top_level)
+    dest_rel = g_strdup (".");
   else
-    {
-      usrmerge = FALSE;
-      /* /path/to/dest/foo/bar */
-      dest = g_build_filename (nftw_data.dest_root, suffix, NULL);
-    }
+    dest_rel = copy_tree_dest_rel (data, suffix, NULL);
 
-  switch (typeflag)
+  if (!glnx_opendirat (data->dest_root_fd, dest_rel, TRUE, &dest_fd, error))
+    return glnx_prefix_error (error, "Unable to open \"%s/%s\"",
+                              data->dest_root, dest_rel);
+
+  while (TRUE)
     {
-      case FTW_D:
-      trace ("Is a directory");
+      g_autofree gchar *child = NULL;
+      struct dirent *dent;
+      struct stat sb;
+      int dest_parent_fd = dest_fd;
 
-        /* If merging /usr, replace /bin, /sbin, /lib* with symlinks like
-         * /bin -> usr/bin */
-        if (usrmerge && strchr (suffix, '/') == NULL)
-          {
-            /* /path/to/dest/bin or similar */
-            g_autofree gchar *in_root = g_build_filename (nftw_data.dest_root,
-                                                          suffix, NULL);
-
-            target = g_build_filename ("usr", suffix, NULL);
-
-            if (TEMP_FAILURE_RETRY (symlink (target, in_root)) != 0)
-              {
-                glnx_throw_errno_prefix (error,
-                                         "Unable to create symlink \"%s\" -> \"%s\"",
-                                         dest, target);
-                return 1;
-              }
-
-            /* Fall through to create usr/bin or similar too */
-          }
-
-        if (!glnx_shutil_mkdir_p_at (-1, dest, sb->st_mode & 07777,
-                                     NULL, error))
-          return 1;
-        break;
+      if (!glnx_dirfd_iterator_next_dent (&iter, &dent, NULL, error))
+        return glnx_prefix_error (error, "Unable to read \"%s/%s\"",
+                                  data->source_root, suffix);
 
-      case FTW_SL:
-        target = glnx_readlinkat_malloc (-1, fpath, NULL, error);
-
-        if (target == NULL)
-          return 1;
-
-        trace ("Is a symlink to \"%s\"", target);
-
-        if (usrmerge)
-          {
-            trace ("Checking for compat symlinks into /usr");
-
-            /* Ignore absolute compat symlinks /lib/foo -> /usr/lib/foo.
-             * In this case suffix would be lib/foo. (In a Debian-based
-             * source root, Debian Policy §10.5 says this is the only
-             * form of compat symlink that should exist in this
-             * direction.) */
-            if (g_str_has_prefix (target, "/usr/") &&
-                strcmp (target + 5, suffix) == 0)
-              {
-                trace ("Ignoring compat symlink \"%s\" -> \"%s\"",
-                       fpath, target);
-                return 0;
-              }
-
-            /* Ignore relative compat symlinks /lib/foo -> ../usr/lib/foo. */
-            if (target[0] != '/')
-              {
-                g_autofree gchar *dir = g_path_get_dirname (suffix);
-                g_autofree gchar *joined = NULL;
-                g_autofree gchar *canon = NULL;
-
-                joined = g_build_filename (dir, target, NULL);
-                trace ("Joined: \"%s\"", joined);
-                canon = g_canonicalize_filename (joined, "/");
-                trace ("Canonicalized: \"%s\"", canon);
-
-                if (g_str_has_prefix (canon, "/usr/") &&
-                    strcmp (canon + 5, suffix) == 0)
-                  {
-                    trace ("Ignoring compat symlink \"%s\" -> \"%s\"",
-                           fpath, target);
-                    return 0;
-                  }
-              }
-          }
-
-        if ((nftw_data.flags & PV_COPY_FLAGS_USRMERGE) != 0 &&
-             g_str_has_prefix (suffix, "usr/") &&
-             gets_usrmerged (suffix + 4))
-          {
-            trace ("Checking for compat symlinks out of /usr");
-
-            /* Ignore absolute compat symlinks /usr/lib/foo -> /lib/foo.
-             * In this case suffix would be usr/lib/foo. (In a Debian-based
-             * source root, Debian Policy §10.5 says this is the only
-             * form of compat symlink that should exist in this
-             * direction.) */
-            if (strcmp (suffix + 3, target) == 0)
-              {
-                trace ("Ignoring compat symlink \"%s\" -> \"%s\"",
-                       fpath, target);
-                return 0;
-              }
-
-            /* Ignore relative compat symlinks
-             * /usr/lib/foo -> ../../lib/foo. */
-            if (target[0] != '/')
-              {
-                g_autofree gchar *dir = g_path_get_dirname (suffix);
-                g_autofree gchar *joined = NULL;
-                g_autofree gchar *canon = NULL;
-
-                joined = g_build_filename (dir, target, NULL);
-                trace ("Joined: \"%s\"", joined);
-                canon = g_canonicalize_filename (joined, "/");
-                trace ("Canonicalized: \"%s\"", canon);
-                g_assert (canon[0] == '/');
-
-                if (strcmp (suffix + 3, canon) == 0)
-                  {
-                    trace ("Ignoring compat symlink \"%s\" -> \"%s\"",
-                           fpath, target);
-                    return 0;
-                  }
-              }
-          }
-
-        if (TEMP_FAILURE_RETRY (symlink (target, dest)) != 0)
-          {
-            glnx_throw_errno_prefix (error,
-                                     "Unable to create symlink \"%s\" -> \"%s\"",
-                                     dest, target);
-            return 1;
-          }
+      if (dent == NULL)
         break;
 
-      case FTW_F:
-        trace ("Is a regular file");
-
-        /* Fast path: try to make a hard link. */
-        if (link (fpath, dest) == 0)
-          break;
-
-        /* Slow path: fall back to copying.
-         *
-         * This does a FICLONE or copy_file_range to get btrfs reflinks
-         * if possible, making the copy as cheap as cp --reflink=auto.
-         *
-         * Rather than second-guessing which errno values would result
-         * in link() failing but a copy succeeding, we just try it
-         * unconditionally - the worst that can happen is that this
-         * fails too. */
-        if (!glnx_file_copy_at (AT_FDCWD, fpath, sb,
-                                AT_FDCWD, dest,
-                                GLNX_FILE_COPY_OVERWRITE | GLNX_FILE_COPY_NOCHOWN,
-                                NULL, error))
-          {
-            glnx_prefix_error (error, "Unable to copy \"%s\" to \"%s\"",
-                               fpath, dest);
-            return 1;
-          }
-        break;
+      if (top_level)
+        child = g_strdup (dent->d_name);
+      else
+        child = g_build_filename (suffix, dent->d_name, NULL);
+
+      if (!glnx_fstatat (iter.fd, dent->d_name, &sb, AT_SYMLINK_NOFOLLOW,
+                         error))
+        return glnx_prefix_error (error, "Unable to stat \"%s/%s\"",
+                                  data->source_root, child);
+
+      /* Only top-level items can move into a different directory
+       * when merging /usr: anything below them moves with them */
+      if (top_level
+          && (data->flags & PV_COPY_FLAGS_USRMERGE) != 0
+          && gets_usrmerged (child))
+        {
+          if (usr_fd < 0
+              && (!glnx_shutil_mkdir_p_at (data->dest_root_fd, "usr", 0755,
+                                           NULL, error)
+                  || !glnx_opendirat (data->dest_root_fd, "usr", TRUE,
+                                      &usr_fd, error)))
+            return FALSE;
+
+          dest_parent_fd = usr_fd;
+        }
+
+      if (!copy_tree_entry (data, child, iter.fd, dest_parent_fd,
+                            dent->d_name, &sb, error))
+        return FALSE;
+
+      /* Stop early if another thread has already failed */
+      if (copy_tree_failed (data))
+        return TRUE;
+    }
+
+  return TRUE;
+}
+
+/*
+ * Copy the directory @suffix, which was taken from the queue.
+ * Called in a worker thread or in the main thread.
+ */
+static void
+copy_tree_process (CopyTreeData *data,
+                   gchar *suffix)
+{
+  g_autoptr(GError) local_error = NULL;
+
+  if (!copy_tree_failed (data))
+    copy_tree_dir (data, suffix, &local_error);
 
-      default:
-        glnx_throw (&nftw_data.error,
-                    "Don't know how to handle ftw type flag %d at %s",
-                    typeflag, fpath);
-        return 1;
+  g_mutex_lock (&data->mutex);
+
+  if (local_error != NULL && data->error == NULL)
+    {
+      data->error = g_steal_pointer (&local_error);
+      g_atomic_int_set (&data->failed, 1);
     }
 
-  return 0;
+  g_assert (data->pending > 0);
+  data->pending--;
+
+  if (data->pending == 0)
+    g_cond_broadcast (&data->cond);
+
+  g_mutex_unlock (&data->mutex);
+  g_free (suffix);
+}
+
+/*
+ * Called in a worker thread for each token pushed to the pool.
+ * The main thread might already have taken the corresponding
+ * directory, in which case there is nothing to do.
+ */
+static void
+copy_tree_worker (gpointer item G_GNUC_UNUSED,
+                  gpointer user_data)
+{
+  CopyTreeData *data = user_data;
+  gchar *suffix;
+
+  g_mutex_lock (&data->mutex);
+  suffix = g_queue_pop_head (data->queue);
+  g_mutex_unlock (&data->mutex);
+
+  if (suffix != NULL)
+    copy_tree_process (data, suffix);
 }
 
+/*
+ * pv_cheap_tree_copy:
+ * @source_root: (type filename): A directory
+ * @dest_root: (type filename): A directory to create, or an existing
+ *  empty directory
+ * @flags: Flags affecting how the copy is done
+ *
+ * Copy @source_root to @dest_root, using hard links where possible
+ * and reflinks or copies otherwise.
+ *
+ * Each subdirectory is copied as a separate job by a pool of worker
+ * threads and the calling thread, so the order in which items are created is not defined,
+ * except that each directory is created before its contents.
+ *
+ * Returns: %TRUE on success
+ */
 gboolean
 pv_cheap_tree_copy (const char *source_root,
                     const char *dest_root,
                     PvCopyFlags flags,
                     GError **error)
 {
-  int res;
+  g_autoptr(GError) local_error = NULL;
+  CopyTreeData data = { NULL };
+  struct stat sb;
+  gboolean ret = FALSE;
 
   g_return_val_if_fail (source_root != NULL, FALSE);
   g_return_val_if_fail (dest_root != NULL, FALSE);
   g_return_val_if_fail (error == NULL || *error == NULL, FALSE);
-  /* Can't run concurrently */
-  g_return_val_if_fail (nftw_data.source_root == NULL, FALSE);
 
-  nftw_data.source_root = flatpak_canonicalize_filename (source_root);
-  nftw_data.dest_root = flatpak_canonicalize_filename (dest_root);
-  nftw_data.flags = flags;
-  nftw_data.error = NULL;
+  data.source_root = flatpak_canonicalize_filename (source_root);
+  data.dest_root = flatpak_canonicalize_filename (dest_root);
+  data.source_root_fd = -1;
+  data.dest_root_fd = -1;
+  data.flags = flags;
+  g_mutex_init (&data.mutex);
+  g_cond_init (&data.cond);
+
+  if (!glnx_fstatat (AT_FDCWD, data.source_root, &sb, AT_SYMLINK_NOFOLLOW,
+                     error))
+    {
+      g_prefix_error (error, "Unable to copy \"%s\" to \"%s\": ",
+                      source_root, dest_root);
+      goto out;
+    }
+
+  if (!S_ISDIR (sb.st_mode))
+    {
+      glnx_throw (error, "\"%s\" is not a directory", data.source_root);
+      goto out;
+    }
+
+  if (!glnx_opendirat (AT_FDCWD, data.source_root, FALSE,
+                       &data.source_root_fd, error))
+    goto out;
+
+  if (!glnx_shutil_mkdir_p_at (-1, data.dest_root, sb.st_mode & 07777,
+                               NULL, error))
+    goto out;
+
+  if (!glnx_opendirat (AT_FDCWD, data.dest_root, TRUE,
+                       &data.dest_root_fd, error))
+    goto out;
+
+  data.queue = g_queue_new ();
+  data.pool = g_thread_pool_new (copy_tree_worker, &data,
+                                 g_get_num_processors (), FALSE,
+                                 &local_error);
 
-  res = nftw (nftw_data.source_root, copy_tree_helper, 100, FTW_PHYS);
+  if (data.pool == NULL)
+    {
+      g_debug ("Unable to create thread pool: %s", local_error->message);
+      g_clear_error (&local_error);
+    }
+
+  copy_tree_queue_dir (&data, "");
+
+  /* Take part in the copy ourselves, so that it finishes even if
+   * g_thread_pool_push() could not start any threads */
+  g_mutex_lock (&data.mutex);
 
-  if (res == -1)
+  while (data.pending > 0)
     {
-      g_assert (nftw_data.error == NULL);
-      glnx_throw_errno_prefix (error, "Unable to copy \"%s\" to \"%s\"",
-                               source_root, dest_root);
+      gchar *suffix = g_queue_pop_head (data.queue);
+
+      if (suffix != NULL)
+        {
+          g_mutex_unlock (&data.mutex);
+          copy_tree_process (&data, suffix);
+          g_mutex_lock (&data.mutex);
+        }
+      else
+        {
+          g_cond_wait (&data.cond, &data.mutex);
+        }
     }
-  else if (res != 0)
+
+  g_mutex_unlock (&data.mutex);
+
+  /* Every directory has been copied, so any tokens that are still
+   * queued have nothing left to do */
+  if (data.pool != NULL)
+    g_thread_pool_free (data.pool, TRUE, TRUE);
+
+  g_queue_free (data.queue);
+
+  if (data.error != NULL)
     {
-      g_propagate_error (error, g_steal_pointer (&nftw_data.error));
+      g_propagate_error (error, g_steal_pointer (&data.error));
+      goto out;
     }
 
-  g_clear_pointer (&nftw_data.source_root, g_free);
-  g_clear_pointer (&nftw_data.dest_root, g_free);
-  g_assert (nftw_data.error == NULL);
-  return (res == 0);
+  ret = TRUE;
+
+out:
+  glnx_close_fd (&data.source_root_fd);
+  glnx_close_fd (&data.dest_root_fd);
+  g_clear_pointer (&data.source_root, g_free);
+  g_clear_pointer (&data.dest_root, g_free);
+  g_mutex_clear (&data.mutex);
+  g_cond_clear (&data.cond);
+  return ret;
 }
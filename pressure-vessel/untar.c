@@ -0,0 +1,1446 @@
+/*
+ * Copyright © 2026 Collabora Ltd.
+ * SPDX-License-Identifier: MIT
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include "untar.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+#include <gio/gio.h>
+#include <gio/gunixinputstream.h>
+
+#ifdef HAVE_LIBZSTD
+#include <zstd.h>
+#endif
+
+#include "steam-runtime-tools/profiling-internal.h"
+#include "dirfd-cache.h"
+
+/* Enabling debug logging for this is rather too verbose, so only
+ * enable it when actively debugging this module */
+#if 0
+#define trace(...) g_debug (__VA_ARGS__)
+#else
+#define trace(...) do { } while (0)
+#endif
+
+#define TAR_BLOCK_SIZE 512
+
+/* Files up to this size are read into memory, then written by a
+ * worker thread while we carry on decompressing the next member.
+ * Larger files are written by the main thread as they are read. */
+#define UNTAR_MAX_BUFFERED_FILE (4 * 1024 * 1024)
+
+/* Maximum total size of buffered files waiting to be written */
+#define UNTAR_MAX_IN_FLIGHT (64 * 1024 * 1024)
+
+/* Maximum number of buffered files waiting to be written, each of which
+ * can hold up to three file descriptors */
+#define UNTAR_MAX_PENDING 128
+
+/* Size of chunks used when streaming or skipping file contents */
+#define UNTAR_CHUNK_SIZE (256 * 1024)
+
+static const guint8 gzip_magic[] = { 0x1f, 0x8b };
+static const guint8 zstd_magic[] = { 0x28, 0xb5, 0x2f, 0xfd };
+
+/*
+ * A source of uncompressed tar data.
+ */
+typedef struct
+{
+  /* Uncompressed data, or zstd-compressed data if zstd != NULL */
+  GInputStream *stream;
+#ifdef HAVE_LIBZSTD
+  ZSTD_DStream *zstd;
+  guint8 *zstd_buf;
+  gsize zstd_buf_size;
+  ZSTD_inBuffer zstd_in;
+#endif
+} UntarReader;
+
+static void
+untar_reader_clear (UntarReader *reader)
+{
+  g_clear_object (&reader->stream);
+#ifdef HAVE_LIBZSTD
+  g_clear_pointer (&reader->zstd, ZSTD_freeDStream);
+  g_clear_pointer (&reader->zstd_buf, g_free);
+#endif
+}
+
+G_DEFINE_AUTO_CLEANUP_CLEAR_FUNC (UntarReader, untar_reader_clear)
+
+/*
+ * Open @archive, which may be an uncompressed tar archive or compressed
+ * with gzip or (if supported) zstd.
+ *
+ * Returns: %FALSE with G_IO_ERROR_NOT_SUPPORTED if the format
+ *  is not supported
+ */
+static gboolean
+untar_reader_open (UntarReader *reader,
+                   const char *archive,
+                   GError **error)
+{
+  glnx_autofd int fd = -1;
+  guint8 header[TAR_BLOCK_SIZE] = { 0 };
+  gssize n;
+
+  if (!glnx_openat_rdonly (AT_FDCWD, archive, TRUE, &fd, error))
+    return FALSE;
+
+  n = TEMP_FAILURE_RETRY (pread (fd, header, sizeof (header), 0));
+
+  if (n < 0)
+    return glnx_throw_errno_prefix (error, "Unable to read \"%s\"", archive);
+
+  if (n >= (gssize) sizeof (gzip_magic)
+      && memcmp (header, gzip_magic, sizeof (gzip_magic)) == 0)
+    {
+      g_autoptr(GInputStream) raw = NULL;
+      g_autoptr(GZlibDecompressor) decompressor = NULL;
+
+      raw = g_unix_input_stream_new (glnx_steal_fd (&fd), TRUE);
+      decompressor = g_zlib_decompressor_new (G_ZLIB_COMPRESSOR_FORMAT_GZIP);
+      reader->stream = g_converter_input_stream_new (raw,
+                                                     G_CONVERTER (decompressor));
+      return TRUE;
+    }
+
+  if (n >= (gssize) sizeof (zstd_magic)
+      && memcmp (header, zstd_magic, sizeof (zstd_magic)) == 0)
+    {
+#ifdef HAVE_LIBZSTD
+      size_t ret;
+
+      reader->zstd = ZSTD_createDStream ();
+
+      if (reader->zstd == NULL)
+        return glnx_throw (error, "Unable to allocate zstd decompressor");
+
+      ret = ZSTD_initDStream (reader->zstd);
+
+      if (ZSTD_isError (ret))
+        return glnx_throw (error, "Unable to initialize zstd decompressor: %s",
+                           ZSTD_getErrorName (ret));
+
+      reader->zstd_buf_size = ZSTD_DStreamInSize ();
+      reader->zstd_buf = g_malloc (reader->zstd_buf_size);
+      reader->zstd_in.src = reader->zstd_buf;
+      reader->zstd_in.size = 0;
+      reader->zstd_in.pos = 0;
+      reader->stream = g_unix_input_stream_new (glnx_steal_fd (&fd), TRUE);
+      return TRUE;
+#else
+      g_set_error (error, G_IO_ERROR, G_IO_ERROR_NOT_SUPPORTED,
+                   "\"%s\" is compressed with zstd, but pressure-vessel "
+                   "was built without libzstd", archive);
+      return FALSE;
+#endif
+    }
+
+  if (n == sizeof (header) && memcmp (&header[257], "ustar", 5) == 0)
+    {
+      reader->stream = g_unix_input_stream_new (glnx_steal_fd (&fd), TRUE);
+      return TRUE;
+    }
+
+  g_set_error (error, G_IO_ERROR, G_IO_ERROR_NOT_SUPPORTED,
+               "\"%s\" is not in a supported archive format", archive);
+  return FALSE;
+}
+
+/*
+ * Read exactly @len bytes of uncompressed data.
+ */
+static gboolean
+untar_reader_read (UntarReader *reader,
+                   void *buf,
+                   gsize len,
+                   GError **error)
+{
+  gsize bytes_read = 0;
+
+#ifdef HAVE_LIBZSTD
+  if (reader->zstd != NULL)
+    {
+      ZSTD_outBuffer out = { buf, len, 0 };
+
+      while (out.pos < out.size)
+        {
+          size_t before = out.pos;
+          size_t ret;
+
+          ret = ZSTD_decompressStream (reader->zstd, &out, &reader->zstd_in);
+
+          if (ZSTD_isError (ret))
+            return glnx_throw (error, "Unable to decompress: %s",
+                               ZSTD_getErrorName (ret));
+
+          /* Only read more input when the decompressor has nothing
+           * more to give us from the input it already has */
+          if (out.pos == before
+              && reader->zstd_in.pos == reader->zstd_in.size)
+            {
+              gssize n = g_input_stream_read (reader->stream,
+                                              reader->zstd_buf,
+                                              reader->zstd_buf_size,
+                                              NULL, error);
+
+              if (n < 0)
+                return FALSE;
+
+              if (n == 0)
+                return glnx_throw (error, "Unexpected end of archive");
+
+              reader->zstd_in.size = n;
+              reader->zstd_in.pos = 0;
+            }
+        }
+
+      return TRUE;
+    }
+#endif
+
+  if (!g_input_stream_read_all (reader->stream, buf, len, &bytes_read,
+                                NULL, error))
+    return FALSE;
+
+  if (bytes_read < len)
+    return glnx_throw (error, "Unexpected end of archive");
+
+  return TRUE;
+}
+
+/*
+ * Read and discard @len bytes of uncompressed data.
+ */
+static gboolean
+untar_reader_skip (UntarReader *reader,
+                   guint64 len,
+                   GError **error)
+{
+  g_autofree guint8 *buf = NULL;
+
+  if (len == 0)
+    return TRUE;
+
+  buf = g_malloc (MIN (len, UNTAR_CHUNK_SIZE));
+
+  while (len > 0)
+    {
+      gsize chunk = MIN (len, UNTAR_CHUNK_SIZE);
+
+      if (!untar_reader_read (reader, buf, chunk, error))
+        return FALSE;
+
+      len -= chunk;
+    }
+
+  return TRUE;
+}
+
+static gsize
+tar_padding (guint64 size)
+{
+  return (TAR_BLOCK_SIZE - (size % TAR_BLOCK_SIZE)) % TAR_BLOCK_SIZE;
+}
+
+/*
+ * Parse a numeric field in a tar header, which is either octal
+ * or (as a GNU extension) big-endian base-256.
+ */
+static gboolean
+tar_parse_number (const char *field,
+                  gsize len,
+                  guint64 *out,
+                  GError **error)
+{
+  guint64 value = 0;
+  gsize i = 0;
+
+  if ((guint8) field[0] & 0x80)
+    {
+      if ((guint8) field[0] != 0x80)
+        return glnx_throw (error, "Unsupported number in tar header");
+
+      for (i = 1; i < len; i++)
+        {
+          if (value > (G_MAXUINT64 >> 8))
+            return glnx_throw (error, "Number in tar header is too large");
+
+          value = (value << 8) | (guint8) field[i];
+        }
+
+      *out = value;
+      return TRUE;
+    }
+
+  while (i < len && (field[i] == ' ' || field[i] == '\0'))
+    i++;
+
+  for (; i < len && field[i] >= '0' && field[i] <= '7'; i++)
+    {
+      if (value > (G_MAXUINT64 >> 3))
+        return glnx_throw (error, "Number in tar header is too large");
+
+      value = (value << 3) | (guint64) (field[i] - '0');
+    }
+
+  if (i < len && field[i] != ' ' && field[i] != '\0')
+    return glnx_throw (error, "Invalid number in tar header");
+
+  *out = value;
+  return TRUE;
+}
+
+static gboolean
+tar_header_checksum_ok (const guint8 *header)
+{
+  guint64 expected;
+  guint64 sum = 0;
+  gsize i;
+
+  if (!tar_parse_number ((const char *) &header[148], 8, &expected, NULL))
+    return FALSE;
+
+  for (i = 0; i < TAR_BLOCK_SIZE; i++)
+    {
+      if (i >= 148 && i < 156)
+        sum += ' ';
+      else
+        sum += header[i];
+    }
+
+  return sum == expected;
+}
+
+/*
+ * Return a copy of @path relative to the root of the archive, without
+ * leading "/" or "./", "." components or trailing slashes, or %NULL
+ * if it would escape from the destination directory.
+ */
+static gchar *
+tar_normalize_path (const char *path)
+{
+  g_auto(GStrv) components = g_strsplit (path, "/", -1);
+  g_autoptr(GString) ret = g_string_new ("");
+  gsize i;
+
+  for (i = 0; components[i] != NULL; i++)
+    {
+      if (components[i][0] == '\0' || strcmp (components[i], ".") == 0)
+        continue;
+
+      if (strcmp (components[i], "..") == 0)
+        return NULL;
+
+      if (ret->len > 0)
+        g_string_append_c (ret, '/');
+
+      g_string_append (ret, components[i]);
+    }
+
+  return g_string_free (g_steal_pointer (&ret), FALSE);
+}
+
+/*
+ * Metadata carried over from extended headers to the next member.
+ */
+typedef struct
+{
+  gchar *path;
+  gchar *linkpath;
+  gboolean have_size;
+  guint64 size;
+  gboolean have_mtime;
+  gint64 mtime;
+} TarOverrides;
+
+static void
+tar_overrides_clear (TarOverrides *self)
+{
+  g_clear_pointer (&self->path, g_free);
+  g_clear_pointer (&self->linkpath, g_free);
+  self->have_size = FALSE;
+  self->have_mtime = FALSE;
+}
+
+G_DEFINE_AUTO_CLEANUP_CLEAR_FUNC (TarOverrides, tar_overrides_clear)
+
+/*
+ * Parse the "LEN KEY=VALUE\n" records in a POSIX.1-2001 extended header.
+ */
+static gboolean
+tar_parse_pax (const char *data,
+               gsize len,
+               TarOverrides *overrides,
+               GError **error)
+{
+  gsize pos = 0;
+
+  while (pos < len)
+    {
+      const char *record = data + pos;
+      const char *key;
+      const char *equals;
+      const char *end;
+      guint64 record_len = 0;
+      gsize i;
+
+      for (i = 0; pos + i < len && g_ascii_isdigit (record[i]); i++)
+        {
+          record_len = record_len * 10 + (guint64) (record[i] - '0');
+
+          /* Stopping here also means record_len cannot overflow,
+           * because len is much less than G_MAXUINT64 / 10 */
+          if (record_len > len - pos)
+            return glnx_throw (error,
+                               "Invalid extended header in tar archive");
+        }
+
+      if (record_len <= i + 1
+          || pos + i >= len
+          || record[i] != ' '
+          || record[record_len - 1] != '\n')
+        return glnx_throw (error, "Invalid extended header in tar archive");
+
+      key = record + i + 1;
+      end = record + record_len - 1;
+      equals = memchr (key, '=', end - key);
+
+      if (equals == NULL)
+        return glnx_throw (error, "Invalid extended header in tar archive");
+
+      if (equals - key == 4 && strncmp (key, "path", 4) == 0)
+        {
+          g_free (overrides->path);
+          overrides->path = g_strndup (equals + 1, end - (equals + 1));
+        }
+      else if (equals - key == 8 && strncmp (key, "linkpath", 8) == 0)
+        {
+          g_free (overrides->linkpath);
+          overrides->linkpath = g_strndup (equals + 1, end - (equals + 1));
+        }
+      else if (equals - key == 4 && strncmp (key, "size", 4) == 0)
+        {
+          g_autofree gchar *value = g_strndup (equals + 1, end - (equals + 1));
+
+          overrides->size = g_ascii_strtoull (value, NULL, 10);
+          overrides->have_size = TRUE;
+        }
+      else if (equals - key == 5 && strncmp (key, "mtime", 5) == 0)
+        {
+          g_autofree gchar *value = g_strndup (equals + 1, end - (equals + 1));
+
+          /* Ignore the fractional part, if any */
+          overrides->mtime = g_ascii_strtoll (value, NULL, 10);
+          overrides->have_mtime = TRUE;
+        }
+
+      pos += record_len;
+    }
+
+  return TRUE;
+}
+
+typedef struct
+{
+  /* The file being written, or -1 if it is to be hard-linked from
+   * the reference copy if possible, and created otherwise */
+  int fd;
+  /* If @fd is -1, the directories containing the file in the
+   * destination and in the reference copy */
+  int parent_fd;
+  int reference_parent_fd;
+  gchar *base;
+  const char *expected_digest;
+  guint8 *data;
+  gsize size;
+  mode_t mode;
+  gint64 mtime;
+  gchar *path;
+} UntarWriteJob;
+
+static void
+untar_write_job_free (UntarWriteJob *job)
+{
+  glnx_close_fd (&job->fd);
+  glnx_close_fd (&job->parent_fd);
+  glnx_close_fd (&job->reference_parent_fd);
+  g_free (job->base);
+  g_free (job->data);
+  g_free (job->path);
+  g_slice_free (UntarWriteJob, job);
+}
+
+typedef struct
+{
+  gchar *path;
+  mode_t mode;
+  gint64 mtime;
+} UntarDirectory;
+
+static void
+untar_directory_clear (gpointer p)
+{
+  UntarDirectory *self = p;
+
+  g_free (self->path);
+}
+
+typedef struct
+{
+  const char *dest_path;
+  GHashTable *reference_digests;
+  /* Worker threads, or NULL if single-threaded. Each item pushed to
+   * the pool is a token asking a thread to take one job from @queue. */
+  GThreadPool *pool;
+  GMutex mutex;
+  /* Signalled when a job is queued or finished */
+  GCond cond;
+  /* Protected by mutex */
+  GQueue *queue;
+  /* Set of paths that will be hard-linked or created by a queued job */
+  GHashTable *deferred;
+  gsize in_flight;
+  guint pending;
+  GError *error;
+} UntarContext;
+
+/*
+ * Set the permissions and modification time of a file we have written.
+ */
+static gboolean
+untar_finish_fd (int fd,
+                 mode_t mode,
+                 gint64 mtime,
+                 const char *dest_path,
+                 const char *path,
+                 GError **error)
+{
+  const struct timespec times[2] =
+  {
+    { 0, UTIME_OMIT },
+    { (time_t) mtime, 0 },
+  };
+
+  if (TEMP_FAILURE_RETRY (fchmod (fd, mode)) != 0)
+    return glnx_throw_errno_prefix (error,
+                                    "Unable to set permissions of \"%s/%s\"",
+                                    dest_path, path);
+
+  if (TEMP_FAILURE_RETRY (futimens (fd, times)) != 0)
+    return glnx_throw_errno_prefix (error,
+                                    "Unable to set modification time of \"%s/%s\"",
+                                    dest_path, path);
+
+  return TRUE;
+}
+
+/*
+ * Evaluate @expr to create @name in @parent_fd. If it fails with EEXIST,
+ * delete the existing non-directory and try again, like tar(1) does.
+ */
+#define untar_replace(parent_fd, name, expr) \
+  ((expr) == 0 \
+   || (errno == EEXIST \
+       && unlinkat ((parent_fd), (name), 0) == 0 \
+       && (expr) == 0))
+
+/*
+ * Create an empty regular file, to be filled in by the caller.
+ */
+static int
+untar_create_file (int parent_fd,
+                   const char *name,
+                   const char *dest_path,
+                   const char *path,
+                   GError **error)
+{
+  int fd;
+
+  fd = TEMP_FAILURE_RETRY (openat (parent_fd, name,
+                                   (O_WRONLY | O_CREAT | O_EXCL
+                                    | O_CLOEXEC | O_NOCTTY),
+                                   0600));
+
+  if (fd < 0 && errno == EEXIST && unlinkat (parent_fd, name, 0) == 0)
+    fd = TEMP_FAILURE_RETRY (openat (parent_fd, name,
+                                     (O_WRONLY | O_CREAT | O_EXCL
+                                      | O_CLOEXEC | O_NOCTTY),
+                                     0600));
+
+  if (fd < 0)
+    glnx_throw_errno_prefix (error, "Unable to create \"%s/%s\"",
+                             dest_path, path);
+
+  return fd;
+}
+
+/*
+ * If @job describes a file that is identical to the file with the
+ * same name in the reference copy, hard-link it into place instead of
+ * writing a new copy. The caller has already checked that the size
+ * and permissions match.
+ *
+ * Returns: %TRUE if the file was linked
+ */
+static gboolean
+untar_try_link (const UntarWriteJob *job)
+{
+  g_autofree gchar *digest = NULL;
+
+  digest = g_compute_checksum_for_data (G_CHECKSUM_SHA256, job->data,
+                                        job->size);
+
+  if (g_ascii_strcasecmp (digest, job->expected_digest) != 0)
+    return FALSE;
+
+  if (!untar_replace (job->parent_fd, job->base,
+                      linkat (job->reference_parent_fd, job->base,
+                              job->parent_fd, job->base, 0)))
+    {
+      trace ("Unable to link \"%s\": %s", job->path, g_strerror (errno));
+      return FALSE;
+    }
+
+  trace ("Linked unchanged file \"%s\"", job->path);
+  return TRUE;
+}
+
+static gboolean
+untar_write_job_run (UntarWriteJob *job,
+                     const char *dest_path,
+                     GError **error)
+{
+  if (job->fd < 0)
+    {
+      if (untar_try_link (job))
+        return TRUE;
+
+      job->fd = untar_create_file (job->parent_fd, job->base, dest_path,
+                                   job->path, error);
+
+      if (job->fd < 0)
+        return FALSE;
+    }
+
+  if (glnx_loop_write (job->fd, job->data, job->size) < 0)
+    return glnx_throw_errno_prefix (error, "Unable to write \"%s/%s\"",
+                                    dest_path, job->path);
+
+  if (!untar_finish_fd (job->fd, job->mode, job->mtime,
+                        dest_path, job->path, error))
+    return FALSE;
+
+  if (!glnx_close_fd (&job->fd) && errno != EINTR)
+    return glnx_throw_errno_prefix (error, "Unable to close \"%s/%s\"",
+                                    dest_path, job->path);
+
+  return TRUE;
+}
+
+/*
+ * Write @job, which was taken from the queue, and free it.
+ * Called in a worker thread or in the main thread, without holding
+ * the mutex.
+ */
+static void
+untar_process_job (UntarContext *ctx,
+                   UntarWriteJob *job)
+{
+  g_autoptr(GError) local_error = NULL;
+  gboolean deferred = (job->fd < 0);
+
+  untar_write_job_run (job, ctx->dest_path, &local_error);
+
+  g_mutex_lock (&ctx->mutex);
+
+  if (local_error != NULL && ctx->error == NULL)
+    ctx->error = g_steal_pointer (&local_error);
+
+  if (deferred)
+    g_hash_table_remove (ctx->deferred, job->path);
+
+  ctx->in_flight -= job->size;
+  ctx->pending--;
+  g_cond_broadcast (&ctx->cond);
+  g_mutex_unlock (&ctx->mutex);
+
+  untar_write_job_free (job);
+}
+
+/*
+ * Called in a worker thread for each token pushed to the pool.
+ * The main thread might already have taken the corresponding job,
+ * in which case there is nothing to do.
+ */
+static void
+untar_worker (gpointer item G_GNUC_UNUSED,
+              gpointer user_data)
+{
+  UntarContext *ctx = user_data;
+  UntarWriteJob *job;
+
+  g_mutex_lock (&ctx->mutex);
+  job = g_queue_pop_head (ctx->queue);
+  g_mutex_unlock (&ctx->mutex);
+
+  if (job != NULL)
+    untar_process_job (ctx, job);
+}
+
+/*
+ * Wait for a job to finish, or take a queued job and write it ourselves
+ * if there is one, so that we make progress even if no worker thread
+ * could be started. Called with the mutex held.
+ */
+static void
+untar_wait_once (UntarContext *ctx)
+{
+  UntarWriteJob *job = g_queue_pop_head (ctx->queue);
+
+  if (job != NULL)
+    {
+      g_mutex_unlock (&ctx->mutex);
+      untar_process_job (ctx, job);
+      g_mutex_lock (&ctx->mutex);
+    }
+  else
+    {
+      g_cond_wait (&ctx->cond, &ctx->mutex);
+    }
+}
+
+/*
+ * Queue @job to be written by a worker thread, or write it immediately
+ * if we are single-threaded.
+ */
+static gboolean
+untar_queue_write (UntarContext *ctx,
+                   UntarWriteJob *job,
+                   GError **error)
+{
+  g_autoptr(GError) local_error = NULL;
+  gboolean ok = TRUE;
+
+  if (ctx->pool == NULL)
+    {
+      ok = untar_write_job_run (job, ctx->dest_path, error);
+      untar_write_job_free (job);
+      return ok;
+    }
+
+  g_mutex_lock (&ctx->mutex);
+
+  while (ctx->pending > 0
+         && (ctx->in_flight + job->size > UNTAR_MAX_IN_FLIGHT
+             || ctx->pending >= UNTAR_MAX_PENDING)
+         && ctx->error == NULL)
+    untar_wait_once (ctx);
+
+  if (ctx->error != NULL)
+    {
+      g_propagate_error (error, g_steal_pointer (&ctx->error));
+      ok = FALSE;
+    }
+  else
+    {
+      ctx->in_flight += job->size;
+      ctx->pending++;
+
+      if (job->fd < 0)
+        g_hash_table_add (ctx->deferred, g_strdup (job->path));
+
+      g_queue_push_tail (ctx->queue, job);
+      g_cond_broadcast (&ctx->cond);
+    }
+
+  g_mutex_unlock (&ctx->mutex);
+
+  if (!ok)
+    {
+      untar_write_job_free (job);
+      return FALSE;
+    }
+
+  /* If this fails, the job is still in our own queue, and will be
+   * picked up by a thread that did start, or by the main thread
+   * while it waits */
+  if (!g_thread_pool_push (ctx->pool, GINT_TO_POINTER (1), &local_error))
+    g_debug ("Unable to start another thread: %s", local_error->message);
+
+  return TRUE;
+}
+
+/*
+ * Wait until @path is no longer going to be created by a queued job,
+ * so that we can replace it or link to it.
+ */
+static void
+untar_wait_for_path (UntarContext *ctx,
+                     const char *path)
+{
+  if (ctx->pool == NULL)
+    return;
+
+  g_mutex_lock (&ctx->mutex);
+
+  while (g_hash_table_contains (ctx->deferred, path))
+    untar_wait_once (ctx);
+
+  g_mutex_unlock (&ctx->mutex);
+}
+
+/*
+ * Wait for all queued writes to finish, and report the first error.
+ */
+static gboolean
+untar_wait (UntarContext *ctx,
+            GError **error)
+{
+  gboolean ok = TRUE;
+
+  g_mutex_lock (&ctx->mutex);
+
+  while (ctx->pending > 0)
+    untar_wait_once (ctx);
+
+  if (ctx->error != NULL)
+    {
+      g_propagate_error (error, g_steal_pointer (&ctx->error));
+      ok = FALSE;
+    }
+
+  g_mutex_unlock (&ctx->mutex);
+  return ok;
+}
+
+/*
+ * If @job might be identical to the file at the same path in the
+ * reference copy, prepare it to be hard-linked from there by a worker
+ * thread. @parent_fd is the directory in the destination containing
+ * @parent/@base, and @references caches directories in the reference
+ * copy.
+ *
+ * Only the size and permissions are compared here, so that the
+ * contents can be hashed without blocking decompression.
+ *
+ * Returns: %TRUE if @job was set up to be linked
+ */
+static gboolean
+untar_prepare_link (const UntarContext *ctx,
+                    PvDirfdCache *references,
+                    UntarWriteJob *job,
+                    const char *parent,
+                    const char *base,
+                    int parent_fd)
+{
+  g_autoptr(GError) local_error = NULL;
+  struct stat stat_buf;
+  const char *expected;
+  int reference_parent_fd;
+
+  if (ctx->reference_digests == NULL)
+    return FALSE;
+
+  expected = g_hash_table_lookup (ctx->reference_digests, job->path);
+
+  if (expected == NULL)
+    return FALSE;
+
+  /* Symbolic links in the reference copy might point anywhere, so
+   * don't follow them, not even in ancestor directories */
+  reference_parent_fd = pv_dirfd_cache_resolve (references, parent,
+                                                SRT_RESOLVE_FLAGS_REJECT_SYMLINKS,
+                                                &local_error);
+
+  if (reference_parent_fd < 0)
+    {
+      trace ("Not linking \"%s\": %s", job->path, local_error->message);
+      return FALSE;
+    }
+
+  /* The link will share its permissions with the reference copy,
+   * so they must match */
+  if (fstatat (reference_parent_fd, base, &stat_buf,
+               AT_SYMLINK_NOFOLLOW) != 0
+      || !S_ISREG (stat_buf.st_mode)
+      || stat_buf.st_size != (off_t) job->size
+      || (stat_buf.st_mode & 0777) != job->mode)
+    return FALSE;
+
+  job->reference_parent_fd = fcntl (reference_parent_fd, F_DUPFD_CLOEXEC, 0);
+  job->parent_fd = fcntl (parent_fd, F_DUPFD_CLOEXEC, 0);
+
+  if (job->reference_parent_fd < 0 || job->parent_fd < 0)
+    {
+      glnx_close_fd (&job->reference_parent_fd);
+      glnx_close_fd (&job->parent_fd);
+      return FALSE;
+    }
+
+  job->base = g_strdup (base);
+  job->expected_digest = expected;
+  return TRUE;
+}
+
+/*
+ * Split @path into the directory that contains it and its basename.
+ */
+static const char *
+untar_split_path (const char *path,
+                  gchar **parent_out)
+{
+  const char *slash = strrchr (path, '/');
+
+  if (slash == NULL)
+    {
+      *parent_out = g_strdup ("");
+      return path;
+    }
+
+  *parent_out = g_strndup (path, slash - path);
+  return slash + 1;
+}
+
+/**
+ * pv_untar:
+ * @archive: Path to a tar archive, possibly compressed with gzip or
+ *  (if pressure-vessel was built with libzstd) zstd
+ * @dest_fd: Directory into which to unpack it
+ * @dest_path: Path to @dest_fd, for diagnostic messages
+ * @member_prefix: (nullable): If not %NULL, only unpack this member
+ *  and its descendants, for example `files`
+ * @reference_fd: A directory containing a previously unpacked version
+ *  of a similar archive, or -1
+ * @reference_digests: (nullable) (element-type filename utf8): A map
+ *  from paths in @reference_fd to the hex SHA-256 digest of the
+ *  regular file at that path, or %NULL
+ * @flags: Flags affecting how we unpack the archive
+ * @error: Used to raise an error on failure
+ *
+ * Unpack @archive into @dest_fd, similar to `tar -xf`, without
+ * running a subprocess.
+ *
+ * Decompression happens in the calling thread, while files are written
+ * by a pool of worker threads, so that writing one file can overlap
+ * with decompressing the next. Files are created relative to
+ * directory file descriptors, and paths that would escape from
+ * @dest_fd are not followed.
+ *
+ * If @reference_digests is provided, regular files whose size,
+ * permissions and SHA-256 digest match the file at the same path in
+ * @reference_fd are hard-linked from there instead of being written
+ * again, so that consecutive versions of a runtime share storage for
+ * their unchanged files. The digests are computed by the worker
+ * threads, and symbolic links in @reference_fd are never followed.
+ * The modification times of those files are shared with the reference
+ * copy. Files too large to be buffered in memory are always written.
+ *
+ * Only the subset of the tar format that is used for runtimes is
+ * supported: ustar with GNU and POSIX.1-2001 extensions for long names,
+ * containing regular files, directories, symbolic links and hard links.
+ * Ownership is not preserved.
+ *
+ * Returns: %TRUE on success, or %FALSE with G_IO_ERROR_NOT_SUPPORTED
+ *  if the archive cannot be unpacked by this implementation, in which
+ *  case the caller should fall back to tar(1)
+ */
+gboolean
+pv_untar (const char *archive,
+          int dest_fd,
+          const char *dest_path,
+          const char *member_prefix,
+          int reference_fd,
+          GHashTable *reference_digests,
+          PvUntarFlags flags,
+          GError **error)
+{
+  g_auto(UntarReader) reader = { NULL };
+  g_auto(TarOverrides) overrides = { NULL };
+  g_autoptr(PvDirfdCache) parents = NULL;
+  g_autoptr(PvDirfdCache) references = NULL;
+  g_autoptr(GArray) directories = NULL;
+  g_autoptr(GError) local_error = NULL;
+  g_autofree gchar *gnu_long_name = NULL;
+  g_autofree gchar *gnu_long_link = NULL;
+  G_GNUC_UNUSED g_autoptr(SrtProfilingTimer) timer = NULL;
+  UntarContext ctx = { dest_path };
+  gboolean ret = FALSE;
+  gsize i;
+
+  g_return_val_if_fail (archive != NULL, FALSE);
+  g_return_val_if_fail (dest_fd >= 0 || dest_fd == AT_FDCWD, FALSE);
+  g_return_val_if_fail (dest_path != NULL, FALSE);
+  g_return_val_if_fail (reference_digests == NULL || reference_fd >= 0,
+                        FALSE);
+  g_return_val_if_fail (error == NULL || *error == NULL, FALSE);
+
+  if (!untar_reader_open (&reader, archive, error))
+    return FALSE;
+
+  timer = _srt_profiling_start ("Unpacking %s", archive);
+  parents = pv_dirfd_cache_new (dest_fd, dest_path);
+
+  if (reference_digests != NULL)
+    references = pv_dirfd_cache_new (reference_fd, "reference copy");
+
+  directories = g_array_new (FALSE, FALSE, sizeof (UntarDirectory));
+  g_array_set_clear_func (directories, untar_directory_clear);
+  ctx.reference_digests = reference_digests;
+  g_mutex_init (&ctx.mutex);
+  g_cond_init (&ctx.cond);
+
+  ctx.queue = g_queue_new ();
+  ctx.deferred = g_hash_table_new_full (g_str_hash, g_str_equal,
+                                        g_free, NULL);
+
+  if (!(flags & PV_UNTAR_FLAGS_SINGLE_THREAD))
+    ctx.pool = g_thread_pool_new (untar_worker, &ctx,
+                                  g_get_num_processors (), FALSE, NULL);
+
+  while (TRUE)
+    {
+      guint8 header[TAR_BLOCK_SIZE];
+      g_autofree gchar *raw_name = NULL;
+      g_autofree gchar *raw_link = NULL;
+      g_autofree gchar *path = NULL;
+      g_autofree gchar *parent = NULL;
+      guint64 size;
+      guint64 mode;
+      guint64 mtime;
+      const char *base;
+      char type;
+      int parent_fd;
+
+      if (!untar_reader_read (&reader, header, sizeof (header), &local_error))
+        goto out;
+
+      /* An all-zeroes block marks the end of the archive */
+      for (i = 0; i < sizeof (header); i++)
+        {
+          if (header[i] != 0)
+            break;
+        }
+
+      if (i == sizeof (header))
+        break;
+
+      if (!tar_header_checksum_ok (header))
+        {
+          glnx_throw (&local_error, "Invalid checksum in tar header");
+          goto out;
+        }
+
+      if (!tar_parse_number ((const char *) &header[124], 12, &size,
+                             &local_error)
+          || !tar_parse_number ((const char *) &header[100], 8, &mode,
+                                &local_error)
+          || !tar_parse_number ((const char *) &header[136], 12, &mtime,
+                                &local_error))
+        goto out;
+
+      type = (char) header[156];
+
+      /* Extended headers that apply to the next member */
+      if (type == 'L' || type == 'K' || type == 'x' || type == 'g')
+        {
+          g_autofree gchar *data = NULL;
+
+          if (size > 16 * 1024 * 1024)
+            {
+              glnx_throw (&local_error, "Extended tar header is too large");
+              goto out;
+            }
+
+          data = g_malloc0 (size + 1);
+
+          if (!untar_reader_read (&reader, data, size, &local_error)
+              || !untar_reader_skip (&reader, tar_padding (size),
+                                     &local_error))
+            goto out;
+
+          if (type == 'L')
+            {
+              g_free (gnu_long_name);
+              gnu_long_name = g_steal_pointer (&data);
+            }
+          else if (type == 'K')
+            {
+              g_free (gnu_long_link);
+              gnu_long_link = g_steal_pointer (&data);
+            }
+          else if (type == 'x'
+                   && !tar_parse_pax (data, size, &overrides, &local_error))
+            {
+              goto out;
+            }
+
+          /* Global extended headers ('g') are ignored, like GNU tar */
+          continue;
+        }
+
+      /* Only apply these to the member that the extended header
+       * describes, never to a further extended header */
+      if (overrides.have_size)
+        size = overrides.size;
+
+      if (overrides.have_mtime)
+        mtime = overrides.mtime;
+
+      if (overrides.path != NULL)
+        raw_name = g_steal_pointer (&overrides.path);
+      else if (gnu_long_name != NULL)
+        raw_name = g_steal_pointer (&gnu_long_name);
+      else if (memcmp (&header[257], "ustar", 5) == 0 && header[345] != '\0')
+        raw_name = g_strdup_printf ("%.155s/%.100s",
+                                    (const char *) &header[345],
+                                    (const char *) &header[0]);
+      else
+        raw_name = g_strndup ((const char *) &header[0], 100);
+
+      if (overrides.linkpath != NULL)
+        raw_link = g_steal_pointer (&overrides.linkpath);
+      else if (gnu_long_link != NULL)
+        raw_link = g_steal_pointer (&gnu_long_link);
+      else
+        raw_link = g_strndup ((const char *) &header[157], 100);
+
+      tar_overrides_clear (&overrides);
+      g_clear_pointer (&gnu_long_name, g_free);
+      g_clear_pointer (&gnu_long_link, g_free);
+
+      path = tar_normalize_path (raw_name);
+
+      if (path == NULL)
+        {
+          glnx_throw (&local_error,
+                      "Refusing to unpack \"%s\" outside destination",
+                      raw_name);
+          goto out;
+        }
+
+      if (member_prefix != NULL
+          && strcmp (path, member_prefix) != 0
+          && !(g_str_has_prefix (path, member_prefix)
+               && path[strlen (member_prefix)] == '/'))
+        {
+          trace ("Skipping \"%s\"", path);
+
+          if (!untar_reader_skip (&reader, size + tar_padding (size),
+                                  &local_error))
+            goto out;
+
+          continue;
+        }
+
+      if (flags & PV_UNTAR_FLAGS_VERBOSE)
+        g_info ("%s", path);
+
+      /* The archive's root directory: nothing to do */
+      if (path[0] == '\0')
+        {
+          if (!untar_reader_skip (&reader, size + tar_padding (size),
+                                  &local_error))
+            goto out;
+
+          continue;
+        }
+
+      /* If a worker thread is still going to create this path,
+       * let it finish before we replace it */
+      untar_wait_for_path (&ctx, path);
+
+      base = untar_split_path (path, &parent);
+      parent_fd = pv_dirfd_cache_resolve (parents, parent,
+                                          SRT_RESOLVE_FLAGS_MKDIR_P,
+                                          &local_error);
+
+      if (parent_fd < 0)
+        goto out;
+
+      switch (type)
+        {
+          case '0':
+          case '\0':
+          case '7':
+            if (size <= UNTAR_MAX_BUFFERED_FILE)
+              {
+                UntarWriteJob *job = g_slice_new0 (UntarWriteJob);
+
+                job->fd = -1;
+                job->parent_fd = -1;
+                job->reference_parent_fd = -1;
+                job->size = size;
+                job->mode = mode & 0777;
+                job->mtime = (gint64) mtime;
+                job->path = g_strdup (path);
+                job->data = g_malloc (MAX (size, 1));
+
+                if (!untar_reader_read (&reader, job->data, size,
+                                        &local_error))
+                  {
+                    untar_write_job_free (job);
+                    goto out;
+                  }
+
+                if (!untar_prepare_link (&ctx, references, job, parent, base,
+                                         parent_fd))
+                  {
+                    job->fd = untar_create_file (parent_fd, base, dest_path,
+                                                 path, &local_error);
+
+                    if (job->fd < 0)
+                      {
+                        untar_write_job_free (job);
+                        goto out;
+                      }
+                  }
+
+                if (!untar_queue_write (&ctx, job, &local_error))
+                  goto out;
+              }
+            else
+              {
+                g_autofree guint8 *buf = g_malloc (UNTAR_CHUNK_SIZE);
+                glnx_autofd int fd = -1;
+                guint64 remaining = size;
+
+                fd = untar_create_file (parent_fd, base, dest_path, path,
+                                        &local_error);
+
+                if (fd < 0)
+                  goto out;
+
+                while (remaining > 0)
+                  {
+                    gsize chunk = MIN (remaining, UNTAR_CHUNK_SIZE);
+
+                    if (!untar_reader_read (&reader, buf, chunk,
+                                            &local_error))
+                      goto out;
+
+                    if (glnx_loop_write (fd, buf, chunk) < 0)
+                      {
+                        glnx_throw_errno_prefix (&local_error,
+                                                 "Unable to write \"%s/%s\"",
+                                                 dest_path, path);
+                        goto out;
+                      }
+
+                    remaining -= chunk;
+                  }
+
+                if (!untar_finish_fd (fd, mode & 0777, (gint64) mtime,
+                                      dest_path, path, &local_error))
+                  goto out;
+              }
+
+            size = 0;     /* Already consumed */
+            break;
+
+          case '1':
+            {
+              g_autofree gchar *target = tar_normalize_path (raw_link);
+              g_autofree gchar *target_parent = NULL;
+              glnx_autofd int target_parent_fd = -1;
+              const char *target_base;
+              int fd;
+
+              if (target == NULL || target[0] == '\0')
+                {
+                  glnx_throw (&local_error,
+                              "Refusing to hard-link \"%s\" to \"%s\"",
+                              path, raw_link);
+                  goto out;
+                }
+
+              /* Resolving the target invalidates parent_fd, so take a
+               * copy of the target's parent and then resolve our parent
+               * again */
+              untar_wait_for_path (&ctx, target);
+              target_base = untar_split_path (target, &target_parent);
+              fd = pv_dirfd_cache_resolve (parents, target_parent,
+                                           SRT_RESOLVE_FLAGS_NONE,
+                                           &local_error);
+
+              if (fd < 0)
+                goto out;
+
+              target_parent_fd = fcntl (fd, F_DUPFD_CLOEXEC, 0);
+
+              if (target_parent_fd < 0)
+                {
+                  glnx_throw_errno_prefix (&local_error, "fcntl");
+                  goto out;
+                }
+
+              parent_fd = pv_dirfd_cache_resolve (parents, parent,
+                                                  SRT_RESOLVE_FLAGS_MKDIR_P,
+                                                  &local_error);
+
+              if (parent_fd < 0)
+                goto out;
+
+              if (!untar_replace (parent_fd, base,
+                                  linkat (target_parent_fd, target_base,
+                                          parent_fd, base, 0)))
+                {
+                  glnx_throw_errno_prefix (&local_error,
+                                           "Unable to hard-link \"%s/%s\" to \"%s\"",
+                                           dest_path, path, target);
+                  goto out;
+                }
+            }
+            break;
+
+          case '2':
+            {
+              const struct timespec times[2] =
+              {
+                { 0, UTIME_OMIT },
+                { (time_t) mtime, 0 },
+              };
+
+              if (!untar_replace (parent_fd, base,
+                                  symlinkat (raw_link, parent_fd, base)))
+                {
+                  glnx_throw_errno_prefix (&local_error,
+                                           "Unable to create symlink \"%s/%s\" -> \"%s\"",
+                                           dest_path, path, raw_link);
+                  goto out;
+                }
+
+              /* Not critical, so ignore errors */
+              utimensat (parent_fd, base, times, AT_SYMLINK_NOFOLLOW);
+            }
+            break;
+
+          case '5':
+            {
+              UntarDirectory dir = { NULL };
+
+              /* Make sure we can write to it while unpacking: the real
+               * permissions are set at the end */
+              if (TEMP_FAILURE_RETRY (mkdirat (parent_fd, base,
+                                               (mode & 01777) | 0700)) != 0
+                  && errno != EEXIST)
+                {
+                  glnx_throw_errno_prefix (&local_error,
+                                           "Unable to create \"%s/%s\"",
+                                           dest_path, path);
+                  goto out;
+                }
+
+              dir.path = g_steal_pointer (&path);
+              dir.mode = mode & 01777;
+              dir.mtime = (gint64) mtime;
+              g_array_append_val (directories, dir);
+            }
+            break;
+
+          default:
+            g_set_error (&local_error, G_IO_ERROR, G_IO_ERROR_NOT_SUPPORTED,
+                         "Member \"%s\" of \"%s\" has unsupported type '%c'",
+                         raw_name, archive, g_ascii_isprint (type) ? type : '?');
+            goto out;
+        }
+
+      if (!untar_reader_skip (&reader, size + tar_padding (size),
+                              &local_error))
+        goto out;
+    }
+
+  if (!untar_wait (&ctx, &local_error))
+    goto out;
+
+  /* Now that their contents are complete, set the real permissions
+   * and modification times of directories. */
+  for (i = 0; i < directories->len; i++)
+    {
+      const UntarDirectory *dir = &g_array_index (directories,
+                                                  UntarDirectory, i);
+      g_autoptr(GError) dir_error = NULL;
+      glnx_autofd int fd = -1;
+
+      /* A later member might have replaced the directory, or one of
+       * its ancestors, with a symlink: don't follow it */
+      fd = _srt_resolve_in_sysroot (dest_fd, dir->path,
+                                    (SRT_RESOLVE_FLAGS_REJECT_SYMLINKS
+                                     | SRT_RESOLVE_FLAGS_DIRECTORY),
+                                    NULL, &dir_error);
+
+      if (fd < 0)
+        {
+          if (g_error_matches (dir_error, G_IO_ERROR,
+                               G_IO_ERROR_TOO_MANY_LINKS)
+              || g_error_matches (dir_error, G_IO_ERROR,
+                                  G_IO_ERROR_NOT_DIRECTORY)
+              || g_error_matches (dir_error, G_IO_ERROR,
+                                  G_IO_ERROR_NOT_FOUND))
+            {
+              g_debug ("Not setting permissions of \"%s/%s\": %s",
+                       dest_path, dir->path, dir_error->message);
+              continue;
+            }
+
+          g_propagate_error (&local_error, g_steal_pointer (&dir_error));
+          goto out;
+        }
+
+      if (!untar_finish_fd (fd, dir->mode, dir->mtime, dest_path,
+                            dir->path, &local_error))
+        goto out;
+    }
+
+  ret = TRUE;
+
+out:
+  if (ctx.pool != NULL)
+    {
+      /* Wait for any writes that are in progress, but report our own
+       * error in preference to theirs. On success, there is nothing
+       * left in the queue; on failure, the rest is discarded below. */
+      g_thread_pool_free (ctx.pool, TRUE, TRUE);
+      g_clear_error (&ctx.error);
+    }
+
+  g_queue_free_full (ctx.queue, (GDestroyNotify) untar_write_job_free);
+  g_hash_table_unref (ctx.deferred);
+
+  g_mutex_clear (&ctx.mutex);
+  g_cond_clear (&ctx.cond);
+
+  if (!ret)
+    g_propagate_error (error, g_steal_pointer (&local_error));
+
+  return ret;
+}
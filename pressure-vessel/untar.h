@@ -0,0 +1,55 @@
+/*
+ * Copyright © 2026 Collabora Ltd.
+ * SPDX-License-Identifier: MIT
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#pragma once
+
+#include <glib.h>
+
+#include "steam-runtime-tools/glib-backports-internal.h"
+#include "libglnx/libglnx.h"
+
+/**
+ * PvUntarFlags:
+ * @PV_UNTAR_FLAGS_VERBOSE: Log each member as it is unpacked
+ * @PV_UNTAR_FLAGS_SINGLE_THREAD: Write files from the calling thread
+ *  only, for easier debugging
+ * @PV_UNTAR_FLAGS_NONE: None of the above
+ *
+ * Flags affecting pv_untar().
+ */
+typedef enum
+{
+  PV_UNTAR_FLAGS_VERBOSE = (1 << 0),
+  PV_UNTAR_FLAGS_SINGLE_THREAD = (1 << 1),
+  PV_UNTAR_FLAGS_NONE = 0
+} PvUntarFlags;
+
+gboolean pv_untar (const char *archive,
+                   int dest_fd,
+                   const char *dest_path,
+                   const char *member_prefix,
+                   int reference_fd,
+                   GHashTable *reference_digests,
+                   PvUntarFlags flags,
+                   GError **error);
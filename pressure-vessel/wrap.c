@@ -694,6 +694,7 @@ static gboolean opt_launcher = FALSE;
 static gboolean opt_only_prepare = FALSE;
 static gboolean opt_remove_game_overlay = FALSE;
 static gboolean opt_import_vulkan_layers = TRUE;
+static gboolean opt_overlay_runtime = FALSE;
 static PvShell opt_shell = PV_SHELL_NONE;
 static GArray *opt_pass_fds = NULL;
 static GArray *opt_preload_modules = NULL;
@@ -1158,6 +1159,17 @@ static GOptionEntry options[] =
     "home directory."
     "[Default if $PRESSURE_VESSEL_IMPORT_VULKAN_LAYERS is 0]",
     NULL },
+  { "overlay-runtime", '\0',
+    G_OPTION_FLAG_NONE, G_OPTION_ARG_NONE, &opt_overlay_runtime,
+    "With --copy-runtime, if possible, use overlayfs to avoid copying "
+    "parts of the runtime that will not be modified. "
+    "[Default if $PRESSURE_VESSEL_OVERLAY_RUNTIME is 1]",
+    NULL },
+  { "no-overlay-runtime", '\0',
+    G_OPTION_FLAG_REVERSE, G_OPTION_ARG_NONE, &opt_overlay_runtime,
+    "Don't behave as described for --overlay-runtime. "
+    "[Default unless $PRESSURE_VESSEL_OVERLAY_RUNTIME is 1]",
+    NULL },
   { "runtime", '\0',
     G_OPTION_FLAG_NONE, G_OPTION_ARG_FILENAME, &opt_runtime,
     "Mount the given sysroot or merged /usr in the container, and augment "
@@ -1412,6 +1424,8 @@ main (int argc,
                                               opt_systemd_scope);
   opt_import_vulkan_layers = pv_boolean_environment ("PRESSURE_VESSEL_IMPORT_VULKAN_LAYERS",
                                                      TRUE);
+  opt_overlay_runtime = pv_boolean_environment ("PRESSURE_VESSEL_OVERLAY_RUNTIME",
+                                                FALSE);
 
   opt_share_home = tristate_environment ("PRESSURE_VESSEL_SHARE_HOME");
   opt_gc_legacy_runtimes = pv_boolean_environment ("PRESSURE_VESSEL_GC_LEGACY_RUNTIMES", FALSE);
@@ -1910,6 +1924,9 @@ main (int argc,
       if (opt_copy_runtime)
         flags |= PV_RUNTIME_FLAGS_COPY_RUNTIME;
 
+      if (opt_overlay_runtime)
+        flags |= PV_RUNTIME_FLAGS_OVERLAY_RUNTIME;
+
       if (opt_single_thread)
         flags |= PV_RUNTIME_FLAGS_SINGLE_THREAD;
 
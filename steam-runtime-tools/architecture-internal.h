@@ -33,9 +33,16 @@ typedef struct
 {
   const char *multiarch_tuple;
   const char *interoperable_runtime_linker;
+  /* Values of EI_CLASS, EI_DATA and e_machine in the ELF header */
+  unsigned char elf_class;
+  unsigned char elf_encoding;
+  guint16 elf_machine;
+  /* Non-multiarch library directory for this ABI, such as "lib64" */
+  const char *default_libdir;
 } SrtKnownArchitecture;
 
 G_GNUC_INTERNAL const SrtKnownArchitecture *_srt_architecture_get_known (void);
+G_GNUC_INTERNAL const SrtKnownArchitecture *_srt_architecture_get_by_tuple (const char *multiarch_tuple);
 
 G_GNUC_INTERNAL gboolean _srt_architecture_can_run (gchar **envp,
                                                     const char *helpers_path,
@@ -31,6 +31,9 @@
 #include "steam-runtime-tools/utils.h"
 #include "steam-runtime-tools/utils-internal.h"
 
+#include <elf.h>
+#include <string.h>
+
 #include <glib-object.h>
 
 /**
@@ -51,16 +54,28 @@ static const SrtKnownArchitecture known_architectures[] =
     {
       .multiarch_tuple = SRT_ABI_X86_64,
       .interoperable_runtime_linker = "/lib64/ld-linux-x86-64.so.2",
+      .elf_class = ELFCLASS64,
+      .elf_encoding = ELFDATA2LSB,
+      .elf_machine = EM_X86_64,
+      .default_libdir = "lib64",
     },
 
     {
       .multiarch_tuple = SRT_ABI_I386,
       .interoperable_runtime_linker = "/lib/ld-linux.so.2",
+      .elf_class = ELFCLASS32,
+      .elf_encoding = ELFDATA2LSB,
+      .elf_machine = EM_386,
+      .default_libdir = "lib",
     },
 
     {
       .multiarch_tuple = "x86_64-linux-gnux32",
       .interoperable_runtime_linker = "/libx32/ld-linux-x32.so.2",
+      .elf_class = ELFCLASS32,
+      .elf_encoding = ELFDATA2LSB,
+      .elf_machine = EM_X86_64,
+      .default_libdir = "libx32",
     },
 
     { NULL }
@@ -76,6 +91,26 @@ _srt_architecture_get_known (void)
   return &known_architectures[0];
 }
 
+/*
+ * Returns: (nullable): The known architecture with @multiarch_tuple,
+ *  or %NULL if it is not known
+ */
+const SrtKnownArchitecture *
+_srt_architecture_get_by_tuple (const char *multiarch_tuple)
+{
+  gsize i;
+
+  g_return_val_if_fail (multiarch_tuple != NULL, NULL);
+
+  for (i = 0; known_architectures[i].multiarch_tuple != NULL; i++)
+    {
+      if (strcmp (known_architectures[i].multiarch_tuple, multiarch_tuple) == 0)
+        return &known_architectures[i];
+    }
+
+  return NULL;
+}
+
 gboolean
 _srt_architecture_can_run (gchar **envp,
                            const char *helpers_path,
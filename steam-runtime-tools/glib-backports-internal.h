@@ -98,6 +98,11 @@ GSource *my_g_unix_fd_source_new (int fd,
                                   GIOCondition condition);
 #endif
 
+#if !GLIB_CHECK_VERSION(2, 36, 0)
+#define g_get_num_processors() my_g_get_num_processors ()
+guint my_g_get_num_processors (void);
+#endif
+
 #if !GLIB_CHECK_VERSION(2, 58, 0)
 #define g_canonicalize_filename(f, r) my_g_canonicalize_filename (f, r)
 gchar *my_g_canonicalize_filename (const gchar *filename,
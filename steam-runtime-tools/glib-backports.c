@@ -353,6 +353,31 @@ my_g_unix_fd_add_full (int priority,
 }
 #endif
 
+#if !GLIB_CHECK_VERSION(2, 36, 0)
+/**
+ * g_get_num_processors:
+ *
+ * Determine the approximate number of threads that the system will
+ * schedule simultaneously for this process.  This is intended to be
+ * used as a parameter to g_thread_pool_new() for CPU bound tasks and
+ * similar cases.
+ *
+ * Returns: Number of schedulable threads, always greater than 0
+ *
+ * Since: 2.36
+ */
+guint
+my_g_get_num_processors (void)
+{
+  long count = sysconf (_SC_NPROCESSORS_ONLN);
+
+  if (count > 0)
+    return MIN (count, G_MAXINT);
+
+  return 1;
+}
+#endif
+
 #if !GLIB_CHECK_VERSION(2, 58, 0)
 /*
  * g_canonicalize_filename:
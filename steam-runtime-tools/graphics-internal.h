@@ -26,6 +26,8 @@
 
 #pragma once
 
+#include "steam-runtime-tools/helper-server-internal.h"
+#include "steam-runtime-tools/libdl-internal.h"
 #include "steam-runtime-tools/steam-runtime-tools.h"
 #include "steam-runtime-tools/system-info-internal.h"
 #include "steam-runtime-tools/utils-internal.h"
@@ -102,12 +104,45 @@ static inline int _srt_graphics_hash_key(SrtWindowSystem winsys, SrtRenderingInt
 
 #ifndef __GTK_DOC_IGNORE__
 
+/*
+ * SrtGraphicsProbeResult:
+ * @output: What the check wrote to stdout
+ * @messages: What the check wrote to stderr
+ * @wait_status: The check's wait status, as for g_spawn_sync()
+ *
+ * The result of one of the checks done by the combined
+ * `check-graphics` helper.
+ */
+typedef struct
+{
+  gchar *output;
+  gchar *messages;
+  int wait_status;
+} SrtGraphicsProbeResult;
+
+G_GNUC_INTERNAL void _srt_graphics_probe_result_free (gpointer p);
+
+G_GNUC_INTERNAL gboolean _srt_graphics_probe_is_available (const char *helpers_path,
+                                                           const char *multiarch_tuple);
+G_GNUC_INTERNAL gboolean _srt_graphics_probe_supports (SrtWindowSystem window_system,
+                                                       SrtRenderingInterface rendering_interface);
+G_GNUC_INTERNAL GHashTable *_srt_graphics_probe_results_new_from_json (const char *json,
+                                                                       GError **error);
+G_GNUC_INTERNAL GHashTable *_srt_run_graphics_probe (gchar **envp,
+                                                     const char *helpers_path,
+                                                     SrtTestFlags test_flags,
+                                                     const char *multiarch_tuple,
+                                                     const SrtRenderingInterface *rendering_interfaces,
+                                                     gsize n_rendering_interfaces,
+                                                     GError **error);
+
 G_GNUC_INTERNAL SrtGraphicsIssues _srt_check_graphics (gchar **envp,
                                                        const char *helpers_path,
                                                        SrtTestFlags test_flags,
                                                        const char *multiarch_tuple,
                                                        SrtWindowSystem window_system,
                                                        SrtRenderingInterface rendering_interface,
+                                                       const SrtGraphicsProbeResult *probe_result,
                                                        SrtGraphics **details_out);
 
 static inline SrtGraphics *
@@ -283,12 +318,14 @@ GList *_srt_load_egl_icds (const char *helpers_path,
                            const char *sysroot,
                            gchar **envp,
                            const char * const *multiarch_tuples,
+                           SrtLibraryResolver *resolver,
                            SrtCheckFlags check_flags);
 G_GNUC_INTERNAL
 GList *_srt_load_vulkan_icds (const char *helpers_path,
                               const char *sysroot,
                               gchar **envp,
                               const char * const *multiarch_tuples,
+                              SrtLibraryResolver *resolver,
                               SrtCheckFlags check_flags);
 
 G_GNUC_INTERNAL
@@ -297,6 +334,7 @@ GList *_srt_list_graphics_modules (const gchar *sysroot,
                                    const char *helpers_path,
                                    const char *multiarch_tuple,
                                    SrtCheckFlags check_flags,
+                                   SrtHelperServer *server,
                                    SrtGraphicsModule which);
 
 G_GNUC_INTERNAL
@@ -304,6 +342,7 @@ GList *_srt_load_vulkan_layers_extended (const char *helpers_path,
                                          const char *sysroot,
                                          gchar **envp,
                                          const char * const *multiarch_tuples,
+                                         SrtLibraryResolver *resolver,
                                          gboolean explicit,
                                          SrtCheckFlags check_flags);
 
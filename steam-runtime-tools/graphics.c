@@ -31,19 +31,19 @@
 #include "steam-runtime-tools/graphics-internal.h"
 #include "steam-runtime-tools/json-glib-backports-internal.h"
 #include "steam-runtime-tools/json-utils-internal.h"
+#include "steam-runtime-tools/libdl-internal.h"
 #include "steam-runtime-tools/library-internal.h"
 #include "steam-runtime-tools/resolve-in-sysroot-internal.h"
 #include "steam-runtime-tools/utils.h"
 #include "steam-runtime-tools/utils-internal.h"
 
+#include <elf.h>
 #include <errno.h>
 #include <fcntl.h>
-#include <gelf.h>
 #include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
 #include <sys/types.h>
-#include <libelf.h>
 
 #include <json-glib/json-glib.h>
 
@@ -1253,6 +1253,42 @@ out:
   return library_vendor;
 }
 
+/*
+ * Report any issues indicated by the wait status of a helper
+ *
+ * @wait_status: The wait status of the helper
+ * @exit_status: (out) (transfer full): Exit status of helper(s) executed.
+ *   0 on success, positive on unsuccessful exit(), -1 if killed by a signal
+ * @terminating_signal: (out) (transfer full): Signal used to terminate helper
+ *   process if any, 0 otherwise
+ * @non_zero_waitstatus_issue: Which issue should be set if wait_status is non zero
+ */
+static SrtGraphicsIssues
+_srt_process_helper_wait_status (int wait_status,
+                                 int *exit_status,
+                                 int *terminating_signal,
+                                 SrtGraphicsIssues non_zero_wait_status_issue)
+{
+  SrtGraphicsIssues issues = SRT_GRAPHICS_ISSUES_NONE;
+
+  if (wait_status != 0)
+    {
+      g_debug ("... wait status %d", wait_status);
+      issues |= non_zero_wait_status_issue;
+
+      if (_srt_process_timeout_wait_status (wait_status, exit_status, terminating_signal))
+        {
+          issues |= SRT_GRAPHICS_ISSUES_TIMEOUT;
+        }
+    }
+  else
+    {
+      *exit_status = 0;
+    }
+
+  return issues;
+}
+
 /*
  * Run the given helper and report any issues found
  *
@@ -1266,7 +1302,6 @@ out:
  *   not run at all
  * @terminating_signal: (out) (transfer full): Signal used to terminate helper
  *   process if any, 0 otherwise
- * @verbose: If true set environment variables for debug output
  * @non_zero_waitstatus_issue: Which issue should be set if wait_status is non zero
  */
 static SrtGraphicsIssues
@@ -1277,7 +1312,6 @@ _srt_run_helper (GStrv *my_environ,
                  int *wait_status,
                  int *exit_status,
                  int *terminating_signal,
-                 gboolean verbose,
                  SrtGraphicsIssues non_zero_wait_status_issue)
 {
   // non_zero_wait_status_issue needs to be something other than NONE, otherwise
@@ -1292,13 +1326,6 @@ _srt_run_helper (GStrv *my_environ,
   SrtGraphicsIssues issues = SRT_GRAPHICS_ISSUES_NONE;
   GError *error = NULL;
 
-  if (verbose)
-    {
-      // Issues found, so run again with LIBGL_DEBUG=verbose set in environment
-      *my_environ = g_environ_setenv (*my_environ, "LIBGL_DEBUG", "verbose", TRUE);
-    }
-
-  // Ignore what came on stderr previously, use this run's error message
   g_free(*output);
   *output = NULL;
   g_free(*child_stderr);
@@ -1321,22 +1348,253 @@ _srt_run_helper (GStrv *my_environ,
       issues |= non_zero_wait_status_issue;
     }
 
-  if (*wait_status != 0)
+  issues |= _srt_process_helper_wait_status (*wait_status,
+                                             exit_status,
+                                             terminating_signal,
+                                             non_zero_wait_status_issue);
+  return issues;
+}
+
+void
+_srt_graphics_probe_result_free (gpointer p)
+{
+  SrtGraphicsProbeResult *self = p;
+
+  g_free (self->output);
+  g_free (self->messages);
+  g_slice_free (SrtGraphicsProbeResult, self);
+}
+
+/*
+ * _srt_graphics_probe_supports:
+ * @window_system: The window system to check
+ * @rendering_interface: The graphics renderer to check
+ *
+ * Returns: %TRUE if the combined `check-graphics` helper can check
+ *  this combination
+ */
+gboolean
+_srt_graphics_probe_supports (SrtWindowSystem window_system,
+                              SrtRenderingInterface rendering_interface)
+{
+  if (window_system != SRT_WINDOW_SYSTEM_X11)
+    return FALSE;
+
+  switch (rendering_interface)
     {
-      g_debug ("... wait status %d", *wait_status);
-      issues |= non_zero_wait_status_issue;
+      case SRT_RENDERING_INTERFACE_VULKAN:
+      case SRT_RENDERING_INTERFACE_VDPAU:
+      case SRT_RENDERING_INTERFACE_VAAPI:
+        return TRUE;
+
+      case SRT_RENDERING_INTERFACE_GL:
+      case SRT_RENDERING_INTERFACE_GLESV2:
+      default:
+        return FALSE;
+    }
+}
 
-      if (_srt_process_timeout_wait_status (*wait_status, exit_status, terminating_signal))
+/*
+ * _srt_graphics_probe_is_available:
+ * @helpers_path: An optional path to find helpers, the default is used if null
+ * @multiarch_tuple: A multiarch tuple to check e.g. i386-linux-gnu
+ *
+ * Returns: %TRUE if the combined `check-graphics` helper is installed
+ *  for @multiarch_tuple
+ */
+gboolean
+_srt_graphics_probe_is_available (const char *helpers_path,
+                                  const char *multiarch_tuple)
+{
+  g_autoptr(GPtrArray) argv = NULL;
+  g_autoptr(GError) local_error = NULL;
+
+  argv = _srt_get_helper (helpers_path, multiarch_tuple, "check-graphics",
+                          SRT_HELPER_FLAGS_NONE, &local_error);
+
+  if (argv == NULL)
+    {
+      g_debug ("%s", local_error->message);
+      return FALSE;
+    }
+
+  return TRUE;
+}
+
+/*
+ * _srt_graphics_probe_results_new_from_json:
+ * @json: The output of the combined `check-graphics` helper
+ * @error: Used to raise an error on failure
+ *
+ * Returns: (transfer container) (element-type SrtRenderingInterface SrtGraphicsProbeResult):
+ *  A map from rendering interfaces, as GINT_TO_POINTER(), to the result
+ *  of the check, or %NULL on error
+ */
+GHashTable *
+_srt_graphics_probe_results_new_from_json (const char *json,
+                                           GError **error)
+{
+  g_autoptr(GHashTable) results = NULL;
+  g_autoptr(JsonNode) node = NULL;
+  g_autoptr(GList) members = NULL;
+  JsonObject *object;
+  const GList *iter;
+
+  g_return_val_if_fail (json != NULL, NULL);
+  g_return_val_if_fail (error == NULL || *error == NULL, NULL);
+
+  node = json_from_string (json, error);
+
+  if (node == NULL)
+    {
+      if (error != NULL && *error == NULL)
+        g_set_error (error, G_IO_ERROR, G_IO_ERROR_INVALID_DATA,
+                     "The check-graphics output is empty");
+      return NULL;
+    }
+
+  if (!JSON_NODE_HOLDS_OBJECT (node))
+    return glnx_null_throw (error, "The check-graphics output is not a JSON object");
+
+  object = json_node_get_object (node);
+  members = json_object_get_members (object);
+  results = g_hash_table_new_full (NULL, NULL, NULL,
+                                   _srt_graphics_probe_result_free);
+
+  for (iter = members; iter != NULL; iter = iter->next)
+    {
+      const char *name = iter->data;
+      SrtGraphicsProbeResult *result;
+      JsonObject *member;
+      JsonNode *member_node;
+      int rendering_interface;
+
+      if (!srt_enum_from_nick (SRT_TYPE_RENDERING_INTERFACE, name,
+                               &rendering_interface, NULL))
         {
-          issues |= SRT_GRAPHICS_ISSUES_TIMEOUT;
+          g_debug ("Ignoring unknown rendering interface \"%s\"", name);
+          continue;
         }
+
+      member_node = json_object_get_member (object, name);
+
+      if (!JSON_NODE_HOLDS_OBJECT (member_node))
+        return glnx_null_throw (error, "The check-graphics result for \"%s\" "
+                                "is not a JSON object", name);
+
+      member = json_node_get_object (member_node);
+
+      if (!json_object_has_member (member, "wait-status"))
+        return glnx_null_throw (error, "The check-graphics result for \"%s\" "
+                                "has no wait status", name);
+
+      result = g_slice_new0 (SrtGraphicsProbeResult);
+      result->wait_status = json_object_get_int_member_with_default (member,
+                                                                     "wait-status",
+                                                                     -1);
+      result->output = g_strdup (json_object_get_string_member_with_default (member,
+                                                                             "stdout",
+                                                                             NULL));
+      result->messages = g_strdup (json_object_get_string_member_with_default (member,
+                                                                               "stderr",
+                                                                               NULL));
+      g_hash_table_replace (results, GINT_TO_POINTER (rendering_interface),
+                            result);
     }
-  else
+
+  return g_steal_pointer (&results);
+}
+
+/*
+ * _srt_run_graphics_probe:
+ * @envp: (not nullable): Used instead of `environ`
+ * @helpers_path: An optional path to find helpers, the default is used if null
+ * @test_flags: Flags used during automated testing
+ * @multiarch_tuple: A multiarch tuple to check e.g. i386-linux-gnu
+ * @rendering_interfaces: (array length=n_rendering_interfaces): The
+ *  rendering interfaces to check on %SRT_WINDOW_SYSTEM_X11, which must
+ *  all be supported by _srt_graphics_probe_supports()
+ * @n_rendering_interfaces: The number of rendering interfaces
+ * @error: Used to raise an error on failure
+ *
+ * Run the combined `check-graphics` helper, which does several of the
+ * checks that _srt_check_graphics() would do, but with one process tree
+ * instead of one process per check. Each result can be passed to
+ * _srt_check_graphics() to avoid running the individual helper.
+ *
+ * Returns: (transfer container) (element-type SrtRenderingInterface SrtGraphicsProbeResult):
+ *  The same as _srt_graphics_probe_results_new_from_json(), or %NULL
+ *  if the helper could not be run
+ */
+GHashTable *
+_srt_run_graphics_probe (gchar **envp,
+                         const char *helpers_path,
+                         SrtTestFlags test_flags,
+                         const char *multiarch_tuple,
+                         const SrtRenderingInterface *rendering_interfaces,
+                         gsize n_rendering_interfaces,
+                         GError **error)
+{
+  g_autoptr(GPtrArray) argv = NULL;
+  g_auto(GStrv) my_environ = NULL;
+  g_autofree gchar *output = NULL;
+  g_autofree gchar *child_stderr = NULL;
+  int wait_status = -1;
+  gsize i;
+
+  g_return_val_if_fail (envp != NULL, NULL);
+  g_return_val_if_fail (_srt_check_not_setuid (), NULL);
+  g_return_val_if_fail (error == NULL || *error == NULL, NULL);
+
+  argv = _srt_get_helper (helpers_path, multiarch_tuple, "check-graphics",
+                          SRT_HELPER_FLAGS_NONE, error);
+
+  if (argv == NULL)
+    return NULL;
+
+  /* The helper times out each check separately, in the same way as
+   * SRT_HELPER_FLAGS_TIME_OUT would */
+  if (test_flags & SRT_TEST_FLAGS_TIME_OUT_SOONER)
     {
-      *exit_status = 0;
+      g_ptr_array_add (argv, g_strdup ("--kill-after=1"));
+      g_ptr_array_add (argv, g_strdup ("--timeout=1"));
     }
 
-  return issues;
+  for (i = 0; i < n_rendering_interfaces; i++)
+    {
+      g_return_val_if_fail (_srt_graphics_probe_supports (SRT_WINDOW_SYSTEM_X11,
+                                                          rendering_interfaces[i]),
+                            NULL);
+      g_ptr_array_add (argv,
+                       g_strdup (srt_enum_value_to_nick (SRT_TYPE_RENDERING_INTERFACE,
+                                                         rendering_interfaces[i])));
+    }
+
+  g_ptr_array_add (argv, NULL);
+
+  /* Use the same environment as _srt_check_graphics() */
+  my_environ = _srt_filter_gameoverlayrenderer_from_envp (envp);
+  my_environ = g_environ_setenv (my_environ, "LIBGL_DEBUG", "verbose", TRUE);
+
+  if (!g_spawn_sync (NULL,    /* working directory */
+                     (gchar **) argv->pdata,
+                     my_environ,    /* envp */
+                     G_SPAWN_DEFAULT,
+                     _srt_child_setup_unblock_signals,
+                     NULL,    /* user data */
+                     &output, /* stdout */
+                     &child_stderr,
+                     &wait_status,
+                     error))
+    return NULL;
+
+  if (child_stderr != NULL && child_stderr[0] != '\0')
+    g_debug ("check-graphics: %s", child_stderr);
+
+  if (!g_spawn_check_exit_status (wait_status, error))
+    return NULL;
+
+  return _srt_graphics_probe_results_new_from_json (output, error);
 }
 
 /**
@@ -1347,6 +1605,8 @@ _srt_run_helper (GStrv *my_environ,
  * @multiarch_tuple: A multiarch tuple to check e.g. i386-linux-gnu
  * @winsys: The window system to check.
  * @renderer: The graphics renderer to check.
+ * @probe_result: (nullable): The result of this check from
+ *  _srt_run_graphics_probe(), or %NULL to run the individual helper
  * @details_out: The SrtGraphics object containing the details of the check.
  *
  * Return the problems found when checking the graphics stack given.
@@ -1361,8 +1621,10 @@ _srt_check_graphics (gchar **envp,
                      const char *multiarch_tuple,
                      SrtWindowSystem window_system,
                      SrtRenderingInterface rendering_interface,
+                     const SrtGraphicsProbeResult *probe_result,
                      SrtGraphics **details_out)
 {
+  GPtrArray *argv = NULL;
   gchar *output = NULL;
   gchar *child_stderr = NULL;
   gchar *child_stderr2 = NULL;
@@ -1379,6 +1641,7 @@ _srt_check_graphics (gchar **envp,
   SrtGraphicsLibraryVendor library_vendor = SRT_GRAPHICS_LIBRARY_VENDOR_UNKNOWN;
   g_auto(GStrv) json_output = NULL;
   g_autoptr(GPtrArray) graphics_device = g_ptr_array_new_with_free_func (g_object_unref);
+  gboolean verbose = FALSE;
   gsize i;
 
   g_return_val_if_fail (details_out == NULL || *details_out == NULL, SRT_GRAPHICS_ISSUES_UNKNOWN);
@@ -1386,20 +1649,27 @@ _srt_check_graphics (gchar **envp,
   g_return_val_if_fail (((unsigned) rendering_interface) < SRT_N_RENDERING_INTERFACES, SRT_GRAPHICS_ISSUES_UNKNOWN);
   g_return_val_if_fail (_srt_check_not_setuid (), SRT_GRAPHICS_ISSUES_UNKNOWN);
   g_return_val_if_fail (envp != NULL, SRT_GRAPHICS_ISSUES_UNKNOWN);
+  g_return_val_if_fail (probe_result == NULL
+                        || _srt_graphics_probe_supports (window_system,
+                                                         rendering_interface),
+                        SRT_GRAPHICS_ISSUES_UNKNOWN);
 
-  GPtrArray *argv = _argv_for_graphics_test (helpers_path,
-                                             test_flags,
-                                             multiarch_tuple,
-                                             &window_system,
-                                             rendering_interface,
-                                             &error);
-
-  if (argv == NULL)
+  if (probe_result == NULL)
     {
-      issues |= SRT_GRAPHICS_ISSUES_CANNOT_LOAD;
-      /* Put the error message in the 'messages' */
-      child_stderr = g_strdup (error->message);
-      goto out;
+      argv = _argv_for_graphics_test (helpers_path,
+                                      test_flags,
+                                      multiarch_tuple,
+                                      &window_system,
+                                      rendering_interface,
+                                      &error);
+
+      if (argv == NULL)
+        {
+          issues |= SRT_GRAPHICS_ISSUES_CANNOT_LOAD;
+          /* Put the error message in the 'messages' */
+          child_stderr = g_strdup (error->message);
+          goto out;
+        }
     }
 
   my_environ = _srt_filter_gameoverlayrenderer_from_envp (envp);
@@ -1426,24 +1696,28 @@ _srt_check_graphics (gchar **envp,
         g_return_val_if_reached (SRT_GRAPHICS_ISSUES_UNKNOWN);
     }
 
-  issues |= _srt_run_helper (&my_environ,
-                             &output,
-                             &child_stderr,
-                             argv,
-                             &wait_status,
-                             &exit_status,
-                             &terminating_signal,
-                             FALSE,
-                             non_zero_wait_status_issue);
-
-  if (rendering_interface != SRT_RENDERING_INTERFACE_VULKAN
-      && issues != SRT_GRAPHICS_ISSUES_NONE)
+  /* Always collect the verbose diagnostics, so that we don't need to run
+   * the helpers a second time if they fail. They are only reported if
+   * there were issues. For Vulkan `LIBGL_DEBUG` has no effect, and its
+   * messages are always reported. */
+  if (rendering_interface != SRT_RENDERING_INTERFACE_VULKAN)
     {
-      /* For Vulkan `LIBGL_DEBUG` has no effect. Also we try to continue even
-       * if we faced some issues because we might still have a valid JSON in
-       * output */
+      verbose = TRUE;
+      my_environ = g_environ_setenv (my_environ, "LIBGL_DEBUG", "verbose", TRUE);
+    }
 
-      // Issues found, so run again with LIBGL_DEBUG=verbose set in environment
+  if (probe_result != NULL)
+    {
+      output = g_strdup (probe_result->output);
+      child_stderr = g_strdup (probe_result->messages);
+      wait_status = probe_result->wait_status;
+      issues |= _srt_process_helper_wait_status (wait_status,
+                                                 &exit_status,
+                                                 &terminating_signal,
+                                                 non_zero_wait_status_issue);
+    }
+  else
+    {
       issues |= _srt_run_helper (&my_environ,
                                  &output,
                                  &child_stderr,
@@ -1451,12 +1725,14 @@ _srt_check_graphics (gchar **envp,
                                  &wait_status,
                                  &exit_status,
                                  &terminating_signal,
-                                 TRUE,
                                  non_zero_wait_status_issue);
-
-      goto out;
     }
 
+  /* For Vulkan we try to continue even if we faced some issues, because
+   * we might still have a valid JSON in output */
+  if (verbose && issues != SRT_GRAPHICS_ISSUES_NONE)
+    goto out;
+
   switch (rendering_interface)
     {
       case SRT_RENDERING_INTERFACE_GL:
@@ -1469,36 +1745,15 @@ _srt_check_graphics (gchar **envp,
             else
               g_debug ("The helper output is not a valid JSON: %s", error->message);
             issues |= SRT_GRAPHICS_ISSUES_CANNOT_LOAD;
-
-            // Issues found, so run again with LIBGL_DEBUG=verbose set in environment
-            issues |= _srt_run_helper (&my_environ,
-                                       &output,
-                                       &child_stderr,
-                                       argv,
-                                       &wait_status,
-                                       &exit_status,
-                                       &terminating_signal,
-                                       TRUE,
-                                       SRT_GRAPHICS_ISSUES_CANNOT_LOAD);
-
             goto out;
           }
 
         issues |= _srt_process_wflinfo (node, &version_string, &renderer_string);
 
-        if (issues != SRT_GRAPHICS_ISSUES_NONE)
-          {
-            // Issues found, so run again with LIBGL_DEBUG=verbose set in environment
-            issues |= _srt_run_helper (&my_environ,
-                                       &output,
-                                       &child_stderr,
-                                       argv,
-                                       &wait_status,
-                                       &exit_status,
-                                       &terminating_signal,
-                                       TRUE,
-                                       SRT_GRAPHICS_ISSUES_CANNOT_LOAD);
-          }
+        /* wflinfo worked, so its verbose diagnostics are not interesting:
+         * only check-gl's are reported, if it fails */
+        if (issues == SRT_GRAPHICS_ISSUES_NONE)
+          g_clear_pointer (&child_stderr, g_free);
 
         if (rendering_interface == SRT_RENDERING_INTERFACE_GL &&
             window_system == SRT_WINDOW_SYSTEM_GLX)
@@ -1528,22 +1783,7 @@ _srt_check_graphics (gchar **envp,
                                        &wait_status,
                                        &exit_status,
                                        &terminating_signal,
-                                       FALSE,
                                        SRT_GRAPHICS_ISSUES_CANNOT_DRAW);
-
-            if (issues != SRT_GRAPHICS_ISSUES_NONE)
-              {
-                // Issues found, so run again with LIBGL_DEBUG=verbose set in environment
-                issues |= _srt_run_helper (&my_environ,
-                                           &output,
-                                           &child_stderr2,
-                                           argv,
-                                           &wait_status,
-                                           &exit_status,
-                                           &terminating_signal,
-                                           TRUE,
-                                           SRT_GRAPHICS_ISSUES_CANNOT_DRAW);
-              }
           }
         break;
 
@@ -1665,11 +1905,18 @@ _srt_check_graphics (gchar **envp,
 
 out:
 
+  if (verbose && issues == SRT_GRAPHICS_ISSUES_NONE)
+    {
+      g_clear_pointer (&child_stderr, g_free);
+      g_clear_pointer (&child_stderr2, g_free);
+    }
+
   /* If we have stderr (or error messages) from both wflinfo and
    * check-gl, combine them */
   if (child_stderr2 != NULL && child_stderr2[0] != '\0')
     {
-      gchar *tmp = g_strconcat (child_stderr, child_stderr2, NULL);
+      gchar *tmp = g_strconcat (child_stderr != NULL ? child_stderr : "",
+                                child_stderr2, NULL);
 
       g_free (child_stderr);
       child_stderr = tmp;
@@ -3398,16 +3645,24 @@ _update_duplicated_value (GType which,
 }
 
 /*
- * Use 'inspect-library' to get the absolute path of @library_path,
- * resolving also its eventual symbolic links.
+ * Get the absolute path of @library_path, resolving also its eventual
+ * symbolic links. This is done in-process if possible, and otherwise
+ * by using 'inspect-library'.
  */
 static gchar *
-_get_library_canonical_path (gchar **envp,
+_get_library_canonical_path (SrtLibraryResolver *resolver,
+                             gchar **envp,
                              const char *helpers_path,
                              const char *multiarch,
                              const gchar *library_path)
 {
   g_autoptr(SrtLibrary) library = NULL;
+  gchar *canonical_path = NULL;
+
+  if (_srt_library_resolver_get_canonical_path (resolver, envp, multiarch,
+                                                library_path, &canonical_path))
+    return canonical_path;
+
   _srt_check_library_presence (helpers_path, library_path, multiarch, NULL,
                                NULL, envp,
                                SRT_LIBRARY_SYMBOLS_FORMAT_PLAIN, &library);
@@ -3416,12 +3671,17 @@ _get_library_canonical_path (gchar **envp,
    * contains ./ or ../
    * The absolute path is gathered using 'inspect-library', so we don't have
    * to worry about still having special tokens, like ${LIB}, in the path. */
-  return realpath (srt_library_get_absolute_path (library), NULL);
+  canonical_path = realpath (srt_library_get_absolute_path (library), NULL);
+  _srt_library_resolver_set_canonical_path (resolver, multiarch, library_path,
+                                            canonical_path);
+  return canonical_path;
 }
 
 /*
  * @helpers_path: (nullable): An optional path to find "inspect-library"
  *  helper, PATH is used if %NULL
+ * @resolver: (nullable): Used to find and cache the absolute paths of
+ *  libraries
  * @loadable: (inout) (element-type SrtVulkanLayer):
  *
  * Iterate the provided @loadable list and update their "issues" property
@@ -3436,8 +3696,10 @@ _srt_loadable_flag_duplicates (GType which,
                                gchar **envp,
                                const char *helpers_path,
                                const char * const *multiarch_tuples,
+                               SrtLibraryResolver *resolver,
                                GList *loadable)
 {
+  g_autoptr(SrtLibraryResolver) local_resolver = NULL;
   g_autoptr(GHashTable) loadable_seen = NULL;
   gsize i;
   GList *l;
@@ -3446,6 +3708,9 @@ _srt_loadable_flag_duplicates (GType which,
                     || which == SRT_TYPE_EGL_ICD
                     || which == SRT_TYPE_VULKAN_LAYER);
 
+  if (resolver == NULL)
+    resolver = local_resolver = _srt_library_resolver_new ();
+
   loadable_seen = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
 
   for (l = loadable; l != NULL; l = l->next)
@@ -3474,14 +3739,15 @@ _srt_loadable_flag_duplicates (GType which,
               for (i = 0; multiarch_tuples[i] != NULL; i++)
                 {
                   g_autofree gchar *canonical_path = NULL;
-                  canonical_path = _get_library_canonical_path (envp, helpers_path,
+                  canonical_path = _get_library_canonical_path (resolver, envp,
+                                                                helpers_path,
                                                                 multiarch_tuples[i],
                                                                 resolved_path);
 
                   if (canonical_path == NULL)
                     {
                       /* Either the library is of a different ELF class or it is missing */
-                      g_debug ("Unable to get the absolute path of \"%s\" via inspect-library",
+                      g_debug ("Unable to get the absolute path of \"%s\"",
                                resolved_path);
                       continue;
                     }
@@ -3516,14 +3782,15 @@ _srt_loadable_flag_duplicates (GType which,
                 {
                   g_autofree gchar *canonical_path = NULL;
                   g_autofree gchar *hash_key = NULL;
-                  canonical_path = _get_library_canonical_path (envp, helpers_path,
+                  canonical_path = _get_library_canonical_path (resolver, envp,
+                                                                helpers_path,
                                                                 multiarch_tuples[i],
                                                                 resolved_path);
 
                   if (canonical_path == NULL)
                     {
                       /* Either the library is of a different ELF class or it is missing */
-                      g_debug ("Unable to get the absolute path of \"%s\" via inspect-library",
+                      g_debug ("Unable to get the absolute path of \"%s\"",
                                resolved_path);
                       continue;
                     }
@@ -3559,6 +3826,8 @@ _srt_loadable_flag_duplicates (GType which,
  *  EGL ICDs are searched by their absolute path, obtained using
  *  "inspect-library" in the provided multiarch tuples, instead of just their
  *  resolved library path.
+ * @resolver: (nullable): Used to find and cache the absolute paths of
+ *  libraries when searching for duplicates
  * @check_flags: Whether to check for problems
  *
  * Implementation of srt_system_info_list_egl_icds().
@@ -3571,6 +3840,7 @@ _srt_load_egl_icds (const char *helpers_path,
                     const char *sysroot,
                     gchar **envp,
                     const char * const *multiarch_tuples,
+                    SrtLibraryResolver *resolver,
                     SrtCheckFlags check_flags)
 {
   const gchar *value;
@@ -3644,7 +3914,7 @@ _srt_load_egl_icds (const char *helpers_path,
 
   if (!(check_flags & SRT_CHECK_FLAGS_SKIP_SLOW_CHECKS))
     _srt_loadable_flag_duplicates (SRT_TYPE_EGL_ICD, envp, helpers_path,
-                                   multiarch_tuples, ret);
+                                   multiarch_tuples, resolver, ret);
 
   return g_list_reverse (ret);
 }
@@ -3929,40 +4199,17 @@ out:
 static int
 _srt_get_library_class (const gchar *library)
 {
-  Elf *elf = NULL;
-  int fd = -1;
-  int class = ELFCLASSNONE;
+  SrtElfHeader header;
 
   g_return_val_if_fail (library != NULL, ELFCLASSNONE);
 
-  if (elf_version (EV_CURRENT) == EV_NONE)
+  if (!_srt_elf_header_get (library, &header))
     {
-      g_debug ("elf_version(EV_CURRENT): %s", elf_errmsg (elf_errno ()));
-      goto out;
+      g_debug ("unable to read ELF header from %s", library);
+      return ELFCLASSNONE;
     }
 
-  if ((fd = open (library, O_RDONLY | O_CLOEXEC, 0)) < 0)
-    {
-      g_debug ("failed to open %s", library);
-      goto out;
-    }
-
-  if ((elf = elf_begin (fd, ELF_C_READ, NULL)) == NULL)
-    {
-      g_debug ("elf_begin() failed: %s", elf_errmsg (elf_errno ()));
-      goto out;
-    }
-
-  class = gelf_getclass (elf);
-
-out:
-  if (elf != NULL)
-    elf_end (elf);
-
-  if (fd >= 0)
-    close (fd);
-
-  return class;
+  return header.elf_class;
 }
 
 /**
@@ -4153,12 +4400,25 @@ _srt_get_modules_from_path (gchar **envp,
         {
           gchar *this_driver_link = NULL;
           const gchar *this_driver = g_ptr_array_index (in_this_dir, j);
-          issues = _srt_check_library_presence (helpers_path, this_driver, multiarch_tuple,
-                                                NULL, NULL, envp, SRT_LIBRARY_SYMBOLS_FORMAT_PLAIN, NULL);
-          /* If "${multiarch}-inspect-library" was unable to load the driver, it's safe to assume that
-           * its ELF class was not what we were searching for. */
-          if (issues & SRT_LIBRARY_ISSUES_CANNOT_LOAD)
-            continue;
+          gboolean matches;
+
+          /* For real architectures, reading the ELF header is enough to
+           * tell whether the driver is for the ABI we are searching for,
+           * without spawning a subprocess per candidate */
+          if (_srt_elf_check_architecture (this_driver, multiarch_tuple, &matches))
+            {
+              if (!matches)
+                continue;
+            }
+          else
+            {
+              issues = _srt_check_library_presence (helpers_path, this_driver, multiarch_tuple,
+                                                    NULL, NULL, envp, SRT_LIBRARY_SYMBOLS_FORMAT_PLAIN, NULL);
+              /* If "${multiarch}-inspect-library" was unable to load the driver, it's safe to assume that
+               * its ELF class was not what we were searching for. */
+              if (issues & SRT_LIBRARY_ISSUES_CANNOT_LOAD)
+                continue;
+            }
 
           switch (module)
             {
@@ -4358,6 +4618,8 @@ out:
  * @multiarch_tuple: (not nullable) (type filename): A Debian-style multiarch tuple
  *  such as %SRT_ABI_X86_64
  * @check_flags: Flags affecting how we do the search
+ * @server: (nullable): An inspect-library server for @multiarch_tuple,
+ *  used to look up all the loader libraries in a single request
  * @module: Which graphic module to search
  * @drivers_out: (inout): Prepend the found drivers to this list.
  *  If @module is #SRT_GRAPHICS_DRI_MODULE or #SRT_GRAPHICS_VAAPI_MODULE or
@@ -4375,6 +4637,7 @@ _srt_get_modules_full (const char *sysroot,
                        const char *helpers_path,
                        const char *multiarch_tuple,
                        SrtCheckFlags check_flags,
+                       SrtHelperServer *server,
                        SrtGraphicsModule module,
                        GList **drivers_out)
 {
@@ -4392,6 +4655,7 @@ _srt_get_modules_full (const char *sysroot,
   GHashTable *drivers_set;
   gboolean is_extra = FALSE;
   GPtrArray *vdpau_argv = NULL;
+  GPtrArray *loader_details = NULL;
   GError *error = NULL;
 
   g_return_if_fail (envp != NULL);
@@ -4541,6 +4805,25 @@ _srt_get_modules_full (const char *sysroot,
         }
     }
 
+  if (server != NULL)
+    {
+      /* Ask the resident helper about all the loaders at once, instead of
+       * starting a new inspect-library process for each of them */
+      gsize n_loaders = g_strv_length ((gchar **) loader_libraries);
+      g_autofree const char **no_symbols = g_new0 (const char *, n_loaders);
+
+      _srt_check_library_presence_batch (helpers_path,
+                                         server,
+                                         multiarch_tuple,
+                                         loader_libraries,
+                                         no_symbols,
+                                         n_loaders,
+                                         NULL,    /* hidden dependencies */
+                                         envp,
+                                         SRT_LIBRARY_SYMBOLS_FORMAT_PLAIN,
+                                         &loader_details);
+    }
+
   for (gsize i = 0; loader_libraries[i] != NULL; i++)
     {
       SrtLibrary *library_details = NULL;
@@ -4550,14 +4833,22 @@ _srt_get_modules_full (const char *sysroot,
       GList *extras = NULL;
       SrtLibraryIssues issues;
 
-      issues = _srt_check_library_presence (helpers_path,
-                                            loader_libraries[i],
-                                            multiarch_tuple,
-                                            NULL,   /* symbols path */
-                                            NULL,   /* hidden dependencies */
-                                            envp,
-                                            SRT_LIBRARY_SYMBOLS_FORMAT_PLAIN,
-                                            &library_details);
+      if (loader_details != NULL)
+        {
+          library_details = g_object_ref (g_ptr_array_index (loader_details, i));
+          issues = srt_library_get_issues (library_details);
+        }
+      else
+        {
+          issues = _srt_check_library_presence (helpers_path,
+                                                loader_libraries[i],
+                                                multiarch_tuple,
+                                                NULL,   /* symbols path */
+                                                NULL,   /* hidden dependencies */
+                                                envp,
+                                                SRT_LIBRARY_SYMBOLS_FORMAT_PLAIN,
+                                                &library_details);
+        }
 
       if (issues & (SRT_LIBRARY_ISSUES_CANNOT_LOAD |
                     SRT_LIBRARY_ISSUES_UNKNOWN |
@@ -4734,6 +5025,7 @@ _srt_get_modules_full (const char *sysroot,
 
 out:
   g_clear_pointer (&vdpau_argv, g_ptr_array_unref);
+  g_clear_pointer (&loader_details, g_ptr_array_unref);
   if (tmp_dir)
     {
       if (!_srt_rm_rf (tmp_dir))
@@ -4850,6 +5142,7 @@ out:
  * @multiarch_tuple: (not nullable) (type filename): A Debian-style multiarch tuple
  *  such as %SRT_ABI_X86_64
  * @check_flags: Flags affecting how we do the search
+ * @server: (nullable): An inspect-library server for @multiarch_tuple
  * @which: Graphics modules to look for
  *
  * Implementation of srt_system_info_list_dri_drivers() etc.
@@ -4871,6 +5164,7 @@ _srt_list_graphics_modules (const char *sysroot,
                             const char *helpers_path,
                             const char *multiarch_tuple,
                             SrtCheckFlags check_flags,
+                            SrtHelperServer *server,
                             SrtGraphicsModule which)
 {
   GList *drivers = NULL;
@@ -4882,7 +5176,7 @@ _srt_list_graphics_modules (const char *sysroot,
     _srt_list_glx_icds (sysroot, envp, helpers_path, multiarch_tuple, &drivers);
   else
     _srt_get_modules_full (sysroot, envp, helpers_path, multiarch_tuple,
-                           check_flags, which, &drivers);
+                           check_flags, server, which, &drivers);
 
   return g_list_reverse (drivers);
 }
@@ -6070,6 +6364,8 @@ _srt_graphics_get_vulkan_search_paths (const char *sysroot,
  *  Vulkan ICDs are searched by their absolute path, obtained using
  *  "inspect-library" in the provided multiarch tuples, instead of just their
  *  resolved library path.
+ * @resolver: (nullable): Used to find and cache the absolute paths of
+ *  libraries when searching for duplicates
  * @check_flags: Whether to check for problems
  *
  * Implementation of srt_system_info_list_vulkan_icds().
@@ -6082,6 +6378,7 @@ _srt_load_vulkan_icds (const char *helpers_path,
                        const char *sysroot,
                        gchar **envp,
                        const char * const *multiarch_tuples,
+                       SrtLibraryResolver *resolver,
                        SrtCheckFlags check_flags)
 {
   const gchar *value;
@@ -6122,7 +6419,7 @@ _srt_load_vulkan_icds (const char *helpers_path,
 
   if (!(check_flags & SRT_CHECK_FLAGS_SKIP_SLOW_CHECKS))
     _srt_loadable_flag_duplicates (SRT_TYPE_VULKAN_ICD, envp, helpers_path,
-                                   multiarch_tuples, ret);
+                                   multiarch_tuples, resolver, ret);
 
   return g_list_reverse (ret);
 }
@@ -6945,6 +7242,8 @@ vulkan_layer_load_json_cb (const char *sysroot,
  *  Vulkan layers are searched by their absolute path, obtained using
  *  'inspect-library' in the provided multiarch tuples, instead of just their
  *  resolved library path.
+ * @resolver: (nullable): Used to find and cache the absolute paths of
+ *  libraries when searching for duplicates
  * @explicit: If %TRUE, load explicit layers, otherwise load implicit layers.
  * @check_flags: Whether to check for problems
  *
@@ -6959,6 +7258,7 @@ _srt_load_vulkan_layers_extended (const char *helpers_path,
                                   const char *sysroot,
                                   gchar **envp,
                                   const char * const *multiarch_tuples,
+                                  SrtLibraryResolver *resolver,
                                   gboolean explicit,
                                   SrtCheckFlags check_flags)
 {
@@ -6998,7 +7298,7 @@ _srt_load_vulkan_layers_extended (const char *helpers_path,
 
   if (!(check_flags & SRT_CHECK_FLAGS_SKIP_SLOW_CHECKS))
     _srt_loadable_flag_duplicates (SRT_TYPE_VULKAN_LAYER, envp, helpers_path,
-                                   multiarch_tuples, ret);
+                                   multiarch_tuples, resolver, ret);
 
   return g_list_reverse (ret);
 }
@@ -7021,8 +7321,8 @@ _srt_load_vulkan_layers (const char *sysroot,
                          gchar **envp,
                          gboolean explicit)
 {
-  return _srt_load_vulkan_layers_extended (NULL, sysroot, envp, NULL, explicit,
-                                           SRT_CHECK_FLAGS_NONE);
+  return _srt_load_vulkan_layers_extended (NULL, sysroot, envp, NULL, NULL,
+                                           explicit, SRT_CHECK_FLAGS_NONE);
 }
 
 static SrtVulkanLayer *
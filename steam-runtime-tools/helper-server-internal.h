@@ -0,0 +1,60 @@
+/*
+ * Copyright © 2026 Collabora Ltd.
+ *
+ * SPDX-License-Identifier: MIT
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#pragma once
+
+#include <glib.h>
+#include <glib-object.h>
+
+#include "steam-runtime-tools/glib-backports-internal.h"
+
+/*
+ * A helper such as inspect-library that stays resident and answers
+ * requests over a socket, to avoid repeating the fork(), exec() and
+ * dynamic linker startup for each request.
+ *
+ * Each request and each response is a frame consisting of the payload
+ * length in bytes as an ASCII decimal number, a newline, and the payload.
+ */
+typedef struct _SrtHelperServer SrtHelperServer;
+
+G_GNUC_INTERNAL
+SrtHelperServer *_srt_helper_server_new (const char *helpers_path,
+                                         const char *multiarch_tuple,
+                                         const char *helper_name,
+                                         const char * const *server_args,
+                                         gchar **envp,
+                                         guint max_processes,
+                                         GError **error);
+G_GNUC_INTERNAL
+void _srt_helper_server_free (SrtHelperServer *self);
+G_GNUC_INTERNAL
+gchar *_srt_helper_server_call (SrtHelperServer *self,
+                                const char *request,
+                                gsize request_len,
+                                gchar **messages_out,
+                                GError **error);
+
+G_DEFINE_AUTOPTR_CLEANUP_FUNC (SrtHelperServer, _srt_helper_server_free)
@@ -0,0 +1,610 @@
+/*
+ * Copyright © 2026 Collabora Ltd.
+ *
+ * SPDX-License-Identifier: MIT
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include "steam-runtime-tools/helper-server-internal.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <gio/gio.h>
+
+#include "steam-runtime-tools/glib-backports-internal.h"
+#include "steam-runtime-tools/utils-internal.h"
+
+/* Longer than inspect-library's own per-library timeout, including
+ * the time it waits for SIGTERM to take effect */
+#define REQUEST_TIMEOUT_SECONDS 30
+
+/* After this many server processes have failed, stop trying to start
+ * new ones: the caller will fall back to one-shot helpers */
+#define MAX_FAILURES 3
+
+/* Frames larger than this are assumed to be a protocol error */
+#define MAX_FRAME_SIZE (64 * 1024 * 1024)
+
+typedef struct
+{
+  GPid pid;
+  /* Our end of a socket connected to the server's stdin and stdout */
+  int fd;
+  /* Read end of a pipe connected to the server's stderr, or -1 if
+   * the server has closed it */
+  int stderr_fd;
+} HelperProcess;
+
+struct _SrtHelperServer
+{
+  GMutex mutex;
+  GCond cond;
+  gchar **argv;
+  gchar **envp;
+  /* (element-type HelperProcess) Processes not currently in use */
+  GPtrArray *idle;
+  /* Number of processes, either idle or in use by a caller */
+  guint n_processes;
+  guint max_processes;
+  guint n_failures;
+};
+
+static void
+helper_process_free (HelperProcess *process)
+{
+  /* The server exits when it reaches end-of-file on its stdin */
+  if (process->fd >= 0)
+    close (process->fd);
+
+  if (process->stderr_fd >= 0)
+    close (process->stderr_fd);
+
+  if (process->pid > 0)
+    {
+      while (waitpid (process->pid, NULL, 0) < 0 && errno == EINTR)
+        continue;
+    }
+
+  g_slice_free (HelperProcess, process);
+}
+
+/*
+ * Kill @process without waiting for it to finish what it was doing.
+ */
+static void
+helper_process_kill (HelperProcess *process)
+{
+  if (process->pid > 0)
+    kill (process->pid, SIGKILL);
+
+  helper_process_free (process);
+}
+
+/*
+ * _srt_helper_server_new:
+ * @helpers_path: (nullable): Directory to search for helper executables,
+ *  or %NULL for default behaviour
+ * @multiarch_tuple: Multiarch tuple of the helper to run
+ * @helper_name: Name of the helper, such as `inspect-library`
+ * @server_args: (array zero-terminated=1): Arguments that make the
+ *  helper act as a server
+ * @envp: Environment for the helper
+ * @max_processes: Maximum number of server processes to run in
+ *  parallel, or 0 to use one per CPU
+ * @error: Used to raise an error if the helper cannot be found
+ *
+ * Prepare to run @helper_name as a resident server. No processes
+ * are started until they are needed.
+ *
+ * Returns: (transfer full): A new #SrtHelperServer, or %NULL on error
+ */
+SrtHelperServer *
+_srt_helper_server_new (const char *helpers_path,
+                        const char *multiarch_tuple,
+                        const char *helper_name,
+                        const char * const *server_args,
+                        gchar **envp,
+                        guint max_processes,
+                        GError **error)
+{
+  g_autoptr(GPtrArray) argv = NULL;
+  SrtHelperServer *self;
+  gsize i;
+
+  g_return_val_if_fail (multiarch_tuple != NULL, NULL);
+  g_return_val_if_fail (helper_name != NULL, NULL);
+  g_return_val_if_fail (envp != NULL, NULL);
+  g_return_val_if_fail (error == NULL || *error == NULL, NULL);
+  g_return_val_if_fail (_srt_check_not_setuid (), NULL);
+
+  /* Each request has its own timeout, so we don't want timeout(1)
+   * to kill the server */
+  argv = _srt_get_helper (helpers_path, multiarch_tuple, helper_name,
+                          SRT_HELPER_FLAGS_NONE, error);
+
+  if (argv == NULL)
+    return NULL;
+
+  for (i = 0; server_args != NULL && server_args[i] != NULL; i++)
+    g_ptr_array_add (argv, g_strdup (server_args[i]));
+
+  g_ptr_array_add (argv, NULL);
+
+  if (max_processes == 0)
+    max_processes = MAX (1, g_get_num_processors ());
+
+  self = g_slice_new0 (SrtHelperServer);
+  g_mutex_init (&self->mutex);
+  g_cond_init (&self->cond);
+  self->argv = (gchar **) g_ptr_array_free (g_steal_pointer (&argv), FALSE);
+  self->envp = _srt_filter_gameoverlayrenderer_from_envp (envp);
+  self->idle = g_ptr_array_new ();
+  self->max_processes = max_processes;
+  return self;
+}
+
+/*
+ * _srt_helper_server_free:
+ * @self: The server
+ *
+ * Stop all server processes and free @self. There must not be any
+ * calls to _srt_helper_server_call() in progress.
+ */
+void
+_srt_helper_server_free (SrtHelperServer *self)
+{
+  g_return_if_fail (self != NULL);
+  g_warn_if_fail (self->idle->len == self->n_processes);
+
+  g_ptr_array_foreach (self->idle, (GFunc) helper_process_free, NULL);
+  g_ptr_array_unref (self->idle);
+  g_strfreev (self->argv);
+  g_strfreev (self->envp);
+  g_cond_clear (&self->cond);
+  g_mutex_clear (&self->mutex);
+  g_slice_free (SrtHelperServer, self);
+}
+
+typedef struct
+{
+  int socket_fd;
+  int stderr_fd;
+} ChildSetupData;
+
+/*
+ * Called in the child process between fork() and exec(), so it must
+ * be async-signal-safe.
+ */
+static void
+helper_server_child_setup (gpointer user_data)
+{
+  const ChildSetupData *data = user_data;
+
+  if (dup2 (data->socket_fd, STDIN_FILENO) != STDIN_FILENO
+      || dup2 (data->socket_fd, STDOUT_FILENO) != STDOUT_FILENO
+      || dup2 (data->stderr_fd, STDERR_FILENO) != STDERR_FILENO)
+    _exit (1);
+
+  _srt_child_setup_unblock_signals (NULL);
+}
+
+static HelperProcess *
+helper_server_start_process (SrtHelperServer *self,
+                             GError **error)
+{
+  HelperProcess *process;
+  ChildSetupData data;
+  int sockets[2];
+  int stderr_pipe[2];
+
+  if (socketpair (AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, sockets) != 0)
+    {
+      int saved_errno = errno;
+
+      g_set_error (error, G_IO_ERROR, g_io_error_from_errno (saved_errno),
+                   "Unable to create socket pair: %s",
+                   g_strerror (saved_errno));
+      return NULL;
+    }
+
+  if (pipe2 (stderr_pipe, O_CLOEXEC) != 0)
+    {
+      int saved_errno = errno;
+
+      close (sockets[0]);
+      close (sockets[1]);
+      g_set_error (error, G_IO_ERROR, g_io_error_from_errno (saved_errno),
+                   "Unable to create pipe: %s",
+                   g_strerror (saved_errno));
+      return NULL;
+    }
+
+  /* We only read stderr when poll() says there is something to read,
+   * or when draining it after a response */
+  fcntl (stderr_pipe[0], F_SETFL, O_NONBLOCK);
+
+  process = g_slice_new0 (HelperProcess);
+  process->fd = sockets[0];
+  process->stderr_fd = stderr_pipe[0];
+  data.socket_fd = sockets[1];
+  data.stderr_fd = stderr_pipe[1];
+
+  g_debug ("Starting %s as a server", self->argv[0]);
+
+  if (!g_spawn_async (NULL,     /* working directory */
+                      self->argv,
+                      self->envp,
+                      G_SPAWN_DO_NOT_REAP_CHILD,
+                      helper_server_child_setup,
+                      &data,
+                      &process->pid,
+                      error))
+    {
+      close (sockets[1]);
+      close (stderr_pipe[1]);
+      process->pid = 0;
+      helper_process_free (process);
+      return NULL;
+    }
+
+  close (sockets[1]);
+  close (stderr_pipe[1]);
+  return process;
+}
+
+/*
+ * Append whatever @process has written to its stderr so far to
+ * @messages, without blocking.
+ */
+static void
+helper_process_read_stderr (HelperProcess *process,
+                            GString *messages)
+{
+  char buf[4096];
+
+  while (process->stderr_fd >= 0)
+    {
+      ssize_t n = read (process->stderr_fd, buf, sizeof (buf));
+
+      if (n < 0 && errno == EINTR)
+        continue;
+
+      /* EAGAIN: nothing more to read for now */
+      if (n < 0)
+        break;
+
+      if (n == 0)
+        {
+          /* End-of-file: the server has exited or closed its stderr */
+          close (process->stderr_fd);
+          process->stderr_fd = -1;
+          break;
+        }
+
+      g_string_append_len (messages, buf, n);
+    }
+}
+
+static gboolean
+send_all (int fd,
+          const char *data,
+          gsize len,
+          GError **error)
+{
+  while (len > 0)
+    {
+      /* MSG_NOSIGNAL: if the server has crashed, fail with EPIPE
+       * instead of raising SIGPIPE in the caller */
+      ssize_t n = send (fd, data, len, MSG_NOSIGNAL);
+
+      if (n < 0 && errno == EINTR)
+        continue;
+
+      if (n < 0)
+        {
+          int saved_errno = errno;
+
+          g_set_error (error, G_IO_ERROR, g_io_error_from_errno (saved_errno),
+                       "Unable to send request to helper: %s",
+                       g_strerror (saved_errno));
+          return FALSE;
+        }
+
+      data += n;
+      len -= n;
+    }
+
+  return TRUE;
+}
+
+/*
+ * Read exactly @len bytes from @process into @buf, failing if they are
+ * not available before @deadline (in g_get_monotonic_time() units).
+ * Meanwhile, append anything that @process writes to its stderr to
+ * @messages, so that it cannot block on a full pipe.
+ */
+static gboolean
+recv_all (HelperProcess *process,
+          char *buf,
+          gsize len,
+          gint64 deadline,
+          GString *messages,
+          GError **error)
+{
+  int fd = process->fd;
+
+  while (len > 0)
+    {
+      struct pollfd pfds[2] =
+      {
+        { .fd = fd, .events = POLLIN },
+        { .fd = process->stderr_fd, .events = POLLIN },
+      };
+      gint64 remaining = (deadline - g_get_monotonic_time ()) / G_TIME_SPAN_MILLISECOND;
+      ssize_t n;
+      int ready;
+
+      if (remaining <= 0)
+        {
+          g_set_error_literal (error, G_IO_ERROR, G_IO_ERROR_TIMED_OUT,
+                               "Timed out waiting for helper");
+          return FALSE;
+        }
+
+      /* poll() ignores negative fds, so if stderr has been closed,
+       * we only wait for the socket */
+      ready = poll (pfds, G_N_ELEMENTS (pfds), (int) MIN (remaining, G_MAXINT));
+
+      if (ready < 0 && errno == EINTR)
+        continue;
+
+      if (ready == 0)
+        continue;
+
+      if (ready < 0)
+        {
+          int saved_errno = errno;
+
+          g_set_error (error, G_IO_ERROR, g_io_error_from_errno (saved_errno),
+                       "Unable to wait for helper: %s",
+                       g_strerror (saved_errno));
+          return FALSE;
+        }
+
+      if (pfds[1].revents != 0)
+        helper_process_read_stderr (process, messages);
+
+      if (pfds[0].revents == 0)
+        continue;
+
+      n = read (fd, buf, len);
+
+      if (n < 0 && errno == EINTR)
+        continue;
+
+      if (n < 0)
+        {
+          int saved_errno = errno;
+
+          g_set_error (error, G_IO_ERROR, g_io_error_from_errno (saved_errno),
+                       "Unable to read response from helper: %s",
+                       g_strerror (saved_errno));
+          return FALSE;
+        }
+
+      if (n == 0)
+        {
+          g_set_error_literal (error, G_IO_ERROR, G_IO_ERROR_CONNECTION_CLOSED,
+                               "Helper exited unexpectedly");
+          return FALSE;
+        }
+
+      buf += n;
+      len -= n;
+    }
+
+  return TRUE;
+}
+
+static gchar *
+helper_process_call (HelperProcess *process,
+                     const char *request,
+                     gsize request_len,
+                     GString *messages,
+                     GError **error)
+{
+  g_autofree gchar *header = g_strdup_printf ("%" G_GSIZE_FORMAT "\n",
+                                              request_len);
+  g_autofree gchar *response = NULL;
+  gint64 deadline;
+  char length_buf[24];
+  char *endptr;
+  guint64 len;
+  gsize i;
+
+  if (!send_all (process->fd, header, strlen (header), error)
+      || !send_all (process->fd, request, request_len, error))
+    return NULL;
+
+  deadline = g_get_monotonic_time () + (REQUEST_TIMEOUT_SECONDS * G_TIME_SPAN_SECOND);
+
+  /* The length is short, so read it one byte at a time to avoid
+   * reading beyond the newline */
+  for (i = 0; i < sizeof (length_buf) - 1; i++)
+    {
+      if (!recv_all (process, &length_buf[i], 1, deadline, messages, error))
+        return NULL;
+
+      if (length_buf[i] == '\n')
+        break;
+    }
+
+  if (i == 0 || i == sizeof (length_buf) - 1)
+    {
+      g_set_error_literal (error, G_IO_ERROR, G_IO_ERROR_INVALID_DATA,
+                           "Invalid frame header from helper");
+      return NULL;
+    }
+
+  length_buf[i] = '\0';
+  len = g_ascii_strtoull (length_buf, &endptr, 10);
+
+  if (*endptr != '\0' || len > MAX_FRAME_SIZE)
+    {
+      g_set_error (error, G_IO_ERROR, G_IO_ERROR_INVALID_DATA,
+                   "Invalid frame length from helper: %s", length_buf);
+      return NULL;
+    }
+
+  response = g_malloc (len + 1);
+
+  if (!recv_all (process, response, len, deadline, messages, error))
+    return NULL;
+
+  /* Anything written to stderr while handling this request was written
+   * before the response, so it is already in the pipe */
+  helper_process_read_stderr (process, messages);
+  response[len] = '\0';
+  return g_steal_pointer (&response);
+}
+
+/*
+ * _srt_helper_server_call:
+ * @self: The server
+ * @request: (array length=request_len): The payload of the request
+ * @request_len: Length of @request in bytes
+ * @messages_out: (out) (optional) (nullable) (transfer full): Used to
+ *  return whatever the server process wrote to its stderr while
+ *  handling @request, or %NULL if it wrote nothing
+ * @error: Used to raise an error on failure
+ *
+ * Send @request to one of the server processes, starting one if
+ * necessary, and return the payload of its response. This may be
+ * called from any thread.
+ *
+ * If the server process fails, it is killed and an error is raised,
+ * so that the caller can fall back to running the helper directly.
+ * A new server process will be started for the next call, unless
+ * too many have already failed.
+ *
+ * Returns: (transfer full): The response, or %NULL on error
+ */
+gchar *
+_srt_helper_server_call (SrtHelperServer *self,
+                         const char *request,
+                         gsize request_len,
+                         gchar **messages_out,
+                         GError **error)
+{
+  HelperProcess *process = NULL;
+  g_autoptr(GError) local_error = NULL;
+  g_autoptr(GString) messages = NULL;
+  gchar *response;
+
+  g_return_val_if_fail (self != NULL, NULL);
+  g_return_val_if_fail (request != NULL || request_len == 0, NULL);
+  g_return_val_if_fail (messages_out == NULL || *messages_out == NULL, NULL);
+  g_return_val_if_fail (error == NULL || *error == NULL, NULL);
+
+  g_mutex_lock (&self->mutex);
+
+  while (self->n_failures < MAX_FAILURES
+         && self->idle->len == 0
+         && self->n_processes >= self->max_processes)
+    g_cond_wait (&self->cond, &self->mutex);
+
+  if (self->n_failures >= MAX_FAILURES)
+    {
+      g_mutex_unlock (&self->mutex);
+      g_set_error (error, G_IO_ERROR, G_IO_ERROR_FAILED,
+                   "Too many failures running %s as a server", self->argv[0]);
+      return NULL;
+    }
+
+  if (self->idle->len > 0)
+    process = g_ptr_array_remove_index_fast (self->idle, self->idle->len - 1);
+  else
+    self->n_processes++;
+
+  g_mutex_unlock (&self->mutex);
+
+  if (process == NULL)
+    process = helper_server_start_process (self, &local_error);
+
+  messages = g_string_new ("");
+
+  if (process != NULL)
+    {
+      /* Anything left over from a previous request is not relevant */
+      helper_process_read_stderr (process, messages);
+
+      if (messages->len > 0)
+        g_debug ("%s server: %s", self->argv[0], messages->str);
+
+      g_string_truncate (messages, 0);
+      response = helper_process_call (process, request, request_len,
+                                      messages, &local_error);
+    }
+  else
+    {
+      response = NULL;
+    }
+
+  if (response == NULL)
+    {
+      g_debug ("%s server failed: %s", self->argv[0], local_error->message);
+
+      if (messages->len > 0)
+        g_debug ("%s server: %s", self->argv[0], messages->str);
+
+      g_clear_pointer (&process, helper_process_kill);
+    }
+  else if (messages_out != NULL && messages->len > 0)
+    {
+      *messages_out = g_utf8_make_valid (messages->str, messages->len);
+    }
+
+  g_mutex_lock (&self->mutex);
+
+  if (response != NULL)
+    {
+      g_ptr_array_add (self->idle, process);
+    }
+  else
+    {
+      self->n_processes--;
+      self->n_failures++;
+      g_propagate_error (error, g_steal_pointer (&local_error));
+    }
+
+  g_cond_broadcast (&self->cond);
+  g_mutex_unlock (&self->mutex);
+  return response;
+}
@@ -23,9 +23,13 @@
  * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
  */
 
+#pragma once
+
 #include <glib.h>
 #include <glib-object.h>
 
+#include "steam-runtime-tools/glib-backports-internal.h"
+
 G_GNUC_INTERNAL gchar *_srt_libdl_detect_platform (gchar **envp,
                                                    const char *helpers_path,
                                                    const char *multiarch_tuple,
@@ -55,3 +59,44 @@ typedef enum
 G_GNUC_INTERNAL
 SrtLoadableKind _srt_loadable_classify (const char *loadable,
                                         SrtLoadableFlags *flags_out);
+
+G_GNUC_INTERNAL
+GHashTable *_srt_ld_so_cache_load (const char *path,
+                                   GError **error);
+
+typedef struct
+{
+  /* Values of EI_CLASS, EI_DATA, e_type and e_machine */
+  guint8 elf_class;
+  guint8 elf_encoding;
+  guint16 elf_type;
+  guint16 elf_machine;
+} SrtElfHeader;
+
+G_GNUC_INTERNAL
+gboolean _srt_elf_header_get (const char *path,
+                              SrtElfHeader *header_out);
+G_GNUC_INTERNAL
+gboolean _srt_elf_check_architecture (const char *path,
+                                      const char *multiarch_tuple,
+                                      gboolean *matches_out);
+
+typedef struct _SrtLibraryResolver SrtLibraryResolver;
+
+G_GNUC_INTERNAL
+SrtLibraryResolver *_srt_library_resolver_new (void);
+G_GNUC_INTERNAL
+void _srt_library_resolver_free (SrtLibraryResolver *self);
+G_GNUC_INTERNAL
+gboolean _srt_library_resolver_get_canonical_path (SrtLibraryResolver *self,
+                                                   gchar **envp,
+                                                   const char *multiarch_tuple,
+                                                   const char *library,
+                                                   gchar **canonical_path_out);
+G_GNUC_INTERNAL
+void _srt_library_resolver_set_canonical_path (SrtLibraryResolver *self,
+                                               const char *multiarch_tuple,
+                                               const char *library,
+                                               const char *canonical_path);
+
+G_DEFINE_AUTOPTR_CLEANUP_FUNC (SrtLibraryResolver, _srt_library_resolver_free)
@@ -25,6 +25,15 @@
 
 #include "steam-runtime-tools/libdl-internal.h"
 
+#include <elf.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+#include "steam-runtime-tools/architecture-internal.h"
 #include "steam-runtime-tools/glib-backports-internal.h"
 #include "steam-runtime-tools/utils.h"
 #include "steam-runtime-tools/utils-internal.h"
@@ -220,3 +229,658 @@ out:
 
   return kind;
 }
+
+/* On-disk format of ld.so.cache, as documented in glibc's dl-cache.h */
+
+#define LD_SO_CACHE_OLD_MAGIC "ld.so-1.7.0"
+#define LD_SO_CACHE_NEW_MAGIC "glibc-ld.so.cache"
+#define LD_SO_CACHE_NEW_VERSION "1.1"
+
+typedef struct
+{
+  char magic[sizeof (LD_SO_CACHE_OLD_MAGIC) - 1];
+  guint32 nlibs;
+} LdSoCacheOldHeader;
+
+typedef struct
+{
+  gint32 flags;
+  guint32 key;
+  guint32 value;
+} LdSoCacheOldEntry;
+
+typedef struct
+{
+  char magic[sizeof (LD_SO_CACHE_NEW_MAGIC) - 1];
+  char version[sizeof (LD_SO_CACHE_NEW_VERSION) - 1];
+  guint32 nlibs;
+  guint32 len_strings;
+  guint8 flags;
+  guint8 padding[3];
+  guint32 extension_offset;
+  guint32 unused[3];
+} LdSoCacheNewHeader;
+
+typedef struct
+{
+  gint32 flags;
+  guint32 key;
+  guint32 value;
+  guint32 osversion;
+  guint64 hwcap;
+} LdSoCacheNewEntry;
+
+/*
+ * Return a pointer to the string at @offset in the @len bytes at
+ * @strings, or %NULL if it is out of range or not NUL-terminated.
+ */
+static const char *
+ld_so_cache_get_string (const char *strings,
+                        gsize len,
+                        guint32 offset)
+{
+  if (offset >= len)
+    return NULL;
+
+  if (memchr (strings + offset, '\0', len - offset) == NULL)
+    return NULL;
+
+  return strings + offset;
+}
+
+/*
+ * _srt_ld_so_cache_load:
+ * @path: Path to an `ld.so.cache`, usually `/etc/ld.so.cache`
+ * @error: Used to raise an error on failure
+ *
+ * Read the new-format entries from @path. The old format, which is no
+ * longer generated by glibc 2.32 or later, is only used to locate the
+ * new-format entries that follow it.
+ *
+ * Returns: (transfer container) (element-type utf8 GPtrArray): A map
+ *  from SONAME to a #GPtrArray of absolute paths, in the order that
+ *  `ld.so(8)` would try them, or %NULL on error
+ */
+GHashTable *
+_srt_ld_so_cache_load (const char *path,
+                       GError **error)
+{
+  g_autoptr(GHashTable) ret = NULL;
+  g_autofree gchar *contents = NULL;
+  LdSoCacheNewHeader header;
+  const char *strings;
+  gsize strings_len;
+  gsize offset = 0;
+  gsize len;
+  gsize i;
+
+  g_return_val_if_fail (path != NULL, NULL);
+  g_return_val_if_fail (error == NULL || *error == NULL, NULL);
+
+  if (!g_file_get_contents (path, &contents, &len, error))
+    return NULL;
+
+  if (len >= sizeof (LdSoCacheOldHeader)
+      && memcmp (contents, LD_SO_CACHE_OLD_MAGIC,
+                 sizeof (LD_SO_CACHE_OLD_MAGIC) - 1) == 0)
+    {
+      LdSoCacheOldHeader old_header;
+
+      memcpy (&old_header, contents, sizeof (old_header));
+
+      if (old_header.nlibs > (len - sizeof (old_header)) / sizeof (LdSoCacheOldEntry))
+        return glnx_null_throw (error, "\"%s\" is truncated", path);
+
+      /* The new-format entries follow, aligned to 8 bytes */
+      offset = sizeof (old_header) + old_header.nlibs * sizeof (LdSoCacheOldEntry);
+      offset = (offset + 7) & ~((gsize) 7);
+    }
+
+  if (offset > len
+      || len - offset < sizeof (header)
+      || memcmp (contents + offset, LD_SO_CACHE_NEW_MAGIC,
+                 sizeof (LD_SO_CACHE_NEW_MAGIC) - 1) != 0)
+    return glnx_null_throw (error, "\"%s\" is not in a supported format", path);
+
+  memcpy (&header, contents + offset, sizeof (header));
+
+  if (memcmp (header.version, LD_SO_CACHE_NEW_VERSION,
+              sizeof (header.version)) != 0)
+    return glnx_null_throw (error, "\"%s\" has unsupported version %.3s",
+                            path, header.version);
+
+  if (header.nlibs > (len - offset - sizeof (header)) / sizeof (LdSoCacheNewEntry))
+    return glnx_null_throw (error, "\"%s\" is truncated", path);
+
+  /* Offsets into the string table are relative to the new-format header */
+  strings = contents + offset;
+  strings_len = len - offset;
+  ret = g_hash_table_new_full (g_str_hash, g_str_equal, g_free,
+                               (GDestroyNotify) g_ptr_array_unref);
+
+  for (i = 0; i < header.nlibs; i++)
+    {
+      LdSoCacheNewEntry entry;
+      GPtrArray *paths;
+      const char *key;
+      const char *value;
+
+      memcpy (&entry,
+              contents + offset + sizeof (header) + i * sizeof (entry),
+              sizeof (entry));
+      key = ld_so_cache_get_string (strings, strings_len, entry.key);
+      value = ld_so_cache_get_string (strings, strings_len, entry.value);
+
+      if (key == NULL || value == NULL)
+        continue;
+
+      paths = g_hash_table_lookup (ret, key);
+
+      if (paths == NULL)
+        {
+          paths = g_ptr_array_new_with_free_func (g_free);
+          g_hash_table_replace (ret, g_strdup (key), paths);
+        }
+
+      g_ptr_array_add (paths, g_strdup (value));
+    }
+
+  return g_steal_pointer (&ret);
+}
+
+typedef struct
+{
+  dev_t dev;
+  ino_t ino;
+} ElfHeaderKey;
+
+typedef struct
+{
+  ElfHeaderKey key;
+  off_t size;
+  struct timespec mtime;
+  SrtElfHeader header;
+  gboolean is_elf;
+} ElfHeaderEntry;
+
+/* (element-type ElfHeaderKey ElfHeaderEntry): Headers that we have
+ * already read, shared by all threads and protected by the lock */
+static GHashTable *elf_header_index = NULL;
+G_LOCK_DEFINE_STATIC (elf_header_index);
+
+static guint
+elf_header_key_hash (gconstpointer p)
+{
+  const ElfHeaderKey *key = p;
+
+  return g_int64_hash (&(gint64) { (gint64) key->ino })
+         ^ g_int64_hash (&(gint64) { (gint64) key->dev });
+}
+
+static gboolean
+elf_header_key_equal (gconstpointer a,
+                      gconstpointer b)
+{
+  const ElfHeaderKey *key_a = a;
+  const ElfHeaderKey *key_b = b;
+
+  return key_a->dev == key_b->dev && key_a->ino == key_b->ino;
+}
+
+static void
+elf_header_entry_free (gpointer p)
+{
+  g_slice_free (ElfHeaderEntry, p);
+}
+
+/*
+ * Parse the start of an ELF header. Returns %FALSE if @data is not
+ * the start of an ELF object.
+ */
+static gboolean
+elf_header_parse (const unsigned char *data,
+                  gsize len,
+                  SrtElfHeader *header_out)
+{
+  /* e_type and e_machine are at the same offsets for both classes */
+  if (len < EI_NIDENT + 4 || memcmp (data, ELFMAG, SELFMAG) != 0)
+    return FALSE;
+
+  header_out->elf_class = data[EI_CLASS];
+  header_out->elf_encoding = data[EI_DATA];
+
+  switch (header_out->elf_encoding)
+    {
+      case ELFDATA2LSB:
+        header_out->elf_type = data[EI_NIDENT] | (data[EI_NIDENT + 1] << 8);
+        header_out->elf_machine = data[EI_NIDENT + 2] | (data[EI_NIDENT + 3] << 8);
+        return TRUE;
+
+      case ELFDATA2MSB:
+        header_out->elf_type = (data[EI_NIDENT] << 8) | data[EI_NIDENT + 1];
+        header_out->elf_machine = (data[EI_NIDENT + 2] << 8) | data[EI_NIDENT + 3];
+        return TRUE;
+
+      default:
+        return FALSE;
+    }
+}
+
+/*
+ * _srt_elf_header_get:
+ * @path: (type filename): A file
+ * @header_out: (out caller-allocates): Used to return the header
+ *
+ * Read the fields of the ELF header that identify the ABI of @path,
+ * without needing libelf or a helper subprocess. Only the fixed-size
+ * ELF header is read, using a single `pread()`.
+ *
+ * Results are cached for the lifetime of the process, keyed by the
+ * device and inode of the file and invalidated if its size or
+ * modification time changes, so it is cheap to call this repeatedly
+ * for the same files. This function is thread-safe.
+ *
+ * Returns: %TRUE if @path is an ELF object
+ */
+gboolean
+_srt_elf_header_get (const char *path,
+                     SrtElfHeader *header_out)
+{
+  unsigned char data[sizeof (Elf64_Ehdr)];
+  glnx_autofd int fd = -1;
+  ElfHeaderEntry *entry;
+  struct stat stat_buf;
+  ssize_t len;
+
+  g_return_val_if_fail (path != NULL, FALSE);
+  g_return_val_if_fail (header_out != NULL, FALSE);
+
+  fd = open (path, O_RDONLY | O_CLOEXEC);
+
+  if (fd < 0 || fstat (fd, &stat_buf) < 0)
+    return FALSE;
+
+  G_LOCK (elf_header_index);
+
+  if (elf_header_index != NULL)
+    {
+      ElfHeaderKey key = { stat_buf.st_dev, stat_buf.st_ino };
+
+      entry = g_hash_table_lookup (elf_header_index, &key);
+
+      if (entry != NULL
+          && entry->size == stat_buf.st_size
+          && entry->mtime.tv_sec == stat_buf.st_mtim.tv_sec
+          && entry->mtime.tv_nsec == stat_buf.st_mtim.tv_nsec)
+        {
+          gboolean is_elf = entry->is_elf;
+
+          *header_out = entry->header;
+          G_UNLOCK (elf_header_index);
+          return is_elf;
+        }
+    }
+
+  G_UNLOCK (elf_header_index);
+
+  entry = g_slice_new0 (ElfHeaderEntry);
+  entry->key.dev = stat_buf.st_dev;
+  entry->key.ino = stat_buf.st_ino;
+  entry->size = stat_buf.st_size;
+  entry->mtime = stat_buf.st_mtim;
+
+  len = TEMP_FAILURE_RETRY (pread (fd, data, sizeof (data), 0));
+
+  if (len > 0)
+    entry->is_elf = elf_header_parse (data, len, &entry->header);
+
+  *header_out = entry->header;
+
+  G_LOCK (elf_header_index);
+
+  if (elf_header_index == NULL)
+    elf_header_index = g_hash_table_new_full (elf_header_key_hash,
+                                              elf_header_key_equal,
+                                              NULL,
+                                              elf_header_entry_free);
+
+  g_hash_table_replace (elf_header_index, &entry->key, entry);
+  G_UNLOCK (elf_header_index);
+
+  return entry->is_elf;
+}
+
+/*
+ * Returns: %TRUE if @header is for an ELF object that could be loaded
+ *  into a process with architecture @arch
+ */
+static gboolean
+elf_header_matches_architecture (const SrtElfHeader *header,
+                                 const SrtKnownArchitecture *arch)
+{
+  return (header->elf_class == arch->elf_class
+          && header->elf_encoding == arch->elf_encoding
+          && header->elf_machine == arch->elf_machine);
+}
+
+/*
+ * Returns: %TRUE if @path is an ELF object that could be loaded
+ *  into a process with architecture @arch
+ */
+static gboolean
+elf_matches_architecture (const char *path,
+                          const SrtKnownArchitecture *arch)
+{
+  SrtElfHeader header;
+
+  if (!_srt_elf_header_get (path, &header))
+    return FALSE;
+
+  return elf_header_matches_architecture (&header, arch);
+}
+
+/*
+ * _srt_elf_check_architecture:
+ * @path: (type filename): A file
+ * @multiarch_tuple: A multiarch tuple such as %SRT_ABI_X86_64
+ * @matches_out: (out): Used to return %TRUE if @path is an ELF object
+ *  for @multiarch_tuple
+ *
+ * Check the architecture of @path using _srt_elf_header_get().
+ *
+ * Returns: %FALSE if @multiarch_tuple is not a known architecture,
+ *  in which case the caller will have to use a helper subprocess
+ */
+gboolean
+_srt_elf_check_architecture (const char *path,
+                             const char *multiarch_tuple,
+                             gboolean *matches_out)
+{
+  const SrtKnownArchitecture *arch;
+
+  g_return_val_if_fail (path != NULL, FALSE);
+  g_return_val_if_fail (multiarch_tuple != NULL, FALSE);
+  g_return_val_if_fail (matches_out != NULL, FALSE);
+
+  arch = _srt_architecture_get_by_tuple (multiarch_tuple);
+
+  if (arch == NULL)
+    return FALSE;
+
+  *matches_out = elf_matches_architecture (path, arch);
+  return TRUE;
+}
+
+struct _SrtLibraryResolver
+{
+  /* "multiarch-tuple/library" => canonical path, or %NULL if the
+   * library cannot be loaded for that ABI */
+  GHashTable *canonical_paths;
+  /* SONAME => GPtrArray of paths, or %NULL if unavailable */
+  GHashTable *ld_so_cache;
+  gboolean tried_ld_so_cache;
+};
+
+/*
+ * _srt_library_resolver_new:
+ *
+ * Create an object that can find the canonical path of a library as
+ * it would be loaded by `dlopen()`, without needing to run a helper
+ * subprocess in simple cases, and caches the results.
+ *
+ * The results depend on the environment variables, in particular
+ * `LD_LIBRARY_PATH`, so the caller must discard the resolver if the
+ * environment changes.
+ *
+ * Returns: (transfer full): A new resolver
+ */
+SrtLibraryResolver *
+_srt_library_resolver_new (void)
+{
+  SrtLibraryResolver *self = g_slice_new0 (SrtLibraryResolver);
+
+  self->canonical_paths = g_hash_table_new_full (g_str_hash, g_str_equal,
+                                                 g_free, g_free);
+  return self;
+}
+
+void
+_srt_library_resolver_free (SrtLibraryResolver *self)
+{
+  g_clear_pointer (&self->canonical_paths, g_hash_table_unref);
+  g_clear_pointer (&self->ld_so_cache, g_hash_table_unref);
+  g_slice_free (SrtLibraryResolver, self);
+}
+
+/*
+ * Return the canonical path of @path if it exists and has architecture
+ * @arch, or %NULL.
+ */
+static gchar *
+library_resolver_try_path (const char *path,
+                           const SrtKnownArchitecture *arch)
+{
+  if (!elf_matches_architecture (path, arch))
+    return NULL;
+
+  return realpath (path, NULL);
+}
+
+/*
+ * Return the canonical path of @soname if it can be found in @dir,
+ * or %NULL.
+ */
+static gchar *
+library_resolver_try_dir (const char *dir,
+                          const char *soname,
+                          const SrtKnownArchitecture *arch)
+{
+  g_autofree gchar *path = g_build_filename (dir, soname, NULL);
+
+  return library_resolver_try_path (path, arch);
+}
+
+/*
+ * Search for @soname in approximately the same way as `ld.so(8)`.
+ * Returns %FALSE if we cannot reliably emulate the search.
+ */
+static gboolean
+library_resolver_search (SrtLibraryResolver *self,
+                         gchar **envp,
+                         const SrtKnownArchitecture *arch,
+                         const char *soname,
+                         gchar **canonical_path_out)
+{
+  const char *ld_library_path;
+  g_autofree gchar *multiarch_lib = NULL;
+  g_autofree gchar *multiarch_usr_lib = NULL;
+  g_autofree gchar *default_lib = NULL;
+  g_autofree gchar *default_usr_lib = NULL;
+  const char *default_dirs[4];
+  GPtrArray *cached;
+  gsize i;
+
+  ld_library_path = g_environ_getenv (envp, "LD_LIBRARY_PATH");
+
+  if (ld_library_path != NULL)
+    {
+      g_auto(GStrv) dirs = NULL;
+
+      /* The helper would expand dynamic string tokens relative to
+       * its own location and architecture, so leave that to it */
+      if (strchr (ld_library_path, '$') != NULL)
+        return FALSE;
+
+      dirs = g_strsplit_set (ld_library_path, ":;", -1);
+
+      for (i = 0; dirs[i] != NULL; i++)
+        {
+          /* An empty element means the current working directory */
+          *canonical_path_out = library_resolver_try_dir (dirs[i][0] == '\0' ? "." : dirs[i],
+                                                          soname, arch);
+
+          if (*canonical_path_out != NULL)
+            return TRUE;
+        }
+    }
+
+  if (!self->tried_ld_so_cache)
+    {
+      g_autoptr(GError) local_error = NULL;
+
+      self->ld_so_cache = _srt_ld_so_cache_load ("/etc/ld.so.cache", &local_error);
+      self->tried_ld_so_cache = TRUE;
+
+      if (self->ld_so_cache == NULL)
+        g_debug ("Unable to load ld.so.cache: %s", local_error->message);
+    }
+
+  if (self->ld_so_cache != NULL)
+    {
+      cached = g_hash_table_lookup (self->ld_so_cache, soname);
+
+      for (i = 0; cached != NULL && i < cached->len; i++)
+        {
+          *canonical_path_out = library_resolver_try_path (g_ptr_array_index (cached, i),
+                                                           arch);
+
+          if (*canonical_path_out != NULL)
+            return TRUE;
+        }
+    }
+
+  /* Fall back to the directories that are compiled into ld.so by the
+   * major distributions */
+  default_dirs[0] = multiarch_lib = g_build_filename ("/lib", arch->multiarch_tuple, NULL);
+  default_dirs[1] = multiarch_usr_lib = g_build_filename ("/usr/lib", arch->multiarch_tuple, NULL);
+  default_dirs[2] = default_lib = g_build_filename ("/", arch->default_libdir, NULL);
+  default_dirs[3] = default_usr_lib = g_build_filename ("/usr", arch->default_libdir, NULL);
+
+  for (i = 0; i < G_N_ELEMENTS (default_dirs); i++)
+    {
+      *canonical_path_out = library_resolver_try_dir (default_dirs[i],
+                                                      soname, arch);
+
+      if (*canonical_path_out != NULL)
+        return TRUE;
+    }
+
+  /* Not found, but we are confident that the helper would not find it
+   * either */
+  return TRUE;
+}
+
+/*
+ * _srt_library_resolver_get_canonical_path:
+ * @self: A resolver
+ * @envp: (array zero-terminated=1): Behave as though `environ` was this array
+ * @multiarch_tuple: The ABI in which to load @library
+ * @library: A SONAME such as `libEGL_mesa.so.0`, or a path
+ * @canonical_path_out: (out) (transfer full) (optional): Used to return
+ *  the canonical path of @library, or %NULL if it could not be loaded
+ *  as @multiarch_tuple
+ *
+ * Find the path from which `dlopen()` would load @library in a process
+ * of architecture @multiarch_tuple, with symbolic links resolved, either
+ * from the cache or by emulating the search done by `ld.so(8)`.
+ *
+ * Returns: %TRUE if the result is known, or %FALSE if the caller will
+ *  need to run a helper subprocess to find out, in which case it should
+ *  call _srt_library_resolver_set_canonical_path() with the result
+ */
+gboolean
+_srt_library_resolver_get_canonical_path (SrtLibraryResolver *self,
+                                          gchar **envp,
+                                          const char *multiarch_tuple,
+                                          const char *library,
+                                          gchar **canonical_path_out)
+{
+  const SrtKnownArchitecture *arch;
+  g_autofree gchar *key = NULL;
+  g_autofree gchar *canonical_path = NULL;
+  SrtLoadableFlags flags = SRT_LOADABLE_FLAGS_NONE;
+  gpointer value;
+
+  g_return_val_if_fail (self != NULL, FALSE);
+  g_return_val_if_fail (envp != NULL, FALSE);
+  g_return_val_if_fail (multiarch_tuple != NULL, FALSE);
+  g_return_val_if_fail (library != NULL, FALSE);
+  g_return_val_if_fail (canonical_path_out == NULL || *canonical_path_out == NULL,
+                        FALSE);
+
+  key = g_strdup_printf ("%s/%s", multiarch_tuple, library);
+
+  if (g_hash_table_lookup_extended (self->canonical_paths, key, NULL, &value))
+    {
+      if (canonical_path_out != NULL)
+        *canonical_path_out = g_strdup (value);
+
+      return TRUE;
+    }
+
+  /* We can only check ELF headers for architectures that we know about */
+  arch = _srt_architecture_get_by_tuple (multiarch_tuple);
+
+  if (arch == NULL)
+    return FALSE;
+
+  switch (_srt_loadable_classify (library, &flags))
+    {
+      case SRT_LOADABLE_KIND_PATH:
+        if (flags & SRT_LOADABLE_FLAGS_DYNAMIC_TOKENS)
+          return FALSE;
+
+        canonical_path = library_resolver_try_path (library, arch);
+        break;
+
+      case SRT_LOADABLE_KIND_BASENAME:
+        if (!library_resolver_search (self, envp, arch, library, &canonical_path))
+          return FALSE;
+
+        break;
+
+      case SRT_LOADABLE_KIND_ERROR:
+      default:
+        break;
+    }
+
+  if (canonical_path != NULL)
+    g_debug ("%s library \"%s\" resolved in-process to \"%s\"",
+             multiarch_tuple, library, canonical_path);
+  else
+    g_debug ("%s library \"%s\" not found in-process",
+             multiarch_tuple, library);
+
+  g_hash_table_replace (self->canonical_paths, g_steal_pointer (&key),
+                        g_strdup (canonical_path));
+
+  if (canonical_path_out != NULL)
+    *canonical_path_out = g_steal_pointer (&canonical_path);
+
+  return TRUE;
+}
+
+/*
+ * _srt_library_resolver_set_canonical_path:
+ * @self: A resolver
+ * @multiarch_tuple: The ABI in which @library was loaded
+ * @library: A SONAME or path
+ * @canonical_path: (nullable): The canonical path of @library, or %NULL
+ *  if it could not be loaded as @multiarch_tuple
+ *
+ * Remember a result that the caller found by some other means.
+ */
+void
+_srt_library_resolver_set_canonical_path (SrtLibraryResolver *self,
+                                          const char *multiarch_tuple,
+                                          const char *library,
+                                          const char *canonical_path)
+{
+  g_return_if_fail (self != NULL);
+  g_return_if_fail (multiarch_tuple != NULL);
+  g_return_if_fail (library != NULL);
+
+  g_hash_table_replace (self->canonical_paths,
+                        g_strdup_printf ("%s/%s", multiarch_tuple, library),
+                        g_strdup (canonical_path));
+}
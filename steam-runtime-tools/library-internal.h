@@ -27,6 +27,7 @@
 #pragma once
 
 #include "steam-runtime-tools/library.h"
+#include "steam-runtime-tools/helper-server-internal.h"
 
 #include <json-glib/json-glib.h>
 
@@ -107,4 +108,16 @@ SrtLibraryIssues _srt_check_library_presence (const char *helpers_path,
                                               SrtLibrarySymbolsFormat symbols_format,
                                               SrtLibrary **more_details_out);
 
+G_GNUC_INTERNAL
+SrtLibraryIssues _srt_check_library_presence_batch (const char *helpers_path,
+                                                    SrtHelperServer *server,
+                                                    const char *multiarch,
+                                                    const char * const *requested_names,
+                                                    const char * const *symbols_paths,
+                                                    gsize n_libraries,
+                                                    GHashTable *hidden_deps,
+                                                    gchar **envp,
+                                                    SrtLibrarySymbolsFormat symbols_format,
+                                                    GPtrArray **libraries_out);
+
 SrtLibraryIssues _srt_library_get_issues_from_report (JsonObject *json_obj);
@@ -623,6 +623,189 @@ srt_check_library_presence (const char *requested_name,
                                       symbols_format, more_details_out);
 }
 
+/*
+ * Results parsed from `inspect-library --line-based`.
+ */
+typedef struct
+{
+  gchar *absolute_path;
+  gchar *real_soname;
+  gchar *messages;
+  GPtrArray *missing_symbols;
+  GPtrArray *misversioned_symbols;
+  GPtrArray *dependencies;
+} InspectLibraryResult;
+
+static void
+inspect_library_result_init (InspectLibraryResult *self)
+{
+  self->absolute_path = NULL;
+  self->real_soname = NULL;
+  self->messages = NULL;
+  self->missing_symbols = g_ptr_array_new_with_free_func (g_free);
+  self->misversioned_symbols = g_ptr_array_new_with_free_func (g_free);
+  self->dependencies = g_ptr_array_new_with_free_func (g_free);
+}
+
+static void
+inspect_library_result_clear (InspectLibraryResult *self)
+{
+  g_clear_pointer (&self->absolute_path, g_free);
+  g_clear_pointer (&self->real_soname, g_free);
+  g_clear_pointer (&self->messages, g_free);
+  g_clear_pointer (&self->missing_symbols, g_ptr_array_unref);
+  g_clear_pointer (&self->misversioned_symbols, g_ptr_array_unref);
+  g_clear_pointer (&self->dependencies, g_ptr_array_unref);
+}
+
+/*
+ * inspect_library_result_parse_line:
+ * @self: Results for @requested_name
+ * @requested_name: The library that was inspected
+ * @line: A line of `inspect-library --line-based` output, without
+ *  its trailing newline
+ * @value_out: (out) (optional) (transfer full): Used to return the
+ *  decoded value of lines that were not understood
+ *
+ * Returns: %TRUE if @line was understood
+ */
+static gboolean
+inspect_library_result_parse_line (InspectLibraryResult *self,
+                                   const char *requested_name,
+                                   const char *line,
+                                   gchar **value_out)
+{
+  const char *equals;
+  g_autofree gchar *decoded = NULL;
+
+  equals = strchr (line, '=');
+
+  if (equals == NULL)
+    {
+      g_warning ("Unexpected line in inspect-library output: %s", line);
+      return TRUE;
+    }
+
+  decoded = g_strcompress (equals + 1);
+
+  if (g_str_has_prefix (line, "requested="))
+    {
+      if (strcmp (requested_name, decoded) != 0)
+        {
+          g_warning ("Unexpected inspect-library output: "
+                     "asked for \"%s\", but got \"%s\"?",
+                     requested_name, decoded);
+          /* might as well continue to process it, though... */
+        }
+    }
+  else if (g_str_has_prefix (line, "soname="))
+    {
+      if (self->real_soname == NULL)
+        self->real_soname = g_steal_pointer (&decoded);
+      else
+        g_warning ("More than one SONAME in inspect-library output");
+    }
+  else if (g_str_has_prefix (line, "path="))
+    {
+      if (self->absolute_path == NULL)
+        self->absolute_path = g_steal_pointer (&decoded);
+      else
+        g_warning ("More than one path in inspect-library output");
+    }
+  else if (g_str_has_prefix (line, "missing_symbol="))
+    {
+      g_ptr_array_add (self->missing_symbols, g_steal_pointer (&decoded));
+    }
+  else if (g_str_has_prefix (line, "misversioned_symbol="))
+    {
+      g_ptr_array_add (self->misversioned_symbols, g_steal_pointer (&decoded));
+    }
+  else if (g_str_has_prefix (line, "dependency="))
+    {
+      g_ptr_array_add (self->dependencies, g_steal_pointer (&decoded));
+    }
+  else if (g_str_has_prefix (line, "messages="))
+    {
+      if (self->messages == NULL)
+        self->messages = g_steal_pointer (&decoded);
+      else
+        g_warning ("More than one messages line in inspect-library output");
+    }
+  else
+    {
+      if (value_out != NULL)
+        *value_out = g_steal_pointer (&decoded);
+
+      return FALSE;
+    }
+
+  return TRUE;
+}
+
+/*
+ * inspect_library_result_finish:
+ * @self: Results for @requested_name
+ * @issues: Issues already known, for example because the helper failed
+ * @messages: (nullable): Diagnostic messages, or %NULL to use the
+ *  messages that were parsed from the output
+ * @more_details_out: (out) (optional) (transfer full): Used to return
+ *  a #SrtLibrary
+ *
+ * Returns: @issues, plus any issues indicated by @self
+ */
+static SrtLibraryIssues
+inspect_library_result_finish (InspectLibraryResult *self,
+                               const char *multiarch,
+                               const char *requested_name,
+                               SrtLibraryIssues issues,
+                               const char *messages,
+                               int exit_status,
+                               int terminating_signal,
+                               SrtLibrary **more_details_out)
+{
+  const char * const *missing_symbols_strv = NULL;
+  const char * const *misversioned_symbols_strv = NULL;
+  const char * const *dependencies_strv = NULL;
+
+  if (self->missing_symbols->len > 0)
+    {
+      issues |= SRT_LIBRARY_ISSUES_MISSING_SYMBOLS;
+      g_ptr_array_add (self->missing_symbols, NULL);
+      missing_symbols_strv = (const char * const *) self->missing_symbols->pdata;
+    }
+
+  if (self->misversioned_symbols->len > 0)
+    {
+      issues |= SRT_LIBRARY_ISSUES_MISVERSIONED_SYMBOLS;
+      g_ptr_array_add (self->misversioned_symbols, NULL);
+      misversioned_symbols_strv = (const char * const *) self->misversioned_symbols->pdata;
+    }
+
+  if (self->dependencies->len > 0)
+    {
+      g_ptr_array_add (self->dependencies, NULL);
+      dependencies_strv = (const char * const *) self->dependencies->pdata;
+    }
+
+  if (messages == NULL)
+    messages = self->messages;
+
+  if (more_details_out != NULL)
+    *more_details_out = _srt_library_new (multiarch,
+                                          self->absolute_path,
+                                          requested_name,
+                                          issues,
+                                          messages,
+                                          missing_symbols_strv,
+                                          misversioned_symbols_strv,
+                                          dependencies_strv,
+                                          self->real_soname,
+                                          exit_status,
+                                          terminating_signal);
+
+  return issues;
+}
+
 SrtLibraryIssues
 _srt_check_library_presence (const char *helpers_path,
                              const char *requested_name,
@@ -636,23 +819,16 @@ _srt_check_library_presence (const char *helpers_path,
   GPtrArray *argv = NULL;
   gchar *output = NULL;
   gchar *child_stderr = NULL;
-  gchar *absolute_path = NULL;
-  gchar *real_soname = NULL;
   int wait_status = -1;
   int exit_status = -1;
   int terminating_signal = 0;
   GError *error = NULL;
-  g_autoptr(GPtrArray) missing_symbols = NULL;
-  g_autoptr(GPtrArray) misversioned_symbols = NULL;
-  g_autoptr(GPtrArray) dependencies = NULL;
+  InspectLibraryResult result;
   SrtLibraryIssues issues = SRT_LIBRARY_ISSUES_NONE;
   GStrv my_environ = NULL;
   SrtHelperFlags flags = SRT_HELPER_FLAGS_TIME_OUT;
   GString *log_args = NULL;
   gchar *next_line;
-  const char * const *missing_symbols_strv = NULL;
-  const char * const *misversioned_symbols_strv = NULL;
-  const char * const *dependencies_strv = NULL;
 
   g_return_val_if_fail (requested_name != NULL, SRT_LIBRARY_ISSUES_UNKNOWN);
   g_return_val_if_fail (multiarch != NULL, SRT_LIBRARY_ISSUES_UNKNOWN);
@@ -661,6 +837,8 @@ _srt_check_library_presence (const char *helpers_path,
   g_return_val_if_fail (envp != NULL, SRT_LIBRARY_ISSUES_UNKNOWN);
   g_return_val_if_fail (_srt_check_not_setuid (), SRT_LIBRARY_ISSUES_UNKNOWN);
 
+  inspect_library_result_init (&result);
+
   if (symbols_path == NULL)
     issues |= SRT_LIBRARY_ISSUES_UNKNOWN_EXPECTATIONS;
 
@@ -752,17 +930,12 @@ _srt_check_library_presence (const char *helpers_path,
       exit_status = 0;
     }
 
-  missing_symbols = g_ptr_array_new_with_free_func (g_free);
-  misversioned_symbols = g_ptr_array_new_with_free_func (g_free);
-  dependencies = g_ptr_array_new_with_free_func (g_free);
-
   next_line = output;
 
   while (next_line != NULL)
     {
       char *line = next_line;
-      char *equals;
-      g_autofree gchar *decoded = NULL;
+      g_autofree gchar *unknown = NULL;
 
       if (*next_line == '\0')
         break;
@@ -775,51 +948,141 @@ _srt_check_library_presence (const char *helpers_path,
           next_line++;
         }
 
-      equals = strchr (line, '=');
+      if (!inspect_library_result_parse_line (&result, requested_name,
+                                              line, &unknown))
+        g_debug ("Unknown line in inspect-library output: %s", line);
+    }
+
+out:
+  issues = inspect_library_result_finish (&result, multiarch, requested_name,
+                                          issues, child_stderr,
+                                          exit_status, terminating_signal,
+                                          more_details_out);
 
-      if (equals == NULL)
+  inspect_library_result_clear (&result);
+  g_strfreev (my_environ);
+  g_clear_pointer (&argv, g_ptr_array_unref);
+  g_free (child_stderr);
+  g_free (output);
+  g_clear_error (&error);
+  return issues;
+}
+
+/*
+ * Parse the output of `inspect-library --line-based --batch`, which
+ * was asked to check @requested_names, appending a #SrtLibrary to
+ * @libraries for each library that it reported.
+ *
+ * Returns: The number of libraries that were reported
+ */
+static gsize
+parse_batch_output (char *output,
+                    const char *multiarch,
+                    const char * const *requested_names,
+                    const char * const *symbols_paths,
+                    gsize n_libraries,
+                    GPtrArray *libraries,
+                    SrtLibraryIssues *combined_issues)
+{
+  InspectLibraryResult result = { NULL };
+  gboolean in_result = FALSE;
+  gchar *next_line;
+  gsize done = 0;
+
+  next_line = output;
+
+  while (next_line != NULL && done < n_libraries)
+    {
+      char *line = next_line;
+      g_autofree gchar *value = NULL;
+
+      if (*next_line == '\0')
+        break;
+
+      next_line = strchr (line, '\n');
+
+      if (next_line != NULL)
         {
-          g_warning ("Unexpected line in inspect-library output: %s", line);
-          continue;
+          *next_line = '\0';
+          next_line++;
         }
 
-      decoded = g_strcompress (equals + 1);
-
-      if (g_str_has_prefix (line, "requested="))
+      if (!in_result)
         {
-          if (strcmp (requested_name, decoded) != 0)
+          if (g_str_has_prefix (line, "begin="))
             {
-              g_warning ("Unexpected inspect-library output: "
-                         "asked for \"%s\", but got \"%s\"?",
-                         requested_name, decoded);
-              /* might as well continue to process it, though... */
+              value = g_strcompress (line + strlen ("begin="));
+
+              if (strcmp (value, requested_names[done]) != 0)
+                {
+                  g_warning ("Unexpected inspect-library output: "
+                             "asked for \"%s\", but got \"%s\"?",
+                             requested_names[done], value);
+                  break;
+                }
+
+              inspect_library_result_init (&result);
+              in_result = TRUE;
             }
-        }
-      else if (g_str_has_prefix (line, "soname="))
-        {
-          if (real_soname == NULL)
-            real_soname = g_steal_pointer (&decoded);
           else
-            g_warning ("More than one SONAME in inspect-library output");
+            {
+              g_warning ("Unexpected line in inspect-library output: %s", line);
+            }
+
+          continue;
         }
-      else if (g_str_has_prefix (line, "path="))
+
+      if (inspect_library_result_parse_line (&result, requested_names[done],
+                                             line, &value))
+        continue;
+
+      if (g_str_has_prefix (line, "wait_status="))
         {
-          if (absolute_path == NULL)
-            absolute_path = g_steal_pointer (&decoded);
+          SrtLibraryIssues issues = SRT_LIBRARY_ISSUES_NONE;
+          SrtLibrary *library = NULL;
+          g_autofree gchar *messages = NULL;
+          int exit_status = -1;
+          int terminating_signal = 0;
+          int child_wait_status = (int) g_ascii_strtoll (value, NULL, 10);
+
+          if (symbols_paths[done] == NULL)
+            issues |= SRT_LIBRARY_ISSUES_UNKNOWN_EXPECTATIONS;
+
+          if (child_wait_status != 0)
+            {
+              g_debug ("%s: wait status %d", requested_names[done],
+                       child_wait_status);
+              issues |= SRT_LIBRARY_ISSUES_CANNOT_LOAD;
+
+              if (_srt_process_timeout_wait_status (child_wait_status,
+                                                    &exit_status,
+                                                    &terminating_signal))
+                issues |= SRT_LIBRARY_ISSUES_TIMEOUT;
+
+              /* Be consistent with _srt_check_library_presence(), which
+               * does not parse the output of a failed helper */
+              messages = g_steal_pointer (&result.messages);
+              inspect_library_result_clear (&result);
+              inspect_library_result_init (&result);
+              result.messages = g_steal_pointer (&messages);
+            }
           else
-            g_warning ("More than one path in inspect-library output");
-        }
-      else if (g_str_has_prefix (line, "missing_symbol="))
-        {
-          g_ptr_array_add (missing_symbols, g_steal_pointer (&decoded));
-        }
-      else if (g_str_has_prefix (line, "misversioned_symbol="))
-        {
-          g_ptr_array_add (misversioned_symbols, g_steal_pointer (&decoded));
-        }
-      else if (g_str_has_prefix (line, "dependency="))
-        {
-          g_ptr_array_add (dependencies, g_steal_pointer (&decoded));
+            {
+              exit_status = 0;
+            }
+
+          *combined_issues |= inspect_library_result_finish (&result,
+                                                             multiarch,
+                                                             requested_names[done],
+                                                             issues,
+                                                             NULL,
+                                                             exit_status,
+                                                             terminating_signal,
+                                                             &library);
+          g_ptr_array_add (libraries, library);
+          inspect_library_result_clear (&result);
+          in_result = FALSE;
+          done++;
         }
       else
         {
@@ -827,48 +1090,298 @@ _srt_check_library_presence (const char *helpers_path,
         }
     }
 
-out:
-  if (missing_symbols != NULL && missing_symbols->len > 0)
+  if (in_result)
+    inspect_library_result_clear (&result);
+
+  return done;
+}
+
+/*
+ * Check @requested_names with one `inspect-library --batch` process,
+ * appending a #SrtLibrary to @libraries for each library that it reported.
+ *
+ * Returns: The number of libraries that were checked
+ */
+static gsize
+check_libraries_in_batch (const char *helpers_path,
+                          const char *multiarch,
+                          const char * const *requested_names,
+                          const char * const *symbols_paths,
+                          gsize n_libraries,
+                          GHashTable *hidden_deps,
+                          gchar **envp,
+                          SrtLibrarySymbolsFormat symbols_format,
+                          GPtrArray *libraries,
+                          SrtLibraryIssues *combined_issues)
+{
+  g_autoptr(GPtrArray) argv = NULL;
+  g_autofree gchar *output = NULL;
+  g_autofree gchar *child_stderr = NULL;
+  g_auto(GStrv) my_environ = NULL;
+  g_autoptr(GError) error = NULL;
+  int wait_status = -1;
+  gsize i;
+
+  /* The helper applies a timeout to each library individually, so we
+   * don't want timeout(1) to kill the whole batch */
+  argv = _srt_get_helper (helpers_path, multiarch, "inspect-library",
+                          SRT_HELPER_FLAGS_NONE, &error);
+
+  if (argv == NULL)
     {
-      issues |= SRT_LIBRARY_ISSUES_MISSING_SYMBOLS;
-      g_ptr_array_add (missing_symbols, NULL);
-      missing_symbols_strv = (const char * const *) missing_symbols->pdata;
+      g_debug ("Unable to check libraries in a batch: %s", error->message);
+      return 0;
     }
 
-  if (misversioned_symbols != NULL && misversioned_symbols->len > 0)
+  g_ptr_array_add (argv, g_strdup ("--line-based"));
+  g_ptr_array_add (argv, g_strdup ("--batch"));
+
+  switch (symbols_format)
     {
-      issues |= SRT_LIBRARY_ISSUES_MISVERSIONED_SYMBOLS;
-      g_ptr_array_add (misversioned_symbols, NULL);
-      misversioned_symbols_strv = (const char * const *) misversioned_symbols->pdata;
+      case SRT_LIBRARY_SYMBOLS_FORMAT_PLAIN:
+        break;
+
+      case SRT_LIBRARY_SYMBOLS_FORMAT_DEB_SYMBOLS:
+        g_ptr_array_add (argv, g_strdup ("--deb-symbols"));
+        break;
+
+      default:
+        g_return_val_if_reached (0);
     }
 
-  if (dependencies != NULL && dependencies->len > 0)
+  for (i = 0; hidden_deps != NULL && i < n_libraries; i++)
     {
-      g_ptr_array_add (dependencies, NULL);
-      dependencies_strv = (const char * const *) dependencies->pdata;
+      const char * const *deps = g_hash_table_lookup (hidden_deps,
+                                                      requested_names[i]);
+
+      for (gsize j = 0; deps != NULL && deps[j] != NULL; j++)
+        g_ptr_array_add (argv,
+                         g_strdup_printf ("--hidden-dependency-of=%s=%s",
+                                          requested_names[i], deps[j]));
     }
 
-  if (more_details_out != NULL)
-    *more_details_out = _srt_library_new (multiarch,
-                                          absolute_path,
-                                          requested_name,
-                                          issues,
-                                          child_stderr,
-                                          missing_symbols_strv,
-                                          misversioned_symbols_strv,
-                                          dependencies_strv,
-                                          real_soname,
-                                          exit_status,
-                                          terminating_signal);
+  for (i = 0; i < n_libraries; i++)
+    {
+      g_ptr_array_add (argv, g_strdup (requested_names[i]));
+      g_ptr_array_add (argv, g_strdup (symbols_paths[i] != NULL ? symbols_paths[i] : ""));
+    }
 
-  g_strfreev (my_environ);
-  g_clear_pointer (&argv, g_ptr_array_unref);
-  g_free (absolute_path);
-  g_free (child_stderr);
-  g_free (output);
-  g_free (real_soname);
-  g_clear_error (&error);
-  return issues;
+  g_debug ("Checking %" G_GSIZE_FORMAT " %s libraries in one batch",
+           n_libraries, multiarch);
+
+  /* NULL terminate the array */
+  g_ptr_array_add (argv, NULL);
+
+  my_environ = _srt_filter_gameoverlayrenderer_from_envp (envp);
+
+  if (!g_spawn_sync (NULL,       /* working directory */
+                     (gchar **) argv->pdata,
+                     my_environ, /* envp */
+                     G_SPAWN_SEARCH_PATH,          /* flags */
+                     _srt_child_setup_unblock_signals,
+                     NULL,       /* user data */
+                     &output,    /* stdout */
+                     &child_stderr,
+                     &wait_status,
+                     &error))
+    {
+      g_debug ("An error occurred calling the helper: %s", error->message);
+      return 0;
+    }
+
+  if (wait_status != 0)
+    g_debug ("... wait status %d: %s", wait_status, child_stderr);
+
+  return parse_batch_output (output, multiarch, requested_names,
+                             symbols_paths, n_libraries, libraries,
+                             combined_issues);
+}
+
+/*
+ * Check @requested_names one at a time with an `inspect-library --server`,
+ * appending a #SrtLibrary to @libraries for each library that it reported.
+ *
+ * Returns: The number of libraries that were checked
+ */
+static gsize
+check_libraries_with_server (SrtHelperServer *server,
+                             const char *multiarch,
+                             const char * const *requested_names,
+                             const char * const *symbols_paths,
+                             gsize n_libraries,
+                             GHashTable *hidden_deps,
+                             SrtLibrarySymbolsFormat symbols_format,
+                             GPtrArray *libraries,
+                             SrtLibraryIssues *combined_issues)
+{
+  const char *format;
+  gsize i;
+
+  switch (symbols_format)
+    {
+      case SRT_LIBRARY_SYMBOLS_FORMAT_PLAIN:
+        format = "plain";
+        break;
+
+      case SRT_LIBRARY_SYMBOLS_FORMAT_DEB_SYMBOLS:
+        format = "deb-symbols";
+        break;
+
+      default:
+        g_return_val_if_reached (0);
+    }
+
+  for (i = 0; i < n_libraries; i++)
+    {
+      g_autoptr(GString) request = g_string_new ("");
+      g_autoptr(GError) error = NULL;
+      g_autofree gchar *response = NULL;
+      g_autofree gchar *server_messages = NULL;
+      const char * const *deps = NULL;
+      const char *symbols_path = symbols_paths[i];
+
+      if (symbols_path == NULL)
+        symbols_path = "";
+
+      /* The request is a sequence of NUL-terminated fields */
+      g_string_append_len (request, requested_names[i],
+                           strlen (requested_names[i]) + 1);
+      g_string_append_len (request, symbols_path, strlen (symbols_path) + 1);
+      g_string_append_len (request, format, strlen (format) + 1);
+
+      if (hidden_deps != NULL)
+        deps = g_hash_table_lookup (hidden_deps, requested_names[i]);
+
+      for (gsize j = 0; deps != NULL && deps[j] != NULL; j++)
+        g_string_append_len (request, deps[j], strlen (deps[j]) + 1);
+
+      response = _srt_helper_server_call (server, request->str, request->len,
+                                          &server_messages, &error);
+
+      if (response == NULL)
+        {
+          g_debug ("Unable to check \"%s\" with a server: %s",
+                   requested_names[i], error->message);
+          break;
+        }
+
+      /* Diagnostics about each library are in its messages= line, so
+       * anything else is about the server itself: treat it the same as
+       * the stderr of a batch helper */
+      if (server_messages != NULL)
+        g_debug ("... while checking \"%s\": %s",
+                 requested_names[i], server_messages);
+
+      if (parse_batch_output (response, multiarch, &requested_names[i],
+                              &symbols_paths[i], 1, libraries,
+                              combined_issues) != 1)
+        break;
+    }
+
+  return i;
+}
+
+/*
+ * _srt_check_library_presence_batch:
+ * @helpers_path: (nullable): Directory to search for helper executables,
+ *  or %NULL for default behaviour
+ * @server: (nullable): An `inspect-library --server` to use if possible
+ * @multiarch: A multiarch tuple like %SRT_ABI_I386, representing an ABI.
+ * @requested_names: (array length=n_libraries): The `SONAME`s or paths
+ *  of shared libraries to check
+ * @symbols_paths: (array length=n_libraries) (element-type filename):
+ *  For each library, the filename of a file listing symbols, or %NULL
+ *  if we do not know which symbols the library is meant to contain
+ * @n_libraries: Number of libraries to check
+ * @hidden_deps: (nullable) (element-type filename GStrv): A map from
+ *  SONAME to its hidden dependencies
+ * @envp: Environment for the helper
+ * @symbols_format: The format of @symbols_paths
+ * @libraries_out: (out) (optional) (transfer full) (element-type SrtLibrary):
+ *  Used to return an array of @n_libraries #SrtLibrary objects, in the
+ *  same order as @requested_names
+ *
+ * Equivalent to calling _srt_check_library_presence() for each library,
+ * but with a single `inspect-library --batch` process per call, which
+ * avoids repeating the `fork()`, `exec()` and dynamic linker startup for
+ * each library. If @server is non-%NULL, it is used instead, so that
+ * even the first `exec()` can be avoided. If the server or the batch
+ * helper fails partway through, libraries that it did not report are
+ * checked by the next method.
+ *
+ * Returns: A bitfield containing the combined problems for all
+ *  libraries, or %SRT_LIBRARY_ISSUES_NONE if no problems were found.
+ */
+SrtLibraryIssues
+_srt_check_library_presence_batch (const char *helpers_path,
+                                   SrtHelperServer *server,
+                                   const char *multiarch,
+                                   const char * const *requested_names,
+                                   const char * const *symbols_paths,
+                                   gsize n_libraries,
+                                   GHashTable *hidden_deps,
+                                   gchar **envp,
+                                   SrtLibrarySymbolsFormat symbols_format,
+                                   GPtrArray **libraries_out)
+{
+  g_autoptr(GPtrArray) libraries = NULL;
+  SrtLibraryIssues combined_issues = SRT_LIBRARY_ISSUES_NONE;
+  gsize done = 0;
+  gsize i;
+
+  g_return_val_if_fail (multiarch != NULL, SRT_LIBRARY_ISSUES_UNKNOWN);
+  g_return_val_if_fail (requested_names != NULL || n_libraries == 0,
+                        SRT_LIBRARY_ISSUES_UNKNOWN);
+  g_return_val_if_fail (symbols_paths != NULL || n_libraries == 0,
+                        SRT_LIBRARY_ISSUES_UNKNOWN);
+  g_return_val_if_fail (libraries_out == NULL || *libraries_out == NULL,
+                        SRT_LIBRARY_ISSUES_UNKNOWN);
+  g_return_val_if_fail (envp != NULL, SRT_LIBRARY_ISSUES_UNKNOWN);
+  g_return_val_if_fail (_srt_check_not_setuid (), SRT_LIBRARY_ISSUES_UNKNOWN);
+
+  libraries = g_ptr_array_new_full (n_libraries, g_object_unref);
+
+  if (n_libraries == 0)
+    goto out;
+
+  if (server != NULL)
+    done = check_libraries_with_server (server, multiarch, requested_names,
+                                        symbols_paths, n_libraries,
+                                        hidden_deps, symbols_format,
+                                        libraries, &combined_issues);
+
+  if (done < n_libraries)
+    done += check_libraries_in_batch (helpers_path, multiarch,
+                                      &requested_names[done],
+                                      &symbols_paths[done],
+                                      n_libraries - done,
+                                      hidden_deps, envp, symbols_format,
+                                      libraries, &combined_issues);
+
+  for (i = done; i < n_libraries; i++)
+    {
+      SrtLibrary *library = NULL;
+      const char * const *deps = NULL;
+
+      if (hidden_deps != NULL)
+        deps = g_hash_table_lookup (hidden_deps, requested_names[i]);
+
+      combined_issues |= _srt_check_library_presence (helpers_path,
+                                                      requested_names[i],
+                                                      multiarch,
+                                                      symbols_paths[i],
+                                                      deps,
+                                                      envp,
+                                                      symbols_format,
+                                                      &library);
+      g_ptr_array_add (libraries, library);
+    }
+
+out:
+  if (libraries_out != NULL)
+    *libraries_out = g_steal_pointer (&libraries);
+
+  return combined_issues;
 }
 
 /**
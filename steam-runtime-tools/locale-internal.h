@@ -27,6 +27,7 @@
 #pragma once
 
 #include "steam-runtime-tools/steam-runtime-tools.h"
+#include "steam-runtime-tools/helper-server-internal.h"
 
 #include <json-glib/json-glib.h>
 
@@ -57,6 +58,7 @@ _srt_locale_new (const char *requested_name,
 G_GNUC_INTERNAL
 SrtLocale *_srt_check_locale (gchar **envp,
                               const char *helpers_path,
+                              SrtHelperServer *server,
                               const char *multiarch_tuple,
                               const char *requested_name,
                               GError **error);
@@ -33,6 +33,7 @@
 #include "steam-runtime-tools/locale-internal.h"
 #include "steam-runtime-tools/utils-internal.h"
 
+#include <string.h>
 #include <sys/types.h>
 #include <sys/wait.h>
 
@@ -192,12 +193,16 @@ srt_locale_class_init (SrtLocaleClass *cls)
  * _srt_check_locale:
  * @envp: Environment variables
  * @helpers_path: Path to find helper executables
+ * @server: (nullable): A `check-locale --server` to use if possible
  * @multiarch_tuple: Multiarch tuple of helper executable to use
  * @requested_name: The locale name to check for
  * @error: Used to return an error if %NULL is returned
  *
  * Check whether the given locale can be set.
  *
+ * If @server is non-%NULL, it is used instead of running the helper
+ * again, unless the server fails.
+ *
  * On success, a #SrtLocale object with more details is returned.
  * On failure, an error in the %SRT_LOCALE_ERROR domain is set.
  *
@@ -206,6 +211,7 @@ srt_locale_class_init (SrtLocaleClass *cls)
 SrtLocale *
 _srt_check_locale (gchar **envp,
                    const char *helpers_path,
+                   SrtHelperServer *server,
                    const char *multiarch_tuple,
                    const char *requested_name,
                    GError **error)
@@ -217,6 +223,7 @@ _srt_check_locale (gchar **envp,
   SrtLocale *ret = NULL;
   GStrv my_environ = NULL;
   int exit_status;
+  gboolean from_server = FALSE;
 
   g_return_val_if_fail (error == NULL || *error == NULL, NULL);
   g_return_val_if_fail (envp != NULL, NULL);
@@ -226,6 +233,31 @@ _srt_check_locale (gchar **envp,
   if (multiarch_tuple == NULL)
     multiarch_tuple = _SRT_MULTIARCH;
 
+  if (server != NULL)
+    {
+      g_autoptr(GError) server_error = NULL;
+      g_autofree gchar *server_messages = NULL;
+
+      output = _srt_helper_server_call (server, requested_name,
+                                        strlen (requested_name),
+                                        &server_messages,
+                                        &server_error);
+
+      if (output != NULL)
+        {
+          g_debug ("Checked locale \"%s\" with a server", requested_name);
+
+          if (server_messages != NULL)
+            g_debug ("... %s", server_messages);
+
+          from_server = TRUE;
+          goto parse;
+        }
+
+      g_debug ("Unable to check locale \"%s\" with a server: %s",
+               requested_name, server_error->message);
+    }
+
   argv = _srt_get_helper (helpers_path, multiarch_tuple, "check-locale",
                           SRT_HELPER_FLAGS_NONE, error);
 
@@ -276,6 +308,7 @@ _srt_check_locale (gchar **envp,
       goto out;
     }
 
+parse:
   node = json_from_string (output, error);
   if (node == NULL)
     {
@@ -285,6 +318,11 @@ _srt_check_locale (gchar **envp,
 
   object = json_node_get_object (node);
 
+  /* The server does not report an exit status, but the helper would
+   * have exited with status 1 in the cases where it reports an error */
+  if (from_server)
+    exit_status = json_object_has_member (object, "error") ? 1 : 0;
+
   if (exit_status == 1)
     {
       if (json_object_has_member (object, "error"))
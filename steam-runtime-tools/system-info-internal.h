@@ -34,6 +34,8 @@
  * @SRT_CHECK_FLAGS_SKIP_SLOW_CHECKS: Don't spend time detecting potential problems
  * @SRT_CHECK_FLAGS_SKIP_EXTRAS: Don't spend time locating "extra" libraries that
  *  are only interesting for diagnostic checks
+ * @SRT_CHECK_FLAGS_HELPER_SERVERS: Keep helpers such as inspect-library
+ *  running between checks, which is faster for long-lived processes
  *
  * A bitfield with flags representing behaviour changes,
  * or %SRT_CHECK_FLAGS_NONE (which is numerically zero) for normal
@@ -43,9 +45,14 @@ typedef enum
 {
   SRT_CHECK_FLAGS_SKIP_SLOW_CHECKS = (1 << 0),
   SRT_CHECK_FLAGS_SKIP_EXTRAS = (1 << 0),
+  SRT_CHECK_FLAGS_HELPER_SERVERS = (1 << 2),
   SRT_CHECK_FLAGS_NONE = 0
 } SrtCheckFlags;
 
 G_GNUC_INTERNAL
 void _srt_system_info_set_check_flags (SrtSystemInfo *self,
                                        SrtCheckFlags flags);
+
+G_GNUC_INTERNAL
+gchar *_srt_system_info_dup_cache_key (SrtSystemInfo *self,
+                                       const char * const *multiarch_tuples);
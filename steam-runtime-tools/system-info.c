@@ -37,6 +37,7 @@
 #include "steam-runtime-tools/desktop-entry-internal.h"
 #include "steam-runtime-tools/graphics.h"
 #include "steam-runtime-tools/graphics-internal.h"
+#include "steam-runtime-tools/helper-server-internal.h"
 #include "steam-runtime-tools/json-utils-internal.h"
 #include "steam-runtime-tools/libdl-internal.h"
 #include "steam-runtime-tools/library-internal.h"
@@ -56,6 +57,7 @@
 #include <string.h>
 #include <sys/stat.h>
 #include <sys/types.h>
+#include <sys/utsname.h>
 #include <unistd.h>
 #include <json-glib/json-glib.h>
 
@@ -121,10 +123,15 @@ struct _SrtSystemInfo
   SrtContainerInfo *container_info;
   SrtSteam *steam_data;
   SrtXdgPortal *xdg_portal_data;
+  /* Canonical paths of libraries, used to detect duplicated ICDs and
+   * layers, or %NULL if not yet needed */
+  SrtLibraryResolver *library_resolver;
   struct
   {
     /* GQuark => MaybeLocale */
     GHashTable *cached_locales;
+    /* check-locale for the primary ABI, or %NULL if not yet needed */
+    SrtHelperServer *server;
     SrtLocaleIssues issues;
     gboolean have_issues;
   } locales;
@@ -267,6 +274,9 @@ typedef struct
   SrtGraphicsIssues cached_combined_graphics_issues;
   gboolean graphics_cache_available;
 
+  /* inspect-library, or %NULL if not yet needed */
+  SrtHelperServer *inspect_library_server;
+
   ModuleList graphics_modules[NUM_SRT_GRAPHICS_MODULES];
 } Abi;
 
@@ -274,7 +284,6 @@ static Abi *
 ensure_abi_unless_immutable (SrtSystemInfo *self,
                              const char *multiarch_tuple)
 {
-  const SrtKnownArchitecture *iter;
   GQuark quark;
   guint i;
   Abi *abi = NULL;
@@ -295,17 +304,7 @@ ensure_abi_unless_immutable (SrtSystemInfo *self,
   abi = g_slice_new0 (Abi);
   abi->multiarch_tuple = quark;
 
-  for (iter = _srt_architecture_get_known ();
-       iter->multiarch_tuple != NULL;
-       iter++)
-    {
-      if (strcmp (iter->multiarch_tuple, multiarch_tuple) == 0)
-        {
-          abi->known_architecture = iter;
-          break;
-        }
-    }
-
+  abi->known_architecture = _srt_architecture_get_by_tuple (multiarch_tuple);
   abi->can_run = TRI_MAYBE;
   abi->cached_results = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, g_object_unref);
   abi->cached_combined_issues = SRT_LIBRARY_ISSUES_NONE;
@@ -336,6 +335,8 @@ abi_free (gpointer self)
   if (abi->cached_graphics_results != NULL)
     g_hash_table_unref (abi->cached_graphics_results);
 
+  g_clear_pointer (&abi->inspect_library_server, _srt_helper_server_free);
+
   for (i = 0; i < G_N_ELEMENTS (abi->graphics_modules); i++)
     g_list_free_full (abi->graphics_modules[i].modules, g_object_unref);
 
@@ -437,6 +438,7 @@ static void
 forget_locales (SrtSystemInfo *self)
 {
   g_clear_pointer (&self->locales.cached_locales, g_hash_table_unref);
+  g_clear_pointer (&self->locales.server, _srt_helper_server_free);
   self->locales.issues = SRT_LOCALE_ISSUES_NONE;
   self->locales.have_issues = FALSE;
 }
@@ -536,6 +538,79 @@ forget_xdg_portal (SrtSystemInfo *self)
   g_clear_object (&self->xdg_portal_data);
 }
 
+/*
+ * Forget any cached canonical paths of libraries.
+ */
+static void
+forget_library_resolver (SrtSystemInfo *self)
+{
+  g_clear_pointer (&self->library_resolver, _srt_library_resolver_free);
+}
+
+static SrtLibraryResolver *
+ensure_library_resolver (SrtSystemInfo *self)
+{
+  if (self->library_resolver == NULL)
+    self->library_resolver = _srt_library_resolver_new ();
+
+  return self->library_resolver;
+}
+
+/*
+ * Return the server stored in @server_p, starting it if necessary,
+ * or %NULL if helper servers are not enabled or not available.
+ */
+static SrtHelperServer *
+ensure_helper_server (SrtSystemInfo *self,
+                      SrtHelperServer **server_p,
+                      const char *multiarch_tuple,
+                      const char *helper_name,
+                      const char * const *server_args)
+{
+  g_autoptr(GError) local_error = NULL;
+
+  if (!(self->check_flags & SRT_CHECK_FLAGS_HELPER_SERVERS))
+    return NULL;
+
+  if (*server_p == NULL)
+    {
+      *server_p = _srt_helper_server_new (self->helpers_path, multiarch_tuple,
+                                          helper_name, server_args, self->env,
+                                          0, &local_error);
+
+      if (*server_p == NULL)
+        g_debug ("Unable to run %s %s as a server: %s",
+                 multiarch_tuple, helper_name, local_error->message);
+    }
+
+  return *server_p;
+}
+
+static SrtHelperServer *
+ensure_inspect_library_server (SrtSystemInfo *self,
+                               const char *multiarch_tuple)
+{
+  static const char * const server_args[] = { "--line-based", "--server", NULL };
+  Abi *abi = ensure_abi_unless_immutable (self, multiarch_tuple);
+
+  if (abi == NULL)
+    return NULL;
+
+  return ensure_helper_server (self, &abi->inspect_library_server,
+                               multiarch_tuple, "inspect-library",
+                               server_args);
+}
+
+static SrtHelperServer *
+ensure_check_locale_server (SrtSystemInfo *self)
+{
+  static const char * const server_args[] = { "--server", NULL };
+
+  return ensure_helper_server (self, &self->locales.server,
+                               srt_system_info_get_primary_multiarch_tuple (self),
+                               "check-locale", server_args);
+}
+
 static void
 srt_system_info_finalize (GObject *object)
 {
@@ -545,6 +620,7 @@ srt_system_info_finalize (GObject *object)
   forget_container_info (self);
   forget_icds (self);
   forget_layers (self);
+  forget_library_resolver (self);
   forget_locales (self);
   forget_os (self);
   forget_overrides (self);
@@ -1453,63 +1529,96 @@ _srt_system_info_get_pinned_libs_from_report (JsonObject *json_obj,
   return pinned_list;
 }
 
-/**
- * srt_system_info_check_libraries:
- * @self: The #SrtSystemInfo object to use.
- * @multiarch_tuple: A multiarch tuple like %SRT_ABI_I386, representing an ABI.
- * @libraries_out: (out) (optional) (element-type SrtLibrary) (transfer full):
- *  Used to return a #GList object where every element of said list is an
- *  #SrtLibrary object, representing every `SONAME` found from the expectations
- *  folder. Free with `g_list_free_full(libraries, g_object_unref)`.
- *
- * Check if the running system has all the expected libraries, and related symbols,
- * as listed in the `deb-symbols(5)` files `*.symbols` in the @multiarch
- * subdirectory of #SrtSystemInfo:expectations.
- *
- * Returns: A bitfield containing problems, or %SRT_LIBRARY_ISSUES_NONE
- *  if no problems were found.
- */
-SrtLibraryIssues
-srt_system_info_check_libraries (SrtSystemInfo *self,
-                                 const gchar *multiarch_tuple,
-                                 GList **libraries_out)
+/* Don't split up the library checks any further than this */
+#define MIN_LIBRARIES_PER_JOB 16
+
+/* Read-only state shared between LibrariesJobs */
+typedef struct
 {
-  Abi *abi = NULL;
-  gchar *dir_path = NULL;
-  const gchar *filename = NULL;
-  gchar *symbols_file = NULL;
-  size_t len = 0;
-  ssize_t chars;
-  GDir *dir = NULL;
-  FILE *fp = NULL;
-  GError *error = NULL;
-  SrtLibraryIssues ret = SRT_LIBRARY_ISSUES_UNKNOWN;
+  const char *helpers_path;
+  SrtHelperServer *server;
+  const char *multiarch_tuple;
+  GHashTable *hidden_deps;
+  gchar **env;
+} LibrariesJobContext;
 
-  g_return_val_if_fail (SRT_IS_SYSTEM_INFO (self), SRT_LIBRARY_ISSUES_UNKNOWN);
-  g_return_val_if_fail (multiarch_tuple != NULL, SRT_LIBRARY_ISSUES_UNKNOWN);
-  g_return_val_if_fail (libraries_out == NULL || *libraries_out == NULL,
-                        SRT_LIBRARY_ISSUES_UNKNOWN);
+typedef struct
+{
+  const char * const *requested_names;
+  const char * const *symbols_paths;
+  gsize n_libraries;
+  GPtrArray *libraries;
+  SrtLibraryIssues issues;
+} LibrariesJob;
 
-  abi = ensure_abi_unless_immutable (self, multiarch_tuple);
+static void
+libraries_job_free (gpointer p)
+{
+  LibrariesJob *job = p;
 
-  if (abi == NULL)
-    return SRT_LIBRARY_ISSUES_CANNOT_LOAD;
+  g_clear_pointer (&job->libraries, g_ptr_array_unref);
+  g_slice_free (LibrariesJob, job);
+}
 
-  /* If we cached already the result, we return it */
-  if (abi->libraries_cache_available)
-    {
-      if (libraries_out != NULL)
-        {
-          *libraries_out = g_list_sort (g_hash_table_get_values (abi->cached_results),
-                                        (GCompareFunc) library_compare);
-          g_list_foreach (*libraries_out, (GFunc) G_CALLBACK (g_object_ref), NULL);
-        }
+/* Called in a worker thread, so it must not touch the SrtSystemInfo */
+static void
+libraries_job_run (gpointer data,
+                   gpointer user_data)
+{
+  LibrariesJob *job = data;
+  const LibrariesJobContext *context = user_data;
+
+  job->issues = _srt_check_library_presence_batch (context->helpers_path,
+                                                   context->server,
+                                                   context->multiarch_tuple,
+                                                   job->requested_names,
+                                                   job->symbols_paths,
+                                                   job->n_libraries,
+                                                   context->hidden_deps,
+                                                   context->env,
+                                                   SRT_LIBRARY_SYMBOLS_FORMAT_DEB_SYMBOLS,
+                                                   &job->libraries);
+}
 
-      return abi->cached_combined_issues;
-    }
+/* State for checking the libraries of one ABI, which can be run
+ * concurrently with checks for other ABIs */
+typedef struct
+{
+  LibrariesJobContext context;
+  GPtrArray *sonames;
+  GPtrArray *symbols_files;
+  /* (element-type LibrariesJob) */
+  GPtrArray *jobs;
+} LibrariesCheck;
 
-  if (self->immutable_values)
-    return SRT_LIBRARY_ISSUES_UNKNOWN;
+static void
+libraries_check_clear (LibrariesCheck *check)
+{
+  g_clear_pointer (&check->jobs, g_ptr_array_unref);
+  g_clear_pointer (&check->sonames, g_ptr_array_unref);
+  g_clear_pointer (&check->symbols_files, g_ptr_array_unref);
+}
+
+/*
+ * Set up @check to check the libraries listed in the expectations
+ * for @multiarch_tuple.
+ *
+ * Returns: %SRT_LIBRARY_ISSUES_NONE if @check->jobs are ready to be
+ *  run, or the problem that prevented us from checking the libraries
+ */
+static SrtLibraryIssues
+libraries_check_prepare (SrtSystemInfo *self,
+                         const char *multiarch_tuple,
+                         LibrariesCheck *check)
+{
+  g_autofree gchar *dir_path = NULL;
+  g_autoptr(GDir) dir = NULL;
+  g_autoptr(GError) error = NULL;
+  const gchar *filename = NULL;
+  size_t len = 0;
+  ssize_t chars;
+  gsize n_jobs;
+  gsize i;
 
   if (!ensure_expectations (self))
     {
@@ -1522,15 +1631,18 @@ srt_system_info_check_libraries (SrtSystemInfo *self,
   if (error)
     {
       g_debug ("An error occurred while opening the symbols directory: %s", error->message);
-      g_clear_error (&error);
-      ret = SRT_LIBRARY_ISSUES_UNKNOWN_EXPECTATIONS;
-      goto out;
+      return SRT_LIBRARY_ISSUES_UNKNOWN_EXPECTATIONS;
     }
 
   ensure_hidden_deps (self);
 
+  check->sonames = g_ptr_array_new_with_free_func (g_free);
+  check->symbols_files = g_ptr_array_new_with_free_func (g_free);
+
   while ((filename = g_dir_read_name (dir)))
     {
+      g_autofree gchar *symbols_file = NULL;
+      FILE *fp = NULL;
       char *line = NULL;
 
       if (!g_str_has_suffix (filename, ".symbols"))
@@ -1543,7 +1655,7 @@ srt_system_info_check_libraries (SrtSystemInfo *self,
         {
           int saved_errno = errno;
           g_debug ("Error reading \"%s\": %s\n", symbols_file, strerror (saved_errno));
-          goto out;
+          return SRT_LIBRARY_ISSUES_UNKNOWN;
         }
 
       while ((chars = getline(&line, &len, fp)) != -1)
@@ -1557,29 +1669,124 @@ srt_system_info_check_libraries (SrtSystemInfo *self,
 
           if (line[0] != '#' && line[0] != '*' && line[0] != '|' && line[0] != ' ')
             {
-              /* This line introduces a new SONAME. We extract it and call
-                * `_srt_check_library_presence` with the symbols file where we
-                * found it, as an argument. */
-              SrtLibrary *library = NULL;
-              char *soname = g_strdup (strsep (&pointer_into_line, " \t"));
-              gchar **hidden_deps = g_hash_table_lookup (self->cached_hidden_deps, soname);
-              abi->cached_combined_issues |= _srt_check_library_presence (self->helpers_path,
-                                                                          soname,
-                                                                          multiarch_tuple,
-                                                                          symbols_file,
-                                                                          (const gchar * const *)hidden_deps,
-                                                                          self->env,
-                                                                          SRT_LIBRARY_SYMBOLS_FORMAT_DEB_SYMBOLS,
-                                                                          &library);
-              g_hash_table_insert (abi->cached_results, soname, library);
+              /* This line introduces a new SONAME. We extract it and
+               * check it later, together with all the others, using
+               * the symbols file where we found it. */
+              g_ptr_array_add (check->sonames,
+                               g_strdup (strsep (&pointer_into_line, " \t")));
+              g_ptr_array_add (check->symbols_files, g_strdup (symbols_file));
             }
         }
       free (line);
-      g_clear_pointer (&symbols_file, g_free);
-      g_clear_pointer (&fp, fclose);
+      fclose (fp);
+    }
+
+  /* Check the libraries with a few inspect-library processes running
+   * in parallel, instead of one process per library */
+  check->jobs = g_ptr_array_new_with_free_func (libraries_job_free);
+  n_jobs = MIN (g_get_num_processors (),
+                (check->sonames->len + MIN_LIBRARIES_PER_JOB - 1) / MIN_LIBRARIES_PER_JOB);
+
+  for (i = 0; i < n_jobs; i++)
+    {
+      LibrariesJob *job = g_slice_new0 (LibrariesJob);
+      gsize start = (check->sonames->len * i) / n_jobs;
+      gsize end = (check->sonames->len * (i + 1)) / n_jobs;
+
+      job->requested_names = (const char * const *) &check->sonames->pdata[start];
+      job->symbols_paths = (const char * const *) &check->symbols_files->pdata[start];
+      job->n_libraries = end - start;
+      g_ptr_array_add (check->jobs, job);
+    }
+
+  check->context.helpers_path = self->helpers_path;
+  check->context.server = ensure_inspect_library_server (self, multiarch_tuple);
+  check->context.multiarch_tuple = multiarch_tuple;
+  check->context.hidden_deps = self->cached_hidden_deps;
+  check->context.env = self->env;
+  return SRT_LIBRARY_ISSUES_NONE;
+}
+
+/*
+ * Store the results of @check, after its jobs have finished, in @abi.
+ */
+static void
+libraries_check_finish (LibrariesCheck *check,
+                        Abi *abi)
+{
+  gsize i, j;
+
+  for (i = 0; i < check->jobs->len; i++)
+    {
+      LibrariesJob *job = g_ptr_array_index (check->jobs, i);
+
+      abi->cached_combined_issues |= job->issues;
+
+      if (job->libraries == NULL)
+        continue;
+
+      for (j = 0; j < job->libraries->len; j++)
+        g_hash_table_insert (abi->cached_results,
+                             g_strdup (job->requested_names[j]),
+                             g_object_ref (g_ptr_array_index (job->libraries, j)));
     }
 
   abi->libraries_cache_available = TRUE;
+}
+
+/**
+ * srt_system_info_check_libraries:
+ * @self: The #SrtSystemInfo object to use.
+ * @multiarch_tuple: A multiarch tuple like %SRT_ABI_I386, representing an ABI.
+ * @libraries_out: (out) (optional) (element-type SrtLibrary) (transfer full):
+ *  Used to return a #GList object where every element of said list is an
+ *  #SrtLibrary object, representing every `SONAME` found from the expectations
+ *  folder. Free with `g_list_free_full(libraries, g_object_unref)`.
+ *
+ * Check if the running system has all the expected libraries, and related symbols,
+ * as listed in the `deb-symbols(5)` files `*.symbols` in the @multiarch
+ * subdirectory of #SrtSystemInfo:expectations.
+ *
+ * Returns: A bitfield containing problems, or %SRT_LIBRARY_ISSUES_NONE
+ *  if no problems were found.
+ */
+SrtLibraryIssues
+srt_system_info_check_libraries (SrtSystemInfo *self,
+                                 const gchar *multiarch_tuple,
+                                 GList **libraries_out)
+{
+  Abi *abi = NULL;
+  LibrariesCheck check = {};
+  SrtLibraryIssues ret;
+
+  g_return_val_if_fail (SRT_IS_SYSTEM_INFO (self), SRT_LIBRARY_ISSUES_UNKNOWN);
+  g_return_val_if_fail (multiarch_tuple != NULL, SRT_LIBRARY_ISSUES_UNKNOWN);
+  g_return_val_if_fail (libraries_out == NULL || *libraries_out == NULL,
+                        SRT_LIBRARY_ISSUES_UNKNOWN);
+
+  abi = ensure_abi_unless_immutable (self, multiarch_tuple);
+
+  if (abi == NULL)
+    return SRT_LIBRARY_ISSUES_CANNOT_LOAD;
+
+  if (!abi->libraries_cache_available)
+    {
+      if (self->immutable_values)
+        return SRT_LIBRARY_ISSUES_UNKNOWN;
+
+      ret = libraries_check_prepare (self, multiarch_tuple, &check);
+
+      if (ret != SRT_LIBRARY_ISSUES_NONE)
+        {
+          libraries_check_clear (&check);
+          return ret;
+        }
+
+      _srt_run_jobs_in_parallel (check.jobs, libraries_job_run, &check.context);
+      libraries_check_finish (&check, abi);
+      libraries_check_clear (&check);
+    }
+
   if (libraries_out != NULL)
     {
       *libraries_out = g_list_sort (g_hash_table_get_values (abi->cached_results),
@@ -1587,19 +1794,55 @@ srt_system_info_check_libraries (SrtSystemInfo *self,
       g_list_foreach (*libraries_out, (GFunc) G_CALLBACK (g_object_ref), NULL);
     }
 
-  ret = abi->cached_combined_issues;
+  return abi->cached_combined_issues;
+}
 
-  out:
-    g_clear_pointer (&symbols_file, g_free);
-    g_clear_pointer (&dir_path, g_free);
+/*
+ * Check @requested_name, using an inspect-library server if enabled.
+ */
+static SrtLibraryIssues
+check_one_library (SrtSystemInfo *self,
+                   const char *multiarch_tuple,
+                   const char *requested_name,
+                   const char *symbols_file,
+                   GHashTable *hidden_deps,
+                   SrtLibrary **library_out)
+{
+  g_autoptr(GPtrArray) libraries = NULL;
+  SrtHelperServer *server;
+  SrtLibraryIssues issues;
 
-    if (fp != NULL)
-      g_clear_pointer (&fp, fclose);
+  server = ensure_inspect_library_server (self, multiarch_tuple);
 
-    if (dir != NULL)
-      g_dir_close (dir);
+  if (server == NULL)
+    {
+      const char * const *deps = NULL;
 
-    return ret;
+      if (hidden_deps != NULL)
+        deps = g_hash_table_lookup (hidden_deps, requested_name);
+
+      return _srt_check_library_presence (self->helpers_path,
+                                          requested_name,
+                                          multiarch_tuple,
+                                          symbols_file,
+                                          deps,
+                                          self->env,
+                                          SRT_LIBRARY_SYMBOLS_FORMAT_DEB_SYMBOLS,
+                                          library_out);
+    }
+
+  issues = _srt_check_library_presence_batch (self->helpers_path,
+                                              server,
+                                              multiarch_tuple,
+                                              &requested_name,
+                                              &symbols_file,
+                                              1,
+                                              hidden_deps,
+                                              self->env,
+                                              SRT_LIBRARY_SYMBOLS_FORMAT_DEB_SYMBOLS,
+                                              &libraries);
+  *library_out = g_object_ref (g_ptr_array_index (libraries, 0));
+  return issues;
 }
 
 /**
@@ -1707,15 +1950,10 @@ srt_system_info_check_library (SrtSystemInfo *self,
               char *soname_found = g_strdup (strsep (&pointer_into_line, " \t"));
               if (g_strcmp0 (soname_found, requested_name) == 0)
                 {
-                  gchar **hidden_deps = g_hash_table_lookup (self->cached_hidden_deps, requested_name);
-                  issues = _srt_check_library_presence (self->helpers_path,
-                                                        soname_found,
-                                                        multiarch_tuple,
-                                                        symbols_file,
-                                                        (const gchar * const *)hidden_deps,
-                                                        self->env,
-                                                        SRT_LIBRARY_SYMBOLS_FORMAT_DEB_SYMBOLS,
-                                                        &library);
+                  issues = check_one_library (self, multiarch_tuple,
+                                              soname_found, symbols_file,
+                                              self->cached_hidden_deps,
+                                              &library);
                   g_hash_table_insert (abi->cached_results, soname_found, library);
                   abi->cached_combined_issues |= issues;
                   if (more_details_out != NULL)
@@ -1734,14 +1972,8 @@ srt_system_info_check_library (SrtSystemInfo *self,
 
   /* The SONAME's symbols file is not available.
    * We do instead a simple absence/presence check. */
-  issues = _srt_check_library_presence (self->helpers_path,
-                                        requested_name,
-                                        multiarch_tuple,
-                                        NULL,
-                                        NULL,
-                                        self->env,
-                                        SRT_LIBRARY_SYMBOLS_FORMAT_DEB_SYMBOLS,
-                                        &library);
+  issues = check_one_library (self, multiarch_tuple, requested_name,
+                              NULL, NULL, &library);
   g_hash_table_insert (abi->cached_results, g_strdup (requested_name), library);
   abi->cached_combined_issues |= issues;
   if (more_details_out != NULL)
@@ -1777,6 +2009,7 @@ forget_libraries (SrtSystemInfo *self)
       g_hash_table_remove_all (abi->cached_results);
       abi->cached_combined_issues = SRT_LIBRARY_ISSUES_NONE;
       abi->libraries_cache_available = FALSE;
+      g_clear_pointer (&abi->inspect_library_server, _srt_helper_server_free);
     }
 }
 
@@ -1874,6 +2107,7 @@ srt_system_info_check_graphics (SrtSystemInfo *self,
                                 multiarch_tuple,
                                 window_system,
                                 rendering_interface,
+                                NULL,
                                 &graphics);
   g_hash_table_insert (abi->cached_graphics_results, GINT_TO_POINTER(hash_key), graphics);
   abi->cached_combined_graphics_issues |= issues;
@@ -1883,6 +2117,239 @@ srt_system_info_check_graphics (SrtSystemInfo *self,
   return issues;
 }
 
+static const struct
+{
+  SrtWindowSystem window_system;
+  SrtRenderingInterface rendering_interface;
+} all_graphics_combinations[] =
+{
+  { SRT_WINDOW_SYSTEM_GLX, SRT_RENDERING_INTERFACE_GL },
+  { SRT_WINDOW_SYSTEM_EGL_X11, SRT_RENDERING_INTERFACE_GL },
+  { SRT_WINDOW_SYSTEM_EGL_X11, SRT_RENDERING_INTERFACE_GLESV2 },
+  { SRT_WINDOW_SYSTEM_X11, SRT_RENDERING_INTERFACE_VULKAN },
+  { SRT_WINDOW_SYSTEM_X11, SRT_RENDERING_INTERFACE_VDPAU },
+  { SRT_WINDOW_SYSTEM_X11, SRT_RENDERING_INTERFACE_VAAPI },
+};
+
+/* Read-only state shared between GraphicsJobs */
+typedef struct
+{
+  gchar **env;
+  const char *helpers_path;
+  SrtTestFlags test_flags;
+  const char *multiarch_tuple;
+} GraphicsJobContext;
+
+typedef struct
+{
+  SrtWindowSystem window_system;
+  SrtRenderingInterface rendering_interface;
+  SrtGraphics *graphics;
+  SrtGraphicsIssues issues;
+  /* (element-type GraphicsJob): If not %NULL, this job runs the combined
+   * check-graphics helper, and uses its results to do these checks
+   * instead of its own */
+  GPtrArray *probed;
+} GraphicsJob;
+
+static void
+graphics_job_free (gpointer p)
+{
+  GraphicsJob *job = p;
+
+  g_clear_object (&job->graphics);
+  g_clear_pointer (&job->probed, g_ptr_array_unref);
+  g_slice_free (GraphicsJob, job);
+}
+
+static void graphics_job_run (gpointer data,
+                              gpointer user_data);
+
+/* Called in a worker thread, so it must not touch the SrtSystemInfo */
+static void
+graphics_probe_job_run (GraphicsJob *job,
+                        const GraphicsJobContext *context)
+{
+  g_autofree SrtRenderingInterface *interfaces = NULL;
+  g_autoptr(GHashTable) results = NULL;
+  g_autoptr(GError) local_error = NULL;
+  gsize i;
+
+  interfaces = g_new0 (SrtRenderingInterface, job->probed->len);
+
+  for (i = 0; i < job->probed->len; i++)
+    {
+      GraphicsJob *probed = g_ptr_array_index (job->probed, i);
+
+      interfaces[i] = probed->rendering_interface;
+    }
+
+  results = _srt_run_graphics_probe (context->env,
+                                     context->helpers_path,
+                                     context->test_flags,
+                                     context->multiarch_tuple,
+                                     interfaces,
+                                     job->probed->len,
+                                     &local_error);
+
+  if (results == NULL)
+    g_debug ("Unable to run check-graphics, falling back to individual "
+             "checks: %s", local_error->message);
+
+  for (i = 0; i < job->probed->len; i++)
+    {
+      GraphicsJob *probed = g_ptr_array_index (job->probed, i);
+      const SrtGraphicsProbeResult *probe_result = NULL;
+
+      if (results != NULL)
+        probe_result = g_hash_table_lookup (results,
+                                            GINT_TO_POINTER (probed->rendering_interface));
+
+      if (probe_result == NULL)
+        {
+          graphics_job_run (probed, (gpointer) context);
+          continue;
+        }
+
+      probed->issues = _srt_check_graphics (context->env,
+                                            context->helpers_path,
+                                            context->test_flags,
+                                            context->multiarch_tuple,
+                                            probed->window_system,
+                                            probed->rendering_interface,
+                                            probe_result,
+                                            &probed->graphics);
+    }
+}
+
+/* Called in a worker thread, so it must not touch the SrtSystemInfo */
+static void
+graphics_job_run (gpointer data,
+                  gpointer user_data)
+{
+  GraphicsJob *job = data;
+  const GraphicsJobContext *context = user_data;
+
+  if (job->probed != NULL)
+    {
+      graphics_probe_job_run (job, context);
+      return;
+    }
+
+  job->issues = _srt_check_graphics (context->env,
+                                     context->helpers_path,
+                                     context->test_flags,
+                                     context->multiarch_tuple,
+                                     job->window_system,
+                                     job->rendering_interface,
+                                     NULL,
+                                     &job->graphics);
+}
+
+/*
+ * Add the results of @job, and any jobs that it probed, to @abi.
+ */
+static void
+graphics_job_merge (GraphicsJob *job,
+                    Abi *abi)
+{
+  gsize i;
+
+  if (job->probed != NULL)
+    {
+      for (i = 0; i < job->probed->len; i++)
+        graphics_job_merge (g_ptr_array_index (job->probed, i), abi);
+
+      return;
+    }
+
+  g_hash_table_insert (abi->cached_graphics_results,
+                       GINT_TO_POINTER (_srt_graphics_hash_key (job->window_system,
+                                                                job->rendering_interface)),
+                       g_steal_pointer (&job->graphics));
+}
+
+/* State for checking the graphics stack of one ABI, which can be run
+ * concurrently with checks for other ABIs */
+typedef struct
+{
+  GraphicsJobContext context;
+  /* (element-type GraphicsJob) */
+  GPtrArray *jobs;
+} GraphicsCheck;
+
+/*
+ * Set up @check to do each graphics check for @multiarch_tuple whose
+ * result is not already cached in @abi.
+ */
+static void
+graphics_check_prepare (SrtSystemInfo *self,
+                        Abi *abi,
+                        const char *multiarch_tuple,
+                        GraphicsCheck *check)
+{
+  GraphicsJob *probe_job = NULL;
+  gsize i;
+
+  check->jobs = g_ptr_array_new_with_free_func (graphics_job_free);
+  check->context.env = self->env;
+  check->context.helpers_path = self->helpers_path;
+  check->context.test_flags = self->test_flags;
+  check->context.multiarch_tuple = multiarch_tuple;
+
+  /* If possible, do the checks that don't involve GL in a single
+   * check-graphics process tree, which only needs to load the
+   * loader libraries once */
+  if (_srt_graphics_probe_is_available (self->helpers_path, multiarch_tuple))
+    {
+      probe_job = g_slice_new0 (GraphicsJob);
+      probe_job->probed = g_ptr_array_new_with_free_func (graphics_job_free);
+    }
+
+  for (i = 0; i < G_N_ELEMENTS (all_graphics_combinations); i++)
+    {
+      SrtWindowSystem window_system = all_graphics_combinations[i].window_system;
+      SrtRenderingInterface rendering_interface = all_graphics_combinations[i].rendering_interface;
+      int hash_key = _srt_graphics_hash_key (window_system, rendering_interface);
+      GraphicsJob *job;
+
+      if (g_hash_table_contains (abi->cached_graphics_results,
+                                 GINT_TO_POINTER (hash_key)))
+        continue;
+
+      job = g_slice_new0 (GraphicsJob);
+      job->window_system = window_system;
+      job->rendering_interface = rendering_interface;
+
+      if (probe_job != NULL
+          && _srt_graphics_probe_supports (window_system, rendering_interface))
+        g_ptr_array_add (probe_job->probed, job);
+      else
+        g_ptr_array_add (check->jobs, job);
+    }
+
+  if (probe_job != NULL && probe_job->probed->len > 0)
+    g_ptr_array_add (check->jobs, g_steal_pointer (&probe_job));
+  else
+    g_clear_pointer (&probe_job, graphics_job_free);
+}
+
+/*
+ * Store the results of @check, after its jobs have finished, in @abi,
+ * and free it.
+ */
+static void
+graphics_check_finish (GraphicsCheck *check,
+                       Abi *abi)
+{
+  gsize i;
+
+  for (i = 0; i < check->jobs->len; i++)
+    graphics_job_merge (g_ptr_array_index (check->jobs, i), abi);
+
+  g_clear_pointer (&check->jobs, g_ptr_array_unref);
+}
+
 /**
  * srt_system_info_check_all_graphics:
  * @self: The #SrtSystemInfo object to use.
@@ -1894,87 +2361,191 @@ srt_system_info_check_graphics (SrtSystemInfo *self,
  * least %SRT_RENDERING_INTERFACE_GL on %SRT_WINDOW_SYSTEM_GLX. Additional combinations
  * will be added in future versions of this library.
  *
- * Returns: (transfer full) (type SrtGraphics): A list of #SrtGraphics objects
- * representing the items tested and results.
- * Free with 'g_list_free_full(list, g_object_unref)`.
+ * Returns: (transfer full) (type SrtGraphics): A list of #SrtGraphics objects
+ * representing the items tested and results.
+ * Free with 'g_list_free_full(list, g_object_unref)`.
+ */
+GList * srt_system_info_check_all_graphics (SrtSystemInfo *self,
+                                            const char *multiarch_tuple)
+{
+  Abi *abi = NULL;
+
+  g_return_val_if_fail (SRT_IS_SYSTEM_INFO (self), NULL);
+  g_return_val_if_fail (multiarch_tuple != NULL, NULL);
+
+  abi = ensure_abi_unless_immutable (self, multiarch_tuple);
+
+  if (abi == NULL)
+    return NULL;
+
+  GList *list = NULL;
+
+  /* If we cached already the result, we return it */
+  if (abi->graphics_cache_available)
+    {
+      list = g_list_sort (g_hash_table_get_values (abi->cached_graphics_results),
+                                    (GCompareFunc) graphics_compare);
+      g_list_foreach (list, (GFunc) G_CALLBACK (g_object_ref), NULL);
+
+      return list;
+    }
+
+  if (!self->immutable_values)
+    {
+      GraphicsCheck check = {};
+
+      graphics_check_prepare (self, abi, multiarch_tuple, &check);
+
+      /* Each of these checks can take several seconds, but they are
+       * independent, so run them concurrently */
+      _srt_run_jobs_in_parallel (check.jobs, graphics_job_run, &check.context);
+      graphics_check_finish (&check, abi);
+    }
+
+  // Try each rendering interface
+  // Try each window system
+
+  for (gsize i = 0; i < G_N_ELEMENTS (all_graphics_combinations); i++)
+    abi->cached_combined_graphics_issues |=
+      srt_system_info_check_graphics (self,
+                                      multiarch_tuple,
+                                      all_graphics_combinations[i].window_system,
+                                      all_graphics_combinations[i].rendering_interface,
+                                      NULL);
+
+  abi->graphics_cache_available = TRUE;
+
+  list = g_list_sort (g_hash_table_get_values (abi->cached_graphics_results),
+                      (GCompareFunc) graphics_compare);
+  g_list_foreach (list, (GFunc) G_CALLBACK (g_object_ref), NULL);
+
+  return list;
+}
+
+/* A LibrariesJob or GraphicsJob, as part of a larger batch */
+typedef struct
+{
+  GFunc func;
+  gpointer job;
+  gpointer context;
+} PrefetchJob;
+
+static void
+prefetch_job_add_all (GPtrArray *prefetch_jobs,
+                      GPtrArray *jobs,
+                      GFunc func,
+                      gpointer context)
+{
+  gsize i;
+
+  for (i = 0; i < jobs->len; i++)
+    {
+      PrefetchJob *prefetch_job = g_new0 (PrefetchJob, 1);
+
+      prefetch_job->func = func;
+      prefetch_job->job = g_ptr_array_index (jobs, i);
+      prefetch_job->context = context;
+      g_ptr_array_add (prefetch_jobs, prefetch_job);
+    }
+}
+
+/* Called in a worker thread, so it must not touch the SrtSystemInfo */
+static void
+prefetch_job_run (gpointer data,
+                  gpointer user_data)
+{
+  PrefetchJob *prefetch_job = data;
+
+  prefetch_job->func (prefetch_job->job, prefetch_job->context);
+}
+
+/**
+ * srt_system_info_prefetch:
+ * @self: The #SrtSystemInfo object to use.
+ * @multiarch_tuples: (array zero-terminated=1): Multiarch tuples like
+ *  %SRT_ABI_I386, representing ABIs
+ * @flags: The checks to do
+ *
+ * Do the checks selected by @flags for each ABI in @multiarch_tuples,
+ * and cache the results. The checks for different ABIs are independent,
+ * so they are all run concurrently, which is faster than calling
+ * srt_system_info_check_libraries() or srt_system_info_check_all_graphics()
+ * for each ABI in turn.
+ *
+ * Subsequent calls to those functions will return the cached results.
  */
-GList * srt_system_info_check_all_graphics (SrtSystemInfo *self,
-                                            const char *multiarch_tuple)
+void
+srt_system_info_prefetch (SrtSystemInfo *self,
+                          const char * const *multiarch_tuples,
+                          SrtPrefetchFlags flags)
 {
-  Abi *abi = NULL;
-
-  g_return_val_if_fail (SRT_IS_SYSTEM_INFO (self), NULL);
-  g_return_val_if_fail (multiarch_tuple != NULL, NULL);
+  g_autoptr(GPtrArray) prefetch_jobs = NULL;
+  g_autofree LibrariesCheck *libraries = NULL;
+  g_autofree GraphicsCheck *graphics = NULL;
+  g_autofree Abi **abis = NULL;
+  gsize n;
+  gsize i, j;
 
-  abi = ensure_abi_unless_immutable (self, multiarch_tuple);
+  g_return_if_fail (SRT_IS_SYSTEM_INFO (self));
+  g_return_if_fail (multiarch_tuples != NULL);
 
-  if (abi == NULL)
-    return NULL;
+  if (self->immutable_values)
+    return;
 
-  GList *list = NULL;
+  n = g_strv_length ((gchar **) multiarch_tuples);
+  abis = g_new0 (Abi *, n);
+  libraries = g_new0 (LibrariesCheck, n);
+  graphics = g_new0 (GraphicsCheck, n);
+  prefetch_jobs = g_ptr_array_new_with_free_func (g_free);
 
-  /* If we cached already the result, we return it */
-  if (abi->graphics_cache_available)
+  for (i = 0; i < n; i++)
     {
-      list = g_list_sort (g_hash_table_get_values (abi->cached_graphics_results),
-                                    (GCompareFunc) graphics_compare);
-      g_list_foreach (list, (GFunc) G_CALLBACK (g_object_ref), NULL);
+      abis[i] = ensure_abi_unless_immutable (self, multiarch_tuples[i]);
 
-      return list;
-    }
+      for (j = 0; j < i; j++)
+        {
+          if (abis[j] == abis[i])
+            abis[i] = NULL;
+        }
 
-  // Try each rendering interface
-  // Try each window system
+      if (abis[i] == NULL)
+        continue;
 
-  abi->cached_combined_graphics_issues |=
-    srt_system_info_check_graphics (self,
-                                    multiarch_tuple,
-                                    SRT_WINDOW_SYSTEM_GLX,
-                                    SRT_RENDERING_INTERFACE_GL,
-                                    NULL);
-
-  abi->cached_combined_graphics_issues |=
-    srt_system_info_check_graphics (self,
-                                    multiarch_tuple,
-                                    SRT_WINDOW_SYSTEM_EGL_X11,
-                                    SRT_RENDERING_INTERFACE_GL,
-                                    NULL);
-
-  abi->cached_combined_graphics_issues |=
-    srt_system_info_check_graphics (self,
-                                    multiarch_tuple,
-                                    SRT_WINDOW_SYSTEM_EGL_X11,
-                                    SRT_RENDERING_INTERFACE_GLESV2,
-                                    NULL);
-
-  abi->cached_combined_graphics_issues |=
-    srt_system_info_check_graphics (self,
-                                    multiarch_tuple,
-                                    SRT_WINDOW_SYSTEM_X11,
-                                    SRT_RENDERING_INTERFACE_VULKAN,
-                                    NULL);
-
-  abi->cached_combined_graphics_issues |=
-    srt_system_info_check_graphics (self,
-                                    multiarch_tuple,
-                                    SRT_WINDOW_SYSTEM_X11,
-                                    SRT_RENDERING_INTERFACE_VDPAU,
-                                    NULL);
-
-  abi->cached_combined_graphics_issues |=
-    srt_system_info_check_graphics (self,
-                                    multiarch_tuple,
-                                    SRT_WINDOW_SYSTEM_X11,
-                                    SRT_RENDERING_INTERFACE_VAAPI,
-                                    NULL);
+      if ((flags & SRT_PREFETCH_FLAGS_LIBRARIES)
+          && !abis[i]->libraries_cache_available)
+        {
+          /* If this fails, srt_system_info_check_libraries() will
+           * report the same problem later */
+          if (libraries_check_prepare (self, multiarch_tuples[i],
+                                       &libraries[i]) == SRT_LIBRARY_ISSUES_NONE)
+            prefetch_job_add_all (prefetch_jobs, libraries[i].jobs,
+                                  libraries_job_run, &libraries[i].context);
+          else
+            libraries_check_clear (&libraries[i]);
+        }
 
-  abi->graphics_cache_available = TRUE;
+      if ((flags & SRT_PREFETCH_FLAGS_GRAPHICS)
+          && !abis[i]->graphics_cache_available)
+        {
+          graphics_check_prepare (self, abis[i], multiarch_tuples[i],
+                                  &graphics[i]);
+          prefetch_job_add_all (prefetch_jobs, graphics[i].jobs,
+                                graphics_job_run, &graphics[i].context);
+        }
+    }
 
-  list = g_list_sort (g_hash_table_get_values (abi->cached_graphics_results),
-                      (GCompareFunc) graphics_compare);
-  g_list_foreach (list, (GFunc) G_CALLBACK (g_object_ref), NULL);
+  _srt_run_jobs_in_parallel (prefetch_jobs, prefetch_job_run, NULL);
 
-  return list;
+  for (i = 0; i < n; i++)
+    {
+      if (libraries[i].jobs != NULL)
+        libraries_check_finish (&libraries[i], abis[i]);
+
+      libraries_check_clear (&libraries[i]);
+
+      if (graphics[i].jobs != NULL)
+        graphics_check_finish (&graphics[i], abis[i]);
+    }
 }
 
 /**
@@ -2001,6 +2572,7 @@ srt_system_info_set_environ (SrtSystemInfo *self,
   forget_graphics_modules (self);
   forget_libraries (self);
   forget_graphics_results (self);
+  forget_library_resolver (self);
   forget_locales (self);
   forget_pinned_libs (self);
   forget_xdg_portal (self);
@@ -2703,6 +3275,7 @@ srt_system_info_set_helpers_path (SrtSystemInfo *self,
   forget_libraries (self);
   forget_graphics_results (self);
   forget_layers (self);
+  forget_library_resolver (self);
   forget_locales (self);
   free (self->helpers_path);
   self->helpers_path = g_strdup (path);
@@ -2887,6 +3460,110 @@ GStrv srt_system_info_dup_multiarch_tuples (SrtSystemInfo *self)
   return ret;
 }
 
+/* Read-only state shared between LocaleJobs */
+typedef struct
+{
+  gchar **env;
+  const char *helpers_path;
+  SrtHelperServer *server;
+  const char *multiarch_tuple;
+} LocaleJobContext;
+
+typedef struct
+{
+  GQuark quark;
+  MaybeLocale *maybe;
+} LocaleJob;
+
+static void
+locale_job_free (gpointer p)
+{
+  LocaleJob *job = p;
+
+  g_clear_pointer (&job->maybe, maybe_locale_free);
+  g_slice_free (LocaleJob, job);
+}
+
+/* Called in a worker thread, so it must not touch the SrtSystemInfo */
+static void
+locale_job_run (gpointer data,
+                gpointer user_data)
+{
+  LocaleJob *job = data;
+  const LocaleJobContext *context = user_data;
+  GError *local_error = NULL;
+  SrtLocale *locale;
+
+  locale = _srt_check_locale (context->env,
+                              context->helpers_path,
+                              context->server,
+                              context->multiarch_tuple,
+                              g_quark_to_string (job->quark),
+                              &local_error);
+
+  if (locale != NULL)
+    {
+      job->maybe = maybe_locale_new_positive (locale);
+      g_object_unref (locale);
+    }
+  else
+    {
+      job->maybe = maybe_locale_new_negative (local_error);
+      g_clear_error (&local_error);
+    }
+}
+
+/*
+ * Populate the locale cache for each of @names that is not already
+ * cached, running the check-locale helpers in parallel.
+ */
+static void
+prefetch_locales (SrtSystemInfo *self,
+                  const char * const *names)
+{
+  g_autoptr(GPtrArray) jobs = NULL;
+  LocaleJobContext context;
+  gsize i;
+
+  g_return_if_fail (!self->immutable_values);
+
+  if (self->locales.cached_locales == NULL)
+    self->locales.cached_locales = g_hash_table_new_full (NULL, NULL, NULL,
+                                                          maybe_locale_free);
+
+  jobs = g_ptr_array_new_with_free_func (locale_job_free);
+
+  for (i = 0; names[i] != NULL; i++)
+    {
+      GQuark quark = g_quark_from_string (names[i]);
+      LocaleJob *job;
+
+      if (g_hash_table_contains (self->locales.cached_locales,
+                                 GUINT_TO_POINTER (quark)))
+        continue;
+
+      job = g_slice_new0 (LocaleJob);
+      job->quark = quark;
+      g_ptr_array_add (jobs, job);
+    }
+
+  context.env = self->env;
+  context.helpers_path = self->helpers_path;
+  context.server = ensure_check_locale_server (self);
+  context.multiarch_tuple = srt_system_info_get_primary_multiarch_tuple (self);
+  _srt_run_jobs_in_parallel (jobs, locale_job_run, &context);
+
+  for (i = 0; i < jobs->len; i++)
+    {
+      LocaleJob *job = g_ptr_array_index (jobs, i);
+
+      if (job->maybe != NULL)
+        g_hash_table_replace (self->locales.cached_locales,
+                              GUINT_TO_POINTER (job->quark),
+                              g_steal_pointer (&job->maybe));
+    }
+}
+
 /**
  * srt_system_info_get_locale_issues:
  * @self: The #SrtSystemInfo
@@ -2904,10 +3581,15 @@ srt_system_info_get_locale_issues (SrtSystemInfo *self)
 
   if (!self->locales.have_issues && !self->immutable_values)
     {
+      static const char * const names[] = { "", "C.UTF-8", "en_US.UTF-8", NULL };
       SrtLocale *locale = NULL;
 
       self->locales.issues = SRT_LOCALE_ISSUES_NONE;
 
+      /* The locales are independent, so check them all at the same time;
+       * the srt_system_info_check_locale() calls below use the cache */
+      prefetch_locales (self, names);
+
       locale = srt_system_info_check_locale (self, "", NULL);
 
       if (locale == NULL)
@@ -3005,6 +3687,7 @@ srt_system_info_check_locale (SrtSystemInfo *self,
 
       locale = _srt_check_locale (self->env,
                                   self->helpers_path,
+                                  ensure_check_locale_server (self),
                                   srt_system_info_get_primary_multiarch_tuple (self),
                                   g_quark_to_string (quark),
                                   &local_error);
@@ -3137,6 +3820,7 @@ srt_system_info_list_egl_icds (SrtSystemInfo *self,
                                            multiarch_tuples == NULL ?
                                              (const char * const *) stored_multiarch_tuples :
                                              multiarch_tuples,
+                                           ensure_library_resolver (self),
                                            self->check_flags);
       self->icds.have_egl = TRUE;
     }
@@ -3205,6 +3889,7 @@ srt_system_info_list_vulkan_icds (SrtSystemInfo *self,
                                                  multiarch_tuples == NULL ?
                                                    (const char * const *) stored_multiarch_tuples :
                                                    multiarch_tuples,
+                                                 ensure_library_resolver (self),
                                                  self->check_flags);
       self->icds.have_vulkan = TRUE;
     }
@@ -3258,6 +3943,7 @@ srt_system_info_list_explicit_vulkan_layers (SrtSystemInfo *self)
                                                                        self->sysroot,
                                                                        self->env,
                                                                        (const char * const *) multiarch_tuples,
+                                                                       ensure_library_resolver (self),
                                                                        TRUE,
                                                                        self->check_flags);
       self->layers.have_vulkan_explicit = TRUE;
@@ -3312,6 +3998,7 @@ srt_system_info_list_implicit_vulkan_layers (SrtSystemInfo *self)
                                                                        self->sysroot,
                                                                        self->env,
                                                                        (const char * const *) multiarch_tuples,
+                                                                       ensure_library_resolver (self),
                                                                        FALSE,
                                                                        self->check_flags);
       self->layers.have_vulkan_implicit = TRUE;
@@ -3372,11 +4059,15 @@ _srt_system_info_list_graphics_modules (SrtSystemInfo *self,
 
   if (!abi->graphics_modules[which].available && !self->immutable_values)
     {
+      SrtHelperServer *server = ensure_inspect_library_server (self,
+                                                               multiarch_tuple);
+
       abi->graphics_modules[which].modules = _srt_list_graphics_modules (self->sysroot,
                                                                          self->env,
                                                                          self->helpers_path,
                                                                          multiarch_tuple,
                                                                          self->check_flags,
+                                                                         server,
                                                                          which);
       abi->graphics_modules[which].available = TRUE;
     }
@@ -4345,3 +5036,385 @@ srt_system_info_dup_libdl_platform (SrtSystemInfo *self,
 
   return g_strdup (abi->libdl_platform);
 }
+
+static void
+cache_key_add_string (GChecksum *checksum,
+                      const char *name,
+                      const char *value)
+{
+  /* Include the terminating '\0' to avoid ambiguity */
+  g_checksum_update (checksum, (const guchar *) name, strlen (name) + 1);
+
+  if (value != NULL)
+    g_checksum_update (checksum, (const guchar *) value, strlen (value) + 1);
+  else
+    g_checksum_update (checksum, (const guchar *) "", 0);
+}
+
+static void
+cache_key_add_file (GChecksum *checksum,
+                    const char *path)
+{
+  g_autofree gchar *description = NULL;
+  struct stat stat_buf;
+
+  if (stat (path, &stat_buf) == 0)
+    description = g_strdup_printf ("dev=%" G_GUINT64_FORMAT
+                                   " ino=%" G_GUINT64_FORMAT
+                                   " size=%" G_GINT64_FORMAT
+                                   " mtime=%" G_GINT64_FORMAT ".%09ld"
+                                   " ctime=%" G_GINT64_FORMAT ".%09ld",
+                                   (guint64) stat_buf.st_dev,
+                                   (guint64) stat_buf.st_ino,
+                                   (gint64) stat_buf.st_size,
+                                   (gint64) stat_buf.st_mtim.tv_sec,
+                                   (long) stat_buf.st_mtim.tv_nsec,
+                                   (gint64) stat_buf.st_ctim.tv_sec,
+                                   (long) stat_buf.st_ctim.tv_nsec);
+  else
+    description = g_strdup_printf ("errno=%d", errno);
+
+  cache_key_add_string (checksum, path, description);
+}
+
+/*
+ * Add each direct member of @path whose name starts with @prefix,
+ * and if @prefix is empty, @path itself.
+ */
+static void
+cache_key_add_directory_members (GChecksum *checksum,
+                                 const char *path,
+                                 const char *prefix)
+{
+  g_autoptr(GPtrArray) members = g_ptr_array_new_with_free_func (g_free);
+  g_autoptr(GDir) dir = NULL;
+  const char *member;
+  gsize i;
+
+  if (prefix[0] == '\0')
+    cache_key_add_file (checksum, path);
+
+  dir = g_dir_open (path, 0, NULL);
+
+  if (dir == NULL)
+    return;
+
+  while ((member = g_dir_read_name (dir)) != NULL)
+    {
+      if (g_str_has_prefix (member, prefix))
+        g_ptr_array_add (members, g_build_filename (path, member, NULL));
+    }
+
+  g_ptr_array_sort (members, _srt_indirect_strcmp0);
+
+  for (i = 0; i < members->len; i++)
+    cache_key_add_file (checksum, g_ptr_array_index (members, i));
+}
+
+/*
+ * Add @path and each of its direct members.
+ */
+static void
+cache_key_add_directory (GChecksum *checksum,
+                         const char *path)
+{
+  cache_key_add_directory_members (checksum, path, "");
+}
+
+/*
+ * Add the directories next to a graphics loader library in @libdir
+ * that _srt_get_modules_full() searches for DRI, VA-API and VDPAU
+ * drivers, and the GLX vendor libraries alongside it, so that
+ * installing, removing or upgrading a driver changes the cache key.
+ */
+static void
+cache_key_add_graphics_modules (GChecksum *checksum,
+                                const char *libdir)
+{
+  static const char * const module_dirs[] =
+  {
+    "dri",
+    "dri/intel-vaapi-driver",
+    "GL/lib/dri",
+    "vdpau",
+    "xorg/modules/dri",
+  };
+  gsize i;
+
+  for (i = 0; i < G_N_ELEMENTS (module_dirs); i++)
+    {
+      g_autofree gchar *dir = g_build_filename (libdir, module_dirs[i], NULL);
+
+      cache_key_add_directory (checksum, dir);
+    }
+
+  cache_key_add_directory_members (checksum, libdir, "libGLX_");
+}
+
+/*
+ * Add the file that would be loaded for @library, which is either
+ * a path or a SONAME. If @libdirs is non-%NULL, add the directory
+ * containing that file to it.
+ */
+static void
+cache_key_add_library (SrtSystemInfo *self,
+                       GChecksum *checksum,
+                       const char *multiarch_tuple,
+                       const char *library,
+                       GPtrArray *libdirs)
+{
+  g_autofree gchar *canonical_path = NULL;
+
+  if (library == NULL)
+    return;
+
+  if (_srt_library_resolver_get_canonical_path (ensure_library_resolver (self),
+                                                self->env,
+                                                multiarch_tuple,
+                                                library,
+                                                &canonical_path))
+    {
+      cache_key_add_string (checksum, library, canonical_path);
+
+      if (canonical_path != NULL)
+        {
+          cache_key_add_file (checksum, canonical_path);
+
+          if (libdirs != NULL)
+            {
+              g_autofree gchar *libdir = g_path_get_dirname (canonical_path);
+
+              if (!g_ptr_array_find_with_equal_func (libdirs, libdir,
+                                                     g_str_equal, NULL))
+                g_ptr_array_add (libdirs, g_steal_pointer (&libdir));
+            }
+        }
+    }
+  else
+    {
+      /* We can't find it without running a helper, so just use the
+       * library name, and the file itself if it's an absolute path */
+      cache_key_add_string (checksum, library, multiarch_tuple);
+
+      if (library[0] == '/')
+        cache_key_add_file (checksum, library);
+    }
+}
+
+/*
+ * _srt_system_info_dup_cache_key:
+ * @self: The #SrtSystemInfo
+ * @multiarch_tuples: (array zero-terminated=1): ABIs that will be checked
+ *
+ * Compute a fingerprint of the things that can affect the results of
+ * the library, graphics and locale checks, so that the caller can
+ * reuse those results from a previous run while the fingerprint stays
+ * the same. This includes the relevant environment variables, the
+ * `stat()` details of the ICD and layer manifests, the libraries they
+ * refer to, the graphics loader libraries, the directories containing
+ * DRI, VA-API and VDPAU drivers and GLX vendor libraries,
+ * `ld.so.cache`, locale data, the expectations and the helper executables.
+ *
+ * Listing the ICDs and layers has the side-effect of caching them in
+ * @self, as though srt_system_info_list_egl_icds() and similar
+ * functions had been called.
+ *
+ * Returns: (transfer full): A hex string, or %NULL if @self was
+ *  constructed with srt_system_info_new_from_json()
+ */
+gchar *
+_srt_system_info_dup_cache_key (SrtSystemInfo *self,
+                                const char * const *multiarch_tuples)
+{
+  static const char * const environment_variables[] =
+  {
+    "DISPLAY",
+    "LANG",
+    "LANGUAGE",
+    "LD_LIBRARY_PATH",
+    "LD_PRELOAD",
+    "LOCPATH",
+    "PATH",
+    "SRT_HELPERS_PATH",
+    "STEAM_RUNTIME",
+    "WAYLAND_DISPLAY",
+    "XDG_SESSION_TYPE",
+  };
+  /* Colon-separated search paths for graphics drivers, except for
+   * VDPAU_DRIVER_PATH which is a single directory */
+  static const char * const driver_path_variables[] =
+  {
+    "LIBGL_DRIVERS_PATH",
+    "LIBVA_DRIVERS_PATH",
+    "VDPAU_DRIVER_PATH",
+  };
+  static const char * const files[] =
+  {
+    "/etc/ld.so.cache",
+    "/etc/ld.so.preload",
+    "/sys/module/nvidia/version",
+    "/usr/lib/locale/locale-archive",
+    "/usr/share/i18n/SUPPORTED",
+    "/usr/share/i18n/locales/en_US",
+  };
+  static const char * const loaders[] =
+  {
+    "libEGL.so.1",
+    "libEGL_mesa.so.0",
+    "libGL.so.1",
+    "libGLESv2.so.2",
+    "libGLX.so.0",
+    "libGLX_mesa.so.0",
+    "libGLdispatch.so.0",
+    "libva.so.1",
+    "libva.so.2",
+    "libva-x11.so.2",
+    "libvdpau.so.1",
+    "libvulkan.so.1",
+  };
+  g_autoptr(GChecksum) checksum = NULL;
+  g_auto(GStrv) driver_environment = NULL;
+  g_autoptr(SrtObjectList) egl_icds = NULL;
+  g_autoptr(SrtObjectList) vulkan_icds = NULL;
+  g_autoptr(SrtObjectList) explicit_layers = NULL;
+  g_autoptr(SrtObjectList) implicit_layers = NULL;
+  struct utsname uts;
+  const GList *iter;
+  gsize i, j;
+
+  g_return_val_if_fail (SRT_IS_SYSTEM_INFO (self), NULL);
+  g_return_val_if_fail (multiarch_tuples != NULL, NULL);
+
+  if (self->immutable_values)
+    return NULL;
+
+  checksum = g_checksum_new (G_CHECKSUM_SHA256);
+
+  cache_key_add_string (checksum, "version", VERSION);
+  cache_key_add_string (checksum, "sysroot", self->sysroot);
+  cache_key_add_string (checksum, "helpers_path", self->helpers_path);
+
+  if (uname (&uts) == 0)
+    {
+      cache_key_add_string (checksum, "kernel-release", uts.release);
+      cache_key_add_string (checksum, "kernel-version", uts.version);
+    }
+
+  for (i = 0; i < G_N_ELEMENTS (environment_variables); i++)
+    cache_key_add_string (checksum, environment_variables[i],
+                          g_environ_getenv (self->env, environment_variables[i]));
+
+  for (i = 0; self->env[i] != NULL; i++)
+    {
+      if (g_str_has_prefix (self->env[i], "LC_"))
+        cache_key_add_string (checksum, "env", self->env[i]);
+    }
+
+  driver_environment = srt_system_info_list_driver_environment (self);
+
+  for (i = 0; driver_environment != NULL && driver_environment[i] != NULL; i++)
+    cache_key_add_string (checksum, "driver-env", driver_environment[i]);
+
+  for (i = 0; i < G_N_ELEMENTS (files); i++)
+    cache_key_add_file (checksum, files[i]);
+
+  for (i = 0; i < G_N_ELEMENTS (driver_path_variables); i++)
+    {
+      const char *value = g_environ_getenv (self->env, driver_path_variables[i]);
+      g_auto(GStrv) dirs = NULL;
+
+      if (value == NULL || value[0] == '\0')
+        continue;
+
+      if (g_str_equal (driver_path_variables[i], "VDPAU_DRIVER_PATH"))
+        {
+          cache_key_add_directory (checksum, value);
+          continue;
+        }
+
+      dirs = g_strsplit (value, ":", -1);
+
+      for (j = 0; dirs[j] != NULL; j++)
+        {
+          if (dirs[j][0] != '\0')
+            cache_key_add_directory (checksum, dirs[j]);
+        }
+    }
+
+  egl_icds = srt_system_info_list_egl_icds (self, multiarch_tuples);
+  vulkan_icds = srt_system_info_list_vulkan_icds (self, multiarch_tuples);
+  explicit_layers = srt_system_info_list_explicit_vulkan_layers (self);
+  implicit_layers = srt_system_info_list_implicit_vulkan_layers (self);
+
+  for (iter = egl_icds; iter != NULL; iter = iter->next)
+    cache_key_add_file (checksum, srt_egl_icd_get_json_path (iter->data));
+
+  for (iter = vulkan_icds; iter != NULL; iter = iter->next)
+    cache_key_add_file (checksum, srt_vulkan_icd_get_json_path (iter->data));
+
+  for (iter = explicit_layers; iter != NULL; iter = iter->next)
+    cache_key_add_file (checksum, srt_vulkan_layer_get_json_path (iter->data));
+
+  for (iter = implicit_layers; iter != NULL; iter = iter->next)
+    cache_key_add_file (checksum, srt_vulkan_layer_get_json_path (iter->data));
+
+  if (ensure_expectations (self))
+    cache_key_add_string (checksum, "expectations", self->expectations);
+
+  for (i = 0; multiarch_tuples[i] != NULL; i++)
+    {
+      const char *tuple = multiarch_tuples[i];
+      g_autoptr(GPtrArray) argv = NULL;
+      g_autoptr(GPtrArray) libdirs = g_ptr_array_new_with_free_func (g_free);
+      g_autoptr(GError) local_error = NULL;
+
+      cache_key_add_string (checksum, "multiarch", tuple);
+
+      for (j = 0; j < G_N_ELEMENTS (loaders); j++)
+        cache_key_add_library (self, checksum, tuple, loaders[j], libdirs);
+
+      /* DRI, VA-API and VDPAU drivers and GLX vendor libraries are
+       * found relative to the loaders, rather than being listed in
+       * a manifest */
+      for (j = 0; j < libdirs->len; j++)
+        cache_key_add_graphics_modules (checksum, g_ptr_array_index (libdirs, j));
+
+      for (iter = egl_icds; iter != NULL; iter = iter->next)
+        {
+          g_autofree gchar *library = srt_egl_icd_resolve_library_path (iter->data);
+
+          cache_key_add_library (self, checksum, tuple, library, NULL);
+        }
+
+      for (iter = vulkan_icds; iter != NULL; iter = iter->next)
+        {
+          g_autofree gchar *library = srt_vulkan_icd_resolve_library_path (iter->data);
+
+          cache_key_add_library (self, checksum, tuple, library, NULL);
+        }
+
+      if (self->expectations != NULL && self->expectations[0] != '\0')
+        {
+          g_autofree gchar *dir = g_build_filename (self->expectations, tuple, NULL);
+
+          cache_key_add_directory (checksum, dir);
+        }
+
+      /* All the helpers for an ABI are installed in the same directory */
+      argv = _srt_get_helper (self->helpers_path, tuple, "inspect-library",
+                              SRT_HELPER_FLAGS_NONE, &local_error);
+
+      if (argv != NULL)
+        {
+          g_autofree gchar *dir = g_path_get_dirname (g_ptr_array_index (argv, 0));
+
+          cache_key_add_directory (checksum, dir);
+        }
+      else
+        {
+          cache_key_add_string (checksum, "helpers", local_error->message);
+        }
+    }
+
+  return g_strdup (g_checksum_get_string (checksum));
+}
@@ -75,6 +75,24 @@ typedef enum
   SRT_DRIVER_FLAGS_NONE = 0
 } SrtDriverFlags;
 
+/**
+ * SrtPrefetchFlags:
+ * @SRT_PREFETCH_FLAGS_LIBRARIES: Check libraries, as if via
+ *  srt_system_info_check_libraries()
+ * @SRT_PREFETCH_FLAGS_GRAPHICS: Check graphics, as if via
+ *  srt_system_info_check_all_graphics()
+ * @SRT_PREFETCH_FLAGS_NONE: Don't check anything
+ *
+ * A bitfield with flags representing the checks that should be
+ * done in advance by srt_system_info_prefetch().
+ */
+typedef enum
+{
+  SRT_PREFETCH_FLAGS_LIBRARIES = (1 << 0),
+  SRT_PREFETCH_FLAGS_GRAPHICS = (1 << 1),
+  SRT_PREFETCH_FLAGS_NONE = 0
+} SrtPrefetchFlags;
+
 typedef struct _SrtSystemInfo SrtSystemInfo;
 typedef struct _SrtSystemInfoClass SrtSystemInfoClass;
 
@@ -127,6 +145,10 @@ SrtGraphicsIssues srt_system_info_check_graphics (SrtSystemInfo *self,
 _SRT_PUBLIC
 GList * srt_system_info_check_all_graphics (SrtSystemInfo *self,
                                             const char *multiarch_tuple);
+_SRT_PUBLIC
+void srt_system_info_prefetch (SrtSystemInfo *self,
+                               const char * const *multiarch_tuples,
+                               SrtPrefetchFlags flags);
 
 _SRT_PUBLIC
 GList *srt_system_info_list_egl_icds (SrtSystemInfo *self,
@@ -77,6 +77,10 @@ gboolean srt_add_flag_from_nick (GType flags_type,
 
 G_GNUC_INTERNAL void _srt_child_setup_unblock_signals (gpointer ignored);
 
+G_GNUC_INTERNAL void _srt_run_jobs_in_parallel (GPtrArray *jobs,
+                                                GFunc func,
+                                                gpointer user_data);
+
 _SRT_PRIVATE_EXPORT
 void _srt_unblock_signals (void);
 
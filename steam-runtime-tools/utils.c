@@ -212,6 +212,10 @@ _srt_process_timeout_wait_status (int wait_status, int *exit_status, int *termin
   return timed_out;
 }
 
+/* Protects the cached results of _srt_find_myself(), which can be
+ * called from _srt_run_jobs_in_parallel() worker threads */
+G_LOCK_DEFINE_STATIC (find_myself);
+
 G_GNUC_INTERNAL const char *
 _srt_find_myself (const char **helpers_path_out,
                   GError **error)
@@ -221,12 +225,15 @@ _srt_find_myself (const char **helpers_path_out,
   Dl_info ignored;
   struct link_map *map = NULL;
   gchar *dir = NULL;
+  const char *ret;
 
   g_return_val_if_fail (_srt_check_not_setuid (), NULL);
   g_return_val_if_fail (error == NULL || *error == NULL, NULL);
   g_return_val_if_fail (helpers_path_out == NULL || *helpers_path_out == NULL,
                         NULL);
 
+  G_LOCK (find_myself);
+
   if (saved_prefix != NULL && saved_helpers_path != NULL)
     goto out;
 
@@ -297,8 +304,10 @@ out:
   if (helpers_path_out != NULL)
     *helpers_path_out = saved_helpers_path;
 
+  ret = saved_prefix;
+  G_UNLOCK (find_myself);
   g_free (dir);
-  return saved_prefix;
+  return ret;
 }
 
 /*
@@ -658,6 +667,109 @@ _srt_child_setup_unblock_signals (gpointer ignored)
     (void) sigaction (signals_blocked_by_steam[i], &action, NULL);
 }
 
+typedef struct
+{
+  GPtrArray *jobs;
+  GFunc func;
+  gpointer user_data;
+  /* Index of the next job to be claimed, accessed atomically */
+  gint next;
+} ParallelJobs;
+
+/*
+ * Claim the next job that no other thread has started, and run it.
+ * Return %FALSE if there were no more jobs.
+ */
+static gboolean
+parallel_jobs_run_next (ParallelJobs *parallel)
+{
+  guint i = (guint) g_atomic_int_add (&parallel->next, 1);
+
+  if (i >= parallel->jobs->len)
+    return FALSE;
+
+  parallel->func (g_ptr_array_index (parallel->jobs, i), parallel->user_data);
+  return TRUE;
+}
+
+static void
+parallel_jobs_worker (gpointer unused,
+                      gpointer user_data)
+{
+  while (parallel_jobs_run_next (user_data))
+    continue;
+}
+
+/*
+ * _srt_run_jobs_in_parallel:
+ * @jobs: (element-type gpointer): Non-%NULL opaque data for each job
+ * @func: Called as `func (job, user_data)` for each item in @jobs
+ * @user_data: Passed to @func
+ *
+ * Call @func for each item in @jobs, using a pool of worker threads
+ * with one thread per CPU (or fewer), and return when all jobs have
+ * finished. The calling thread runs jobs too, so if no worker threads
+ * can be started, the jobs are run one at a time.
+ *
+ * This is intended for jobs that mostly wait for a helper subprocess
+ * or for filesystem I/O.
+ * @func may be called in any thread, so it must not touch non-thread-safe
+ * state such as a #SrtSystemInfo: it should store its results in the job,
+ * for the caller to merge back after this function returns.
+ */
+void
+_srt_run_jobs_in_parallel (GPtrArray *jobs,
+                           GFunc func,
+                           gpointer user_data)
+{
+  g_autoptr(GError) error = NULL;
+  ParallelJobs parallel = { jobs, func, user_data, 0 };
+  GThreadPool *pool = NULL;
+  guint max_threads;
+  guint i;
+
+  g_return_if_fail (jobs != NULL);
+  g_return_if_fail (func != NULL);
+
+  max_threads = MIN (jobs->len, g_get_num_processors ());
+
+  /* The calling thread is one of the workers, so we only need to
+   * start max_threads - 1 more */
+  if (max_threads > 1)
+    {
+      pool = g_thread_pool_new (parallel_jobs_worker, &parallel,
+                                max_threads - 1, FALSE, &error);
+
+      if (pool == NULL)
+        {
+          g_debug ("Unable to create thread pool: %s", error->message);
+          g_clear_error (&error);
+        }
+    }
+
+  for (i = 0; pool != NULL && i + 1 < max_threads; i++)
+    {
+      /* Each item in the pool's queue is a request for one more thread
+       * to help claim jobs, rather than a job itself, so that a job
+       * is never lost or run twice if a thread cannot be started */
+      if (!g_thread_pool_push (pool, GUINT_TO_POINTER (i + 1), &error))
+        {
+          g_debug ("Unable to start another thread: %s", error->message);
+          g_clear_error (&error);
+          break;
+        }
+    }
+
+  while (parallel_jobs_run_next (&parallel))
+    continue;
+
+  /* Every job has been claimed, so we only need to wait for the ones
+   * that are still running: any requests for more threads that are
+   * still queued can be discarded */
+  if (pool != NULL)
+    g_thread_pool_free (pool, TRUE, TRUE);
+}
+
 /*
  * _srt_unblock_signals:
  *
@@ -24,6 +24,7 @@
 #include <glib/gstdio.h>
 
 #include "tests/test-helpers.h"
+#include "utils/ld-libs.h"
 #include "utils/library-cmp.h"
 #include "utils/utils.h"
 
@@ -311,6 +312,124 @@ test_library_cmp_by_name (Fixture *f,
   free (comparators);
 }
 
+static void
+test_library_cmp_cache (Fixture *f,
+                        gconstpointer data)
+{
+  library_cmp_cache cache = LIBRARY_CMP_CACHE_INIT;
+  library_cmp_cache reloaded = LIBRARY_CMP_CACHE_INIT;
+  GError *error = NULL;
+  gchar *tmpdir = g_dir_make_tmp ("libcapsule.XXXXXX", &error);
+  gchar *container_file;
+  gchar *container_lib;
+  gchar *provider_file;
+  gchar *provider_lib;
+  gchar *soname = g_strdup ("libdbus-1.so.3");
+  library_cmp_function *comparators;
+  library_details details = {};
+  char *saved = NULL;
+  size_t saved_len = 0;
+  int code = -1;
+  char *message = NULL;
+  FILE *fh;
+  static const char garbage[] = "nope\n-1\tlibdbus-1.so.3\n";
+
+  g_assert_no_error (error);
+  g_assert_nonnull (tmpdir);
+
+  comparators = library_cmp_list_from_string ("name", ",", NULL, NULL);
+  g_assert_nonnull (comparators);
+  details.name = soname;
+  details.comparators = comparators;
+
+  container_file = g_build_filename (tmpdir, "libdbus-1.so.3.1", NULL);
+  container_lib = g_build_filename (tmpdir, "c-libdbus-1.so.3", NULL);
+  provider_file = g_build_filename (tmpdir, "libdbus-1.so.3.2", NULL);
+  provider_lib = g_build_filename (tmpdir, "p-libdbus-1.so.3", NULL);
+  touch (container_file);
+  touch (provider_file);
+  assert_with_errno (symlink ("libdbus-1.so.3.1", container_lib) == 0);
+  assert_with_errno (symlink ("libdbus-1.so.3.2", provider_lib) == 0);
+
+  /* Not cached yet: compare the files and remember the result */
+  g_assert_cmpint (library_cmp_list_iterate_cached (&cache, &details,
+                                                    container_lib, tmpdir,
+                                                    provider_lib, tmpdir),
+                   <, 0);
+  g_assert_true (library_cmp_cache_has_changes (&cache));
+
+  assert_with_errno ((fh = open_memstream (&saved, &saved_len)) != NULL);
+
+  if (!library_cmp_cache_save_to_stream (&cache, fh, "memstream",
+                                         &code, &message))
+    g_error ("%s", message);
+
+  assert_with_errno (fclose (fh) == 0);
+  g_test_message ("%s", saved);
+  g_assert_true (g_str_has_prefix (saved, "# "));
+  g_assert_nonnull (strstr (saved, "\n-1\tlibdbus-1.so.3\t"));
+
+  assert_with_errno ((fh = fmemopen (saved, saved_len, "r")) != NULL);
+
+  if (!library_cmp_cache_load_from_stream (&reloaded, fh, "saved",
+                                           &code, &message))
+    g_error ("%s", message);
+
+  g_assert_cmpstr (message, ==, NULL);
+  g_assert_cmpuint (code, ==, -1);
+  assert_with_errno (fclose (fh) == 0);
+  g_assert_false (library_cmp_cache_has_changes (&reloaded));
+
+  /* The same files again: the decision comes from the cache */
+  g_assert_cmpint (library_cmp_list_iterate_cached (&reloaded, &details,
+                                                    container_lib, tmpdir,
+                                                    provider_lib, tmpdir),
+                   <, 0);
+  g_assert_false (library_cmp_cache_has_changes (&reloaded));
+
+  /* If one of them changes, we have to look again */
+  assert_with_errno (g_file_set_contents (provider_file, "x", 1, NULL));
+  g_assert_cmpint (library_cmp_list_iterate_cached (&reloaded, &details,
+                                                    container_lib, tmpdir,
+                                                    provider_lib, tmpdir),
+                   <, 0);
+  g_assert_true (library_cmp_cache_has_changes (&reloaded));
+  library_cmp_cache_clear (&reloaded);
+
+  /* A cache in an unknown format is ignored, not an error */
+  assert_with_errno ((fh = fmemopen ((char *) garbage, strlen (garbage),
+                                     "r")) != NULL);
+
+  if (!library_cmp_cache_load_from_stream (&reloaded, fh, "garbage",
+                                           &code, &message))
+    g_error ("%s", message);
+
+  assert_with_errno (fclose (fh) == 0);
+  g_assert_cmpint (library_cmp_list_iterate_cached (&reloaded, &details,
+                                                    container_lib, tmpdir,
+                                                    provider_lib, tmpdir),
+                   <, 0);
+  g_assert_true (library_cmp_cache_has_changes (&reloaded));
+
+  /* With no cache, this is just library_cmp_list_iterate() */
+  g_assert_cmpint (library_cmp_list_iterate_cached (NULL, &details,
+                                                    container_lib, tmpdir,
+                                                    provider_lib, tmpdir),
+                   <, 0);
+
+  library_cmp_cache_clear (&cache);
+  library_cmp_cache_clear (&reloaded);
+  assert_with_errno (rm_rf (tmpdir));
+  g_free (container_file);
+  g_free (container_lib);
+  g_free (provider_file);
+  g_free (provider_lib);
+  g_free (soname);
+  g_free (tmpdir);
+  free (comparators);
+  free (saved);
+}
+
 typedef struct
 {
   const char *soname;
@@ -785,6 +904,113 @@ test_ptr_list (Fixture *f,
   ptr_list_free (list);
 }
 
+// Return the number of file descriptors we have open
+static int
+count_fds (void)
+{
+  GDir *dir = g_dir_open ("/proc/self/fd", 0, NULL);
+  int n = 0;
+
+  if (dir == NULL)
+    return -1;
+
+  while (g_dir_read_name (dir) != NULL)
+    n++;
+
+  g_dir_close (dir);
+  return n;
+}
+
+// Resolve the dependencies of target, optionally using dso_cache, and
+// return whether it succeeded
+static gboolean
+find_dependencies (ld_libs *ldlibs,
+                   const char *target,
+                   ld_dso_cache *dso_cache)
+{
+  int code = 0;
+  char *message = NULL;
+  gboolean ok;
+
+  ok = ld_libs_init (ldlibs, NULL, NULL, 0, &code, &message);
+  g_assert_cmpstr (message, ==, NULL);
+  g_assert_true (ok);
+
+  if (dso_cache != NULL)
+    ld_libs_use_dso_cache (ldlibs, dso_cache);
+
+  ok = (ld_libs_set_target (ldlibs, target, &code, &message)
+        && ld_libs_find_dependencies (ldlibs, &code, &message));
+
+  if (!ok)
+    g_test_message ("%s: %d: %s", target, code, message);
+
+  free (message);
+  return ok;
+}
+
+static void
+test_ld_libs_dso_cache (Fixture *f,
+                        gconstpointer data)
+{
+  static const char * const targets[] =
+  {
+    "libc.so.6",
+    "libglib-2.0.so.0",
+    "libelf.so.1",
+    // repeated, so that it comes from the cache the second time
+    "libglib-2.0.so.0",
+    "libcapsule-no-such-library.so.0",
+  };
+  ld_dso_cache dso_cache = {};
+  int fds_before;
+  gsize i;
+
+  fds_before = count_fds ();
+
+  for (i = 0; i < G_N_ELEMENTS (targets); i++)
+    {
+      ld_libs uncached = {};
+      ld_libs cached = {};
+      gboolean uncached_ok;
+      gboolean cached_ok;
+
+      g_test_message ("%s", targets[i]);
+      uncached_ok = find_dependencies (&uncached, targets[i], NULL);
+      cached_ok = find_dependencies (&cached, targets[i], &dso_cache);
+      g_assert_cmpint (uncached_ok, ==, cached_ok);
+
+      if (uncached_ok)
+        {
+          int j;
+
+          g_assert_cmpint (cached.last_idx, ==, uncached.last_idx);
+
+          for (j = 0; j < DSO_LIMIT; j++)
+            {
+              g_assert_cmpstr (cached.needed[j].name, ==,
+                               uncached.needed[j].name);
+              g_assert_cmpstr (cached.needed[j].path, ==,
+                               uncached.needed[j].path);
+              g_assert_cmpint (cached.needed[j].depcount, ==,
+                               uncached.needed[j].depcount);
+              g_assert_cmpint (cached.needed[j].fd, ==, -1);
+            }
+        }
+
+      ld_libs_finish (&uncached);
+      ld_libs_finish (&cached);
+    }
+
+  g_assert_cmpuint (dso_cache.n_entries, >, 0);
+
+  // The cache does not hold the libraries it has inspected open
+  if (fds_before >= 0)
+    g_assert_cmpint (count_fds (), ==, fds_before);
+
+  ld_dso_cache_clear (&dso_cache);
+}
+
 static void
 teardown (Fixture *f,
           gconstpointer data)
@@ -809,12 +1035,16 @@ main (int argc,
   g_test_add ("/library-cmp/configurable", Fixture, NULL,
               setup, test_library_cmp, teardown);
 #endif
+  g_test_add ("/library-cmp/cache", Fixture, NULL,
+              setup, test_library_cmp_cache, teardown);
   g_test_add ("/library-cmp/name", Fixture, NULL,
               setup, test_library_cmp_by_name, teardown);
   g_test_add ("/library-knowledge/bad", Fixture, NULL,
               setup, test_library_knowledge_bad, teardown);
   g_test_add ("/library-knowledge/good", Fixture, NULL,
               setup, test_library_knowledge_good, teardown);
+  g_test_add ("/ld-libs/dso-cache", Fixture, NULL,
+              setup, test_ld_libs_dso_cache, teardown);
   g_test_add ("/ptr-list", Fixture, NULL, setup, test_ptr_list, teardown);
 
   return g_test_run ();
@@ -20,7 +20,6 @@
 #include <err.h>
 #include <errno.h>
 #include <fcntl.h>
-#include <fnmatch.h>
 #include <getopt.h>
 #include <glob.h>
 #include <stdbool.h>
@@ -106,6 +105,7 @@ enum
   OPTION_COMPARE_BY,
   OPTION_CONTAINER,
   OPTION_DEST,
+  OPTION_LIBRARY_CMP_CACHE,
   OPTION_LIBRARY_KNOWLEDGE,
   OPTION_LINK_TARGET,
   OPTION_NO_GLIBC,
@@ -129,12 +129,21 @@ static const char *option_link_target = NULL;
 static remap_tuple *remap_prefix = NULL;
 static bool option_glibc = true;
 
+// Opened on first use by sysroot_cache(), then shared by every pattern
+// and every ld_libs for the rest of the process:
+static ld_cache provider_cache = { .is_open = 0 };
+static ld_cache container_cache = { .is_open = 0 };
+// Likewise, every DSO that any ld_libs looks at is only opened and
+// parsed once, however many patterns depend on it:
+static ld_dso_cache dso_cache = {};
+
 static struct option long_options[] =
 {
     { "compare-by", required_argument, NULL, OPTION_COMPARE_BY },
     { "container", required_argument, NULL, OPTION_CONTAINER },
     { "dest", required_argument, NULL, OPTION_DEST },
     { "help", no_argument, NULL, 'h' },
+    { "library-cmp-cache", required_argument, NULL, OPTION_LIBRARY_CMP_CACHE },
     { "library-knowledge", required_argument, NULL, OPTION_LIBRARY_KNOWLEDGE },
     { "link-target", required_argument, NULL, OPTION_LINK_TARGET },
     { "no-glibc", no_argument, NULL, OPTION_NO_GLIBC },
@@ -244,6 +253,9 @@ static void usage (int code)
                "\tdeciding which libraries are needed [default: /]\n" );
   fprintf( fh, "--dest=LIBDIR\n"
                "\tCreate symlinks in LIBDIR [default: .]\n" );
+  fprintf( fh, "--library-cmp-cache=FILE\n"
+               "\tRemember which library was chosen in FILE, and reuse\n"
+               "\tthe decision while both libraries are unchanged.\n" );
   fprintf( fh, "--library-knowledge=FILE\n"
                "\tLoad information about known libraries from a"
                "\t.desktop-style file at FILE, overriding --compare-by.\n" );
@@ -321,22 +333,59 @@ typedef struct
     capture_flags flags;
     library_cmp_function *comparators;
     library_knowledge knowledge;
+    library_cmp_cache *cmp_cache;
 } capture_options;
 
+// Return the ld.so.cache for @sysroot, which must be either
+// option_provider or option_container, opening it if necessary.
+// Returns NULL with the error set if it cannot be opened.
+static ld_cache *
+sysroot_cache( const char *sysroot, int *code, char **message )
+{
+    ld_cache *cache;
+
+    if( strcmp( sysroot, option_provider ) == 0 )
+    {
+        cache = &provider_cache;
+    }
+    else
+    {
+        assert( option_container != NULL );
+        assert( strcmp( sysroot, option_container ) == 0 );
+        cache = &container_cache;
+    }
+
+    if( !cache->is_open &&
+        !ld_cache_open_in_sysroot( cache, sysroot, code, message ) )
+    {
+        assert( !cache->is_open );
+        return NULL;
+    }
+
+    return cache;
+}
+
 static bool
 init_with_target( ld_libs *ldlibs, const char *tree, const char *target,
                   int *code, char **message )
 {
+    ld_cache *cache;
+
     if( !ld_libs_init( ldlibs, NULL, tree, debug_flags, code, message ) )
     {
         goto fail;
     }
 
-    if( !ld_libs_load_cache( ldlibs, code, message ) )
+    cache = sysroot_cache( tree, code, message );
+
+    if( cache == NULL )
     {
         goto fail;
     }
 
+    ld_libs_use_cache( ldlibs, cache );
+    ld_libs_use_dso_cache( ldlibs, &dso_cache );
+
     if( !ld_libs_set_target( ldlibs, target, code, message ) )
     {
         goto fail;
@@ -518,11 +567,12 @@ capture_one( const char *soname, const capture_options *options,
                 if( details.comparators == NULL )
                     details.comparators = options->comparators;
 
-                decision = library_cmp_list_iterate( &details,
-                                                     needed_path_in_container,
-                                                     option_container,
-                                                     needed_path_in_provider,
-                                                     option_provider );
+                decision = library_cmp_list_iterate_cached( options->cmp_cache,
+                                                            &details,
+                                                            needed_path_in_container,
+                                                            option_container,
+                                                            needed_path_in_provider,
+                                                            option_provider );
 
                 if( decision > 0 )
                 {
@@ -673,7 +723,6 @@ typedef struct
     const char *pattern;
     const capture_options *options;
     bool found;
-    ld_cache cache;
     int *code;
     char **message;
 } cache_foreach_context;
@@ -683,30 +732,21 @@ cache_foreach_cb (const char *name, int flag, unsigned int osv,
                   uint64_t hwcap, const char *path, void *data)
 {
   cache_foreach_context *ctx = data;
+  capture_options new_options;
 
-  if( !name || !*name )
-  {
-      warnx( "warning: empty name found in ld.so.cache" );
-      return 0;
-  }
-
+  // ld_cache_foreach_match() only calls this for names that match.
   // We don't really care about whether the library matches our class,
   // machine, hwcaps etc. - if we can't dlopen a library of this name,
   // we'll just skip it.
-  if( fnmatch( ctx->pattern, name, 0 ) == 0 )
-  {
-      capture_options new_options;
+  DEBUG( DEBUG_TOOL, "%s matches %s", name, ctx->pattern );
 
-      DEBUG( DEBUG_TOOL, "%s matches %s", name, ctx->pattern );
+  ctx->found = true;
 
-      ctx->found = true;
+  new_options = *ctx->options;
+  new_options.flags |= CAPTURE_FLAG_IF_EXISTS;
 
-      new_options = *ctx->options;
-      new_options.flags |= CAPTURE_FLAG_IF_EXISTS;
-
-      if( !capture_one( name, &new_options, ctx->code, ctx->message ) )
-          return 1;
-  }
+  if( !capture_one( name, &new_options, ctx->code, ctx->message ) )
+      return 1;
 
   return 0;   // continue iteration
 }
@@ -718,38 +758,22 @@ capture_soname_match( const char *pattern, const capture_options *options,
     cache_foreach_context ctx = {
         .pattern = pattern,
         .options = options,
-        .cache = { .is_open = 0 },
         .found = false,
         .code = code,
         .message = message,
     };
-    bool ret = false;
-    size_t i;
+    ld_cache *cache;
 
     DEBUG( DEBUG_TOOL, "%s", pattern );
 
-    for( i = 0; ld_cache_filenames[i] != NULL; i++ )
-    {
-        _capsule_autofree char *cache_path = NULL;
-
-        if( message != NULL )
-            _capsule_clear( message );
-
-        cache_path = build_filename_alloc( option_provider,
-                                           ld_cache_filenames[i],
-                                           NULL );
+    cache = sysroot_cache( option_provider, code, message );
 
-        if( ld_cache_open( &ctx.cache, cache_path, code, message ) )
-            break;
-        else
-            assert( !ctx.cache.is_open );
-    }
-
-    if( !ctx.cache.is_open )
-        goto out;
+    if( cache == NULL )
+        return false;
 
-    if( ld_cache_foreach( &ctx.cache, cache_foreach_cb, &ctx ) != 0 )
-        goto out;
+    if( ld_cache_foreach_match( cache, pattern,
+                                cache_foreach_cb, &ctx ) != 0 )
+        return false;
 
     if( !ctx.found && !( options->flags & CAPTURE_FLAG_IF_EXISTS ) )
     {
@@ -757,16 +781,10 @@ capture_soname_match( const char *pattern, const capture_options *options,
                             "no matches found for glob pattern \"%s\" "
                             "in ld.so.cache",
                             pattern );
-        goto out;
+        return false;
     }
 
-    ret = true;
-
-out:
-    if( ctx.cache.is_open )
-        ld_cache_close( &ctx.cache );
-
-    return ret;
+    return true;
 }
 
 static bool
@@ -1171,6 +1189,87 @@ capture_patterns( const char * const *patterns,
     return true;
 }
 
+// The cache is only an optimization, so failing to load or save it
+// is not fatal: we just make the decisions again.
+static void
+load_library_cmp_cache( library_cmp_cache *cache, const char *path )
+{
+    int code = 0;
+    _capsule_autofree char *message = NULL;
+    FILE *fh = fopen( path, "re" );
+
+    if( fh == NULL )
+    {
+        if( errno != ENOENT )
+            warn( "warning: unable to open \"%s\"", path );
+
+        return;
+    }
+
+    if( !library_cmp_cache_load_from_stream( cache, fh, path,
+                                             &code, &message ) )
+    {
+        warnx( "warning: code %d: %s", code, message );
+        library_cmp_cache_clear( cache );
+    }
+
+    fclose( fh );
+}
+
+static void
+save_library_cmp_cache( const library_cmp_cache *cache, const char *path )
+{
+    int code = 0;
+    _capsule_autofree char *message = NULL;
+    _capsule_autofree char *tmp = NULL;
+    FILE *fh = NULL;
+    int fd;
+
+    // Other instances might be using the same cache, so replace it
+    // atomically: the last one to finish wins
+    xasprintf( &tmp, "%s.XXXXXX", path );
+    fd = mkostemp( tmp, O_CLOEXEC );
+
+    if( fd < 0 )
+    {
+        warn( "warning: unable to create \"%s\"", tmp );
+        return;
+    }
+
+    fh = fdopen( fd, "w" );
+
+    if( fh == NULL )
+    {
+        warn( "warning: unable to write \"%s\"", tmp );
+        close( fd );
+        goto fail;
+    }
+
+    if( !library_cmp_cache_save_to_stream( cache, fh, tmp, &code, &message ) )
+    {
+        warnx( "warning: code %d: %s", code, message );
+        fclose( fh );
+        goto fail;
+    }
+
+    if( fclose( fh ) != 0 )
+    {
+        warn( "warning: unable to write \"%s\"", tmp );
+        goto fail;
+    }
+
+    if( rename( tmp, path ) != 0 )
+    {
+        warn( "warning: unable to rename \"%s\" to \"%s\"", tmp, path );
+        goto fail;
+    }
+
+    return;
+
+fail:
+    unlink( tmp );
+}
+
 int
 main (int argc, char **argv)
 {
@@ -1179,8 +1278,11 @@ main (int argc, char **argv)
         .flags = (CAPTURE_FLAG_LIBRARY_ITSELF |
                   CAPTURE_FLAG_DEPENDENCIES ),
         .knowledge = LIBRARY_KNOWLEDGE_INIT,
+        .cmp_cache = NULL,
     };
+    library_cmp_cache cmp_cache = LIBRARY_CMP_CACHE_INIT;
     const char *option_compare_by = "name,provider";
+    const char *option_library_cmp_cache = NULL;
     const char *option_library_knowledge = NULL;
     int code = 0;
     char *message = NULL;
@@ -1221,6 +1323,10 @@ main (int argc, char **argv)
                 option_dest = optarg;
                 break;
 
+            case OPTION_LIBRARY_CMP_CACHE:
+                option_library_cmp_cache = optarg;
+                break;
+
             case OPTION_LIBRARY_KNOWLEDGE:
                 if( option_library_knowledge != NULL )
                     errx( 1, "--library-knowledge can only be used once" );
@@ -1338,6 +1444,12 @@ main (int argc, char **argv)
         fclose( fh );
     }
 
+    if( option_library_cmp_cache != NULL )
+    {
+        load_library_cmp_cache( &cmp_cache, option_library_cmp_cache );
+        options.cmp_cache = &cmp_cache;
+    }
+
     dest_fd = open( option_dest, O_RDWR|O_DIRECTORY|O_CLOEXEC|O_PATH );
 
     if( dest_fd < 0 )
@@ -1350,7 +1462,15 @@ main (int argc, char **argv)
         errx( 1, "code %d: %s", code, message );
     }
 
+    if( option_library_cmp_cache != NULL &&
+        library_cmp_cache_has_changes( &cmp_cache ) )
+        save_library_cmp_cache( &cmp_cache, option_library_cmp_cache );
+
     close( dest_fd );
+    library_cmp_cache_clear( &cmp_cache );
+    ld_cache_close( &provider_cache );
+    ld_cache_close( &container_cache );
+    ld_dso_cache_clear( &dso_cache );
     free( options.comparators );
     library_knowledge_clear( &options.knowledge );
 
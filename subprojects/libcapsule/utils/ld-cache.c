@@ -18,7 +18,10 @@
 // License along with libcapsule.  If not, see <http://www.gnu.org/licenses/>.
 
 #include <errno.h>
+#include <fnmatch.h>
+#include <limits.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <sys/mman.h>
 #include <sys/types.h>
 #include <sys/stat.h>
@@ -101,6 +104,8 @@ ld_cache_reset (ld_cache *cache)
     cache->type     = CACHE_NONE;
     cache->mmap     = MAP_FAILED;
     cache->is_open  = 0;
+    cache->index    = NULL;
+    cache->index_len = 0;
 }
 
 void
@@ -117,6 +122,7 @@ ld_cache_close (ld_cache *cache)
     if( cache->mmap && cache->map_size )
         munmap( cache->mmap, cache->map_size );
 
+    free( cache->index );
     ld_cache_reset( cache );
 }
 
@@ -239,6 +245,41 @@ cleanup:
     return 0;
 }
 
+// Open the first of ld_cache_filenames that exists below sysroot,
+// which may be NULL or empty for the real root filesystem.
+// returns true on success, false otherwise (with the last error set)
+int
+ld_cache_open_in_sysroot (ld_cache *cache, const char *sysroot,
+                          int *code, char **message)
+{
+    char prefixed[PATH_MAX] = { '\0' };
+    size_t i;
+
+    if( sysroot == NULL )
+        sysroot = "";
+
+    for( i = 0; ld_cache_filenames[i] != NULL; i++ )
+    {
+        if( message != NULL )
+            _capsule_clear( message );
+
+        if( build_filename( prefixed, sizeof(prefixed), sysroot,
+                            ld_cache_filenames[i], NULL ) >= sizeof(prefixed) )
+        {
+            _capsule_set_error( code, message, ENAMETOOLONG,
+                                "Cannot append \"%s\" to prefix \"%s\": too long",
+                                ld_cache_filenames[i], sysroot );
+            continue;
+        }
+
+        if( ld_cache_open( cache, prefixed, code, message ) )
+            return 1;
+    }
+
+    // return the last error
+    return 0;
+}
+
 // iterate over the entries in the ld cache, invoking callback cb on each one
 // until eithe the callback returns true or we run out of entries.
 // if the callback terminates iteration by returning true, return that value,
@@ -277,6 +318,190 @@ ld_cache_foreach (ld_cache *cache, ld_cache_entry_cb cb, void *data)
     return rval;
 }
 
+// return the number of entries in the cache
+static unsigned int
+ld_cache_n_entries (const ld_cache *cache)
+{
+    switch( cache->type )
+    {
+      case CACHE_OLD:
+        return cache->file.old->nlibs;
+
+      case CACHE_NEW:
+        return cache->file.new->nlibs;
+
+      case CACHE_NONE:
+      default:
+        return 0;
+    }
+}
+
+// invoke callback cb on the i'th entry in the cache
+static intptr_t
+ld_cache_call_nth (ld_cache *cache, unsigned int i,
+                   ld_cache_entry_cb cb, void *data)
+{
+    const char *base = cache->data;
+
+    if( cache->type == CACHE_OLD )
+    {
+        struct file_entry *f = &cache->file.old->libs[i];
+        return cb( base + f->key, f->flags, 0, 0, base + f->value, data );
+    }
+    else
+    {
+        struct file_entry_new *f = &cache->file.new->libs[i];
+        return cb( base + f->key, f->flags,
+                   f->osversion, f->hwcap, base + f->value, data );
+    }
+}
+
+static int
+index_entry_cmp (const void *a, const void *b)
+{
+    const ld_cache_index_entry *ea = a;
+    const ld_cache_index_entry *eb = b;
+    int ret = strcmp( ea->name, eb->name );
+
+    if( ret != 0 )
+        return ret;
+
+    // entries with the same name stay in cache order, because
+    // the first one that is usable wins
+    return (ea->idx > eb->idx) - (ea->idx < eb->idx);
+}
+
+static int
+uint_cmp (const void *a, const void *b)
+{
+    unsigned int ia = *(const unsigned int *) a;
+    unsigned int ib = *(const unsigned int *) b;
+
+    return (ia > ib) - (ia < ib);
+}
+
+// build an index of the cache sorted by name, so that we can find
+// entries by binary search instead of comparing against each one
+static void
+ld_cache_ensure_index (ld_cache *cache)
+{
+    unsigned int n = ld_cache_n_entries( cache );
+    const char *base = cache->data;
+
+    if( cache->index != NULL || n == 0 )
+        return;
+
+    cache->index = xcalloc( n, sizeof( ld_cache_index_entry ) );
+
+    for( unsigned int i = 0; i < n; i++ )
+    {
+        ld_cache_index_entry *e = &cache->index[cache->index_len];
+
+        if( cache->type == CACHE_OLD )
+            e->name = base + cache->file.old->libs[i].key;
+        else
+            e->name = base + cache->file.new->libs[i].key;
+
+        // malformed cache entry? it can't match anything useful
+        if( *e->name == '\0' )
+            continue;
+
+        e->idx = i;
+        cache->index_len++;
+    }
+
+    qsort( cache->index, cache->index_len, sizeof( ld_cache_index_entry ),
+           index_entry_cmp );
+
+    DEBUG( DEBUG_LDCACHE, "Indexed %zu ld.cache entries", cache->index_len );
+}
+
+// return the position in the index of the first entry whose name
+// is greater than or equal to prefix
+static size_t
+ld_cache_index_lower_bound (const ld_cache *cache, const char *prefix,
+                            size_t len)
+{
+    size_t lo = 0;
+    size_t hi = cache->index_len;
+
+    while( lo < hi )
+    {
+        size_t mid = lo + (hi - lo) / 2;
+
+        if( strncmp( cache->index[mid].name, prefix, len ) < 0 )
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+
+    return lo;
+}
+
+// like ld_cache_foreach, but only for entries whose name is exactly
+// name, in cache order:
+intptr_t
+ld_cache_foreach_name (ld_cache *cache, const char *name,
+                       ld_cache_entry_cb cb, void *data)
+{
+    size_t len = strlen( name );
+    intptr_t rval = 0;
+
+    ld_cache_ensure_index( cache );
+
+    for( size_t i = ld_cache_index_lower_bound( cache, name, len + 1 );
+         !rval && i < cache->index_len;
+         i++ )
+    {
+        if( strcmp( cache->index[i].name, name ) != 0 )
+            break;
+
+        rval = ld_cache_call_nth( cache, cache->index[i].idx, cb, data );
+    }
+
+    return rval;
+}
+
+// like ld_cache_foreach, but only for entries whose name matches the
+// fnmatch(3) pattern, in cache order. Only the entries that start with
+// the literal part of the pattern (if any) need to be checked.
+intptr_t
+ld_cache_foreach_match (ld_cache *cache, const char *pattern,
+                        ld_cache_entry_cb cb, void *data)
+{
+    size_t len = strcspn( pattern, "*?[\\" );
+    unsigned int *matches = NULL;
+    size_t n_matches = 0;
+    intptr_t rval = 0;
+    size_t i;
+
+    ld_cache_ensure_index( cache );
+
+    if( cache->index_len == 0 )
+        return 0;
+
+    matches = xcalloc( cache->index_len, sizeof( unsigned int ) );
+
+    for( i = ld_cache_index_lower_bound( cache, pattern, len );
+         i < cache->index_len;
+         i++ )
+    {
+        if( strncmp( cache->index[i].name, pattern, len ) != 0 )
+            break;
+
+        if( fnmatch( pattern, cache->index[i].name, 0 ) == 0 )
+            matches[n_matches++] = cache->index[i].idx;
+    }
+
+    qsort( matches, n_matches, sizeof( unsigned int ), uint_cmp );
+
+    for( i = 0; !rval && i < n_matches; i++ )
+        rval = ld_cache_call_nth( cache, matches[i], cb, data );
+
+    free( matches );
+    return rval;
+}
+
 intptr_t
 ld_entry_dump (const char *name,
                int flag,
@@ -73,6 +73,13 @@ struct cache_file
     struct file_entry libs[0];
 };
 
+// One entry in the index of an ld_cache, sorted by name
+typedef struct
+{
+    const char *name;
+    unsigned int idx;  // position of the entry in the cache
+} ld_cache_index_entry;
+
 typedef struct
 {
     int fd;
@@ -82,6 +89,10 @@ typedef struct
     union { struct cache_file *old; struct cache_file_new *new; } file;
     cache_type type;
     int is_open;
+    // Built on first use by ld_cache_foreach_name() or
+    // ld_cache_foreach_match(), and freed by ld_cache_close()
+    ld_cache_index_entry *index;
+    size_t index_len;
 } ld_cache;
 
 // ==========================================================================
@@ -97,8 +108,14 @@ typedef intptr_t (*ld_cache_entry_cb) (const char *name,
 
 int      ld_cache_open    (ld_cache *cache, const char *path, int *code,
                            char **message);
+int      ld_cache_open_in_sysroot (ld_cache *cache, const char *sysroot,
+                                   int *code, char **message);
 void     ld_cache_close   (ld_cache *cache);
 intptr_t ld_cache_foreach (ld_cache *cache, ld_cache_entry_cb cb, void *data);
+intptr_t ld_cache_foreach_name (ld_cache *cache, const char *name,
+                                ld_cache_entry_cb cb, void *data);
+intptr_t ld_cache_foreach_match (ld_cache *cache, const char *pattern,
+                                 ld_cache_entry_cb cb, void *data);
 
 intptr_t ld_entry_dump (const char *name, int flag, unsigned int osv,
                         uint64_t hwcap, const char *path, void *data);
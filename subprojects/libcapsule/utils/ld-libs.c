@@ -193,57 +193,65 @@ set_elf_constraints (ld_libs *ldlibs)
              ( ldlibs->elf_machine |= EM_NONE      ) );
 }
 
-// check that the currently opened DSO at offset idx in the needed array
+// check that a DSO of class eclass and machine type machine
 // matches the class & architecture of the DSO we started with:
 // return true on a match, false otherwise
 static int
-check_elf_constraints (ld_libs *ldlibs, int idx, int *code, char **message)
+check_elf_class_and_machine (ld_libs *ldlibs, const char *path,
+                             int eclass, Elf64_Half machine,
+                             int *code, char **message)
 {
-    GElf_Ehdr ehdr = {};
-    int eclass;
-
-    // bogus ELF DSO - no ehdr available?
-    if( !gelf_getehdr( ldlibs->needed[ idx ].dso, &ehdr ) )
-    {
-        // FIXME: elf_errno() isn't actually in the same domain as errno
-        _capsule_set_error( code, message, elf_errno(), "gelf_getehdr(%s): %s",
-                            ldlibs->needed[ idx ].path,
-                            elf_errmsg( elf_errno() ) );
-        return 0;
-    }
-
-    eclass = gelf_getclass( ldlibs->needed[ idx ].dso );
-
     // check class (32 vs 64 bit)
     if( ldlibs->elf_class != eclass )
     {
         _capsule_set_error( code, message, ENOEXEC,
                             "gelf_getclass(%s): expected %d, found %d",
-                            ldlibs->needed[ idx ].path, ldlibs->elf_class,
-                            eclass );
+                            path, ldlibs->elf_class, eclass );
         return 0;
     }
 
     // check target architecture (i386, x86-64)
     // x32 ABI is class 32 but machine x86-64
-    if( ldlibs->elf_machine != ehdr.e_machine )
+    if( ldlibs->elf_machine != machine )
     {
         _capsule_set_error( code, message, ENOEXEC,
                             "ehdr.e_machine of %s: expected %d, found %d",
-                            ldlibs->needed[ idx ].path, ldlibs->elf_machine,
-                            ehdr.e_machine );
+                            path, ldlibs->elf_machine, machine );
         return 0;
     }
 
     DEBUG( DEBUG_ELF, "constraints: class %d; machine: %d;",
            ldlibs->elf_class, ldlibs->elf_machine );
     DEBUG( DEBUG_ELF, "results    : class %d; machine: %d;",
-           eclass, ehdr.e_machine );
+           eclass, machine );
 
     // both the class (word size) and machine (architecture) match
     return 1;
 }
 
+// check that the currently opened DSO at offset idx in the needed array
+// matches the class & architecture of the DSO we started with:
+// return true on a match, false otherwise
+static int
+check_elf_constraints (ld_libs *ldlibs, int idx, int *code, char **message)
+{
+    GElf_Ehdr ehdr = {};
+
+    // bogus ELF DSO - no ehdr available?
+    if( !gelf_getehdr( ldlibs->needed[ idx ].dso, &ehdr ) )
+    {
+        // FIXME: elf_errno() isn't actually in the same domain as errno
+        _capsule_set_error( code, message, elf_errno(), "gelf_getehdr(%s): %s",
+                            ldlibs->needed[ idx ].path,
+                            elf_errmsg( elf_errno() ) );
+        return 0;
+    }
+
+    return check_elf_class_and_machine( ldlibs, ldlibs->needed[ idx ].path,
+                                        gelf_getclass( ldlibs->needed[ idx ].dso ),
+                                        ehdr.e_machine, code, message );
+}
+
 // check that the library we're opening is NOT ourself (this is to stop
 // a proxy libfoo.so.X from opening itself instead of the real target):
 // In normal situations we won't find ourself by accident as the path
@@ -252,7 +260,7 @@ check_elf_constraints (ld_libs *ldlibs, int idx, int *code, char **message)
 // library could result in the capsule library finding itself and
 // inifinitely looping, so we try to avoid that with this test:
 static int
-target_is_ourself  (ld_libs *ldlibs, int idx)
+target_is_ourself  (int fd)
 {
     const struct stat *cdso = stat_caller();
     struct stat xdso = { 0 };
@@ -264,7 +272,7 @@ target_is_ourself  (ld_libs *ldlibs, int idx)
 
     // if stat says we have the same device and inode as
     // the target we're considering ourselves as a target:
-    if( fstat( ldlibs->needed[idx].fd, &xdso ) == 0 )
+    if( fstat( fd, &xdso ) == 0 )
         return ( cdso->st_dev == xdso.st_dev &&
                  cdso->st_ino == xdso.st_ino );
 
@@ -272,14 +280,24 @@ target_is_ourself  (ld_libs *ldlibs, int idx)
     return 0;
 }
 
+// true if ld_lib_open() accepted the entry: either we hold an fd for it,
+// or (with a dso_cache) the cached information about it:
+static int
+needed_is_found (const dso_needed_t *needed)
+{
+    return needed->fd >= 0 || needed->info != NULL;
+}
+
 static void clear_needed (dso_needed_t *needed)
 {
     elf_end( needed->dso );
     needed->dso = NULL;
 
+    // a cached library has no fd, only needed->info:
     if( needed->fd >= 0 )
         close( needed->fd );
     needed->fd = -1;
+    needed->info = NULL;
 
     free( needed->name );
     needed->name = NULL;
@@ -290,6 +308,167 @@ static void clear_needed (dso_needed_t *needed)
     memset( needed->requestors, 0, sizeof(int) * DSO_LIMIT );
 }
 
+// return the DT_NEEDED entries of dso, in the order they appear, as a
+// newly allocated NULL-terminated array of newly allocated strings:
+static char **
+dso_get_needed (Elf *dso)
+{
+    ptr_list *list = ptr_list_alloc( 16 );
+    Elf_Scn *scn = NULL;
+
+    while((scn = elf_nextscn( dso, scn )) != NULL)
+    {
+        GElf_Shdr shdr = {};
+        gelf_getshdr( scn, &shdr );
+
+        // SHT_DYNAMIC is the only section type we care about here:
+        if( shdr.sh_type == SHT_DYNAMIC )
+        {
+            int i = 0;
+            GElf_Dyn dyn = {};
+            Elf_Data *edata = NULL;
+
+            edata = elf_getdata( scn, edata );
+
+            // process each DT_* entry in the SHT_DYNAMIC section:
+            while( gelf_getdyn( edata, i++, &dyn ) &&
+                   (dyn.d_tag != DT_NULL)          )
+            {
+                const char *name;
+
+                // we're only gathering DT_NEEDED (dependency) entries here:
+                if( dyn.d_tag != DT_NEEDED )
+                    continue;
+
+                name = elf_strptr( dso, shdr.sh_link, dyn.d_un.d_val );
+
+                if( name != NULL )
+                    ptr_list_push_ptr( list, xstrdup( name ) );
+            }
+        }
+    }
+
+    return (char **) ptr_list_free_to_array( list, NULL );
+}
+
+// open and inspect the DSO at path, for ld_dso_cache_get():
+// return a new ld_dso_info, or NULL with the error set.
+// we close the DSO again afterwards: the cache can see hundreds of
+// candidates, most of them rejected, and nothing reads them later
+static ld_dso_info *
+ld_dso_info_new (const char *path, int *code, char **message)
+{
+    ld_dso_info *info;
+    GElf_Ehdr ehdr = {};
+    Elf *dso;
+    int fd;
+
+    fd = open( path, O_RDONLY );
+
+    if( fd < 0 )
+    {
+        int errsv = errno;
+
+        _capsule_set_error( code, message, errsv, "Cannot open \"%s\": %s",
+                            path, strerror( errsv ) );
+        return NULL;
+    }
+
+    dso = elf_begin( fd, ELF_C_READ_MMAP, NULL );
+
+    // bogus ELF DSO - no ehdr available?
+    if( !gelf_getehdr( dso, &ehdr ) )
+    {
+        // FIXME: elf_errno() isn't actually in the same domain as errno
+        _capsule_set_error( code, message, elf_errno(), "gelf_getehdr(%s): %s",
+                            path, elf_errmsg( elf_errno() ) );
+        elf_end( dso );
+        close( fd );
+        return NULL;
+    }
+
+    info = xcalloc( 1, sizeof(ld_dso_info) );
+    info->path        = xstrdup( path );
+    info->elf_class   = gelf_getclass( dso );
+    info->elf_machine = ehdr.e_machine;
+    info->is_ourself  = target_is_ourself( fd );
+    info->needed      = dso_get_needed( dso );
+
+    elf_end( dso );
+    close( fd );
+    return info;
+}
+
+// return the cached information about the DSO at path, inspecting it
+// and adding it to the cache if this is the first time we've seen it:
+// return NULL with the error set if it could not be inspected
+static const ld_dso_info *
+ld_dso_cache_get (ld_dso_cache *cache, const char *path,
+                  int *code, char **message)
+{
+    ld_dso_info *info;
+
+    for( size_t i = 0; i < cache->n_entries; i++ )
+    {
+        if( strcmp( cache->entries[i]->path, path ) == 0 )
+            return cache->entries[i];
+    }
+
+    info = ld_dso_info_new( path, code, message );
+
+    if( info == NULL )
+        return NULL;
+
+    cache->entries = xrealloc( cache->entries,
+                               (cache->n_entries + 1) * sizeof(ld_dso_info *) );
+    cache->entries[cache->n_entries++] = info;
+    return info;
+}
+
+// the equivalent of ld_lib_open() for an ld_libs with a dso_cache:
+// the ELF checks use what we found out the first time any ld_libs
+// opened the same path, and the needed entry is left without an fd
+static int
+ld_lib_open_cached (ld_libs *ldlibs, const char *name, int i,
+                    int *code, char **message)
+{
+    dso_needed_t *needed = &ldlibs->needed[i];
+    const ld_dso_info *info;
+
+    info = ld_dso_cache_get( ldlibs->dso_cache, needed->path, code, message );
+
+    if( info == NULL )
+    {
+        clear_needed( needed );
+        return 0;
+    }
+
+    LDLIB_DEBUG( ldlibs, DEBUG_SEARCH,
+                 "[%03d] %s (cached)", i, info->path );
+
+    if( !check_elf_class_and_machine( ldlibs, info->path,
+                                      info->elf_class, info->elf_machine,
+                                      code, message ) )
+    {
+        clear_needed( needed );
+        return 0;
+    }
+
+    if( info->is_ourself )
+    {
+        _capsule_set_error( code, message, EINVAL,
+                            "\"%s\" appears to be the libcapsule shim",
+                            info->path );
+        clear_needed( needed );
+        return 0;
+    }
+
+    needed->info = info;
+    needed->fd   = -1;
+    needed->name = xstrdup( name );
+    return 1;
+}
+
 // open the dso at offset i in the needed array, but only accept it
 // if it matches the class & architecture of the starting DSO:
 // return a true value only if we finish with a valid fd for the DSO
@@ -318,6 +497,9 @@ ld_lib_open (ld_libs *ldlibs, const char *name, int i, int *code, char **message
     LDLIB_DEBUG( ldlibs, DEBUG_SEARCH,
                  "ldlib_open: target +: %s", ldlibs->needed[i].path );
 
+    if( ldlibs->dso_cache != NULL )
+        return ld_lib_open_cached( ldlibs, name, i, code, message );
+
     ldlibs->needed[i].fd = open( ldlibs->needed[i].path, O_RDONLY );
 
     if( ldlibs->needed[i].fd >= 0 )
@@ -344,7 +526,7 @@ ld_lib_open (ld_libs *ldlibs, const char *name, int i, int *code, char **message
             return 0;
         }
 
-        acceptable = !target_is_ourself( ldlibs, i );
+        acceptable = !target_is_ourself( ldlibs->needed[i].fd );
 
         // either clean up the current entry so we can find a better DSO
         // or (for a valid candidate) copy the original requested name in:
@@ -372,7 +554,9 @@ ld_lib_open (ld_libs *ldlibs, const char *name, int i, int *code, char **message
     }
 }
 
-// search callback for search_ldcache. see search_ldcache and ld_cache_foreach:
+// search callback for search_ldcache. see search_ldcache and
+// ld_cache_foreach_name, which only calls this for entries whose name
+// is the one we are looking for.
 // returning a true value means we found (and set up) the DSO we wanted:
 static intptr_t
 search_ldcache_cb (const char *name, // name of the DSO in the ldcache
@@ -383,50 +567,35 @@ search_ldcache_cb (const char *name, // name of the DSO in the ldcache
                    void *data)
 {
     struct dso_cache_search *target = data;
-
-    // passed an empty query, just abort the whole search
-    if( !target->name || !(*target->name) )
-        return 1;
-
-    // what would this even mean? malformed cache entry?
-    // skip it and move on
-    if( !name || !*name )
+    const char *prefix = target->ldlibs->prefix.path;
+    int    idx    = target->idx;
+    char  *lpath  = target->ldlibs->needed[ idx ].path;
+
+    LDLIB_DEBUG( target->ldlibs, DEBUG_SEARCH|DEBUG_LDCACHE,
+                 "checking %s vs %s [%s]",
+                 target->name, name, path );
+    // copy in the prefix and append the DSO path to it
+    if( build_filename( lpath, PATH_MAX, prefix, path, NULL ) >= PATH_MAX )
+    {
         return 0;
+    }
 
-    if( strcmp( name, target->name ) == 0 )
+    // try to open the DSO. This will finish setting up the
+    // needed[idx] slot if successful, and reset it ready for
+    // another attempt if it fails.
+    // TODO: Can we propagate error information?
+    if( !ld_lib_open( target->ldlibs, name, idx, NULL, NULL ) )
     {
-        const char *prefix = target->ldlibs->prefix.path;
-        int    idx    = target->idx;
-        char  *lpath  = target->ldlibs->needed[ idx ].path;
-
-        LDLIB_DEBUG( target->ldlibs, DEBUG_SEARCH|DEBUG_LDCACHE,
-                     "checking %s vs %s [%s]",
-                     target->name, name, path );
-        // copy in the prefix and append the DSO path to it
-        if( build_filename( lpath, PATH_MAX, prefix, path, NULL ) >= PATH_MAX )
-        {
-            return 0;
-        }
-
-        // try to open the DSO. This will finish setting up the
-        // needed[idx] slot if successful, and reset it ready for
-        // another attempt if it fails.
-        // TODO: Can we propagate error information?
-        if( !ld_lib_open( target->ldlibs, name, idx, NULL, NULL ) )
-        {
-            // search_ldcache() relies on fd >= 0 iff we succeeded
-            assert( target->ldlibs->needed[idx].fd < 0 );
-            assert( target->ldlibs->needed[idx].name == NULL );
-            return 0;
-        }
-
-        // search_ldcache() relies on fd >= 0 iff we succeeded
-        assert( target->ldlibs->needed[idx].fd >= 0 );
-        assert( target->ldlibs->needed[idx].name != NULL );
-        return 1;
+        // search_ldcache() relies on needed_is_found() iff we succeeded
+        assert( !needed_is_found( &target->ldlibs->needed[idx] ) );
+        assert( target->ldlibs->needed[idx].name == NULL );
+        return 0;
     }
 
-    return 0;
+    // search_ldcache() relies on needed_is_found() iff we succeeded
+    assert( needed_is_found( &target->ldlibs->needed[idx] ) );
+    assert( target->ldlibs->needed[idx].name != NULL );
+    return 1;
 }
 
 // search the ld.so.cache loaded into ldlibs for one matching `name'
@@ -434,40 +603,53 @@ search_ldcache_cb (const char *name, // name of the DSO in the ldcache
 // attached (as the cache lookup is for unadorned library names):
 //
 // if a match is found, the needed array entry at i will be populated
-// and will contain a valid fd for the DSO. (and search_ldcache will
-// return true). Otherwise the entry will be empty and we will return false:
+// and will contain a valid fd for the DSO, or its cached information if
+// there is a dso_cache (and search_ldcache will return true).
+// Otherwise the entry will be empty and we will return false:
 //
 // this function will respect any path prefix specified in ldlibs
 static int
 search_ldcache (const char *name, ld_libs *ldlibs, int i)
 {
     struct dso_cache_search target;
+    ld_cache *cache;
+
+    // passed an empty query, nothing can match
+    if( !name || !*name )
+        return 0;
 
     target.idx    = i;
     target.name   = name;
     target.ldlibs = ldlibs;
 
-    if( !ldlibs->ldcache.is_open )
+    if( ldlibs->shared_ldcache != NULL )
+    {
+        cache = ldlibs->shared_ldcache;
+    }
+    else
     {
-        if( !ld_libs_load_cache( ldlibs, NULL, NULL ) )
+        if( !ldlibs->ldcache.is_open &&
+            !ld_libs_load_cache( ldlibs, NULL, NULL ) )
         {
             // TODO: report error?
             return 0;
         }
+
+        cache = &ldlibs->ldcache;
     }
 
-    ld_cache_foreach( &ldlibs->ldcache,
-                      search_ldcache_cb, &target );
+    ld_cache_foreach_name( cache, name, search_ldcache_cb, &target );
 
-    return ldlibs->needed[i].fd >= 0;
+    return needed_is_found( &ldlibs->needed[i] );
 }
 
 // search a : separated path (such as LD_LIBRARY_PATH from the environment)
 // for a DSO matching the bare `name' (eg libfoo.so.X)
 //
 // if a match is found, the needed array entry at i will be populated
-// and will contain a valid fd for the DSO. (and search_ldcache will
-// return true). Otherwise the entry will be empty and we will return false:
+// and will contain a valid fd for the DSO, or its cached information if
+// there is a dso_cache (and search_ldcache will return true).
+// Otherwise the entry will be empty and we will return false:
 //
 // this function will respect any path prefix specified in ldlibs
 static int
@@ -539,8 +721,9 @@ search_ldpath (const char *name, const char *ldpath, ld_libs *ldlibs, int i)
 // we will respect any path prefix specified in ldlibs
 //
 // if a match is found, the needed array entry at i will be populated
-// and will contain a valid fd for the DSO. (and search_ldcache will
-// return true). Otherwise the entry will be empty and we will return false:
+// and will contain a valid fd for the DSO, or its cached information if
+// there is a dso_cache (and search_ldcache will return true).
+// Otherwise the entry will be empty and we will return false:
 static int
 dso_find (const char *name, ld_libs *ldlibs, int i, int *code, char **message)
 {
@@ -669,8 +852,9 @@ already_needed (dso_needed_t *needed, int requesting_idx, const char *name)
 }
 
 // we're getting to the meat of it: process a DSO at offset idx in the
-// needed array, extract each SHT_DYNAMIC section, then make sure we
-// can find a DSO to satisfy every DT_NEEDED sub-entry in the section.
+// needed array, take each DT_NEEDED entry from its SHT_DYNAMIC section
+// (or from the dso_cache, if we already did that for the same DSO), then
+// make sure we can find a DSO to satisfy every one of them.
 // this function recurses into itself each time it finds a previously
 // unseen DT_NEEDED value (but not if the DT_NEEDED value is for a DSO
 // it has already found and recorded in the needed array)
@@ -682,7 +866,8 @@ static int
 _dso_iterate_sections (ld_libs *ldlibs, int idx, int *code, char **error)
 {
     int had_error = 0;
-    Elf_Scn *scn = NULL;
+    char **dt_needed = NULL;
+    const char * const *names;
 
     //debug(" ldlibs: %p; idx: %d (%s)", ldlibs, idx, ldlibs->needed[idx].name);
 
@@ -695,99 +880,84 @@ _dso_iterate_sections (ld_libs *ldlibs, int idx, int *code, char **error)
                  ldlibs->needed[idx].dso,
                  ldlibs->needed[idx].path );
 
-    while((scn = elf_nextscn( ldlibs->needed[idx].dso, scn )) != NULL)
+    if( ldlibs->needed[idx].info != NULL )
     {
-        GElf_Shdr shdr = {};
-        gelf_getshdr( scn, &shdr );
-
-        // SHT_DYNAMIC is the only section type we care about here:
-        if( shdr.sh_type == SHT_DYNAMIC )
-        {
-            int i = 0;
-            GElf_Dyn dyn = {};
-            Elf_Data *edata = NULL;
+        names = (const char * const *) ldlibs->needed[idx].info->needed;
+    }
+    else
+    {
+        dt_needed = dso_get_needed( ldlibs->needed[idx].dso );
+        names = (const char * const *) dt_needed;
+    }
 
-            edata = elf_getdata( scn, edata );
+    for( size_t n = 0; !had_error && names[n] != NULL; n++ )
+    {
+        int skip = 0;
+        int next = ldlibs->last_idx;
+        dso_needed_t *needed = ldlibs->needed;
+        const char *next_dso = names[n]; // the dependency we're going to need
+        char *local_error = NULL;
+
+        //////////////////////////////////////////////////
+        // ignore the linker itself
+        if( strstr( next_dso, "ld-" ) == next_dso )
+            continue;
 
-            // process eaach DT_* entry in the SHT_DYNAMIC section:
-            while( !had_error                      &&
-                   gelf_getdyn( edata, i++, &dyn ) &&
-                   (dyn.d_tag != DT_NULL)          )
+        // ignore any DSOs we've been specifically told to leave out:
+        for( char **x = (char **)ldlibs->exclude; x && *x; x++ )
+        {
+            if( strcmp( *x, next_dso ) == 0 )
             {
-                int skip = 0;
-                int next = ldlibs->last_idx;
-                dso_needed_t *needed = ldlibs->needed;
-                char *next_dso; // name of the dependency we're going to need
-                char *local_error = NULL;
-
-                // we're only gathering DT_NEEDED (dependency) entries here:
-                if( dyn.d_tag != DT_NEEDED )
-                    continue;
-
-                next_dso =
-                  elf_strptr( needed[idx].dso, shdr.sh_link, dyn.d_un.d_val );
-
-                //////////////////////////////////////////////////
-                // ignore the linker itself
-                if( strstr( next_dso, "ld-" ) == next_dso )
-                    continue;
-
-                // ignore any DSOs we've been specifically told to leave out:
-                for( char **x = (char **)ldlibs->exclude; x && *x; x++ )
-                {
-                    if( strcmp( *x, next_dso ) == 0 )
-                    {
-                        LDLIB_DEBUG( ldlibs, DEBUG_SEARCH|DEBUG_ELF,
-                                     "skipping %s / %s", next_dso, *x );
-                        skip = 1;
-                        break;
-                    }
-                }
+                LDLIB_DEBUG( ldlibs, DEBUG_SEARCH|DEBUG_ELF,
+                             "skipping %s / %s", next_dso, *x );
+                skip = 1;
+                break;
+            }
+        }
 
-                if( skip )
-                    continue;
+        if( skip )
+            continue;
 
-                //////////////////////////////////////////////////
-                // if we got this far, we have another dependency:
-                needed[idx].depcount++;
+        //////////////////////////////////////////////////
+        // if we got this far, we have another dependency:
+        needed[idx].depcount++;
 
-                // already on our list, no need to do anything else here:
-                if( already_needed( needed, idx, next_dso ) )
-                    continue;
+        // already on our list, no need to do anything else here:
+        if( already_needed( needed, idx, next_dso ) )
+            continue;
 
-                next++;
-                if( next >= DSO_LIMIT )
-                {
-                    had_error = 1;
-                    _capsule_set_error_literal( code, error, ELIBMAX,
-                                                "Too many dependencies" );
-                    break;
-                }
+        next++;
+        if( next >= DSO_LIMIT )
+        {
+            had_error = 1;
+            _capsule_set_error_literal( code, error, ELIBMAX,
+                                        "Too many dependencies" );
+            break;
+        }
 
-                if( !dso_find( next_dso, ldlibs, next, code, &local_error ) )
-                {
-                    had_error = 1;
-                    ldlibs->not_found[ ldlibs->last_not_found++ ] =
-                      _capsule_steal_pointer( &local_error );
-                    // Avoid "piling up" errors which would be a memory
-                    // leak
-                    if( error != NULL && *error == NULL )
-                        *error = xstrdup( "Missing dependencies:" );
-                }
-                else
-                {
-                    LDLIB_DEBUG( ldlibs, DEBUG_CAPSULE,
-                                 "needed[%d] (%s) is the first to need needed[%d] (%s)",
-                                 idx, needed[idx].name, next, next_dso );
-                    // record which DSO requested the new library we found:
-                    needed[next].requestors[idx] = 1;
-                    // now find the dependencies of our newest dependency:
-                    _dso_iterate_sections( ldlibs, next, code, error );
-                }
-            }
+        if( !dso_find( next_dso, ldlibs, next, code, &local_error ) )
+        {
+            had_error = 1;
+            ldlibs->not_found[ ldlibs->last_not_found++ ] =
+              _capsule_steal_pointer( &local_error );
+            // Avoid "piling up" errors which would be a memory
+            // leak
+            if( error != NULL && *error == NULL )
+                *error = xstrdup( "Missing dependencies:" );
+        }
+        else
+        {
+            LDLIB_DEBUG( ldlibs, DEBUG_CAPSULE,
+                         "needed[%d] (%s) is the first to need needed[%d] (%s)",
+                         idx, needed[idx].name, next, next_dso );
+            // record which DSO requested the new library we found:
+            needed[next].requestors[idx] = 1;
+            // now find the dependencies of our newest dependency:
+            _dso_iterate_sections( ldlibs, next, code, error );
         }
     }
 
+    free_strv_full( dt_needed );
     return !had_error;
 }
 
@@ -1055,6 +1225,9 @@ ld_libs_finish (ld_libs *ldlibs)
     ldlibs->last_not_found = 0;
 
     ld_cache_close( &ldlibs->ldcache );
+    // not ours to close
+    ldlibs->shared_ldcache = NULL;
+    ldlibs->dso_cache = NULL;
 
     ldlibs->last_idx = 0;
     ldlibs->elf_class = ELFCLASSNONE;
@@ -1131,27 +1304,45 @@ stat_caller (void)
 int
 ld_libs_load_cache (ld_libs *libs, int *code, char **message)
 {
-    char prefixed[PATH_MAX] = { '\0' };
-    size_t i;
+    return ld_cache_open_in_sysroot( &libs->ldcache, libs->prefix.path,
+                                     code, message );
+}
 
-    for( i = 0; ld_cache_filenames[i] != NULL; i++ )
-    {
-        if( message != NULL )
-            _capsule_clear( message );
+// Use an ld.so.cache that the caller has already opened (typically with
+// ld_cache_open_in_sysroot() for the same prefix), instead of mapping
+// a private copy: this lets several ld_libs share one cache and its
+// name index. The caller must keep it open until ld_libs_finish().
+void
+ld_libs_use_cache (ld_libs *ldlibs, ld_cache *cache)
+{
+    ld_cache_close( &ldlibs->ldcache );
+    ldlibs->shared_ldcache = cache;
+}
 
-        if( build_filename( prefixed, sizeof(prefixed), libs->prefix.path,
-                            ld_cache_filenames[i], NULL ) >= sizeof(prefixed) )
-        {
-            _capsule_set_error( code, message, ENAMETOOLONG,
-                                "Cannot append \"%s\" to prefix \"%s\": too long",
-                                ld_cache_filenames[i], libs->prefix.path );
-            continue;
-        }
+// Open and inspect each DSO only once per cache, instead of once per
+// ld_libs: the class, machine and DT_NEEDED entries of every DSO that
+// ldlibs looks at are remembered in cache, without keeping them open.
+// The caller must keep cache alive until ld_libs_finish(), and free it
+// with ld_dso_cache_clear() when no ld_libs is using it.
+void
+ld_libs_use_dso_cache (ld_libs *ldlibs, ld_dso_cache *cache)
+{
+    ldlibs->dso_cache = cache;
+}
+
+void
+ld_dso_cache_clear (ld_dso_cache *cache)
+{
+    for( size_t i = 0; i < cache->n_entries; i++ )
+    {
+        ld_dso_info *info = cache->entries[i];
 
-        if( ld_cache_open( &libs->ldcache, prefixed, code, message ) )
-            return 1;
+        free( info->path );
+        free_strv_full( info->needed );
+        free( info );
     }
 
-    // return the last error
-    return 0;
+    free( cache->entries );
+    cache->entries = NULL;
+    cache->n_entries = 0;
 }
@@ -32,9 +32,48 @@
 // an issue (shouldn't affect the api or abi):
 #define DSO_LIMIT 256
 
+/*
+ * ld_dso_info:
+ * @path: Absolute path to the library, including any prefix
+ * @elf_class: the ELF class of the library
+ * @elf_machine: the ELF machine type of the library
+ * @is_ourself: true if the library is the caller of ld_libs_init()
+ * @needed: (array zero-terminated=1): the library's DT_NEEDED entries,
+ *  in the order they appear
+ *
+ * Everything ld-libs needs to know about a library to check it and
+ * follow its dependencies, gathered once so that it can be shared
+ * by several ld_libs via an ld_dso_cache. The library is not kept
+ * open once it has been inspected.
+ */
+typedef struct
+{
+    char *path;
+    int elf_class;
+    Elf64_Half elf_machine;
+    int is_ourself;
+    char **needed;
+} ld_dso_info;
+
+/*
+ * ld_dso_cache:
+ * @entries: (array length=n_entries): libraries seen so far
+ * @n_entries: number of items in @entries
+ *
+ * A cache of ld_dso_info, keyed by their path, which can outlive any
+ * number of ld_libs (see ld_libs_use_dso_cache()). Initialize with
+ * `= {}` and free with ld_dso_cache_clear().
+ */
+typedef struct
+{
+    ld_dso_info **entries;
+    size_t n_entries;
+} ld_dso_cache;
+
 /*
  * dso_needed_t:
- * @fd: @path opened for reading (only valid after ld_lib_open())
+ * @fd: @path opened for reading (only valid after ld_lib_open(),
+ *  and only if @info is %NULL: always -1 for a cached library)
  * @name: The name we are looking for, either a bare SONAME or an
  *  absolute path (only valid after ld_lib_open())
  * @path: Absolute path to the library we need to load, including the
@@ -45,7 +84,10 @@
  *  such that `needed[j].depcount` is the number of nonzero
  *  `needed[i].requestors[j]` for each value of *i* where `needed[i]`
  *  has not yet been loaded
- * @dso: @fd opened for ELF inspection (only valid after ld_lib_open())
+ * @dso: @fd opened for ELF inspection (only valid after ld_lib_open(),
+ *  and only if @info is %NULL)
+ * @info: (nullable): cached information about @path,
+ *  or %NULL if @fd and @dso are owned by this struct
  *
  * A library that we need to load.
  */
@@ -57,12 +99,17 @@ typedef struct
     int   requestors[DSO_LIMIT];
     int   depcount;
     Elf  *dso;
+    const ld_dso_info *info;
 } dso_needed_t;
 
 /**
  * ld_libs:
  * @ldcache: the runtime linker cache, or all-zeroes
  *  if ld_libs_load_cache() has not yet been called
+ * @shared_ldcache: (nullable): a runtime linker cache owned by the caller
+ *  of ld_libs_use_cache(), used instead of @ldcache if not %NULL
+ * @dso_cache: (nullable): a cache of libraries owned by the caller of
+ *  ld_libs_use_dso_cache(), or %NULL to inspect each library afresh
  * @last_idx: private, used internally by the ld-libs code
  * @elf_class: the ELF class of the caller that initialized this
  * @elf_machine: the ELF machine type of the caller that initialized this
@@ -82,6 +129,8 @@ typedef struct
 typedef struct
 {
     ld_cache ldcache;
+    ld_cache *shared_ldcache;
+    ld_dso_cache *dso_cache;
     int last_idx;
     int elf_class;
     Elf64_Half elf_machine;
@@ -105,6 +154,10 @@ int   ld_libs_set_target        (ld_libs *ldlibs, const char *target,
 int   ld_libs_find_dependencies (ld_libs *ldlibs, int *code, char **message);
 void  ld_libs_finish            (ld_libs *ldlibs);
 int   ld_libs_load_cache        (ld_libs *libs, int *code, char **message);
+void  ld_libs_use_cache         (ld_libs *ldlibs, ld_cache *cache);
+void  ld_libs_use_dso_cache     (ld_libs *ldlibs, ld_dso_cache *cache);
+
+void  ld_dso_cache_clear        (ld_dso_cache *cache);
 
 void *ld_libs_load (ld_libs *ldlibs, Lmid_t *namespace, int flag, int *error,
                     char **message);
@@ -24,6 +24,7 @@
 #include <fnmatch.h>
 #include <search.h>
 #include <stdbool.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <string.h>
 #include <sys/stat.h>
@@ -50,22 +51,6 @@
 #define VERSYM_HIDDEN 0x8000
 #define VERSYM_VERSION 0x7fff
 
-static int
-bsearch_strcmp_cb( const void *n, const void *ip )
-{
-    const char *needle = n;
-    const char * const *item_p = ip;
-    return strcmp( needle, *item_p );
-}
-
-static int
-qsort_strcmp_cb( const void* s1, const void* s2 )
-{
-    const char * const *a = (const char* const*) s1;
-    const char* const *b = (const char* const*) s2;
-    return strcmp( *a, *b );
-}
-
 /*
  * string_set_diff_flags:
  * @STRING_SET_DIFF_ONLY_IN_FIRST: At least one element is in the first set but not the second
@@ -84,6 +69,101 @@ typedef enum
   STRING_SET_DIFF_NONE = 0
 } string_set_diff_flags;
 
+/*
+ * hashed_string:
+ * @hash: string_hash() of @string
+ * @string: A borrowed string
+ */
+typedef struct
+{
+    uint64_t hash;
+    const char *string;
+} hashed_string;
+
+// 64-bit FNV-1a: cheap, and good enough that collisions are rare
+// (we confirm every match with strcmp() anyway)
+static uint64_t
+string_hash( const char *str )
+{
+    uint64_t hash = UINT64_C(0xcbf29ce484222325);
+
+    for( const unsigned char *p = (const unsigned char *) str; *p != '\0'; p++ )
+    {
+        hash ^= *p;
+        hash *= UINT64_C(0x100000001b3);
+    }
+
+    return hash;
+}
+
+/*
+ * hash_string_set:
+ * @strings: (array length=n): Strings, in any order
+ * @n: Number of elements in @strings
+ *
+ * Returns: (transfer container): An array of @n hashed_string borrowing
+ *  @strings, sorted by hash with an LSD radix sort
+ */
+static hashed_string *
+hash_string_set( char **strings, size_t n )
+{
+    hashed_string *items = xcalloc( n + 1, sizeof( hashed_string ) );
+    hashed_string *scratch = xcalloc( n + 1, sizeof( hashed_string ) );
+
+    for( size_t i = 0; i < n; i++ )
+    {
+        items[i].hash = string_hash( strings[i] );
+        items[i].string = strings[i];
+    }
+
+    // One stable counting sort per byte, least significant first
+    for( unsigned int shift = 0; shift < 64; shift += 8 )
+    {
+        size_t counts[256] = { 0 };
+        size_t total = 0;
+        hashed_string *tmp;
+
+        for( size_t i = 0; i < n; i++ )
+            counts[( items[i].hash >> shift ) & 0xff]++;
+
+        // If every hash has the same byte here, this pass is a no-op
+        if( n == 0 || counts[( items[0].hash >> shift ) & 0xff] == n )
+            continue;
+
+        for( size_t b = 0; b < 256; b++ )
+        {
+            size_t c = counts[b];
+
+            counts[b] = total;
+            total += c;
+        }
+
+        for( size_t i = 0; i < n; i++ )
+            scratch[counts[( items[i].hash >> shift ) & 0xff]++] = items[i];
+
+        tmp = items;
+        items = scratch;
+        scratch = tmp;
+    }
+
+    free( scratch );
+    return items;
+}
+
+// Return true if @needle is one of the @n strings in @haystack
+static bool
+hashed_string_run_contains( const hashed_string *haystack, size_t n,
+                            const char *needle )
+{
+    for( size_t i = 0; i < n; i++ )
+    {
+        if( strcmp( haystack[i].string, needle ) == 0 )
+            return true;
+    }
+
+    return false;
+}
+
 /*
  * compare_string_sets:
  * @first: the first set to compare
@@ -91,51 +171,94 @@ typedef enum
  * @second: the second set to compare
  * @second_length: number of elements in the second set
  *
- * The two sets needs to be ordered because we will use a binary search to do
- * the comparison.
+ * The sets can be in any order. We hash every element, sort the hashes
+ * and merge the two sorted arrays, only comparing the strings themselves
+ * when their hashes are equal.
  */
 static string_set_diff_flags
 compare_string_sets ( char **first, size_t first_length,
                       char **second, size_t second_length )
 {
     string_set_diff_flags result = STRING_SET_DIFF_NONE;
+    const string_set_diff_flags both = ( STRING_SET_DIFF_ONLY_IN_FIRST |
+                                         STRING_SET_DIFF_ONLY_IN_SECOND );
+    hashed_string *a;
+    hashed_string *b;
+    size_t i = 0;
+    size_t j = 0;
 
     assert( first != NULL );
     assert( second != NULL );
 
+    // A set with more elements can't be a subset of the other one
     if( first_length > second_length )
-    {
         result |= STRING_SET_DIFF_ONLY_IN_FIRST;
-    }
-    else
-    {
-        for( size_t i = 0; i < first_length; i++ )
-        {
-            char *found = bsearch( first[i], second, second_length, sizeof(char *), bsearch_strcmp_cb );
-            if( found == NULL )
-            {
-                result |= STRING_SET_DIFF_ONLY_IN_FIRST;
-                break;
-            }
-        }
-    }
 
     if( first_length < second_length )
-    {
         result |= STRING_SET_DIFF_ONLY_IN_SECOND;
-    }
-    else
+
+    if( result == both )
+        return result;
+
+    a = hash_string_set( first, first_length );
+    b = hash_string_set( second, second_length );
+
+    while( i < first_length && j < second_length && result != both )
     {
-        for( size_t i = 0; i < second_length; i++ )
+        if( a[i].hash < b[j].hash )
+        {
+            result |= STRING_SET_DIFF_ONLY_IN_FIRST;
+            i++;
+        }
+        else if( a[i].hash > b[j].hash )
         {
-            char *found = bsearch( second[i], first, first_length, sizeof(char *), bsearch_strcmp_cb );
-            if( found == NULL )
+            result |= STRING_SET_DIFF_ONLY_IN_SECOND;
+            j++;
+        }
+        else
+        {
+            // Equal hashes: almost certainly equal strings, but check,
+            // allowing for more than one string with this hash
+            size_t i_end = i + 1;
+            size_t j_end = j + 1;
+
+            while( i_end < first_length && a[i_end].hash == a[i].hash )
+                i_end++;
+
+            while( j_end < second_length && b[j_end].hash == b[j].hash )
+                j_end++;
+
+            for( size_t k = i; k < i_end; k++ )
             {
-                result |= STRING_SET_DIFF_ONLY_IN_SECOND;
-                break;
+                if( !hashed_string_run_contains( b + j, j_end - j, a[k].string ) )
+                {
+                    result |= STRING_SET_DIFF_ONLY_IN_FIRST;
+                    break;
+                }
+            }
+
+            for( size_t k = j; k < j_end; k++ )
+            {
+                if( !hashed_string_run_contains( a + i, i_end - i, b[k].string ) )
+                {
+                    result |= STRING_SET_DIFF_ONLY_IN_SECOND;
+                    break;
+                }
             }
+
+            i = i_end;
+            j = j_end;
         }
     }
+
+    if( i < first_length )
+        result |= STRING_SET_DIFF_ONLY_IN_FIRST;
+
+    if( j < second_length )
+        result |= STRING_SET_DIFF_ONLY_IN_SECOND;
+
+    free( a );
+    free( b );
     return result;
 }
 
@@ -517,7 +640,7 @@ out:
  *  on failure
  *
  * Returns: (transfer full): The list of versions that the
- *  shared object has, on failure %NULL.
+ *  shared object has, in no particular order, on failure %NULL.
  */
 static char **
 get_versions( Elf *elf, size_t *versions_number, int *code, char **message )
@@ -663,7 +786,6 @@ get_versions( Elf *elf, size_t *versions_number, int *code, char **message )
     }
 
     versions = (char **) ptr_list_free_to_array ( versions_list, versions_number );
-    qsort( versions, *versions_number, sizeof(char *), qsort_strcmp_cb );
     return versions;
 }
 
@@ -714,7 +836,7 @@ static const char * const ignore_symbols[] =
  *  on failure
  *
  * Returns: (transfer full): The list of symbols that the
- *  shared object has, on failure %NULL.
+ *  shared object has, in no particular order, on failure %NULL.
  */
 static char **
 get_symbols ( Elf *elf, size_t *symbols_number, int *code, char **message )
@@ -741,6 +863,8 @@ get_symbols ( Elf *elf, size_t *symbols_number, int *code, char **message )
     size_t phnum;
     size_t sh_entsize;
     ptr_list *symbols_list = NULL;
+    const char **version_names = NULL;
+    size_t n_version_names = 0;
 
     assert( symbols_number != NULL );
 
@@ -879,6 +1003,52 @@ get_symbols ( Elf *elf, size_t *symbols_number, int *code, char **message )
         return symbols;
     }
 
+    /* Map each version index to its name once, instead of walking the
+     * version definitions again for every symbol */
+    if( found_versym && found_verdef )
+    {
+        GElf_Verdef def_mem;
+        GElf_Verdef *def = gelf_getverdef( verdef_data, 0, &def_mem );
+        size_t offset = 0;
+
+        while( def != NULL )
+        {
+            GElf_Verdaux aux_mem;
+            GElf_Verdaux *aux;
+            size_t ndx = def->vd_ndx & VERSYM_VERSION;
+
+            /* The first Verdaux array must exist and it points to the version
+             * definition string that Verdef defines. Every possible additional
+             * Verdaux arrays are the dependencies of said version definition.
+             * In our case we don't need to list the dependencies, so we just
+             * get the first Verdaux of every Verdef. */
+            aux = gelf_getverdaux( verdef_data, offset + def->vd_aux, &aux_mem );
+
+            if( aux != NULL )
+            {
+                if( ndx >= n_version_names )
+                {
+                    version_names = xrealloc( version_names,
+                                              ( ndx + 1 ) * sizeof( char * ) );
+                    memset( version_names + n_version_names, 0,
+                            ( ndx + 1 - n_version_names ) * sizeof( char * ) );
+                    n_version_names = ndx + 1;
+                }
+
+                /* If an index is defined twice, the first one wins */
+                if( version_names[ndx] == NULL )
+                    version_names[ndx] = elf_strptr( elf, shdr->sh_link,
+                                                     aux->vda_name );
+            }
+
+            if( def->vd_next == 0 )
+                break;
+
+            offset += def->vd_next;
+            def = gelf_getverdef( verdef_data, offset, &def_mem );
+        }
+    }
+
     /* Arbitrarily start the list with 8 elements */
     symbols_list = ptr_list_alloc( 8 );
 
@@ -889,10 +1059,7 @@ get_symbols ( Elf *elf, size_t *symbols_number, int *code, char **message )
         const char *symbol;
         GElf_Versym versym_mem;
         GElf_Versym *versym;
-        GElf_Verdaux aux_mem;
-        GElf_Verdaux *aux = NULL;
-        GElf_Verdef def_mem;
-        GElf_Verdef *def = NULL;
+        const char *version = NULL;
         bool interesting = true;
 
         sym = gelf_getsymshndx( sym_data, NULL, index, &sym_mem, NULL );
@@ -921,42 +1088,18 @@ get_symbols ( Elf *elf, size_t *symbols_number, int *code, char **message )
         }
 
         /* Search the version of the symbol */
-        if( found_versym && found_verdef )
+        if( found_versym )
         {
             versym = gelf_getversym( versym_data, index, &versym_mem );
-            def = gelf_getverdef( verdef_data, 0, &def_mem );
-
-            size_t auxoffset;
-            size_t offset = 0;
-            while( def != NULL )
-            {
-                auxoffset = offset + def->vd_aux;
-                offset += def->vd_next;
-
-                /* The first Verdaux array must exist and it points to the version
-                * definition string that Verdef defines. Every possible additional
-                * Verdaux arrays are the dependencies of said version definition.
-                * In our case we don't need to list the dependencies, so we just
-                * get the first Verdaux of every Verdef. */
-                aux = gelf_getverdaux( verdef_data, auxoffset, &aux_mem );
-                if( aux == NULL )
-                    continue;
-
-                /* Break if we have found the symbol's version */
-                if( def->vd_ndx == ( *versym & VERSYM_VERSION ) )
-                    break;
 
-                if( def->vd_next == 0 )
-                    def = NULL;
-                else
-                    def = gelf_getverdef( verdef_data, offset, &def_mem );
-            }
+            if( versym != NULL
+                && ( *versym & VERSYM_VERSION ) < n_version_names )
+                version = version_names[*versym & VERSYM_VERSION];
         }
 
         /* If the symbol is versioned */
-        if( def != NULL && aux != NULL )
+        if( version != NULL )
         {
-            const char *version = elf_strptr( elf, shdr->sh_link, aux->vda_name );
             char *symbol_versioned;
             xasprintf( &symbol_versioned, "%s@%s", symbol, version );
             ptr_list_push_ptr( symbols_list, symbol_versioned );
@@ -967,8 +1110,8 @@ get_symbols ( Elf *elf, size_t *symbols_number, int *code, char **message )
         }
     }
 
+    free( version_names );
     symbols = (char **) ptr_list_free_to_array ( symbols_list, symbols_number );
-    qsort( symbols, *symbols_number, sizeof(char *), qsort_strcmp_cb );
     return symbols;
 }
 
@@ -1617,3 +1760,442 @@ library_cmp_list_iterate( const library_details *details,
 
     return 0;
 }
+
+// First line of a library_cmp_cache file: change the format number
+// if the key or the meaning of a decision changes, so that older
+// caches are discarded instead of being misinterpreted.
+#define LIBRARY_CMP_CACHE_HEADER "# libcapsule library comparison cache, format 1"
+
+// Limit on how many decisions we keep, so that the cache doesn't grow
+// forever as libraries are upgraded: the least recently used are dropped.
+#define LIBRARY_CMP_CACHE_MAX_ENTRIES 4096
+
+/*
+ * library_cmp_cache_entry:
+ * @key: Identities of the files and how they were compared, as
+ *  produced by library_cmp_cache_key()
+ * @decision: The result of library_cmp_list_iterate()
+ * @used: true if @key was looked up or added in this process
+ */
+typedef struct
+{
+    char *key;
+    int decision;
+    bool used;
+} library_cmp_cache_entry;
+
+static int
+library_cmp_cache_entry_cmp( const void *pa, const void *pb )
+{
+    const library_cmp_cache_entry *a = pa;
+    const library_cmp_cache_entry *b = pb;
+
+    return strcmp( a->key, b->key );
+}
+
+static void
+library_cmp_cache_entry_free( library_cmp_cache_entry *self )
+{
+    free( self->key );
+    free( self );
+}
+
+// Add @entry to @self, taking ownership. Return false if an entry
+// with the same key was already present, in which case @entry is freed.
+static bool
+library_cmp_cache_add( library_cmp_cache *self,
+                       library_cmp_cache_entry *entry )
+{
+    library_cmp_cache_entry **node;
+
+    node = tsearch( entry, &self->tree, library_cmp_cache_entry_cmp );
+
+    if( node == NULL )
+        oom();
+
+    if( *node != entry )
+    {
+        library_cmp_cache_entry_free( entry );
+        return false;
+    }
+
+    if( self->entries == NULL )
+        self->entries = ptr_list_alloc( 64 );
+
+    ptr_list_push_ptr( self->entries, entry );
+    return true;
+}
+
+// Append a description of @path to @stream that will change if the file
+// is replaced or modified, or if it would compare differently by name.
+// Return false if it cannot be described.
+static bool
+library_cmp_cache_describe_file( FILE *stream, const char *path )
+{
+    _capsule_autofree char *real = realpath( path, NULL );
+    struct stat stat_buf;
+
+    if( real == NULL || stat( real, &stat_buf ) < 0 )
+        return false;
+
+    if( strpbrk( real, "\t\n" ) != NULL )
+        return false;
+
+    fprintf( stream, "%ju:%ju:%jd:%jd.%09ld:%s",
+             (uintmax_t) stat_buf.st_dev,
+             (uintmax_t) stat_buf.st_ino,
+             (intmax_t) stat_buf.st_size,
+             (intmax_t) stat_buf.st_mtim.tv_sec,
+             (long) stat_buf.st_mtim.tv_nsec,
+             _capsule_basename( real ) );
+    return true;
+}
+
+// Append @patterns to @stream, or return false if they cannot be
+// represented unambiguously.
+static bool
+library_cmp_cache_describe_patterns( FILE *stream, char **patterns )
+{
+    for( size_t i = 0; patterns != NULL && patterns[i] != NULL; i++ )
+    {
+        if( strpbrk( patterns[i], "\t\n;" ) != NULL )
+            return false;
+
+        fprintf( stream, "%s;", patterns[i] );
+    }
+
+    return true;
+}
+
+/*
+ * library_cmp_cache_key:
+ * @details: The library we are interested in and how to compare it
+ * @container_path: The path to the library in the container
+ * @provider_path: The path to the library in the provider
+ *
+ * Returns: (transfer full) (nullable): A string that changes if either
+ *  library or the way they are compared changes, or %NULL if the
+ *  decision cannot be cached
+ */
+static char *
+library_cmp_cache_key( const library_details *details,
+                       const char *container_path,
+                       const char *provider_path )
+{
+    const library_cmp_function *iter;
+    char *buf = NULL;
+    size_t len = 0;
+    bool ok = false;
+    FILE *stream;
+
+    if( strpbrk( details->name, "\t\n" ) != NULL )
+        return NULL;
+
+    stream = open_memstream( &buf, &len );
+
+    if( stream == NULL )
+        oom();
+
+    fprintf( stream, "%s\t", details->name );
+
+    if( !library_cmp_cache_describe_file( stream, container_path ) )
+        goto out;
+
+    fputc( '\t', stream );
+
+    if( !library_cmp_cache_describe_file( stream, provider_path ) )
+        goto out;
+
+    fputc( '\t', stream );
+
+    for( iter = details->comparators; iter != NULL && *iter != NULL; iter++ )
+    {
+        const char *name = NULL;
+
+        for( size_t i = 0; i < N_ELEMENTS( named_comparators ); i++ )
+        {
+            if( *iter == named_comparators[i].comparator )
+            {
+                name = named_comparators[i].name;
+                break;
+            }
+        }
+
+        // a comparator we can't name might do anything
+        if( name == NULL )
+            goto out;
+
+        fprintf( stream, "%s;", name );
+    }
+
+    fputc( '\t', stream );
+
+    if( !library_cmp_cache_describe_patterns( stream, details->public_symbol_versions ) )
+        goto out;
+
+    fputc( '\t', stream );
+
+    if( !library_cmp_cache_describe_patterns( stream, details->public_symbols ) )
+        goto out;
+
+    ok = true;
+
+out:
+    if( fclose( stream ) != 0 )
+        oom();
+
+    if( !ok )
+        _capsule_clear( &buf );
+
+    return buf;
+}
+
+/*
+ * library_cmp_cache_load_from_stream:
+ * @self: The cache
+ * @stream: A stream
+ * @name: The filename of @stream or a placeholder, for diagnostic messages
+ * @code: (out) (optional): Set to an `errno` value on failure
+ * @message: (out) (optional): Set to an error message on failure
+ *
+ * Load decisions previously saved by library_cmp_cache_save_to_stream().
+ * A cache in an unknown format, or lines that cannot be parsed, are
+ * ignored: the worst that can happen is that we make those decisions
+ * again.
+ *
+ * Returns: true on success, false if @stream could not be read
+ */
+bool
+library_cmp_cache_load_from_stream( library_cmp_cache *self,
+                                    FILE *stream, const char *name,
+                                    int *code, char **message )
+{
+    int line_number = 0;
+    char *line = NULL;
+    size_t buf_len = 0;
+    ssize_t len;
+    bool ok = false;
+
+    while( ( len = getline( &line, &buf_len, stream ) ) >= 0 )
+    {
+        library_cmp_cache_entry *entry;
+        char *tab;
+        char *end;
+        long decision;
+
+        line_number++;
+
+        if( len > 0 && line[len - 1] == '\n' )
+            line[--len] = '\0';
+
+        if( line_number == 1 )
+        {
+            if( strcmp( line, LIBRARY_CMP_CACHE_HEADER ) != 0 )
+            {
+                DEBUG( DEBUG_TOOL, "%s: Ignoring cache in unknown format", name );
+                break;
+            }
+
+            continue;
+        }
+
+        tab = strchr( line, '\t' );
+
+        if( tab == NULL )
+        {
+            DEBUG( DEBUG_TOOL, "%s:%d: Ignoring malformed line", name, line_number );
+            continue;
+        }
+
+        *tab = '\0';
+        errno = 0;
+        decision = strtol( line, &end, 10 );
+
+        if( errno != 0 || end == line || *end != '\0'
+            || decision < -1 || decision > 1 )
+        {
+            DEBUG( DEBUG_TOOL, "%s:%d: Ignoring malformed line", name, line_number );
+            continue;
+        }
+
+        entry = xcalloc( 1, sizeof( library_cmp_cache_entry ) );
+        entry->key = xstrdup( tab + 1 );
+        entry->decision = (int) decision;
+        entry->used = false;
+        library_cmp_cache_add( self, entry );
+    }
+
+    if( ferror( stream ) )
+    {
+        int saved_errno = errno;
+
+        _capsule_set_error( code, message, saved_errno,
+                            "Unable to read \"%s\": %s",
+                            name, strerror( saved_errno ) );
+        goto out;
+    }
+
+    DEBUG( DEBUG_TOOL, "Loaded %zu cached library comparisons from \"%s\"",
+           self->entries != NULL ? self->entries->next : 0, name );
+    ok = true;
+
+out:
+    free( line );
+    return ok;
+}
+
+/*
+ * library_cmp_cache_save_to_stream:
+ * @self: The cache
+ * @stream: A stream
+ * @name: The filename of @stream or a placeholder, for diagnostic messages
+ * @code: (out) (optional): Set to an `errno` value on failure
+ * @message: (out) (optional): Set to an error message on failure
+ *
+ * Save the decisions in @self, most recently used first, discarding
+ * the least recently used if there are too many.
+ *
+ * Returns: true on success
+ */
+bool
+library_cmp_cache_save_to_stream( const library_cmp_cache *self,
+                                  FILE *stream, const char *name,
+                                  int *code, char **message )
+{
+    size_t n_entries = self->entries != NULL ? self->entries->next : 0;
+    size_t written = 0;
+
+    fprintf( stream, "%s\n", LIBRARY_CMP_CACHE_HEADER );
+
+    // Two passes: first the entries we used this time, then the rest
+    for( int pass = 0; pass < 2; pass++ )
+    {
+        for( size_t i = 0;
+             i < n_entries && written < LIBRARY_CMP_CACHE_MAX_ENTRIES;
+             i++ )
+        {
+            const library_cmp_cache_entry *entry = ptr_list_nth_ptr( self->entries, i );
+
+            if( entry->used != ( pass == 0 ) )
+                continue;
+
+            fprintf( stream, "%d\t%s\n", entry->decision, entry->key );
+            written++;
+        }
+    }
+
+    if( fflush( stream ) != 0 || ferror( stream ) )
+    {
+        int saved_errno = errno;
+
+        _capsule_set_error( code, message, saved_errno,
+                            "Unable to write \"%s\": %s",
+                            name, strerror( saved_errno ) );
+        return false;
+    }
+
+    return true;
+}
+
+/*
+ * library_cmp_cache_has_changes:
+ * @self: The cache
+ *
+ * Returns: true if decisions have been added since @self was loaded
+ */
+bool
+library_cmp_cache_has_changes( const library_cmp_cache *self )
+{
+    return self->n_added > 0;
+}
+
+static void
+no_op_free( void *p )
+{
+}
+
+void
+library_cmp_cache_clear( library_cmp_cache *self )
+{
+    // The entries are owned by the list, not the tree
+    if( self->tree != NULL )
+        tdestroy( self->tree, no_op_free );
+
+    if( self->entries != NULL )
+    {
+        for( size_t i = 0; i < self->entries->next; i++ )
+            library_cmp_cache_entry_free( ptr_list_nth_ptr( self->entries, i ) );
+
+        ptr_list_free( self->entries );
+    }
+
+    self->tree = NULL;
+    self->entries = NULL;
+    self->n_added = 0;
+}
+
+/*
+ * library_cmp_list_iterate_cached:
+ * @cache: (nullable): Decisions made previously
+ * @details: The library we are interersted in and how to compare it
+ * @container_path: The path to the library in the container
+ * @container_root: The path to the top-level directory of the container
+ * @provider_path: The path to the library in the provider
+ * @provider_root: The path to the top-level directory of the provider
+ *
+ * The same as library_cmp_list_iterate(), but if @cache already has
+ * a decision for the same two files compared in the same way, return
+ * that instead of inspecting them again; otherwise add the new
+ * decision to @cache.
+ *
+ * Returns: Negative if the container version appears newer, zero if they
+ *  appear the same or we cannot tell, or positive if the provider version
+ *  appears newer.
+ */
+int
+library_cmp_list_iterate_cached( library_cmp_cache *cache,
+                                 const library_details *details,
+                                 const char *container_path,
+                                 const char *container_root,
+                                 const char *provider_path,
+                                 const char *provider_root )
+{
+    library_cmp_cache_entry *entry;
+    library_cmp_cache_entry **node;
+    library_cmp_cache_entry key = {};
+
+    assert( details != NULL );
+
+    if( cache != NULL )
+        key.key = library_cmp_cache_key( details, container_path, provider_path );
+
+    if( key.key == NULL )
+        return library_cmp_list_iterate( details,
+                                         container_path, container_root,
+                                         provider_path, provider_root );
+
+    node = tfind( &key, &cache->tree, library_cmp_cache_entry_cmp );
+
+    if( node != NULL )
+    {
+        DEBUG( DEBUG_TOOL, "Using cached comparison of %s: %d",
+               details->name, (*node)->decision );
+        (*node)->used = true;
+        free( key.key );
+        return (*node)->decision;
+    }
+
+    entry = xcalloc( 1, sizeof( library_cmp_cache_entry ) );
+    entry->key = _capsule_steal_pointer( &key.key );
+    entry->decision = library_cmp_list_iterate( details,
+                                                container_path, container_root,
+                                                provider_path, provider_root );
+    // normalize to what we can load again
+    entry->decision = ( entry->decision > 0 ) - ( entry->decision < 0 );
+    entry->used = true;
+
+    if( library_cmp_cache_add( cache, entry ) )
+        cache->n_added++;
+
+    return entry->decision;
+}
@@ -94,3 +94,39 @@ bool library_knowledge_load_from_stream( library_knowledge *self,
 const library_details *library_knowledge_lookup( const library_knowledge *self,
                                                  const char *library );
 void library_knowledge_clear( library_knowledge *self );
+
+/*
+ * library_cmp_cache:
+ * @tree: (element-type library_cmp_cache_entry): A tsearch(3) tree
+ * @entries: (element-type library_cmp_cache_entry): The same entries
+ *  as @tree, in the order they were loaded or added
+ * @n_added: Number of entries added since the cache was loaded
+ *
+ * Decisions previously made by library_cmp_list_iterate(), for pairs
+ * of files that have not changed since, so that they can be reused
+ * by later runs.
+ */
+typedef struct
+{
+    /*< private >*/
+    void *tree;
+    struct ptr_list *entries;
+    size_t n_added;
+} library_cmp_cache;
+
+#define LIBRARY_CMP_CACHE_INIT { NULL, NULL, 0 }
+
+bool library_cmp_cache_load_from_stream( library_cmp_cache *self,
+                                         FILE *stream, const char *name,
+                                         int *code, char **message );
+bool library_cmp_cache_save_to_stream( const library_cmp_cache *self,
+                                       FILE *stream, const char *name,
+                                       int *code, char **message );
+bool library_cmp_cache_has_changes( const library_cmp_cache *self );
+void library_cmp_cache_clear( library_cmp_cache *self );
+int library_cmp_list_iterate_cached( library_cmp_cache *cache,
+                                     const library_details *details,
+                                     const char *container_path,
+                                     const char *container_root,
+                                     const char *provider_path,
+                                     const char *provider_root );
@@ -2787,6 +2787,155 @@ test_check_graphics (Fixture *f,
     }
 }
 
+/*
+ * Results from the combined check-graphics helper are interpreted in
+ * the same way as the output of the individual helpers.
+ */
+static void
+test_check_graphics_probe (Fixture *f,
+                           gconstpointer context)
+{
+  g_autoptr(JsonBuilder) builder = json_builder_new ();
+  g_autoptr(JsonNode) root = NULL;
+  g_autoptr(GHashTable) results = NULL;
+  g_autoptr(SrtGraphics) graphics = NULL;
+  g_autoptr(GError) error = NULL;
+  g_auto(GStrv) envp = g_get_environ ();
+  g_autofree gchar *json = NULL;
+  const SrtGraphicsProbeResult *result;
+  SrtGraphicsIssues issues;
+
+  json_builder_begin_object (builder);
+  json_builder_set_member_name (builder, "vdpau");
+  json_builder_begin_object (builder);
+  json_builder_set_member_name (builder, "wait-status");
+  json_builder_add_int_value (builder, 0);
+  json_builder_set_member_name (builder, "stdout");
+  json_builder_add_string_value (builder, SRT_TEST_GOOD_VDPAU_RENDERER);
+  json_builder_set_member_name (builder, "stderr");
+  json_builder_add_string_value (builder, "info: only shown on failure\n");
+  json_builder_end_object (builder);
+  json_builder_set_member_name (builder, "vaapi");
+  json_builder_begin_object (builder);
+  json_builder_set_member_name (builder, "wait-status");
+  json_builder_add_int_value (builder, 1 << 8);
+  json_builder_set_member_name (builder, "stdout");
+  json_builder_add_string_value (builder, "");
+  json_builder_set_member_name (builder, "stderr");
+  json_builder_add_string_value (builder, SRT_TEST_BAD_VAAPI_MESSAGES);
+  json_builder_end_object (builder);
+  json_builder_set_member_name (builder, "something-else");
+  json_builder_begin_object (builder);
+  json_builder_end_object (builder);
+  json_builder_end_object (builder);
+  root = json_builder_get_root (builder);
+  json = json_to_string (root, FALSE);
+
+  results = _srt_graphics_probe_results_new_from_json (json, &error);
+  g_assert_no_error (error);
+  g_assert_nonnull (results);
+  g_assert_cmpuint (g_hash_table_size (results), ==, 2);
+
+  result = g_hash_table_lookup (results,
+                                GINT_TO_POINTER (SRT_RENDERING_INTERFACE_VDPAU));
+  g_assert_nonnull (result);
+  issues = _srt_check_graphics (envp, f->builddir, SRT_TEST_FLAGS_NONE,
+                                "mock-good", SRT_WINDOW_SYSTEM_X11,
+                                SRT_RENDERING_INTERFACE_VDPAU, result,
+                                &graphics);
+  g_assert_cmpint (issues, ==, SRT_GRAPHICS_ISSUES_NONE);
+  g_assert_cmpstr (srt_graphics_get_renderer_string (graphics), ==,
+                   SRT_TEST_GOOD_VDPAU_RENDERER);
+  g_assert_cmpstr (srt_graphics_get_messages (graphics), ==, NULL);
+  g_assert_cmpint (srt_graphics_get_exit_status (graphics), ==, 0);
+  g_clear_object (&graphics);
+
+  result = g_hash_table_lookup (results,
+                                GINT_TO_POINTER (SRT_RENDERING_INTERFACE_VAAPI));
+  g_assert_nonnull (result);
+  issues = _srt_check_graphics (envp, f->builddir, SRT_TEST_FLAGS_NONE,
+                                "mock-bad", SRT_WINDOW_SYSTEM_X11,
+                                SRT_RENDERING_INTERFACE_VAAPI, result,
+                                &graphics);
+  g_assert_cmpint (issues, ==, SRT_GRAPHICS_ISSUES_CANNOT_DRAW);
+  g_assert_cmpstr (srt_graphics_get_messages (graphics), ==,
+                   SRT_TEST_BAD_VAAPI_MESSAGES);
+  g_assert_cmpint (srt_graphics_get_exit_status (graphics), ==, 1);
+  g_clear_object (&graphics);
+  g_clear_pointer (&results, g_hash_table_unref);
+
+  results = _srt_graphics_probe_results_new_from_json ("[]", &error);
+  g_assert_error (error, G_IO_ERROR, G_IO_ERROR_FAILED);
+  g_assert_null (results);
+  g_clear_error (&error);
+
+  results = _srt_graphics_probe_results_new_from_json ("{\"vulkan\": {}}", &error);
+  g_assert_error (error, G_IO_ERROR, G_IO_ERROR_FAILED);
+  g_assert_null (results);
+  g_clear_error (&error);
+}
+
+/*
+ * The helper is run once per check, always with LIBGL_DEBUG=verbose,
+ * and its verbose diagnostics are only reported if it failed.
+ */
+static void
+test_check_graphics_verbose (Fixture *f,
+                             gconstpointer context)
+{
+  g_autoptr(GError) error = NULL;
+  g_autofree gchar *tmpdir = NULL;
+  g_autofree gchar *log_path = NULL;
+  g_autofree gchar *log = NULL;
+  g_auto(GStrv) envp = g_get_environ ();
+  g_autoptr(SrtGraphics) graphics = NULL;
+  SrtGraphicsIssues issues;
+
+  tmpdir = g_dir_make_tmp ("graphics-test-XXXXXX", &error);
+  g_assert_no_error (error);
+  log_path = g_build_filename (tmpdir, "log", NULL);
+  envp = g_environ_setenv (envp, "SRT_TEST_FLAKY_LOG", log_path, TRUE);
+
+  /* On the first run, the helper fails, and the verbose diagnostics
+   * from that same run are reported */
+  issues = _srt_check_graphics (envp, f->builddir, SRT_TEST_FLAGS_NONE,
+                                "mock-flaky", SRT_WINDOW_SYSTEM_EGL_X11,
+                                SRT_RENDERING_INTERFACE_GLESV2, NULL,
+                                &graphics);
+  g_assert_cmpint (issues, ==, SRT_GRAPHICS_ISSUES_CANNOT_LOAD);
+  g_assert_cmpstr (srt_graphics_get_messages (graphics), ==,
+                   "info: you used LIBGL_DEBUG=verbose\n"
+                   "Waffle error: 0x2 WAFFLE_ERROR_UNKNOWN: XOpenDisplay failed\n");
+  g_assert_cmpint (srt_graphics_get_exit_status (graphics), ==, 1);
+  g_clear_object (&graphics);
+
+  g_file_get_contents (log_path, &log, NULL, &error);
+  g_assert_no_error (error);
+  g_assert_cmpstr (log, ==, "LIBGL_DEBUG=verbose\n");
+  g_clear_pointer (&log, g_free);
+
+  /* On a later run, the helper succeeds, and its verbose diagnostics
+   * are discarded */
+  issues = _srt_check_graphics (envp, f->builddir, SRT_TEST_FLAGS_NONE,
+                                "mock-flaky", SRT_WINDOW_SYSTEM_EGL_X11,
+                                SRT_RENDERING_INTERFACE_GLESV2, NULL,
+                                &graphics);
+  g_assert_cmpint (issues, ==, SRT_GRAPHICS_ISSUES_NONE);
+  g_assert_cmpstr (srt_graphics_get_renderer_string (graphics), ==,
+                   SRT_TEST_GOOD_GRAPHICS_RENDERER);
+  g_assert_cmpstr (srt_graphics_get_messages (graphics), ==, NULL);
+  g_assert_cmpint (srt_graphics_get_exit_status (graphics), ==, 0);
+  g_clear_object (&graphics);
+
+  /* Each check ran the helper exactly once */
+  g_file_get_contents (log_path, &log, NULL, &error);
+  g_assert_no_error (error);
+  g_assert_cmpstr (log, ==, "LIBGL_DEBUG=verbose\n" "LIBGL_DEBUG=verbose\n");
+
+  if (!_srt_rm_rf (tmpdir))
+    g_debug ("Unable to remove temporary directory: %s", tmpdir);
+}
+
 static gint
 glx_icd_compare (SrtGlxIcd *a, SrtGlxIcd *b)
 {
@@ -2960,6 +3109,10 @@ main (int argc,
 
   g_test_add ("/graphics/check", Fixture, NULL,
               setup, test_check_graphics, teardown);
+  g_test_add ("/graphics/check/probe", Fixture, NULL,
+              setup, test_check_graphics_probe, teardown);
+  g_test_add ("/graphics/check/verbose", Fixture, NULL,
+              setup, test_check_graphics_verbose, teardown);
 
   g_test_add ("/graphics/glx/debian", Fixture, NULL,
               setup, test_glx_debian, teardown);
@@ -25,12 +25,15 @@
 
 #include <steam-runtime-tools/steam-runtime-tools.h>
 
+#include <elf.h>
+#include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
 
 #include <glib.h>
 #include <glib/gstdio.h>
 
+#include "steam-runtime-tools/architecture-internal.h"
 #include "steam-runtime-tools/libdl-internal.h"
 #include "test-utils.h"
 
@@ -118,6 +121,244 @@ test_libdl_classify (Fixture *f,
     }
 }
 
+static void
+append_u32 (GByteArray *bytes,
+            guint32 value)
+{
+  g_byte_array_append (bytes, (const guint8 *) &value, sizeof (value));
+}
+
+static void
+test_ld_so_cache (Fixture *f,
+                  gconstpointer context)
+{
+  static const char strings[] =
+    "libfoo.so.1\0"
+    "/lib/x86_64-linux-gnu/libfoo.so.1\0"
+    "/lib/i386-linux-gnu/libfoo.so.1\0"
+    "libbar.so.2\0"
+    "/opt/lib/libbar.so.2\0";
+  const guint32 foo = 0;
+  const guint32 foo_64 = foo + sizeof ("libfoo.so.1");
+  const guint32 foo_32 = foo_64 + sizeof ("/lib/x86_64-linux-gnu/libfoo.so.1");
+  const guint32 bar = foo_32 + sizeof ("/lib/i386-linux-gnu/libfoo.so.1");
+  const guint32 bar_path = bar + sizeof ("libbar.so.2");
+  const guint32 entries[][2] =
+  {
+    { foo, foo_64 },
+    { foo, foo_32 },
+    { bar, bar_path },
+    /* Out of range, and should be ignored */
+    { bar, sizeof (strings) + 4096 },
+  };
+  const guint32 header_len = 48;
+  const guint32 entry_len = 24;
+  const guint32 strings_offset = header_len + G_N_ELEMENTS (entries) * entry_len;
+  g_autoptr(GByteArray) bytes = g_byte_array_new ();
+  g_autoptr(GHashTable) cache = NULL;
+  g_autoptr(GError) error = NULL;
+  g_autofree gchar *tmpdir = NULL;
+  g_autofree gchar *path = NULL;
+  GPtrArray *paths;
+  gsize i;
+
+  tmpdir = g_dir_make_tmp ("libdl-test-XXXXXX", &error);
+  g_assert_no_error (error);
+  path = g_build_filename (tmpdir, "ld.so.cache", NULL);
+
+  g_byte_array_append (bytes, (const guint8 *) "glibc-ld.so.cache1.1", 20);
+  append_u32 (bytes, G_N_ELEMENTS (entries));
+  append_u32 (bytes, sizeof (strings));
+  append_u32 (bytes, 0);  /* flags and padding */
+  append_u32 (bytes, 0);  /* extension_offset */
+  append_u32 (bytes, 0);
+  append_u32 (bytes, 0);
+  append_u32 (bytes, 0);
+  g_assert_cmpuint (bytes->len, ==, header_len);
+
+  for (i = 0; i < G_N_ELEMENTS (entries); i++)
+    {
+      append_u32 (bytes, 0x0303);  /* flags */
+      append_u32 (bytes, strings_offset + entries[i][0]);
+      append_u32 (bytes, strings_offset + entries[i][1]);
+      append_u32 (bytes, 0);  /* osversion */
+      append_u32 (bytes, 0);  /* hwcap */
+      append_u32 (bytes, 0);
+    }
+
+  g_byte_array_append (bytes, (const guint8 *) strings, sizeof (strings));
+
+  g_file_set_contents (path, (const char *) bytes->data, bytes->len, &error);
+  g_assert_no_error (error);
+
+  cache = _srt_ld_so_cache_load (path, &error);
+  g_assert_no_error (error);
+  g_assert_nonnull (cache);
+  g_assert_cmpuint (g_hash_table_size (cache), ==, 2);
+
+  paths = g_hash_table_lookup (cache, "libfoo.so.1");
+  g_assert_nonnull (paths);
+  g_assert_cmpuint (paths->len, ==, 2);
+  g_assert_cmpstr (g_ptr_array_index (paths, 0), ==,
+                   "/lib/x86_64-linux-gnu/libfoo.so.1");
+  g_assert_cmpstr (g_ptr_array_index (paths, 1), ==,
+                   "/lib/i386-linux-gnu/libfoo.so.1");
+
+  paths = g_hash_table_lookup (cache, "libbar.so.2");
+  g_assert_nonnull (paths);
+  g_assert_cmpuint (paths->len, ==, 1);
+  g_assert_cmpstr (g_ptr_array_index (paths, 0), ==, "/opt/lib/libbar.so.2");
+
+  g_clear_pointer (&cache, g_hash_table_unref);
+
+  /* A truncated file is rejected */
+  g_file_set_contents (path, (const char *) bytes->data, header_len + 1, &error);
+  g_assert_no_error (error);
+  cache = _srt_ld_so_cache_load (path, &error);
+  g_assert_error (error, G_IO_ERROR, G_IO_ERROR_FAILED);
+  g_assert_null (cache);
+  g_clear_error (&error);
+
+  /* So is something that is not an ld.so.cache at all */
+  g_file_set_contents (path, "hello, world", -1, &error);
+  g_assert_no_error (error);
+  cache = _srt_ld_so_cache_load (path, &error);
+  g_assert_error (error, G_IO_ERROR, G_IO_ERROR_FAILED);
+  g_assert_null (cache);
+  g_clear_error (&error);
+
+  g_unlink (path);
+  g_rmdir (tmpdir);
+}
+
+static void
+test_elf_header (Fixture *f,
+                 gconstpointer context)
+{
+  unsigned char data[sizeof (Elf64_Ehdr)] = { 0 };
+  g_autoptr(GError) error = NULL;
+  g_autofree gchar *tmpdir = NULL;
+  g_autofree gchar *path = NULL;
+  SrtElfHeader header;
+  gboolean matches;
+
+  tmpdir = g_dir_make_tmp ("srt-test-elf-header-XXXXXX", &error);
+  g_assert_no_error (error);
+  path = g_build_filename (tmpdir, "libfoo.so.1", NULL);
+
+  g_assert_false (_srt_elf_header_get (path, &header));
+
+  g_file_set_contents (path, "not an ELF object", -1, &error);
+  g_assert_no_error (error);
+  g_assert_false (_srt_elf_header_get (path, &header));
+
+  /* A big-endian 32-bit shared library for m68k */
+  memcpy (data, ELFMAG, SELFMAG);
+  data[EI_CLASS] = ELFCLASS32;
+  data[EI_DATA] = ELFDATA2MSB;
+  data[EI_VERSION] = EV_CURRENT;
+  data[EI_NIDENT + 1] = ET_DYN;
+  data[EI_NIDENT + 3] = EM_68K;
+  g_file_set_contents (path, (const char *) data, sizeof (data), &error);
+  g_assert_no_error (error);
+
+  /* The file was replaced, so the cached result is not reused */
+  g_assert_true (_srt_elf_header_get (path, &header));
+  g_assert_cmpuint (header.elf_class, ==, ELFCLASS32);
+  g_assert_cmpuint (header.elf_encoding, ==, ELFDATA2MSB);
+  g_assert_cmpuint (header.elf_type, ==, ET_DYN);
+  g_assert_cmpuint (header.elf_machine, ==, EM_68K);
+
+  /* Asking again gives the same answer */
+  memset (&header, 0, sizeof (header));
+  g_assert_true (_srt_elf_header_get (path, &header));
+  g_assert_cmpuint (header.elf_class, ==, ELFCLASS32);
+  g_assert_cmpuint (header.elf_machine, ==, EM_68K);
+
+  g_assert_true (_srt_elf_check_architecture (path, SRT_ABI_X86_64, &matches));
+  g_assert_false (matches);
+  g_assert_false (_srt_elf_check_architecture (path, "mock-abi", &matches));
+
+  g_unlink (path);
+  g_rmdir (tmpdir);
+
+  if (_srt_architecture_get_by_tuple (_SRT_MULTIARCH) == NULL)
+    {
+      g_test_skip ("Architecture " _SRT_MULTIARCH " not supported");
+      return;
+    }
+
+  /* Our own executable is an ELF object for this architecture */
+  g_assert_true (_srt_elf_check_architecture ("/proc/self/exe",
+                                              _SRT_MULTIARCH, &matches));
+  g_assert_true (matches);
+}
+
+static void
+test_library_resolver (Fixture *f,
+                       gconstpointer context)
+{
+  g_autoptr(SrtLibraryResolver) resolver = _srt_library_resolver_new ();
+  g_auto(GStrv) envp = g_get_environ ();
+  g_autofree gchar *expected = NULL;
+  g_autofree gchar *path = NULL;
+
+  /* An architecture we can't emulate needs the caller to run the
+   * helper, and can remember the result */
+  g_assert_false (_srt_library_resolver_get_canonical_path (resolver, envp,
+                                                            "mock-abi",
+                                                            "libfoo.so.1",
+                                                            &path));
+  g_assert_null (path);
+  _srt_library_resolver_set_canonical_path (resolver, "mock-abi",
+                                            "libfoo.so.1", "/mock/libfoo.so.1");
+  g_assert_true (_srt_library_resolver_get_canonical_path (resolver, envp,
+                                                           "mock-abi",
+                                                           "libfoo.so.1",
+                                                           &path));
+  g_assert_cmpstr (path, ==, "/mock/libfoo.so.1");
+  g_clear_pointer (&path, g_free);
+
+  if (_srt_architecture_get_by_tuple (_SRT_MULTIARCH) == NULL)
+    {
+      g_test_skip ("Architecture " _SRT_MULTIARCH " not supported");
+      return;
+    }
+
+  /* Our own executable is an ELF object for this architecture */
+  expected = realpath ("/proc/self/exe", NULL);
+  g_assert_nonnull (expected);
+  g_assert_true (_srt_library_resolver_get_canonical_path (resolver, envp,
+                                                           _SRT_MULTIARCH,
+                                                           "/proc/self/exe",
+                                                           &path));
+  g_assert_cmpstr (path, ==, expected);
+  g_clear_pointer (&path, g_free);
+
+  /* Paths with dynamic string tokens are left to the helper */
+  g_assert_false (_srt_library_resolver_get_canonical_path (resolver, envp,
+                                                            _SRT_MULTIARCH,
+                                                            "/usr/$LIB/libc.so.6",
+                                                            &path));
+  g_assert_null (path);
+
+  /* A missing library is reported as such */
+  g_assert_true (_srt_library_resolver_get_canonical_path (resolver, envp,
+                                                           _SRT_MULTIARCH,
+                                                           "libMISSING.so.62",
+                                                           &path));
+  g_assert_null (path);
+
+  /* A library that is certainly available is found by SONAME */
+  g_assert_true (_srt_library_resolver_get_canonical_path (resolver, envp,
+                                                           _SRT_MULTIARCH,
+                                                           "libglib-2.0.so.0",
+                                                           &path));
+  g_assert_nonnull (path);
+  g_assert_true (g_path_is_absolute (path));
+  g_test_message ("libglib-2.0.so.0 -> %s", path);
+}
+
 int
 main (int argc,
       char **argv)
@@ -126,6 +367,12 @@ main (int argc,
 
   g_test_add ("/libdl/classify", Fixture, NULL, setup,
               test_libdl_classify, teardown);
+  g_test_add ("/libdl/ld-so-cache", Fixture, NULL, setup,
+              test_ld_so_cache, teardown);
+  g_test_add ("/libdl/elf-header", Fixture, NULL, setup,
+              test_elf_header, teardown);
+  g_test_add ("/libdl/library-resolver", Fixture, NULL, setup,
+              test_library_resolver, teardown);
 
   return g_test_run ();
 }
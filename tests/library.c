@@ -739,6 +739,157 @@ test_missing_library (Fixture *f,
   g_object_unref (library);
 }
 
+/*
+ * Test checking several libraries with a single helper process.
+ */
+static void
+test_batch (Fixture *f,
+            gconstpointer context)
+{
+  g_autoptr(GPtrArray) libraries = NULL;
+  g_autoptr(GError) error = NULL;
+  g_autofree gchar *tmp_file = NULL;
+  g_auto(GStrv) envp = g_get_environ ();
+  const char *requested_names[] = { "libz.so.1", "libMISSING.so.62" };
+  const char *symbols_paths[] = { NULL, NULL };
+  SrtLibrary *library;
+  SrtLibraryIssues issues;
+  const char * const *missing_symbols;
+  const char * const *dependencies;
+  gboolean result;
+  int fd;
+
+  if (strcmp (_SRT_MULTIARCH, "") == 0)
+    {
+      g_test_skip ("Unsupported architecture");
+      return;
+    }
+
+  fd = g_file_open_tmp ("library-XXXXXX", &tmp_file, &error);
+  g_assert_no_error (error);
+  g_assert_cmpint (fd, !=, -1);
+  close (fd);
+
+  result = g_file_set_contents (tmp_file,
+                                "inflateCopy@ZLIB_1.2.0\n"
+                                "jpeg_mem_src@LIBJPEGTURBO_6.2\n",
+                                -1, &error);
+  g_assert_no_error (error);
+  g_assert_true (result);
+  symbols_paths[0] = tmp_file;
+
+  issues = _srt_check_library_presence_batch (NULL,
+                                              NULL,
+                                              _SRT_MULTIARCH,
+                                              requested_names,
+                                              symbols_paths,
+                                              G_N_ELEMENTS (requested_names),
+                                              NULL,
+                                              envp,
+                                              SRT_LIBRARY_SYMBOLS_FORMAT_PLAIN,
+                                              &libraries);
+  g_assert_cmpint (issues, ==,
+                   (SRT_LIBRARY_ISSUES_CANNOT_LOAD |
+                    SRT_LIBRARY_ISSUES_MISSING_SYMBOLS |
+                    SRT_LIBRARY_ISSUES_UNKNOWN_EXPECTATIONS));
+  g_assert_nonnull (libraries);
+  g_assert_cmpuint (libraries->len, ==, G_N_ELEMENTS (requested_names));
+
+  library = g_ptr_array_index (libraries, 0);
+  g_assert_cmpstr (srt_library_get_requested_name (library), ==, "libz.so.1");
+  g_assert_cmpint (srt_library_get_issues (library), ==,
+                   SRT_LIBRARY_ISSUES_MISSING_SYMBOLS);
+  g_assert_cmpint (srt_library_get_exit_status (library), ==, 0);
+  g_assert_nonnull (srt_library_get_absolute_path (library));
+  missing_symbols = srt_library_get_missing_symbols (library);
+  g_assert_cmpstr (missing_symbols[0], ==, "jpeg_mem_src@LIBJPEGTURBO_6.2");
+  g_assert_cmpstr (missing_symbols[1], ==, NULL);
+  dependencies = srt_library_get_dependencies (library);
+  g_assert_cmpstr (dependencies[0], !=, NULL);
+
+  library = g_ptr_array_index (libraries, 1);
+  g_assert_cmpstr (srt_library_get_requested_name (library), ==, "libMISSING.so.62");
+  g_assert_cmpint (srt_library_get_issues (library), ==,
+                   (SRT_LIBRARY_ISSUES_CANNOT_LOAD |
+                    SRT_LIBRARY_ISSUES_UNKNOWN_EXPECTATIONS));
+  g_assert_cmpstr (srt_library_get_absolute_path (library), ==, NULL);
+  g_assert_cmpint (srt_library_get_exit_status (library), ==, 1);
+  g_assert_cmpint (srt_library_get_terminating_signal (library), ==, 0);
+  g_assert_nonnull (srt_library_get_messages (library));
+  dependencies = srt_library_get_dependencies (library);
+  g_assert_cmpstr (dependencies[0], ==, NULL);
+
+  g_unlink (tmp_file);
+}
+
+/*
+ * Test checking libraries through a resident inspect-library server,
+ * reusing the same helper process for more than one batch.
+ */
+static void
+test_server (Fixture *f,
+             gconstpointer context)
+{
+  g_autoptr(SrtHelperServer) server = NULL;
+  g_autoptr(GError) error = NULL;
+  g_auto(GStrv) envp = g_get_environ ();
+  const char * const server_args[] = { "--line-based", "--server", NULL };
+  const char *requested_names[] = { "libz.so.1", "libMISSING.so.62" };
+  const char *symbols_paths[] = { NULL, NULL };
+  gsize i;
+
+  if (strcmp (_SRT_MULTIARCH, "") == 0)
+    {
+      g_test_skip ("Unsupported architecture");
+      return;
+    }
+
+  server = _srt_helper_server_new (NULL, _SRT_MULTIARCH, "inspect-library",
+                                   server_args, envp, 1, &error);
+  g_assert_no_error (error);
+  g_assert_nonnull (server);
+
+  for (i = 0; i < 2; i++)
+    {
+      g_autoptr(GPtrArray) libraries = NULL;
+      SrtLibrary *library;
+      SrtLibraryIssues issues;
+
+      issues = _srt_check_library_presence_batch (NULL,
+                                                  server,
+                                                  _SRT_MULTIARCH,
+                                                  requested_names,
+                                                  symbols_paths,
+                                                  G_N_ELEMENTS (requested_names),
+                                                  NULL,
+                                                  envp,
+                                                  SRT_LIBRARY_SYMBOLS_FORMAT_PLAIN,
+                                                  &libraries);
+      g_assert_cmpint (issues, ==,
+                       (SRT_LIBRARY_ISSUES_CANNOT_LOAD |
+                        SRT_LIBRARY_ISSUES_UNKNOWN_EXPECTATIONS));
+      g_assert_nonnull (libraries);
+      g_assert_cmpuint (libraries->len, ==, G_N_ELEMENTS (requested_names));
+
+      library = g_ptr_array_index (libraries, 0);
+      g_assert_cmpstr (srt_library_get_requested_name (library), ==,
+                       "libz.so.1");
+      g_assert_cmpint (srt_library_get_issues (library), ==,
+                       SRT_LIBRARY_ISSUES_UNKNOWN_EXPECTATIONS);
+      g_assert_cmpint (srt_library_get_exit_status (library), ==, 0);
+      g_assert_nonnull (srt_library_get_absolute_path (library));
+
+      library = g_ptr_array_index (libraries, 1);
+      g_assert_cmpstr (srt_library_get_requested_name (library), ==,
+                       "libMISSING.so.62");
+      g_assert_cmpint (srt_library_get_issues (library), ==,
+                       (SRT_LIBRARY_ISSUES_CANNOT_LOAD |
+                        SRT_LIBRARY_ISSUES_UNKNOWN_EXPECTATIONS));
+      g_assert_cmpstr (srt_library_get_absolute_path (library), ==, NULL);
+      g_assert_cmpint (srt_library_get_exit_status (library), ==, 1);
+    }
+}
+
 /*
  * Test a not supported architecture.
  */
@@ -812,6 +963,10 @@ main (int argc,
               test_missing_library, teardown);
   g_test_add ("/library/missing_arch", Fixture, NULL, setup,
               test_missing_arch, teardown);
+  g_test_add ("/library/batch", Fixture, NULL, setup,
+              test_batch, teardown);
+  g_test_add ("/library/server", Fixture, NULL, setup,
+              test_server, teardown);
 
   return g_test_run ();
 }
@@ -92,6 +92,7 @@ import os
 import shutil
 import struct
 import sys
+import tarfile
 import tempfile
 import time
 import unittest
@@ -589,7 +590,11 @@ class TestContainers(BaseTest):
                 # in-place to have the OLD-DEPLOYMENT flag-file, but the
                 # manifest doesn't include that, so if we're using a runtime
                 # with a manifest, that part will fail.
-                for manifest in ('usr-mtree.txt', 'usr-mtree.txt.gz'):
+                for manifest in (
+                    'usr-mtree.bin',
+                    'usr-mtree.txt',
+                    'usr-mtree.txt.gz',
+                ):
                     with contextlib.suppress(FileNotFoundError):
                         os.remove(os.path.join(old_dir, manifest))
 
@@ -815,6 +820,24 @@ class TestContainers(BaseTest):
                 members.discard('tmp-wlock')
                 members.discard('deploy-deleteme')
                 members.discard('deploy-myruntime_0.1.2')
+                # Only created if library comparisons were needed
+                members.discard('libcapsule-cmp-cache.txt')
+
+                # Garbage-collected directories are deleted in the
+                # background, so they might still exist
+                for member in list(members):
+                    if member.startswith('trash-'):
+                        members.discard(member)
+
+                # Runtimes with a manifest also leave behind an unmodified
+                # copy, to be reused next time
+                for member in list(members):
+                    if member.startswith('copy-'):
+                        self.assertTrue(
+                            os.path.isdir(os.path.join(temp, member, 'usr'))
+                        )
+                        members.discard(member)
+
                 # After discarding those, there should be exactly one left:
                 # the one we just created
                 self.assertEqual(len(members), 1)
@@ -1307,6 +1330,172 @@ class TestContainers(BaseTest):
             only_prepare=True,
         )
 
+    def test_unpack_debug_symbols(self) -> None:
+        if self.bwrap is None:
+            self.skipTest('Unable to run bwrap (in a container?)')
+
+        archive = os.path.join(
+            self.containers_dir,
+            ('com.valvesoftware.SteamRuntime.Platform-amd64,i386-'
+             'scout-runtime.tar.gz'),
+        )
+
+        if not os.path.isfile(archive):
+            self.skipTest('{} not found'.format(archive))
+
+        artifacts = os.path.join(self.artifacts, 'unpack_debug_symbols')
+        os.makedirs(artifacts, exist_ok=True)
+        var_dir = os.path.join(self.containers_dir, 'var')
+        os.makedirs(var_dir, exist_ok=True)
+
+        with tempfile.TemporaryDirectory(
+            prefix='test-', dir=var_dir
+        ) as temp, tempfile.TemporaryDirectory(
+            prefix='test-archives-', dir=var_dir
+        ) as archives:
+            runtime_archive = os.path.join(
+                archives, os.path.basename(archive),
+            )
+            os.symlink(archive, runtime_archive)
+
+            # Like a Flatpak debug extension, files/ in the debug
+            # tarball is unpacked into /usr/lib/debug
+            debug_source = os.path.join(archives, 'debug.txt')
+            debug_archive = runtime_archive.replace(
+                '-runtime.tar.gz', '-debug.tar.gz',
+            )
+
+            with open(debug_source, 'w') as writer:
+                writer.write('detached debug symbols\n')
+
+            def write_debug_archive() -> None:
+                with tarfile.open(debug_archive, 'w:gz') as writer:
+                    writer.add(
+                        debug_source,
+                        arcname='files/.build-id/00/pv-test.debug',
+                    )
+
+            write_debug_archive()
+
+            deployment = os.path.join(temp, 'deploy-myruntime_0.1.2')
+            marker = os.path.join(deployment, '.debug-symbols-unpacked')
+            failed = os.path.join(deployment, '.debug-symbols-failed')
+            lock = os.path.join(deployment, '.debug-symbols.lock')
+            unpacked = os.path.join(
+                deployment, 'files', 'lib', 'debug',
+                '.build-id', '00', 'pv-test.debug',
+            )
+            argv = [
+                self.pv_wrap,
+                '--verbose',
+                '--runtime-archive', runtime_archive,
+                '--runtime-id', 'myruntime_0.1.2',
+                '--variable-dir', temp,
+                '--copy-runtime',
+                '--no-gc-runtimes',
+                '--no-generate-locales',
+                '--share-home',
+                '--only-prepare',
+            ]
+
+            def launch(i: int) -> None:
+                with tee_file_and_stderr(
+                    os.path.join(artifacts, 'pressure-vessel-%d.log' % i)
+                ) as tee:
+                    completed = self.run_subprocess(
+                        argv,
+                        cwd=self.artifacts,
+                        stdout=tee.stdin,
+                        stderr=tee.stdin,
+                        universal_newlines=True,
+                    )
+                    self.assertEqual(completed.returncode, 0)
+
+            def wait_for_marker(
+                timeout: float,
+                path: str = marker,
+            ) -> bool:
+                deadline = time.time() + timeout
+
+                while time.time() < deadline:
+                    if os.path.exists(path):
+                        return True
+
+                    time.sleep(0.5)
+
+                return os.path.exists(path)
+
+            launch(0)
+
+            if not os.path.isdir(
+                os.path.join(deployment, 'files', 'lib', 'debug')
+            ):
+                self.skipTest('Runtime has no /usr/lib/debug')
+
+            # The launch does not wait for the debug symbols, but they
+            # arrive in the background
+            self.assertTrue(wait_for_marker(60))
+            self.assertTrue(os.path.exists(lock))
+
+            with open(unpacked) as reader:
+                self.assertEqual(reader.read(), 'detached debug symbols\n')
+
+            # Pretend a previous attempt was interrupted, while another
+            # process is still unpacking: we must not interfere with it
+            os.remove(marker)
+            os.remove(unpacked)
+
+            with open(lock, 'w') as lock_writer:
+                lockdata = struct.pack('hhlli', fcntl.F_WRLCK, 0, 0, 0, 0)
+                fcntl.fcntl(lock_writer.fileno(), fcntl.F_SETLKW, lockdata)
+                launch(1)
+                self.assertFalse(wait_for_marker(5))
+                self.assertFalse(os.path.exists(unpacked))
+
+            # With the lock released, the next launch tries again
+            launch(2)
+            self.assertTrue(wait_for_marker(60))
+
+            with open(unpacked) as reader:
+                self.assertEqual(reader.read(), 'detached debug symbols\n')
+
+            # Once the marker exists, later launches leave it alone
+            marker_stat = os.stat(marker)
+            launch(3)
+            time.sleep(1)
+            self.assertEqual(os.stat(marker).st_ino, marker_stat.st_ino)
+            self.assertEqual(
+                os.stat(marker).st_mtime_ns, marker_stat.st_mtime_ns,
+            )
+
+            # If the debug symbols cannot be unpacked, that is recorded
+            os.remove(marker)
+            os.remove(debug_archive)
+
+            with open(debug_archive, 'wb') as writer:
+                writer.write(b'this is not a tarball\n')
+
+            launch(4)
+            self.assertTrue(wait_for_marker(60, failed))
+            self.assertFalse(os.path.exists(marker))
+
+            # ... and we don't try again with the same tarball
+            failed_stat = os.stat(failed)
+            launch(5)
+            time.sleep(1)
+            self.assertEqual(os.stat(failed).st_ino, failed_stat.st_ino)
+            self.assertEqual(
+                os.stat(failed).st_mtime_ns, failed_stat.st_mtime_ns,
+            )
+            self.assertFalse(os.path.exists(marker))
+
+            # ... until it is replaced
+            os.remove(debug_archive)
+            write_debug_archive()
+            launch(6)
+            self.assertTrue(wait_for_marker(60))
+            self.assertFalse(os.path.exists(failed))
+
     def test_soldier_sysroot(self) -> None:
         soldier = os.path.join(self.containers_dir, 'soldier_sysroot')
 
@@ -1351,6 +1540,94 @@ class TestContainers(BaseTest):
         with self.subTest('transient'):
             self._test_soldier('soldier', soldier)
 
+    def test_soldier_overlay(self) -> None:
+        soldier = os.path.join(self.containers_dir, 'soldier')
+
+        if self.bwrap is None:
+            self.skipTest('Unable to run bwrap (in a container?)')
+
+        if not os.path.isdir(soldier):
+            self.skipTest('{} not found'.format(soldier))
+
+        files = os.path.join(soldier, 'files')
+
+        if not os.path.isdir(files):
+            files = soldier
+
+        artifacts = os.path.join(self.artifacts, 'soldier_overlay')
+        os.makedirs(artifacts, exist_ok=True)
+        var_dir = os.path.join(self.containers_dir, 'var')
+        os.makedirs(var_dir, exist_ok=True)
+
+        with tempfile.TemporaryDirectory(prefix='test-', dir=var_dir) as temp:
+            argv = [
+                self.pv_wrap,
+                '--verbose',
+                '--runtime', soldier,
+                '--variable-dir', temp,
+                '--copy-runtime',
+                '--overlay-runtime',
+                '--gc-runtimes',
+                '--no-generate-locales',
+                '--share-home',
+            ]
+            previous = set()    # type: typing.Set[str]
+
+            for i in range(2):
+                with tee_file_and_stderr(
+                    os.path.join(artifacts, 'pressure-vessel-%d.log' % i)
+                ) as tee:
+                    completed = self.run_subprocess(
+                        argv + ['--', 'true'],
+                        cwd=self.artifacts,
+                        stdout=tee.stdin,
+                        stderr=tee.stdin,
+                        universal_newlines=True,
+                    )
+                    self.assertEqual(completed.returncode, 0)
+
+                probe_cache = os.path.join(temp, 'overlay-probe-cache.txt')
+
+                if not os.path.exists(probe_cache):
+                    self.skipTest('overlayfs not attempted')
+
+                with open(probe_cache) as reader:
+                    if reader.read().endswith(' failed\n'):
+                        self.skipTest('Unable to mount overlayfs')
+
+                current = set(
+                    member for member in os.listdir(temp)
+                    if member.startswith('tmp-')
+                )
+
+                # The overlay sysroot from the previous launch is no
+                # longer in use, so it must have been garbage-collected
+                for member in previous:
+                    self.assertNotIn(member, current)
+
+                self.assertEqual(len(current), 1)
+                tree = os.path.join(temp, current.pop())
+                previous.add(os.path.basename(tree))
+
+                # Only the parts of the runtime that setup reads or edits
+                # are populated, and the rest comes from the lower layer
+                self.assertEqual(
+                    os.readlink(os.path.join(tree, '.ref')), 'usr/.ref',
+                )
+                self.assertTrue(
+                    os.path.isdir(os.path.join(tree, 'usr', 'etc')),
+                )
+
+                # The sysroot must have its own lock file, otherwise it
+                # could never be garbage-collected while the runtime is
+                # in use
+                ours = os.stat(os.path.join(tree, 'usr', '.ref'))
+                theirs = os.stat(os.path.join(files, '.ref'))
+                self.assertFalse(
+                    ours.st_dev == theirs.st_dev
+                    and ours.st_ino == theirs.st_ino
+                )
+
     def test_no_runtime(self) -> None:
         if self.bwrap is None:
             self.skipTest('Unable to run bwrap (in a container?)')
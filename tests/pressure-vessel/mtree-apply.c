@@ -36,8 +36,14 @@
 #include "mtree.h"
 #include "utils.h"
 
+static gchar *opt_check_compiled = NULL;
+
 static GOptionEntry options[] =
 {
+  { "check-compiled", '\0',
+    G_OPTION_FLAG_NONE, G_OPTION_ARG_FILENAME, &opt_check_compiled,
+    "Instead of applying MTREE, check that it was compiled from SOURCE",
+    "SOURCE" },
   { NULL }
 };
 
@@ -67,6 +73,17 @@ main (int argc,
       argc--;
     }
 
+  if (opt_check_compiled != NULL && argc == 2)
+    {
+      ret = EX_UNAVAILABLE;
+
+      if (!pv_mtree_check_compiled (argv[1], opt_check_compiled, error))
+        goto out;
+
+      ret = 0;
+      goto out;
+    }
+
   if (argc < 3 || argc > 4)
     {
       g_printerr ("Usage: %s MTREE ROOT [SOURCE]\n", g_get_prgname ());
@@ -87,5 +104,6 @@ out:
   if (local_error != NULL)
     g_warning ("%s", local_error->message);
 
+  g_free (opt_check_compiled);
   return ret;
 }
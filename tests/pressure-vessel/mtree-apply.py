@@ -4,6 +4,7 @@
 # SPDX-License-Identifier: MIT
 
 import os
+import shutil
 import subprocess
 import sys
 import tempfile
@@ -31,6 +32,37 @@ class TestMtreeApply(BaseTest):
             'test-mtree-apply',
         )
 
+        if 'PRESSURE_VESSEL_UNINSTALLED' in os.environ:
+            self.mtree_compile = os.path.join(
+                self.top_builddir,
+                'pressure-vessel',
+                'pressure-vessel-mtree-compile',
+            )
+        else:
+            self.mtree_compile = (
+                shutil.which('pressure-vessel-mtree-compile')
+                or os.path.join(
+                    '/usr/lib/pressure-vessel/relocatable/bin',
+                    'pressure-vessel-mtree-compile',
+                )
+            )
+
+    def get_manifest(self, source: str, tmpdir: str, compiled: bool) -> str:
+        if not compiled:
+            return source
+
+        compiled_path = os.path.join(tmpdir, 'usr-mtree.bin')
+        subprocess.run(
+            [
+                self.mtree_compile,
+                source,
+                compiled_path,
+            ],
+            check=True,
+            stdout=2,
+        )
+        return compiled_path
+
     def assert_tree_is_superset(
         self,
         superset,
@@ -139,6 +171,12 @@ class TestMtreeApply(BaseTest):
             )
 
     def test_populate(self) -> None:
+        self._test_populate(compiled=False)
+
+    def test_populate_compiled(self) -> None:
+        self._test_populate(compiled=True)
+
+    def _test_populate(self, compiled: bool) -> None:
         content = b'''\
         . type=dir
         ./foo/bar/\302\251 type=dir
@@ -153,9 +191,11 @@ class TestMtreeApply(BaseTest):
         with tempfile.NamedTemporaryFile(
         ) as source, tempfile.TemporaryDirectory(
         ) as expected, tempfile.TemporaryDirectory(
-        ) as dest:
+        ) as dest, tempfile.TemporaryDirectory(
+        ) as tmpdir:
             source.write(content)
             source.flush()
+            manifest = self.get_manifest(source.name, tmpdir, compiled)
 
             os.umask(0o077)
             bar = (Path(expected) / 'foo' / 'bar')
@@ -194,7 +234,7 @@ class TestMtreeApply(BaseTest):
             subprocess.run(
                 [
                     self.mtree_apply,
-                    source.name,
+                    manifest,
                     dest,
                 ],
                 check=True,
@@ -218,6 +258,12 @@ class TestMtreeApply(BaseTest):
             )
 
     def test_populate_copy(self) -> None:
+        self._test_populate_copy(compiled=False)
+
+    def test_populate_copy_compiled(self) -> None:
+        self._test_populate_copy(compiled=True)
+
+    def _test_populate_copy(self, compiled: bool) -> None:
         content = b'''\
 # Content-addressed storage indexed by a truncated sha256
 ./make-executable type=file mode=755 contents=a8/076d3d28d21e02012b20eaf7dbf754
@@ -228,9 +274,11 @@ class TestMtreeApply(BaseTest):
         ) as source, tempfile.TemporaryDirectory(
         ) as reference, tempfile.TemporaryDirectory(
         ) as expected, tempfile.TemporaryDirectory(
-        ) as dest:
+        ) as dest, tempfile.TemporaryDirectory(
+        ) as tmpdir:
             source.write(content)
             source.flush()
+            manifest = self.get_manifest(source.name, tmpdir, compiled)
 
             os.umask(0o077)
 
@@ -255,7 +303,7 @@ class TestMtreeApply(BaseTest):
             subprocess.run(
                 [
                     self.mtree_apply,
-                    source.name,
+                    manifest,
                     dest,
                     reference,
                 ],
@@ -287,6 +335,39 @@ class TestMtreeApply(BaseTest):
             self.assertEqual(info.st_mode & 0o7777, 0o644)
             self.assertEqual(info.st_mtime, 1597415889)
 
+    def test_compiled_out_of_date(self) -> None:
+        with tempfile.NamedTemporaryFile(
+        ) as source, tempfile.TemporaryDirectory(
+        ) as tmpdir:
+            source.write(b'. type=dir\n./foo type=file\n')
+            source.flush()
+            manifest = self.get_manifest(source.name, tmpdir, True)
+
+            subprocess.run(
+                [
+                    self.mtree_apply,
+                    '--check-compiled', source.name,
+                    manifest,
+                ],
+                check=True,
+                stdout=2,
+            )
+
+            # If the text manifest is updated but the compiled manifest
+            # is not, the compiled manifest must not be used
+            source.write(b'./bar type=file\n')
+            source.flush()
+
+            completed = subprocess.run(
+                [
+                    self.mtree_apply,
+                    '--check-compiled', source.name,
+                    manifest,
+                ],
+                stdout=2,
+            )
+            self.assertNotEqual(completed.returncode, 0)
+
     def tearDown(self) -> None:
         super().tearDown()
 
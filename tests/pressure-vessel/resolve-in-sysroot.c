@@ -35,6 +35,7 @@
 #include "libglnx/libglnx.h"
 
 #include "tests/test-utils.h"
+#include "dirfd-cache.h"
 #include "utils.h"
 
 typedef struct
@@ -317,6 +318,82 @@ test_resolve_in_sysroot (Fixture *f,
     }
 }
 
+/*
+ * PvDirfdCache must give the same answers as _srt_resolve_in_sysroot(),
+ * whether the directory was cached or not.
+ */
+static void
+test_dirfd_cache (Fixture *f,
+                  gconstpointer context)
+{
+  static const Symlink prepare_symlinks[] =
+  {
+    { "a/b/abs_symlink_to_c", "/a/b/c" },
+    { "a/b/symlink_to_b2", "../b2" },
+  };
+  static const ResolveTest tests[] =
+  {
+    { { "a/b/c" }, { "a/b/c" } },
+    { { "a/b/c/d" }, { "a/b/c/d" } },
+    { { "./a//b/c/" }, { "a/b/c" } },
+    { { "a/b" }, { "a/b" } },
+    { { "a/b/abs_symlink_to_c/d" }, { "a/b/c/d" } },
+    { { "a/b/symlink_to_b2/c2" }, { "a/b2/c2" } },
+    { { "a/b/c/../../b2" }, { "a/b2" } },
+    { { "a/b2/missing" }, { NULL, G_IO_ERROR_NOT_FOUND } },
+    { { "a/b2/x/y", SRT_RESOLVE_FLAGS_MKDIR_P }, { "a/b2/x/y" } },
+    { { "a/b2/x/z", SRT_RESOLVE_FLAGS_MKDIR_P }, { "a/b2/x/z" } },
+    { { "." }, { "." } },
+  };
+  g_autoptr(GError) error = NULL;
+  g_auto(GLnxTmpDir) tmpdir = { FALSE };
+  g_autoptr(PvDirfdCache) cache = NULL;
+  gsize i;
+
+  glnx_mkdtemp ("test-XXXXXX", 0700, &tmpdir, &error);
+  g_assert_no_error (error);
+
+  glnx_shutil_mkdir_p_at (tmpdir.fd, "a/b/c/d", 0700, NULL, &error);
+  g_assert_no_error (error);
+  glnx_shutil_mkdir_p_at (tmpdir.fd, "a/b2/c2", 0700, NULL, &error);
+  g_assert_no_error (error);
+
+  for (i = 0; i < G_N_ELEMENTS (prepare_symlinks); i++)
+    {
+      const Symlink *it = &prepare_symlinks[i];
+
+      if (symlinkat (it->target, tmpdir.fd, it->name) != 0)
+        g_error ("symlinkat %s: %s", it->name, g_strerror (errno));
+    }
+
+  cache = pv_dirfd_cache_new (tmpdir.fd, tmpdir.path);
+
+  for (i = 0; i < G_N_ELEMENTS (tests); i++)
+    {
+      const ResolveTest *it = &tests[i];
+      int fd;
+
+      g_test_message ("%" G_GSIZE_FORMAT ": Resolving %s", i, it->call.path);
+      fd = pv_dirfd_cache_resolve (cache, it->call.path, it->call.flags,
+                                   &error);
+
+      if (it->expect.path != NULL)
+        {
+          g_assert_no_error (error);
+          g_assert_cmpint (fd, >=, 0);
+          g_assert_true (fd_same_as_rel_path_nofollow (fd, tmpdir.fd,
+                                                       it->expect.path));
+        }
+      else
+        {
+          g_assert_error (error, G_IO_ERROR, it->expect.code);
+          g_test_message ("Got error as expected: %s", error->message);
+          g_assert_cmpint (fd, ==, -1);
+          g_clear_error (&error);
+        }
+    }
+}
+
 int
 main (int argc,
       char **argv)
@@ -326,6 +403,8 @@ main (int argc,
   g_test_init (&argc, &argv, NULL);
   g_test_add ("/resolve-in-sysroot", Fixture, NULL,
               setup, test_resolve_in_sysroot, teardown);
+  g_test_add ("/dirfd-cache", Fixture, NULL,
+              setup, test_dirfd_cache, teardown);
 
   return g_test_run ();
 }
@@ -0,0 +1,659 @@
+/*
+ * Copyright © 2026 Collabora Ltd.
+ *
+ * SPDX-License-Identifier: MIT
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include <fcntl.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <glib.h>
+#include <glib/gstdio.h>
+
+#include "steam-runtime-tools/glib-backports-internal.h"
+#include "steam-runtime-tools/utils-internal.h"
+#include "libglnx/libglnx.h"
+
+#include "tests/test-utils.h"
+#include "untar.h"
+
+#define BLOCK 512
+
+typedef struct
+{
+  TestsOpenFdSet old_fds;
+  GLnxTmpDir tmpdir;
+  GByteArray *archive;
+} Fixture;
+
+typedef struct
+{
+  PvUntarFlags flags;
+} Config;
+
+static const Config default_config = { PV_UNTAR_FLAGS_NONE };
+static const Config single_thread_config = { PV_UNTAR_FLAGS_SINGLE_THREAD };
+
+static void
+setup (Fixture *f,
+       gconstpointer context)
+{
+  g_autoptr(GError) local_error = NULL;
+
+  f->old_fds = tests_check_fd_leaks_enter ();
+  glnx_mkdtemp ("test-untar-XXXXXX", 0700, &f->tmpdir, &local_error);
+  g_assert_no_error (local_error);
+  f->archive = g_byte_array_new ();
+}
+
+static void
+teardown (Fixture *f,
+          gconstpointer context)
+{
+  g_autoptr(GError) local_error = NULL;
+
+  g_clear_pointer (&f->archive, g_byte_array_unref);
+  glnx_tmpdir_delete (&f->tmpdir, NULL, &local_error);
+  g_assert_no_error (local_error);
+  tests_check_fd_leaks_leave (f->old_fds);
+}
+
+/*
+ * Copy up to @len bytes of @s into @field, without necessarily
+ * \0-terminating it, as in a tar header.
+ */
+static void
+set_field (guint8 *field,
+           gsize len,
+           const char *s)
+{
+  if (s != NULL)
+    memcpy (field, s, MIN (strlen (s), len));
+}
+
+/*
+ * Append a ustar header to @archive.
+ */
+static void
+append_header (GByteArray *archive,
+               const char *prefix,
+               const char *name,
+               char type,
+               guint mode,
+               guint64 size,
+               guint64 mtime,
+               const char *link)
+{
+  guint8 header[BLOCK] = { 0 };
+  guint sum = 0;
+  gsize i;
+
+  set_field (&header[0], 100, name);
+  g_snprintf ((char *) &header[100], 8, "%07o", mode);
+  g_snprintf ((char *) &header[108], 8, "%07o", 0);
+  g_snprintf ((char *) &header[116], 8, "%07o", 0);
+  g_snprintf ((char *) &header[124], 12, "%011" G_GINT64_MODIFIER "o", size);
+  g_snprintf ((char *) &header[136], 12, "%011" G_GINT64_MODIFIER "o", mtime);
+  header[156] = (guint8) type;
+  set_field (&header[157], 100, link);
+  memcpy (&header[257], "ustar", 6);
+  memcpy (&header[263], "00", 2);
+  set_field (&header[345], 155, prefix);
+
+  memset (&header[148], ' ', 8);
+
+  for (i = 0; i < sizeof (header); i++)
+    sum += header[i];
+
+  g_snprintf ((char *) &header[148], 8, "%06o", sum);
+  header[155] = ' ';
+  g_byte_array_append (archive, header, sizeof (header));
+}
+
+/*
+ * Append @len bytes of @data to @archive, padded to a whole block.
+ */
+static void
+append_data (GByteArray *archive,
+             const void *data,
+             gsize len)
+{
+  static const guint8 zeroes[BLOCK] = { 0 };
+
+  g_byte_array_append (archive, data, len);
+
+  if (len % BLOCK != 0)
+    g_byte_array_append (archive, zeroes, BLOCK - (len % BLOCK));
+}
+
+static void
+append_file (GByteArray *archive,
+             const char *name,
+             guint mode,
+             guint64 mtime,
+             const char *content)
+{
+  append_header (archive, NULL, name, '0', mode, strlen (content), mtime,
+                 NULL);
+  append_data (archive, content, strlen (content));
+}
+
+static void
+append_end (GByteArray *archive)
+{
+  static const guint8 zeroes[2 * BLOCK] = { 0 };
+
+  g_byte_array_append (archive, zeroes, sizeof (zeroes));
+}
+
+/*
+ * Append a POSIX.1-2001 extended header record "LEN KEY=VALUE\n",
+ * where LEN includes its own digits, to @records.
+ */
+static void
+append_pax_record (GString *records,
+                   const char *key,
+                   const char *value)
+{
+  gsize base = strlen (key) + strlen (value) + 3;
+  gsize len;
+
+  for (len = base + 1; ; len++)
+    {
+      g_autofree gchar *digits = g_strdup_printf ("%" G_GSIZE_FORMAT, len);
+
+      if (strlen (digits) + base == len)
+        break;
+    }
+
+  g_string_append_printf (records, "%" G_GSIZE_FORMAT " %s=%s\n",
+                          len, key, value);
+}
+
+static void
+append_extended_header (GByteArray *archive,
+                        char type,
+                        const char *data,
+                        gsize len)
+{
+  append_header (archive, NULL, "././@LongLink", type, 0644, len, 0, NULL);
+  append_data (archive, data, len);
+}
+
+/*
+ * Write f->archive to disk, truncated to @len bytes if nonzero, and
+ * unpack it into a new directory @dest, optionally linking unchanged
+ * files from @reference.
+ */
+static gboolean
+unpack_full (Fixture *f,
+             const Config *config,
+             gsize len,
+             const char *dest,
+             int reference_fd,
+             GHashTable *reference_digests,
+             GError **error)
+{
+  g_autofree gchar *archive = g_build_filename (f->tmpdir.path,
+                                                "archive.tar", NULL);
+  g_autofree gchar *dest_path = g_build_filename (f->tmpdir.path, dest,
+                                                  NULL);
+  g_autoptr(GError) local_error = NULL;
+  glnx_autofd int dest_fd = -1;
+
+  if (len == 0)
+    len = f->archive->len;
+
+  g_assert_cmpuint (len, <=, f->archive->len);
+  glnx_file_replace_contents_at (f->tmpdir.fd, "archive.tar",
+                                 f->archive->data, len,
+                                 GLNX_FILE_REPLACE_NODATASYNC, NULL,
+                                 &local_error);
+  g_assert_no_error (local_error);
+  g_assert_no_errno (mkdirat (f->tmpdir.fd, dest, 0755));
+  glnx_opendirat (f->tmpdir.fd, dest, TRUE, &dest_fd, &local_error);
+  g_assert_no_error (local_error);
+
+  return pv_untar (archive, dest_fd, dest_path, NULL, reference_fd,
+                   reference_digests, config->flags, error);
+}
+
+static gboolean
+unpack (Fixture *f,
+        const Config *config,
+        gsize len,
+        const char *dest,
+        GError **error)
+{
+  return unpack_full (f, config, len, dest, -1, NULL, error);
+}
+
+static gchar *
+read_file (Fixture *f,
+           const char *path)
+{
+  g_autoptr(GError) local_error = NULL;
+  gchar *ret;
+
+  ret = glnx_file_get_contents_utf8_at (f->tmpdir.fd, path, NULL, NULL,
+                                        &local_error);
+  g_assert_no_error (local_error);
+  return ret;
+}
+
+static void
+test_ustar (Fixture *f,
+            gconstpointer context)
+{
+  const Config *config = context;
+  g_autoptr(GError) local_error = NULL;
+  g_autofree gchar *content = NULL;
+  g_autofree gchar *target = NULL;
+  struct stat file_stat;
+  struct stat hard_stat;
+  struct stat dir_stat;
+
+  append_header (f->archive, NULL, "./top/", '5', 0750, 0, 1000000000, NULL);
+  append_file (f->archive, "./top/file", 0640, 1234567890, "hello\n");
+  append_header (f->archive, NULL, "./top/link", '2', 0777, 0, 0, "file");
+  append_header (f->archive, NULL, "./top/hard", '1', 0640, 0, 0,
+                 "./top/file");
+  /* A name that is split between the prefix and name fields, in a
+   * directory that has no header of its own */
+  append_header (f->archive, "./top/sub", "deep", '0', 0755, 3, 0, NULL);
+  append_data (f->archive, "abc", 3);
+  append_end (f->archive);
+
+  g_assert_true (unpack (f, config, 0, "dest", &local_error));
+  g_assert_no_error (local_error);
+
+  content = read_file (f, "dest/top/file");
+  g_assert_cmpstr (content, ==, "hello\n");
+  g_clear_pointer (&content, g_free);
+  content = read_file (f, "dest/top/sub/deep");
+  g_assert_cmpstr (content, ==, "abc");
+
+  target = glnx_readlinkat_malloc (f->tmpdir.fd, "dest/top/link", NULL,
+                                   &local_error);
+  g_assert_no_error (local_error);
+  g_assert_cmpstr (target, ==, "file");
+
+  g_assert_no_errno (fstatat (f->tmpdir.fd, "dest/top/file", &file_stat,
+                              AT_SYMLINK_NOFOLLOW));
+  g_assert_no_errno (fstatat (f->tmpdir.fd, "dest/top/hard", &hard_stat,
+                              AT_SYMLINK_NOFOLLOW));
+  g_assert_no_errno (fstatat (f->tmpdir.fd, "dest/top", &dir_stat,
+                              AT_SYMLINK_NOFOLLOW));
+  g_assert_cmpuint (file_stat.st_mode & 07777, ==, 0640);
+  g_assert_cmpint (file_stat.st_mtime, ==, 1234567890);
+  g_assert_cmpuint (file_stat.st_ino, ==, hard_stat.st_ino);
+  g_assert_cmpuint (dir_stat.st_mode & 07777, ==, 0750);
+  g_assert_cmpint (dir_stat.st_mtime, ==, 1000000000);
+}
+
+static void
+test_symlinked_directory (Fixture *f,
+                          gconstpointer context)
+{
+  const Config *config = context;
+  g_autoptr(GError) local_error = NULL;
+  g_autofree gchar *outside = g_build_filename (f->tmpdir.path, "outside",
+                                                NULL);
+  struct stat stat_buf;
+
+  g_assert_no_errno (mkdirat (f->tmpdir.fd, "outside", 0700));
+  g_assert_no_errno (fchmodat (f->tmpdir.fd, "outside", 0700, 0));
+
+  /* A directory member that turns out to be a symlink, in this case
+   * pointing outside the destination, must not have its permissions
+   * and modification time applied to the symlink's target */
+  append_header (f->archive, NULL, "link", '2', 0777, 0, 0, outside);
+  append_header (f->archive, NULL, "link/", '5', 0755, 0, 1000000000, NULL);
+  append_header (f->archive, NULL, "real/", '5', 0750, 0, 1000000000, NULL);
+  append_end (f->archive);
+
+  g_assert_true (unpack (f, config, 0, "dest", &local_error));
+  g_assert_no_error (local_error);
+
+  g_assert_no_errno (fstatat (f->tmpdir.fd, "outside", &stat_buf, 0));
+  g_assert_cmpuint (stat_buf.st_mode & 07777, ==, 0700);
+  g_assert_cmpint (stat_buf.st_mtime, !=, 1000000000);
+
+  g_assert_no_errno (fstatat (f->tmpdir.fd, "dest/real", &stat_buf,
+                              AT_SYMLINK_NOFOLLOW));
+  g_assert_cmpuint (stat_buf.st_mode & 07777, ==, 0750);
+  g_assert_cmpint (stat_buf.st_mtime, ==, 1000000000);
+}
+
+static void
+test_gnu_long_names (Fixture *f,
+                     gconstpointer context)
+{
+  const Config *config = context;
+  g_autoptr(GError) local_error = NULL;
+  g_autoptr(GString) long_name = g_string_new ("top/");
+  g_autoptr(GString) long_link = g_string_new ("");
+  g_autofree gchar *link_path = NULL;
+  g_autofree gchar *content = NULL;
+  g_autofree gchar *target = NULL;
+
+  while (long_name->len < 200)
+    g_string_append (long_name, "directory/");
+
+  g_string_append (long_name, "file");
+
+  while (long_link->len < 150)
+    g_string_append (long_link, "../");
+
+  g_string_append (long_link, "target");
+  link_path = g_strdup_printf ("%s-link", long_name->str);
+
+  /* GNU tar includes the trailing \0 in the length */
+  append_extended_header (f->archive, 'L', long_name->str,
+                          long_name->len + 1);
+  append_file (f->archive, long_name->str, 0644, 0, "long\n");
+  append_extended_header (f->archive, 'L', link_path, strlen (link_path));
+  append_extended_header (f->archive, 'K', long_link->str, long_link->len);
+  append_header (f->archive, NULL, link_path, '2', 0777, 0, 0,
+                 long_link->str);
+  append_end (f->archive);
+
+  g_assert_true (unpack (f, config, 0, "dest", &local_error));
+  g_assert_no_error (local_error);
+
+  content = read_file (f, glnx_strjoina ("dest/", long_name->str));
+  g_assert_cmpstr (content, ==, "long\n");
+
+  target = glnx_readlinkat_malloc (f->tmpdir.fd,
+                                   glnx_strjoina ("dest/", link_path),
+                                   NULL, &local_error);
+  g_assert_no_error (local_error);
+  g_assert_cmpstr (target, ==, long_link->str);
+}
+
+static void
+test_pax (Fixture *f,
+          gconstpointer context)
+{
+  const Config *config = context;
+  g_autoptr(GError) local_error = NULL;
+  g_autoptr(GString) records = g_string_new ("");
+  g_autoptr(GString) long_name = g_string_new ("top/");
+  g_autofree gchar *content = NULL;
+  struct stat stat_buf;
+
+  while (long_name->len < 300)
+    g_string_append (long_name, "subdirectory/");
+
+  g_string_append (long_name, "file");
+
+  append_pax_record (records, "path", long_name->str);
+  append_pax_record (records, "mtime", "1500000000.123456789");
+  append_pax_record (records, "comment", "ignored");
+  append_extended_header (f->archive, 'x', records->str, records->len);
+  append_file (f->archive, "truncated-name", 0644, 0, "pax\n");
+
+  /* A size in an extended header applies to the next member with
+   * content, and not to a GNU long name in between */
+  g_string_truncate (records, 0);
+  append_pax_record (records, "size", "5");
+  append_extended_header (f->archive, 'x', records->str, records->len);
+  append_extended_header (f->archive, 'L', "top/sized",
+                          strlen ("top/sized") + 1);
+  append_header (f->archive, NULL, "top/sized", '0', 0644, 0, 0, NULL);
+  append_data (f->archive, "sized", 5);
+
+  /* A global extended header is ignored */
+  g_string_truncate (records, 0);
+  append_pax_record (records, "path", "top/global");
+  append_extended_header (f->archive, 'g', records->str, records->len);
+  append_file (f->archive, "top/local", 0644, 0, "local\n");
+  append_end (f->archive);
+
+  g_assert_true (unpack (f, config, 0, "dest", &local_error));
+  g_assert_no_error (local_error);
+
+  content = read_file (f, glnx_strjoina ("dest/", long_name->str));
+  g_assert_cmpstr (content, ==, "pax\n");
+  g_assert_no_errno (fstatat (f->tmpdir.fd,
+                              glnx_strjoina ("dest/", long_name->str),
+                              &stat_buf, AT_SYMLINK_NOFOLLOW));
+  g_assert_cmpint (stat_buf.st_mtime, ==, 1500000000);
+  g_clear_pointer (&content, g_free);
+
+  content = read_file (f, "dest/top/sized");
+  g_assert_cmpstr (content, ==, "sized");
+  g_clear_pointer (&content, g_free);
+
+  content = read_file (f, "dest/top/local");
+  g_assert_cmpstr (content, ==, "local\n");
+  g_assert_cmpint (faccessat (f->tmpdir.fd, "dest/truncated-name", F_OK,
+                              AT_SYMLINK_NOFOLLOW), !=, 0);
+  g_assert_cmpint (faccessat (f->tmpdir.fd, "dest/top/global", F_OK,
+                              AT_SYMLINK_NOFOLLOW), !=, 0);
+}
+
+static void
+test_pax_invalid (Fixture *f,
+                  gconstpointer context)
+{
+  static const char * const invalid[] =
+  {
+    /* Length with enough digits to overflow a 64-bit integer */
+    "99999999999999999999999999 path=x\n",
+    /* Length longer than the extended header */
+    "99 path=x\n",
+    /* Length that does not reach the newline */
+    "5 path=x\n",
+    /* No length */
+    " path=x\n",
+  };
+  const Config *config = context;
+  gsize i;
+
+  for (i = 0; i < G_N_ELEMENTS (invalid); i++)
+    {
+      g_autoptr(GError) local_error = NULL;
+      g_autofree gchar *dest = g_strdup_printf ("dest%" G_GSIZE_FORMAT, i);
+
+      g_test_message ("%s", invalid[i]);
+      g_byte_array_set_size (f->archive, 0);
+      append_extended_header (f->archive, 'x', invalid[i],
+                              strlen (invalid[i]));
+      append_file (f->archive, "file", 0644, 0, "content\n");
+      append_end (f->archive);
+
+      g_assert_false (unpack (f, config, 0, dest, &local_error));
+      g_assert_error (local_error, G_IO_ERROR, G_IO_ERROR_FAILED);
+      g_test_message ("%s", local_error->message);
+    }
+}
+
+static void
+test_truncated (Fixture *f,
+                gconstpointer context)
+{
+  const Config *config = context;
+  gsize complete;
+  gsize lengths[4];
+  gsize i;
+
+  append_header (f->archive, NULL, "top/", '5', 0755, 0, 0, NULL);
+  append_file (f->archive, "top/file", 0644, 0, "hello\n");
+  complete = f->archive->len;
+  append_end (f->archive);
+
+  /* In the middle of a header */
+  lengths[0] = BLOCK + BLOCK / 2;
+  /* After a header, before its content */
+  lengths[1] = 2 * BLOCK;
+  /* In the middle of the content */
+  lengths[2] = 2 * BLOCK + 3;
+  /* In the middle of the end-of-archive marker */
+  lengths[3] = complete + BLOCK / 2;
+
+  for (i = 0; i < G_N_ELEMENTS (lengths); i++)
+    {
+      g_autoptr(GError) local_error = NULL;
+      g_autofree gchar *dest = g_strdup_printf ("dest%" G_GSIZE_FORMAT, i);
+
+      g_test_message ("Truncated to %" G_GSIZE_FORMAT " bytes", lengths[i]);
+      g_assert_false (unpack (f, config, lengths[i], dest, &local_error));
+      g_assert_error (local_error, G_IO_ERROR, G_IO_ERROR_FAILED);
+      g_test_message ("%s", local_error->message);
+    }
+}
+
+static void
+assert_same_file (Fixture *f,
+                  const char *a,
+                  const char *b,
+                  gboolean same)
+{
+  struct stat a_stat;
+  struct stat b_stat;
+
+  g_assert_no_errno (fstatat (f->tmpdir.fd, a, &a_stat, AT_SYMLINK_NOFOLLOW));
+  g_assert_no_errno (fstatat (f->tmpdir.fd, b, &b_stat, AT_SYMLINK_NOFOLLOW));
+
+  if (same)
+    {
+      g_assert_cmpuint (a_stat.st_dev, ==, b_stat.st_dev);
+      g_assert_cmpuint (a_stat.st_ino, ==, b_stat.st_ino);
+    }
+  else
+    {
+      g_assert_true (a_stat.st_dev != b_stat.st_dev
+                     || a_stat.st_ino != b_stat.st_ino);
+    }
+}
+
+static void
+test_reference (Fixture *f,
+                gconstpointer context)
+{
+  const Config *config = context;
+  g_autoptr(GError) local_error = NULL;
+  g_autoptr(GHashTable) digests = g_hash_table_new_full (g_str_hash,
+                                                          g_str_equal,
+                                                          g_free, g_free);
+  g_autofree gchar *content = NULL;
+  glnx_autofd int reference_fd = -1;
+
+  append_file (f->archive, "top/same", 0644, 0, "unchanged\n");
+  append_file (f->archive, "top/changed", 0644, 0, "old\n");
+  append_file (f->archive, "top/stale", 0644, 0, "stale\n");
+  append_file (f->archive, "top/mode", 0644, 0, "mode\n");
+  append_file (f->archive, "top/unlisted", 0644, 0, "unlisted\n");
+  append_header (f->archive, NULL, "alias", '2', 0777, 0, 0, "top");
+  append_end (f->archive);
+
+  g_assert_true (unpack (f, config, 0, "old", &local_error));
+  g_assert_no_error (local_error);
+
+  g_hash_table_replace (digests, g_strdup ("top/same"),
+                        g_compute_checksum_for_string (G_CHECKSUM_SHA256,
+                                                       "unchanged\n", -1));
+  g_hash_table_replace (digests, g_strdup ("top/changed"),
+                        g_compute_checksum_for_string (G_CHECKSUM_SHA256,
+                                                       "old\n", -1));
+  /* The digest does not match what is really in the reference copy */
+  g_hash_table_replace (digests, g_strdup ("top/stale"),
+                        g_compute_checksum_for_string (G_CHECKSUM_SHA256,
+                                                       "other\n", -1));
+  g_hash_table_replace (digests, g_strdup ("top/mode"),
+                        g_compute_checksum_for_string (G_CHECKSUM_SHA256,
+                                                       "mode\n", -1));
+  /* This is only found by following a symlink in the reference copy */
+  g_hash_table_replace (digests, g_strdup ("alias/same"),
+                        g_compute_checksum_for_string (G_CHECKSUM_SHA256,
+                                                       "unchanged\n", -1));
+
+  /* Same sizes, but different contents or permissions */
+  g_byte_array_set_size (f->archive, 0);
+  append_file (f->archive, "top/same", 0644, 0, "unchanged\n");
+  append_file (f->archive, "top/changed", 0644, 0, "new\n");
+  append_file (f->archive, "top/stale", 0644, 0, "stale\n");
+  append_file (f->archive, "top/mode", 0755, 0, "mode\n");
+  append_file (f->archive, "top/unlisted", 0644, 0, "unlisted\n");
+  append_file (f->archive, "alias/same", 0644, 0, "unchanged\n");
+  /* This must wait for top/same to have been linked */
+  append_header (f->archive, NULL, "top/hardlink", '1', 0644, 0, 0,
+                 "top/same");
+  append_end (f->archive);
+
+  glnx_opendirat (f->tmpdir.fd, "old", TRUE, &reference_fd, &local_error);
+  g_assert_no_error (local_error);
+  g_assert_true (unpack_full (f, config, 0, "new", reference_fd, digests,
+                              &local_error));
+  g_assert_no_error (local_error);
+
+  assert_same_file (f, "old/top/same", "new/top/same", TRUE);
+  assert_same_file (f, "old/top/changed", "new/top/changed", FALSE);
+  assert_same_file (f, "old/top/stale", "new/top/stale", FALSE);
+  assert_same_file (f, "old/top/mode", "new/top/mode", FALSE);
+  assert_same_file (f, "old/top/unlisted", "new/top/unlisted", FALSE);
+  assert_same_file (f, "old/top/same", "new/alias/same", FALSE);
+  assert_same_file (f, "new/top/same", "new/top/hardlink", TRUE);
+
+  content = read_file (f, "new/top/changed");
+  g_assert_cmpstr (content, ==, "new\n");
+  g_clear_pointer (&content, g_free);
+  content = read_file (f, "old/top/changed");
+  g_assert_cmpstr (content, ==, "old\n");
+  g_clear_pointer (&content, g_free);
+  content = read_file (f, "new/top/stale");
+  g_assert_cmpstr (content, ==, "stale\n");
+}
+
+int
+main (int argc,
+      char **argv)
+{
+  _srt_setenv_disable_gio_modules ();
+
+  g_test_init (&argc, &argv, NULL);
+  g_test_add ("/ustar", Fixture, &default_config,
+              setup, test_ustar, teardown);
+  g_test_add ("/ustar/single-thread", Fixture, &single_thread_config,
+              setup, test_ustar, teardown);
+  g_test_add ("/symlinked-directory", Fixture, &default_config,
+              setup, test_symlinked_directory, teardown);
+  g_test_add ("/gnu-long-names", Fixture, &default_config,
+              setup, test_gnu_long_names, teardown);
+  g_test_add ("/pax", Fixture, &default_config,
+              setup, test_pax, teardown);
+  g_test_add ("/pax/invalid", Fixture, &default_config,
+              setup, test_pax_invalid, teardown);
+  g_test_add ("/reference", Fixture, &default_config,
+              setup, test_reference, teardown);
+  g_test_add ("/reference/single-thread", Fixture, &single_thread_config,
+              setup, test_reference, teardown);
+  g_test_add ("/truncated", Fixture, &default_config,
+              setup, test_truncated, teardown);
+  g_test_add ("/truncated/single-thread", Fixture, &single_thread_config,
+              setup, test_truncated, teardown);
+
+  return g_test_run ();
+}
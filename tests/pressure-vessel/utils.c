@@ -24,6 +24,7 @@
  */
 
 #include <stdlib.h>
+#include <string.h>
 #include <unistd.h>
 
 #include <glib.h>
@@ -435,6 +436,46 @@ test_mtree_entry_parse (Fixture *f,
     }
 }
 
+static void
+test_mtree_load_digests (Fixture *f,
+                         gconstpointer context)
+{
+  static const char mtree[] =
+    "#mtree\n"
+    ". type=dir\n"
+    "./lib type=dir\n"
+    "./lib/libfoo.so.1 type=link link=libfoo.so.1.2\n"
+    "./lib/libfoo.so.1.2 type=file size=3 sha256="
+      "a665a45920422f9d417e4867efdc4fb8a04a1f3fff1fa07e998e86f7f7a27ae3\n"
+    "./lib/no-digest type=file size=0\n"
+    "./bin/hello\\040world type=file sha256digest=ABCDEF\n";
+  g_autoptr(GError) error = NULL;
+  g_autoptr(GHashTable) digests = NULL;
+  g_auto(GLnxTmpDir) tmpdir = { FALSE };
+  g_autofree gchar *path = NULL;
+
+  glnx_mkdtemp ("test-XXXXXX", 0700, &tmpdir, &error);
+  g_assert_no_error (error);
+
+  glnx_file_replace_contents_at (tmpdir.fd, "usr-mtree.txt",
+                                 (const guint8 *) mtree, strlen (mtree),
+                                 0, NULL, &error);
+  g_assert_no_error (error);
+
+  path = g_build_filename (tmpdir.path, "usr-mtree.txt", NULL);
+  digests = pv_mtree_load_digests (path, "files/",
+                                   PV_MTREE_APPLY_FLAGS_NONE, &error);
+  g_assert_no_error (error);
+  g_assert_nonnull (digests);
+
+  g_assert_cmpuint (g_hash_table_size (digests), ==, 2);
+  g_assert_cmpstr (g_hash_table_lookup (digests, "files/lib/libfoo.so.1.2"),
+                   ==,
+                   "a665a45920422f9d417e4867efdc4fb8a04a1f3fff1fa07e998e86f7f7a27ae3");
+  g_assert_cmpstr (g_hash_table_lookup (digests, "files/bin/hello world"),
+                   ==, "ABCDEF");
+}
+
 static void
 test_search_path_append (Fixture *f,
                          gconstpointer context)
@@ -480,6 +521,8 @@ main (int argc,
   g_test_add ("/envp-cmp", Fixture, NULL, setup, test_envp_cmp, teardown);
   g_test_add ("/mtree-entry-parse", Fixture, NULL,
               setup, test_mtree_entry_parse, teardown);
+  g_test_add ("/mtree-load-digests", Fixture, NULL,
+              setup, test_mtree_load_digests, teardown);
   g_test_add ("/search-path-append", Fixture, NULL,
               setup, test_search_path_append, teardown);
 
@@ -868,6 +868,346 @@ test_unblocks_sigchld (Fixture *f,
     }
 }
 
+/*
+ * Results of the slow checks are reused from the cache.
+ */
+static void
+test_cache (Fixture *f,
+            gconstpointer context)
+{
+  g_autoptr(GError) error = NULL;
+  g_autofree gchar *tmpdir = g_dir_make_tmp ("srt-test-XXXXXX", &error);
+  g_autofree gchar *cache_dir = NULL;
+  g_autofree gchar *expectations_in = g_build_filename (f->srcdir, "expectations", NULL);
+  g_autofree gchar *first_locales = NULL;
+  g_autofree gchar *first_arch = NULL;
+  g_auto(GStrv) envp = NULL;
+  g_autoptr(GDir) dir = NULL;
+  const char *name;
+  gsize n_files = 0;
+  gsize i;
+  const gchar *argv[] =
+    {
+      "steam-runtime-system-info",
+      "--cache",
+      "--expectations",
+      expectations_in,
+      NULL
+    };
+
+  g_assert_no_error (error);
+  envp = g_get_environ ();
+  envp = g_environ_setenv (envp, "XDG_CACHE_HOME", tmpdir, TRUE);
+  cache_dir = g_build_filename (tmpdir, "steam-runtime-tools", NULL);
+
+  for (i = 0; i < 2; i++)
+    {
+      g_autoptr(JsonNode) node = NULL;
+      g_autofree gchar *output = NULL;
+      g_autofree gchar *locales = NULL;
+      g_autofree gchar *arch = NULL;
+      JsonObject *json;
+      int exit_status = -1;
+      gboolean result;
+
+      result = g_spawn_sync (NULL,    /* working directory */
+                             (gchar **) argv,
+                             envp,
+                             G_SPAWN_SEARCH_PATH,
+                             NULL,    /* child setup */
+                             NULL,    /* user data */
+                             &output, /* stdout */
+                             NULL,    /* stderr */
+                             &exit_status,
+                             &error);
+      g_assert_no_error (error);
+      g_assert_true (result);
+      g_assert_cmpint (exit_status, ==, 0);
+      g_assert_nonnull (output);
+
+      node = json_from_string (output, &error);
+      g_assert_no_error (error);
+      g_assert_nonnull (node);
+      json = json_node_get_object (node);
+
+      g_assert_true (json_object_has_member (json, "locales"));
+      locales = json_to_string (json_object_get_member (json, "locales"), FALSE);
+      g_assert_true (json_object_has_member (json, "architectures"));
+      arch = json_to_string (json_object_get_member (json, "architectures"), FALSE);
+
+      if (i == 0)
+        {
+          first_locales = g_steal_pointer (&locales);
+          first_arch = g_steal_pointer (&arch);
+        }
+      else
+        {
+          g_assert_cmpstr (locales, ==, first_locales);
+          g_assert_cmpstr (arch, ==, first_arch);
+        }
+    }
+
+  dir = g_dir_open (cache_dir, 0, &error);
+  g_assert_no_error (error);
+
+  while ((name = g_dir_read_name (dir)) != NULL)
+    {
+      g_test_message ("Cache file: %s", name);
+      g_assert_true (g_str_has_prefix (name, "system-info-"));
+      g_assert_true (g_str_has_suffix (name, ".json"));
+      n_files++;
+    }
+
+  g_assert_cmpuint (n_files, ==, 1);
+
+  glnx_shutil_rm_rf_at (AT_FDCWD, tmpdir, NULL, &error);
+  g_assert_no_error (error);
+}
+
+/*
+ * Return the name of the only file in @cache_dir.
+ */
+static gchar *
+dup_only_cache_file (const char *cache_dir)
+{
+  g_autoptr(GError) error = NULL;
+  g_autoptr(GDir) dir = NULL;
+  g_autofree gchar *ret = NULL;
+  const char *name;
+
+  dir = g_dir_open (cache_dir, 0, &error);
+  g_assert_no_error (error);
+
+  while ((name = g_dir_read_name (dir)) != NULL)
+    {
+      g_test_message ("Cache file: %s", name);
+      g_assert_null (ret);
+      ret = g_strdup (name);
+    }
+
+  g_assert_nonnull (ret);
+  return g_steal_pointer (&ret);
+}
+
+/*
+ * Adding a driver to a directory that is searched for DRI drivers
+ * invalidates the cache.
+ */
+static void
+test_cache_drivers (Fixture *f,
+                    gconstpointer context)
+{
+  g_autoptr(GError) error = NULL;
+  g_autofree gchar *tmpdir = g_dir_make_tmp ("srt-test-XXXXXX", &error);
+  g_autofree gchar *cache_dir = NULL;
+  g_autofree gchar *dri_dir = NULL;
+  g_autofree gchar *driver = NULL;
+  g_autofree gchar *expectations_in = g_build_filename (f->srcdir, "expectations", NULL);
+  g_autofree gchar *first_name = NULL;
+  g_autofree gchar *second_name = NULL;
+  g_autofree gchar *third_name = NULL;
+  g_auto(GStrv) envp = NULL;
+  gsize i;
+  const gchar *argv[] =
+    {
+      "steam-runtime-system-info",
+      "--cache",
+      "--expectations",
+      expectations_in,
+      NULL
+    };
+
+  g_assert_no_error (error);
+  cache_dir = g_build_filename (tmpdir, "steam-runtime-tools", NULL);
+  dri_dir = g_build_filename (tmpdir, "dri", NULL);
+  driver = g_build_filename (dri_dir, "fake_dri.so", NULL);
+  g_assert_no_errno (g_mkdir (dri_dir, 0755));
+
+  envp = g_get_environ ();
+  envp = g_environ_setenv (envp, "XDG_CACHE_HOME", tmpdir, TRUE);
+  envp = g_environ_setenv (envp, "LIBGL_DRIVERS_PATH", dri_dir, TRUE);
+
+  for (i = 0; i < 3; i++)
+    {
+      int exit_status = -1;
+      gboolean result;
+
+      /* Install a driver between the second and third runs */
+      if (i == 2)
+        {
+          g_file_set_contents (driver, "", 0, &error);
+          g_assert_no_error (error);
+        }
+
+      result = g_spawn_sync (NULL,    /* working directory */
+                             (gchar **) argv,
+                             envp,
+                             G_SPAWN_SEARCH_PATH,
+                             NULL,    /* child setup */
+                             NULL,    /* user data */
+                             NULL,    /* stdout */
+                             NULL,    /* stderr */
+                             &exit_status,
+                             &error);
+      g_assert_no_error (error);
+      g_assert_true (result);
+      g_assert_cmpint (exit_status, ==, 0);
+
+      if (i == 0)
+        first_name = dup_only_cache_file (cache_dir);
+      else if (i == 1)
+        second_name = dup_only_cache_file (cache_dir);
+      else
+        third_name = dup_only_cache_file (cache_dir);
+    }
+
+  /* Nothing changed between the first and second runs */
+  g_assert_cmpstr (first_name, ==, second_name);
+  /* The new driver invalidated the cache */
+  g_assert_cmpstr (second_name, !=, third_name);
+
+  glnx_shutil_rm_rf_at (AT_FDCWD, tmpdir, NULL, &error);
+  g_assert_no_error (error);
+}
+
+/*
+ * With --streaming, each line is a JSON object, and together they
+ * contain the same sections as the normal output.
+ */
+static void
+test_streaming (Fixture *f,
+                gconstpointer context)
+{
+  g_autoptr(GError) error = NULL;
+  g_autoptr(JsonNode) node = NULL;
+  g_autoptr(JsonObject) merged = json_object_new ();
+  g_autoptr(JsonObject) architectures = json_object_new ();
+  g_autoptr(GList) members = NULL;
+  g_autofree gchar *expectations_in = g_build_filename (f->srcdir, "expectations", NULL);
+  g_autofree gchar *output = NULL;
+  g_autofree gchar *streamed = NULL;
+  g_auto(GStrv) lines = NULL;
+  JsonObject *json;
+  const GList *iter;
+  int exit_status = -1;
+  gboolean result;
+  gsize i;
+  const gchar *argv[] =
+    {
+      "steam-runtime-system-info",
+      "--expectations",
+      expectations_in,
+      "--sequential",
+      NULL,   /* placeholder for --streaming */
+      NULL
+    };
+
+  result = g_spawn_sync (NULL,    /* working directory */
+                         (gchar **) argv,
+                         NULL,    /* envp */
+                         G_SPAWN_SEARCH_PATH,
+                         NULL,    /* child setup */
+                         NULL,    /* user data */
+                         &output, /* stdout */
+                         NULL,    /* stderr */
+                         &exit_status,
+                         &error);
+  g_assert_no_error (error);
+  g_assert_true (result);
+  g_assert_cmpint (exit_status, ==, 0);
+  g_assert_nonnull (output);
+
+  node = json_from_string (output, &error);
+  g_assert_no_error (error);
+  g_assert_nonnull (node);
+  json = json_node_get_object (node);
+
+  argv[G_N_ELEMENTS (argv) - 2] = "--streaming";
+  result = g_spawn_sync (NULL,    /* working directory */
+                         (gchar **) argv,
+                         NULL,    /* envp */
+                         G_SPAWN_SEARCH_PATH,
+                         NULL,    /* child setup */
+                         NULL,    /* user data */
+                         &streamed, /* stdout */
+                         NULL,    /* stderr */
+                         &exit_status,
+                         &error);
+  g_assert_no_error (error);
+  g_assert_true (result);
+  g_assert_cmpint (exit_status, ==, 0);
+  g_assert_nonnull (streamed);
+  g_assert_true (g_str_has_suffix (streamed, "\n"));
+
+  lines = g_strsplit (streamed, "\n", -1);
+
+  /* There is an empty string after the final newline */
+  g_assert_cmpuint (g_strv_length (lines), >, 2);
+
+  for (i = 0; lines[i + 1] != NULL; i++)
+    {
+      g_autoptr(JsonNode) line_node = NULL;
+      g_autoptr(GList) line_members = NULL;
+      JsonObject *section;
+
+      g_test_message ("Line %" G_GSIZE_FORMAT ": %s", i, lines[i]);
+      line_node = json_from_string (lines[i], &error);
+      g_assert_no_error (error);
+      g_assert_nonnull (line_node);
+      g_assert_true (JSON_NODE_HOLDS_OBJECT (line_node));
+      section = json_node_get_object (line_node);
+      line_members = json_object_get_members (section);
+
+      for (iter = line_members; iter != NULL; iter = iter->next)
+        {
+          JsonNode *member = json_object_get_member (section, iter->data);
+
+          if (g_strcmp0 (iter->data, "architectures") == 0)
+            {
+              JsonObject *arch = json_node_get_object (member);
+              g_autoptr(GList) arch_members = json_object_get_members (arch);
+
+              /* Each architecture is in a separate section */
+              g_assert_cmpuint (g_list_length (arch_members), ==, 1);
+              g_assert_false (json_object_has_member (architectures,
+                                                      arch_members->data));
+              json_object_set_member (architectures, arch_members->data,
+                                      json_node_copy (json_object_get_member (arch,
+                                                                              arch_members->data)));
+            }
+          else
+            {
+              g_assert_false (json_object_has_member (merged, iter->data));
+              json_object_set_member (merged, iter->data,
+                                      json_node_copy (member));
+            }
+        }
+    }
+
+  g_assert_cmpstr (lines[i], ==, "");
+  json_object_set_object_member (merged, "architectures",
+                                 json_object_ref (architectures));
+
+  members = json_object_get_members (json);
+
+  for (iter = members; iter != NULL; iter = iter->next)
+    {
+      g_autofree gchar *expected = NULL;
+      g_autofree gchar *actual = NULL;
+
+      g_test_message ("Comparing \"%s\"", (const char *) iter->data);
+      g_assert_true (json_object_has_member (merged, iter->data));
+      expected = json_to_string (json_object_get_member (json, iter->data),
+                                 FALSE);
+      actual = json_to_string (json_object_get_member (merged, iter->data),
+                               FALSE);
+      g_assert_cmpstr (actual, ==, expected);
+    }
+
+  g_assert_cmpuint (json_object_get_size (merged), ==,
+                    json_object_get_size (json));
+}
+
 int
 main (int argc,
       char **argv)
@@ -893,6 +1233,12 @@ main (int argc,
               setup, test_help_and_version, teardown);
   g_test_add ("/system-info-cli/unblocks_sigchld", Fixture, NULL,
               setup, test_unblocks_sigchld, teardown);
+  g_test_add ("/system-info-cli/cache", Fixture, NULL,
+              setup, test_cache, teardown);
+  g_test_add ("/system-info-cli/cache-drivers", Fixture, NULL,
+              setup, test_cache_drivers, teardown);
+  g_test_add ("/system-info-cli/streaming", Fixture, NULL,
+              setup, test_streaming, teardown);
 
   return g_test_run ();
 }
@@ -388,6 +388,52 @@ libraries_presence (Fixture *f,
   g_object_unref (info);
 }
 
+/*
+ * Check that srt_system_info_prefetch() fills the same cache that
+ * srt_system_info_check_libraries() would.
+ */
+static void
+libraries_prefetch (Fixture *f,
+                    gconstpointer context)
+{
+  static const char * const multiarch_tuples[] =
+  {
+    _SRT_MULTIARCH,
+    "mock-abi",
+    _SRT_MULTIARCH,
+    NULL
+  };
+  g_autoptr(SrtSystemInfo) info = NULL;
+  g_autofree gchar *expectations_in = NULL;
+  GList *libraries = NULL;
+  SrtLibraryIssues issues;
+
+  if (strcmp (_SRT_MULTIARCH, "") == 0)
+    {
+      g_test_skip ("Unsupported architecture");
+      return;
+    }
+
+  expectations_in = g_build_filename (f->srcdir, "expectations", NULL);
+  info = srt_system_info_new (expectations_in);
+  srt_system_info_prefetch (info, multiarch_tuples,
+                            SRT_PREFETCH_FLAGS_LIBRARIES);
+
+  issues = srt_system_info_check_libraries (info,
+                                            _SRT_MULTIARCH,
+                                            &libraries);
+  g_assert_cmpint (issues, ==, SRT_LIBRARY_ISSUES_NONE);
+  check_libraries_result (libraries);
+  g_list_free_full (libraries, g_object_unref);
+  libraries = NULL;
+
+  /* There are no expectations for this one, so prefetching it did not
+   * cache anything */
+  issues = srt_system_info_check_libraries (info, "mock-abi", &libraries);
+  g_assert_cmpint (issues, ==, SRT_LIBRARY_ISSUES_UNKNOWN_EXPECTATIONS);
+  g_assert_null (libraries);
+}
+
 /*
  * Check that the expectations can be auto-detected from the
  * `STEAM_RUNTIME` environment variable.
@@ -3935,6 +3981,8 @@ main (int argc,
               setup, test_libdl, teardown);
   g_test_add ("/system-info/libraries_presence", Fixture, NULL,
               setup, libraries_presence, teardown);
+  g_test_add ("/system-info/libraries_prefetch", Fixture, NULL,
+              setup, libraries_prefetch, teardown);
   g_test_add ("/system-info/auto_expectations", Fixture, NULL,
               setup, auto_expectations, teardown);
   g_test_add ("/system-info/library_presence", Fixture, NULL,
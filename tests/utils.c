@@ -425,6 +425,46 @@ test_rlimit (Fixture *f,
   g_assert_cmpint (adjusted.rlim_max, ==, original.rlim_max);
 }
 
+static void
+count_job (gpointer job,
+           gpointer user_data)
+{
+  gint *times_run = job;
+  const char *prefix;
+
+  /* This is called concurrently from several threads */
+  prefix = _srt_find_myself (NULL, NULL);
+  g_assert_nonnull (prefix);
+  g_assert_cmpstr (prefix, ==, user_data);
+
+  g_atomic_int_inc (times_run);
+}
+
+static void
+test_run_jobs_in_parallel (Fixture *f,
+                           gconstpointer context)
+{
+  g_autoptr(GPtrArray) jobs = g_ptr_array_new_with_free_func (g_free);
+  const char *prefix;
+  guint i;
+
+  prefix = _srt_find_myself (NULL, NULL);
+  g_assert_nonnull (prefix);
+
+  /* An empty list is OK */
+  _srt_run_jobs_in_parallel (jobs, count_job, (gpointer) prefix);
+
+  for (i = 0; i < 100; i++)
+    g_ptr_array_add (jobs, g_new0 (gint, 1));
+
+  _srt_run_jobs_in_parallel (jobs, count_job, (gpointer) prefix);
+
+  /* Each job was run exactly once */
+  for (i = 0; i < jobs->len; i++)
+    g_assert_cmpint (g_atomic_int_get ((gint *) g_ptr_array_index (jobs, i)),
+                     ==, 1);
+}
+
 static void
 test_same_file (Fixture *f,
                 gconstpointer context)
@@ -562,6 +602,8 @@ main (int argc,
               setup, test_gstring_replace, teardown);
   g_test_add ("/utils/rlimit", Fixture, NULL,
               setup, test_rlimit, teardown);
+  g_test_add ("/utils/run-jobs-in-parallel", Fixture, NULL,
+              setup, test_run_jobs_in_parallel, teardown);
   g_test_add ("/utils/same-file", Fixture, NULL,
               setup, test_same_file, teardown);
   g_test_add ("/utils/str_is_integer", Fixture, NULL,